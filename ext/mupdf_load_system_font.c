@@ -528,17 +528,39 @@ typedef struct cached_font {
 
 static cached_font* cached_fonts = 0;
 
-static fz_buffer* get_cached_font_buffer(fz_context* ctx, sys_font_info* fi) {
+// contexts cloned from this one (they share its font context) cache
+// system fonts under it instead of each having its own copy
+static fz_context* shared_fonts_ctx = NULL;
+
+void set_shared_fonts_ctx(fz_context* ctx) {
     EnterCriticalSection(&cs_fonts);
+    shared_fonts_ctx = ctx;
+    LeaveCriticalSection(&cs_fonts);
+}
+
+// must be called with cs_fonts held
+static fz_context* font_cache_owner(fz_context* ctx) {
+    if (shared_fonts_ctx && ctx->font == shared_fonts_ctx->font) {
+        return shared_fonts_ctx;
+    }
+    return ctx;
+}
+
+// must be called with cs_fonts held
+static fz_buffer* find_cached_font_buffer(fz_context* owner, sys_font_info* fi) {
     cached_font* f = cached_fonts;
-    fz_buffer* buffer = NULL;
     while (f) {
-        if (f->ctx == ctx && f->fi == fi) {
-            buffer = f->buffer;
-            break;
+        if (f->ctx == owner && f->fi == fi) {
+            return f->buffer;
         }
         f = f->next;
     }
+    return NULL;
+}
+
+static fz_buffer* get_cached_font_buffer(fz_context* ctx, sys_font_info* fi) {
+    EnterCriticalSection(&cs_fonts);
+    fz_buffer* buffer = find_cached_font_buffer(font_cache_owner(ctx), fi);
     LeaveCriticalSection(&cs_fonts);
     return buffer;
 }
@@ -658,14 +680,24 @@ static fz_font* pdf_load_windows_font_by_name(fz_context* ctx, const char* orig_
         }
         cached_font* f = (cached_font*)malloc(sizeof(cached_font));
         if (!f) {
+            fz_drop_buffer(ctx, buffer);
             return NULL;
         }
-        f->fi = found;
-        f->ctx = ctx;
-        f->buffer = buffer;
         EnterCriticalSection(&cs_fonts);
-        f->next = cached_fonts;
-        cached_fonts = f;
+        fz_context* owner = font_cache_owner(ctx);
+        // another context sharing the cache might have loaded it in the meantime
+        fz_buffer* cached = find_cached_font_buffer(owner, found);
+        if (cached) {
+            free(f);
+            fz_drop_buffer(ctx, buffer);
+            buffer = cached;
+        } else {
+            f->fi = found;
+            f->ctx = owner;
+            f->buffer = buffer;
+            f->next = cached_fonts;
+            cached_fonts = f;
+        }
         LeaveCriticalSection(&cs_fonts);
 
         fz_warn(ctx, "loading non-embedded font '%s' from '%s'", orig_name, found->fontpath);
@@ -2577,12 +2577,18 @@ int _synctex_open(const char * output, const char * build_directory, char ** syn
 /* SumatraPDF */
 synctex_scanner_t synctex_scanner_new_with_data(char* path, char* data, size_t len) {
     synctex_scanner_t scanner = (synctex_scanner_t)_synctex_malloc(sizeof(_synctex_scanner_t));
+    if (NULL == scanner) {
+        _synctex_error("SyncTeX: malloc problem");
+        free(path);
+        free(data);
+        return NULL;
+    }
+    /* the whole content is in the buffer, so there's no file to read from */
     scanner->buffer_start = data;
     scanner->buffer_end = data + len;
     scanner->buffer_cur = data;
 	scanner->output = path; // takes ownership
-    synctex_scanner_parse(scanner);
-	return scanner;
+    return synctex_scanner_parse(scanner);
 }
 
 /*  Where the synctex scanner is created. */
@@ -2858,6 +2864,8 @@ synctex_scanner_t synctex_scanner_parse(synctex_scanner_t scanner) {
 	(scanner->class[synctex_node_type_math]).scanner = scanner;
 	scanner->class[synctex_node_type_boundary] = synctex_class_boundary;
 	(scanner->class[synctex_node_type_boundary]).scanner = scanner;
+	/* SumatraPDF: synctex_scanner_new_with_data() already set up the buffer */
+	if (NULL == SYNCTEX_START) {
 	SYNCTEX_START = (char *)malloc(SYNCTEX_BUFFER_SIZE+1); /*  one more character for null termination */
 	if (NULL == SYNCTEX_START) {
 		_synctex_error("SyncTeX: malloc error");
@@ -2870,6 +2878,7 @@ synctex_scanner_t synctex_scanner_parse(synctex_scanner_t scanner) {
 	 *  At least, we are sure that SYNCTEX_CUR points to a string covering a valid part of the memory. */
 	*SYNCTEX_END = '\0';
 	SYNCTEX_CUR = SYNCTEX_END;
+	}
 	status = _synctex_scan_preamble(scanner);
 	if (status<SYNCTEX_STATUS_OK) {
 		_synctex_error("SyncTeX Error: Bad preamble\n");
@@ -2885,8 +2894,10 @@ bailey:
 	/*  Everything is finished, free the buffer, close the file */
 	free((void *)SYNCTEX_START);
 	SYNCTEX_START = SYNCTEX_CUR = SYNCTEX_END = NULL;
-	gzclose(SYNCTEX_FILE);
-	SYNCTEX_FILE = NULL;
+	if (SYNCTEX_FILE) {
+		gzclose(SYNCTEX_FILE);
+		SYNCTEX_FILE = NULL;
+	}
 	/*  Final tuning: set the default values for various parameters */
 	/*  1 pre_unit = (scanner->pre_unit)/65536 pt = (scanner->pre_unit)/65781.76 bp
 	 * 1 pt = 65536 sp */
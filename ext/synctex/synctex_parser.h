@@ -100,7 +100,9 @@ typedef _synctex_scanner_t *  synctex_scanner_t;
  */
 synctex_scanner_t synctex_scanner_new_with_output_file(const char * output, const char * build_directory, int parse);
 
-/* SumatraPDF */
+/* SumatraPDF: parses a .synctex file already read into memory.
+ * data must be malloc()ed and have a 0 at data[len]. The scanner takes ownership
+ * of path and data (even on failure) and returns NULL if the content can't be parsed. */
 synctex_scanner_t synctex_scanner_new_with_data(char* path, char* data, size_t len);
 
 /*  This is the designated method to delete a synctex scanner object.
@@ -538,6 +538,18 @@ void fz_save_accelerator(fz_context *ctx, fz_document *doc, const char *accel);
 */
 void fz_output_accelerator(fz_context *ctx, fz_document *doc, fz_output *accel);
 
+/**
+	SumatraPDF: Merge EPUB accelerators written by
+	fz_output_accelerator() for instances of the same document which
+	each laid out only some of the chapters (the others are recorded
+	as -1 pages). For every chapter the first accelerator with a page
+	count for it wins.
+
+	Invalid accelerators and NULL entries are ignored. Returns NULL if
+	none of the accelerators is valid.
+*/
+fz_buffer *fz_merge_epub_accelerators(fz_context *ctx, fz_buffer **accels, int n);
+
 /**
 	New documents are typically created by calls like
 	foo_new_document(fz_context *ctx, ...). These work by
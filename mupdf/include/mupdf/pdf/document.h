@@ -396,6 +396,12 @@ typedef struct
 	int64_t offset; /* Offset of first object */
 } pdf_hint_shared;
 
+typedef struct
+{
+	int num; /* Stream object number */
+	int64_t len; /* Length of the stream data found by repair */
+} pdf_repaired_length;
+
 struct pdf_document
 {
 	fz_document super;
@@ -435,6 +441,14 @@ struct pdf_document
 
 	int repair_attempted;
 	int repair_in_progress;
+	/* Repair results saved by pdf_output_repair_accelerator, used
+	 * instead of scanning the file if the xref turns out broken. */
+	fz_stream *repair_accel;
+	/* Set if repair_accel was used instead of scanning the file. */
+	int repair_accel_loaded;
+	/* Stream lengths corrected by the last repair. */
+	int repaired_lengths_count;
+	pdf_repaired_length *repaired_lengths;
 	int non_structural_change; /* True if we are modifying the document in a way that does not change the (page) structure */
 
 	/* State indicating which file parsing method we are using */
@@ -192,6 +192,13 @@ void pdf_dict_del(fz_context *ctx, pdf_obj *dict, pdf_obj *key);
 void pdf_dict_dels(fz_context *ctx, pdf_obj *dict, const char *key);
 void pdf_sort_dict(fz_context *ctx, pdf_obj *dict);
 
+/*
+	Dictionaries with at least this many entries are indexed by a hash
+	of their keys for lookups. Changing it is only meant for testing.
+*/
+int pdf_dict_hash_threshold(void);
+void pdf_set_dict_hash_threshold(int len);
+
 void pdf_dict_put_bool(fz_context *ctx, pdf_obj *dict, pdf_obj *key, int x);
 void pdf_dict_put_int(fz_context *ctx, pdf_obj *dict, pdf_obj *key, int64_t x);
 void pdf_dict_put_real(fz_context *ctx, pdf_obj *dict, pdf_obj *key, double x);
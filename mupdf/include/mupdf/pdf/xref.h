@@ -222,6 +222,25 @@ void pdf_repair_xref(fz_context *ctx, pdf_document *doc);
 void pdf_repair_obj_stms(fz_context *ctx, pdf_document *doc);
 void pdf_repair_trailer(fz_context *ctx, pdf_document *doc);
 
+/*
+	Write the results of repairing a broken file (xref, trailer and
+	corrected stream lengths) so that the next time the file is opened
+	pdf_load_repair_accelerator() can restore them instead of scanning
+	the whole file. Throws if the document wasn't repaired. Takes
+	ownership of out.
+
+	The data is only valid for the same file, which the caller has to
+	ensure (e.g. by keying it by file size and modification time).
+*/
+void pdf_output_repair_accelerator(fz_context *ctx, pdf_document *doc, fz_output *out);
+
+/*
+	Restore repair results written by pdf_output_repair_accelerator().
+	Returns 0 and leaves the document unchanged if the data doesn't
+	fit the document.
+*/
+int pdf_load_repair_accelerator(fz_context *ctx, pdf_document *doc, fz_stream *accel);
+
 /*
 	Ensure that the current populating xref has a single subsection
 	that covers the entire range.
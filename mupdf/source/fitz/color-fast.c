@@ -266,6 +266,10 @@ static void fast_gray_to_rgb(fz_context *ctx, const fz_pixmap *src, fz_pixmap *d
 				while (h--)
 				{
 					size_t ww = w;
+					size_t done = fz_simd_gray_to_rgb(d, s, w, 1, 1);
+					s += done * 2;
+					d += done * 4;
+					ww -= done;
 					while (ww--)
 					{
 						d[0] = s[0];
@@ -284,6 +288,10 @@ static void fast_gray_to_rgb(fz_context *ctx, const fz_pixmap *src, fz_pixmap *d
 				while (h--)
 				{
 					size_t ww = w;
+					size_t done = fz_simd_gray_to_rgb(d, s, w, 0, 1);
+					s += done;
+					d += done * 4;
+					ww -= done;
 					while (ww--)
 					{
 						d[0] = s[0];
@@ -303,6 +311,10 @@ static void fast_gray_to_rgb(fz_context *ctx, const fz_pixmap *src, fz_pixmap *d
 			while (h--)
 			{
 				size_t ww = w;
+				size_t done = fz_simd_gray_to_rgb(d, s, w, 0, 0);
+				s += done;
+				d += done * 3;
+				ww -= done;
 				while (ww--)
 				{
 					d[0] = s[0];
@@ -956,6 +968,8 @@ static void fast_cmyk_to_rgb(fz_context *ctx, const fz_pixmap *src, fz_pixmap *d
 	int c, m, y, k, r, g, b;
 	int a = 255;
 	int i;
+	/* the SIMD kernels only handle the common case of no spots and no alpha in the source */
+	int simd = !sa && ss == 0 && ds == 0;
 
 	if (copy_spots && ss != ds)
 		fz_throw(ctx, FZ_ERROR_ARGUMENT, "incompatible number of spots when converting pixmap");
@@ -966,6 +980,13 @@ static void fast_cmyk_to_rgb(fz_context *ctx, const fz_pixmap *src, fz_pixmap *d
 	while (h--)
 	{
 		size_t ww = w;
+		if (simd)
+		{
+			size_t done = fz_simd_cmyk_to_rgb(d, s, w, 0, da);
+			s += done * 4;
+			d += done * dn;
+			ww -= done;
+		}
 		while (ww--)
 		{
 			c = s[0];
@@ -1039,6 +1060,8 @@ static void fast_cmyk_to_bgr(fz_context *ctx, const fz_pixmap *src, fz_pixmap *d
 	int c, m, y, k, r, g, b;
 	int a = 255;
 	int i;
+	/* the SIMD kernels only handle the common case of no spots and no alpha in the source */
+	int simd = !sa && ss == 0 && ds == 0;
 
 	if (copy_spots && ss != ds)
 		fz_throw(ctx, FZ_ERROR_ARGUMENT, "incompatible number of spots when converting pixmap");
@@ -1049,6 +1072,13 @@ static void fast_cmyk_to_bgr(fz_context *ctx, const fz_pixmap *src, fz_pixmap *d
 	while (h--)
 	{
 		size_t ww = w;
+		if (simd)
+		{
+			size_t done = fz_simd_cmyk_to_rgb(d, s, w, 1, da);
+			s += done * 4;
+			d += done * dn;
+			ww -= done;
+		}
 		while (ww--)
 		{
 			c = s[0];
@@ -1145,6 +1175,10 @@ static void fast_rgb_to_bgr(fz_context *ctx, const fz_pixmap *src, fz_pixmap *ds
 				while (h--)
 				{
 					size_t ww = w;
+					size_t done = fz_simd_swap_rb_rgba(d, s, w);
+					s += done * 4;
+					d += done * 4;
+					ww -= done;
 					while (ww--)
 					{
 						d[0] = s[2];
@@ -1154,6 +1188,8 @@ static void fast_rgb_to_bgr(fz_context *ctx, const fz_pixmap *src, fz_pixmap *ds
 						s += 4;
 						d += 4;
 					}
+					d += d_line_inc;
+					s += s_line_inc;
 				}
 			}
 			else
@@ -1161,6 +1197,10 @@ static void fast_rgb_to_bgr(fz_context *ctx, const fz_pixmap *src, fz_pixmap *ds
 				while (h--)
 				{
 					size_t ww = w;
+					size_t done = fz_simd_rgb_to_rgba(d, s, w, 1);
+					s += done * 3;
+					d += done * 4;
+					ww -= done;
 					while (ww--)
 					{
 						d[0] = s[2];
@@ -1170,6 +1210,8 @@ static void fast_rgb_to_bgr(fz_context *ctx, const fz_pixmap *src, fz_pixmap *ds
 						s += 3;
 						d += 4;
 					}
+					d += d_line_inc;
+					s += s_line_inc;
 				}
 			}
 		}
@@ -1178,6 +1220,10 @@ static void fast_rgb_to_bgr(fz_context *ctx, const fz_pixmap *src, fz_pixmap *ds
 			while (h--)
 			{
 				size_t ww = w;
+				size_t done = fz_simd_swap_rb_rgb(d, s, w);
+				s += done * 3;
+				d += done * 3;
+				ww -= done;
 				while (ww--)
 				{
 					d[0] = s[2];
@@ -1186,6 +1232,8 @@ static void fast_rgb_to_bgr(fz_context *ctx, const fz_pixmap *src, fz_pixmap *ds
 					s += 3;
 					d += 3;
 				}
+				d += d_line_inc;
+				s += s_line_inc;
 			}
 		}
 	}
@@ -1413,6 +1461,10 @@ static void fast_rgb_to_rgb(fz_context *ctx, const fz_pixmap *src, fz_pixmap *ds
 				while (h--)
 				{
 					size_t ww = w;
+					size_t done = fz_simd_rgb_to_rgba(d, s, w, 0);
+					s += done * 3;
+					d += done * 4;
+					ww -= done;
 					while (ww--)
 					{
 						d[0] = s[0];
@@ -1422,6 +1474,8 @@ static void fast_rgb_to_rgb(fz_context *ctx, const fz_pixmap *src, fz_pixmap *ds
 						s += 3;
 						d += 4;
 					}
+					d += d_line_inc;
+					s += s_line_inc;
 				}
 			}
 		}
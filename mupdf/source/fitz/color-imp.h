@@ -115,6 +115,19 @@ void fz_fast_any_to_alpha(fz_context *ctx, const fz_pixmap *src, fz_pixmap *dst,
 void fz_convert_fast_pixmap_samples(fz_context *ctx, const fz_pixmap *src, fz_pixmap *dst, int copy_spots);
 void fz_convert_slow_pixmap_samples(fz_context *ctx, const fz_pixmap *src, fz_pixmap *dst, fz_colorspace *prf, fz_color_params params, int copy_spots);
 
+/*
+	SIMD kernels for the common conversions, see color-simd.c.
+	They convert the first pixels of a row of w pixels and return
+	how many they did; the caller converts the rest.
+*/
+size_t fz_simd_swap_rb_rgba(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w);
+size_t fz_simd_rgb_to_rgba(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int swap);
+size_t fz_simd_swap_rb_rgb(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w);
+size_t fz_simd_gray_to_rgb(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int sa, int da);
+size_t fz_simd_cmyk_to_rgb(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int bgr, int da);
+size_t fz_simd_premultiply_rgba(unsigned char *s, size_t w);
+size_t fz_simd_unmultiply_rgba(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w);
+
 
 
 #endif
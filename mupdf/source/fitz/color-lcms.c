@@ -48,6 +48,12 @@ static void fz_premultiply_row(fz_context *ctx, int n, int c, int w, unsigned ch
 	unsigned char a;
 	int k;
 	int n1 = n-1;
+	if (n == 4 && c == 3)
+	{
+		int done = (int)fz_simd_premultiply_rgba(s, w);
+		s += done * 4;
+		w -= done;
+	}
 	for (; w > 0; w--)
 	{
 		a = s[n1];
@@ -98,7 +104,19 @@ static int fz_unmultiply_row(fz_context *ctx, int n, int c, int w, unsigned char
 		a = in[n1];
 nonzero:
 		if (a != 0 && a != 255)
+		{
+			if (n == 4 && c == 3)
+			{
+				int done = (int)fz_simd_unmultiply_rgba(s, in, w);
+				s += done * 4;
+				in += done * 4;
+				w -= done;
+				if (w == 0)
+					return 2;
+				a = in[n1];
+			}
 			goto varying;
+		}
 		k = 0;
 		if (a == 0)
 			for (; k < c; k++)
@@ -0,0 +1,621 @@
+// Copyright (C) 2004-2021 Artifex Software, Inc.
+//
+// This file is part of MuPDF.
+//
+// MuPDF is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// MuPDF is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with MuPDF. If not, see <https://www.gnu.org/licenses/agpl-3.0.en.html>
+//
+// Alternative licensing terms are available from the licensor.
+// For commercial licensing, see <https://www.artifex.com/> or contact
+// Artifex Software, Inc., 39 Mesa Street, Suite 108A, San Francisco,
+// CA 94129, USA, for further information.
+
+#include "mupdf/fitz.h"
+
+#include "color-imp.h"
+#include "draw-imp.h"
+
+#include <string.h>
+
+/*
+	SIMD kernels for the most common pixmap color conversions done by
+	color-fast.c and for (un)premultiplying pixmaps with 3 colorants and
+	alpha.
+
+	Like the painters in draw-simd.c, they only do the bulk of a row and
+	return the number of pixels they converted, leaving the remainder to
+	the scalar code, which they must match exactly. They return 0 when
+	SIMD is disabled with fz_set_simd_level() or not supported for the
+	given case.
+
+	Shuffling 3 byte pixels needs SSSE3, which is only assumed at the
+	AVX2 level.
+*/
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/* 255 * 256 / a as used by fz_div255() */
+static const unsigned short inv_alpha[256] = {
+	0, 65280, 32640, 21760, 16320, 13056, 10880, 9325, 8160, 7253, 6528, 5934,
+	5440, 5021, 4662, 4352, 4080, 3840, 3626, 3435, 3264, 3108, 2967, 2838,
+	2720, 2611, 2510, 2417, 2331, 2251, 2176, 2105, 2040, 1978, 1920, 1865,
+	1813, 1764, 1717, 1673, 1632, 1592, 1554, 1518, 1483, 1450, 1419, 1388,
+	1360, 1332, 1305, 1280, 1255, 1231, 1208, 1186, 1165, 1145, 1125, 1106,
+	1088, 1070, 1052, 1036, 1020, 1004, 989, 974, 960, 946, 932, 919,
+	906, 894, 882, 870, 858, 847, 836, 826, 816, 805, 796, 786,
+	777, 768, 759, 750, 741, 733, 725, 717, 709, 701, 694, 687,
+	680, 672, 666, 659, 652, 646, 640, 633, 627, 621, 615, 610,
+	604, 598, 593, 588, 582, 577, 572, 567, 562, 557, 553, 548,
+	544, 539, 535, 530, 526, 522, 518, 514, 510, 506, 502, 498,
+	494, 490, 487, 483, 480, 476, 473, 469, 466, 462, 459, 456,
+	453, 450, 447, 444, 441, 438, 435, 432, 429, 426, 423, 421,
+	418, 415, 413, 410, 408, 405, 402, 400, 398, 395, 393, 390,
+	388, 386, 384, 381, 379, 377, 375, 373, 370, 368, 366, 364,
+	362, 360, 358, 356, 354, 352, 350, 349, 347, 345, 343, 341,
+	340, 338, 336, 334, 333, 331, 329, 328, 326, 324, 323, 321,
+	320, 318, 316, 315, 313, 312, 310, 309, 307, 306, 305, 303,
+	302, 300, 299, 298, 296, 295, 294, 292, 291, 290, 288, 287,
+	286, 285, 283, 282, 281, 280, 278, 277, 276, 275, 274, 273,
+	272, 270, 269, 268, 267, 266, 265, 264, 263, 262, 261, 260,
+	259, 258, 257, 256,
+};
+
+#ifdef SIMD_X86
+
+/* swap bytes 0 and 2 of every 32 bit lane */
+static fz_forceinline __m128i
+sse2_swap_rb(__m128i v)
+{
+	__m128i ga = _mm_and_si128(v, _mm_set1_epi32((int)0xFF00FF00));
+	__m128i rb = _mm_and_si128(v, _mm_set1_epi32(0x00FF00FF));
+	return _mm_or_si128(ga, _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16)));
+}
+
+static size_t
+swap_rb_rgba_sse2(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	size_t i = 0;
+	for (; i + 4 <= w; i += 4)
+		_mm_storeu_si128((__m128i *)(d + i * 4), sse2_swap_rb(_mm_loadu_si128((const __m128i *)(s + i * 4))));
+	return i;
+}
+
+static size_t
+gray_to_rgba_sse2(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	const __m128i opaque = _mm_set1_epi8((char)0xFF);
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		__m128i g = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i gg_lo = _mm_unpacklo_epi8(g, g);
+		__m128i gg_hi = _mm_unpackhi_epi8(g, g);
+		__m128i ga_lo = _mm_unpacklo_epi8(g, opaque);
+		__m128i ga_hi = _mm_unpackhi_epi8(g, opaque);
+		unsigned char *dp = d + i * 4;
+		_mm_storeu_si128((__m128i *)dp, _mm_unpacklo_epi16(gg_lo, ga_lo));
+		_mm_storeu_si128((__m128i *)(dp + 16), _mm_unpackhi_epi16(gg_lo, ga_lo));
+		_mm_storeu_si128((__m128i *)(dp + 32), _mm_unpacklo_epi16(gg_hi, ga_hi));
+		_mm_storeu_si128((__m128i *)(dp + 48), _mm_unpackhi_epi16(gg_hi, ga_hi));
+	}
+	return i;
+}
+
+static size_t
+graya_to_rgba_sse2(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	size_t i = 0;
+	for (; i + 8 <= w; i += 8)
+	{
+		__m128i ga = _mm_loadu_si128((const __m128i *)(s + i * 2));
+		__m128i g = _mm_and_si128(ga, _mm_set1_epi16(0xFF));
+		__m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+		_mm_storeu_si128((__m128i *)(d + i * 4), _mm_unpacklo_epi16(gg, ga));
+		_mm_storeu_si128((__m128i *)(d + i * 4 + 16), _mm_unpackhi_epi16(gg, ga));
+	}
+	return i;
+}
+
+/* 255 - min(c + k, 255) etc. for 4 pixels, with alpha set to 255 */
+static fz_forceinline __m128i
+sse2_cmyk_to_rgba(__m128i v)
+{
+	__m128i k = _mm_srli_epi32(v, 24);
+	k = _mm_or_si128(k, _mm_or_si128(_mm_slli_epi32(k, 8), _mm_slli_epi32(k, 16)));
+	v = _mm_xor_si128(_mm_adds_epu8(v, k), _mm_set1_epi8((char)0xFF));
+	return _mm_or_si128(v, _mm_set1_epi32((int)0xFF000000));
+}
+
+static size_t
+cmyk_to_rgba_sse2(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int bgr)
+{
+	size_t i = 0;
+	for (; i + 4 <= w; i += 4)
+	{
+		__m128i v = sse2_cmyk_to_rgba(_mm_loadu_si128((const __m128i *)(s + i * 4)));
+		if (bgr)
+			v = sse2_swap_rb(v);
+		_mm_storeu_si128((__m128i *)(d + i * 4), v);
+	}
+	return i;
+}
+
+/* fz_mul255(c, a) for the colorants of 2 pixels in 16 bit lanes, alpha is kept */
+static fz_forceinline __m128i
+sse2_premultiply2(__m128i v)
+{
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xFF), 0xFF);
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(v, a), _mm_set1_epi16(128));
+	x = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+	return x;
+}
+
+static size_t
+premultiply_rgba_sse2(unsigned char *s, size_t w)
+{
+	const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= w; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i * 4));
+		__m128i lo = sse2_premultiply2(_mm_unpacklo_epi8(v, zero));
+		__m128i hi = sse2_premultiply2(_mm_unpackhi_epi8(v, zero));
+		__m128i p = _mm_packus_epi16(lo, hi);
+		p = _mm_or_si128(_mm_andnot_si128(alpha_mask, p), _mm_and_si128(alpha_mask, v));
+		_mm_storeu_si128((__m128i *)(s + i * 4), p);
+	}
+	return i;
+}
+
+/*
+	(c * inva) >> 8 truncated to a byte only depends on the lower 16 bits
+	of the product. The alpha lanes are multiplied by 256 to keep them.
+*/
+static size_t
+unmultiply_rgba_sse2(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i byte_mask = _mm_set1_epi16(0xFF);
+	size_t i = 0;
+	for (; i + 4 <= w; i += 4)
+	{
+		const unsigned char *sp = s + i * 4;
+		__m128i v = _mm_loadu_si128((const __m128i *)sp);
+		int i0 = inv_alpha[sp[3]], i1 = inv_alpha[sp[7]], i2 = inv_alpha[sp[11]], i3 = inv_alpha[sp[15]];
+		__m128i inv_lo = _mm_setr_epi16((short)i0, (short)i0, (short)i0, 256, (short)i1, (short)i1, (short)i1, 256);
+		__m128i inv_hi = _mm_setr_epi16((short)i2, (short)i2, (short)i2, 256, (short)i3, (short)i3, (short)i3, 256);
+		__m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), inv_lo), 8);
+		__m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), inv_hi), 8);
+		_mm_storeu_si128((__m128i *)(d + i * 4), _mm_packus_epi16(_mm_and_si128(lo, byte_mask), _mm_and_si128(hi, byte_mask)));
+	}
+	return i;
+}
+
+/*
+	3 byte pixels are shuffled 16 bytes at a time. The loops stop early
+	enough that neither loads nor stores go past the end of the row.
+*/
+TARGET_AVX2 static size_t
+rgb_to_rgba_ssse3(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int swap)
+{
+	const __m128i shuf = swap ?
+		_mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) :
+		_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+	size_t i = 0;
+	for (; i + 6 <= w; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i * 3));
+		_mm_storeu_si128((__m128i *)(d + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuf), opaque));
+	}
+	return i;
+}
+
+TARGET_AVX2 static size_t
+swap_rb_rgb_ssse3(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	const __m128i shuf = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+	size_t i = 0;
+	/* byte 15 belongs to the next pixel and is overwritten by the next store */
+	for (; i + 6 <= w; i += 5)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i * 3));
+		_mm_storeu_si128((__m128i *)(d + i * 3), _mm_shuffle_epi8(v, shuf));
+	}
+	return i;
+}
+
+TARGET_AVX2 static size_t
+gray_to_rgb_ssse3(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	const __m128i shuf0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+	const __m128i shuf1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+	const __m128i shuf2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		__m128i g = _mm_loadu_si128((const __m128i *)(s + i));
+		unsigned char *dp = d + i * 3;
+		_mm_storeu_si128((__m128i *)dp, _mm_shuffle_epi8(g, shuf0));
+		_mm_storeu_si128((__m128i *)(dp + 16), _mm_shuffle_epi8(g, shuf1));
+		_mm_storeu_si128((__m128i *)(dp + 32), _mm_shuffle_epi8(g, shuf2));
+	}
+	return i;
+}
+
+TARGET_AVX2 static size_t
+cmyk_to_rgb_ssse3(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int bgr)
+{
+	const __m128i shuf = bgr ?
+		_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) :
+		_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+	/* writes 16 bytes for 4 pixels, i.e. 4 bytes of the next pixel */
+	for (; i + 6 <= w; i += 4)
+	{
+		__m128i v = sse2_cmyk_to_rgba(_mm_loadu_si128((const __m128i *)(s + i * 4)));
+		_mm_storeu_si128((__m128i *)(d + i * 3), _mm_shuffle_epi8(v, shuf));
+	}
+	return i;
+}
+
+TARGET_AVX2 static fz_forceinline __m256i
+avx2_swap_rb(__m256i v)
+{
+	__m256i ga = _mm256_and_si256(v, _mm256_set1_epi32((int)0xFF00FF00));
+	__m256i rb = _mm256_and_si256(v, _mm256_set1_epi32(0x00FF00FF));
+	return _mm256_or_si256(ga, _mm256_or_si256(_mm256_slli_epi32(rb, 16), _mm256_srli_epi32(rb, 16)));
+}
+
+TARGET_AVX2 static size_t
+swap_rb_rgba_avx2(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	size_t i = 0;
+	for (; i + 8 <= w; i += 8)
+		_mm256_storeu_si256((__m256i *)(d + i * 4), avx2_swap_rb(_mm256_loadu_si256((const __m256i *)(s + i * 4))));
+	return i;
+}
+
+TARGET_AVX2 static size_t
+cmyk_to_rgba_avx2(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int bgr)
+{
+	size_t i = 0;
+	for (; i + 8 <= w; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i * 4));
+		__m256i k = _mm256_srli_epi32(v, 24);
+		k = _mm256_or_si256(k, _mm256_or_si256(_mm256_slli_epi32(k, 8), _mm256_slli_epi32(k, 16)));
+		v = _mm256_xor_si256(_mm256_adds_epu8(v, k), _mm256_set1_epi8((char)0xFF));
+		v = _mm256_or_si256(v, _mm256_set1_epi32((int)0xFF000000));
+		if (bgr)
+			v = avx2_swap_rb(v);
+		_mm256_storeu_si256((__m256i *)(d + i * 4), v);
+	}
+	return i;
+}
+
+TARGET_AVX2 static fz_forceinline __m256i
+avx2_premultiply2(__m256i v)
+{
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0xFF), 0xFF);
+	__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(v, a), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+/* unpacking and packing within 128 bit lanes keeps the pixels in order */
+TARGET_AVX2 static size_t
+premultiply_rgba_avx2(unsigned char *s, size_t w)
+{
+	const __m256i alpha_mask = _mm256_set1_epi32((int)0xFF000000);
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= w; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i * 4));
+		__m256i lo = avx2_premultiply2(_mm256_unpacklo_epi8(v, zero));
+		__m256i hi = avx2_premultiply2(_mm256_unpackhi_epi8(v, zero));
+		__m256i p = _mm256_packus_epi16(lo, hi);
+		p = _mm256_or_si256(_mm256_andnot_si256(alpha_mask, p), _mm256_and_si256(alpha_mask, v));
+		_mm256_storeu_si256((__m256i *)(s + i * 4), p);
+	}
+	return i;
+}
+
+#endif /* SIMD_X86 */
+
+#ifdef SIMD_NEON
+
+static size_t
+swap_rb_rgba_neon(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		uint8x16x4_t v = vld4q_u8(s + i * 4);
+		uint8x16_t t = v.val[0];
+		v.val[0] = v.val[2];
+		v.val[2] = t;
+		vst4q_u8(d + i * 4, v);
+	}
+	return i;
+}
+
+static size_t
+rgb_to_rgba_neon(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int swap)
+{
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		uint8x16x3_t v = vld3q_u8(s + i * 3);
+		uint8x16x4_t o;
+		o.val[0] = v.val[swap ? 2 : 0];
+		o.val[1] = v.val[1];
+		o.val[2] = v.val[swap ? 0 : 2];
+		o.val[3] = vdupq_n_u8(255);
+		vst4q_u8(d + i * 4, o);
+	}
+	return i;
+}
+
+static size_t
+swap_rb_rgb_neon(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		uint8x16x3_t v = vld3q_u8(s + i * 3);
+		uint8x16_t t = v.val[0];
+		v.val[0] = v.val[2];
+		v.val[2] = t;
+		vst3q_u8(d + i * 3, v);
+	}
+	return i;
+}
+
+static size_t
+gray_to_rgb_neon(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int sa, int da)
+{
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		uint8x16_t g, a;
+		if (sa)
+		{
+			uint8x16x2_t ga = vld2q_u8(s + i * 2);
+			g = ga.val[0];
+			a = ga.val[1];
+		}
+		else
+		{
+			g = vld1q_u8(s + i);
+			a = vdupq_n_u8(255);
+		}
+		if (da)
+		{
+			uint8x16x4_t o = { { g, g, g, a } };
+			vst4q_u8(d + i * 4, o);
+		}
+		else
+		{
+			uint8x16x3_t o = { { g, g, g } };
+			vst3q_u8(d + i * 3, o);
+		}
+	}
+	return i;
+}
+
+static size_t
+cmyk_to_rgb_neon(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int bgr, int da)
+{
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		uint8x16x4_t v = vld4q_u8(s + i * 4);
+		uint8x16_t r = vmvnq_u8(vqaddq_u8(v.val[0], v.val[3]));
+		uint8x16_t g = vmvnq_u8(vqaddq_u8(v.val[1], v.val[3]));
+		uint8x16_t b = vmvnq_u8(vqaddq_u8(v.val[2], v.val[3]));
+		if (da)
+		{
+			uint8x16x4_t o = { { bgr ? b : r, g, bgr ? r : b, vdupq_n_u8(255) } };
+			vst4q_u8(d + i * 4, o);
+		}
+		else
+		{
+			uint8x16x3_t o = { { bgr ? b : r, g, bgr ? r : b } };
+			vst3q_u8(d + i * 3, o);
+		}
+	}
+	return i;
+}
+
+static fz_forceinline uint8x8_t
+neon_mul255(uint8x8_t c, uint8x8_t a)
+{
+	uint16x8_t x = vaddq_u16(vmull_u8(c, a), vdupq_n_u16(128));
+	x = vsraq_n_u16(x, x, 8);
+	return vshrn_n_u16(x, 8);
+}
+
+static size_t
+premultiply_rgba_neon(unsigned char *s, size_t w)
+{
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		uint8x16x4_t v = vld4q_u8(s + i * 4);
+		uint8x8_t a_lo = vget_low_u8(v.val[3]);
+		uint8x8_t a_hi = vget_high_u8(v.val[3]);
+		int k;
+		for (k = 0; k < 3; k++)
+			v.val[k] = vcombine_u8(neon_mul255(vget_low_u8(v.val[k]), a_lo), neon_mul255(vget_high_u8(v.val[k]), a_hi));
+		vst4q_u8(s + i * 4, v);
+	}
+	return i;
+}
+
+static size_t
+unmultiply_rgba_neon(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	size_t i = 0;
+	for (; i + 16 <= w; i += 16)
+	{
+		uint8x16x4_t v = vld4q_u8(s + i * 4);
+		uint16_t inv[16];
+		uint16x8_t inv_lo, inv_hi;
+		int k;
+		for (k = 0; k < 16; k++)
+			inv[k] = inv_alpha[s[i * 4 + k * 4 + 3]];
+		inv_lo = vld1q_u16(inv);
+		inv_hi = vld1q_u16(inv + 8);
+		for (k = 0; k < 3; k++)
+		{
+			uint16x8_t lo = vmulq_u16(vmovl_u8(vget_low_u8(v.val[k])), inv_lo);
+			uint16x8_t hi = vmulq_u16(vmovl_u8(vget_high_u8(v.val[k])), inv_hi);
+			v.val[k] = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+		}
+		vst4q_u8(d + i * 4, v);
+	}
+	return i;
+}
+
+#endif /* SIMD_NEON */
+
+size_t
+fz_simd_swap_rb_rgba(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	switch (fz_simd_level())
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return swap_rb_rgba_avx2(d, s, w);
+	case FZ_SIMD_SSE2: return swap_rb_rgba_sse2(d, s, w);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return swap_rb_rgba_neon(d, s, w);
+#endif
+	default: return 0;
+	}
+}
+
+size_t
+fz_simd_rgb_to_rgba(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int swap)
+{
+	switch (fz_simd_level())
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return rgb_to_rgba_ssse3(d, s, w, swap);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return rgb_to_rgba_neon(d, s, w, swap);
+#endif
+	default: return 0;
+	}
+}
+
+size_t
+fz_simd_swap_rb_rgb(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	switch (fz_simd_level())
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return swap_rb_rgb_ssse3(d, s, w);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return swap_rb_rgb_neon(d, s, w);
+#endif
+	default: return 0;
+	}
+}
+
+size_t
+fz_simd_gray_to_rgb(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int sa, int da)
+{
+	switch (fz_simd_level())
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2:
+		if (!da)
+			return gray_to_rgb_ssse3(d, s, w);
+		return sa ? graya_to_rgba_sse2(d, s, w) : gray_to_rgba_sse2(d, s, w);
+	case FZ_SIMD_SSE2:
+		if (!da)
+			return 0;
+		return sa ? graya_to_rgba_sse2(d, s, w) : gray_to_rgba_sse2(d, s, w);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return gray_to_rgb_neon(d, s, w, sa, da);
+#endif
+	default: return 0;
+	}
+}
+
+size_t
+fz_simd_cmyk_to_rgb(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w, int bgr, int da)
+{
+	switch (fz_simd_level())
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return da ? cmyk_to_rgba_avx2(d, s, w, bgr) : cmyk_to_rgb_ssse3(d, s, w, bgr);
+	case FZ_SIMD_SSE2: return da ? cmyk_to_rgba_sse2(d, s, w, bgr) : 0;
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return cmyk_to_rgb_neon(d, s, w, bgr, da);
+#endif
+	default: return 0;
+	}
+}
+
+size_t
+fz_simd_premultiply_rgba(unsigned char *s, size_t w)
+{
+	switch (fz_simd_level())
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return premultiply_rgba_avx2(s, w);
+	case FZ_SIMD_SSE2: return premultiply_rgba_sse2(s, w);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return premultiply_rgba_neon(s, w);
+#endif
+	default: return 0;
+	}
+}
+
+size_t
+fz_simd_unmultiply_rgba(unsigned char * FZ_RESTRICT d, const unsigned char * FZ_RESTRICT s, size_t w)
+{
+	switch (fz_simd_level())
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2:
+	case FZ_SIMD_SSE2:
+		return unmultiply_rgba_sse2(d, s, w);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return unmultiply_rgba_neon(d, s, w);
+#endif
+	default: return 0;
+	}
+}
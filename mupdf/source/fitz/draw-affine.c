@@ -1320,6 +1320,15 @@ paint_affine_lerp_da_sa_3(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRIC
 	template_affine_N_lerp(dp, 1, sp, sw, sh, ss, 1, u, v, fa, fb, w, 3, 3, hp, gp);
 }
 
+static void
+paint_affine_lerp_da_sa_3_simd(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, affint sw, affint sh, ptrdiff_t ss, int sa, affint u, affint v, affint fa, affint fb, int w, int dn, int sn, int alpha, const byte * FZ_RESTRICT color, byte * FZ_RESTRICT hp, byte * FZ_RESTRICT gp, const fz_overprint * FZ_RESTRICT eop)
+{
+	TRACK_FN();
+	/* the SIMD version doesn't update shape and group alpha */
+	if (hp || gp || fz_simd_affine_lerp_rgba(dp, sp, sw, sh, ss, u, v, fa, fb, w) == 0)
+		template_affine_N_lerp(dp, 1, sp, sw, sh, ss, 1, u, v, fa, fb, w, 3, 3, hp, gp);
+}
+
 static void
 paint_affine_lerp_da_sa_alpha_3(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, affint sw, affint sh, ptrdiff_t ss, int sa, affint u, affint v, affint fa, affint fb, int w, int dn, int sn, int alpha, const byte * FZ_RESTRICT color, byte * FZ_RESTRICT hp, byte * FZ_RESTRICT gp, const fz_overprint * FZ_RESTRICT eop)
 {
@@ -1587,7 +1596,7 @@ fz_paint_affine_lerp(int da, int sa, affint fa, affint fb, int n, int alpha, con
 			if (sa)
 			{
 				if (alpha == 255)
-					return paint_affine_lerp_da_sa_3;
+					return fz_simd_level() ? paint_affine_lerp_da_sa_3_simd : paint_affine_lerp_da_sa_3;
 				else if (alpha > 0)
 					return paint_affine_lerp_da_sa_alpha_3;
 			}
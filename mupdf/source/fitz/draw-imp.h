@@ -457,6 +457,32 @@ fz_solid_color_painter_t *fz_get_solid_color_painter(int n, const unsigned char
 fz_span_painter_t *fz_get_span_painter(int da, int sa, int n, int alpha, const fz_overprint * FZ_RESTRICT eop);
 fz_span_color_painter_t *fz_get_span_color_painter(int n, int da, const unsigned char * FZ_RESTRICT color, const fz_overprint * FZ_RESTRICT eop);
 
+/*
+	SIMD painters for pixmaps with 3 colorants and alpha, see draw-simd.c.
+	They are picked by the fz_get_*_painter functions when the CPU
+	supports them. fz_set_simd_level() is meant for testing them against
+	the scalar painters: levels the CPU doesn't support are ignored and
+	it must not be called while other threads are drawing.
+*/
+enum
+{
+	FZ_SIMD_NONE = 0,
+	FZ_SIMD_SSE2 = 1,
+	FZ_SIMD_AVX2 = 2,
+	FZ_SIMD_NEON = 3
+};
+
+int fz_simd_level(void);
+void fz_set_simd_level(int level);
+
+/* these paint as many pixels as they can at once and return how many they painted */
+int fz_simd_solid_color_rgba(unsigned char * FZ_RESTRICT dp, int w, const unsigned char * FZ_RESTRICT color, int sa);
+int fz_simd_span_with_color_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT mp, int w, const unsigned char * FZ_RESTRICT color, int sa);
+int fz_simd_span_with_mask_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, const unsigned char * FZ_RESTRICT mp, int w);
+int fz_simd_span_over_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w);
+int fz_simd_span_over_alpha_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w, int alpha);
+int fz_simd_affine_lerp_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int64_t sw, int64_t sh, ptrdiff_t ss, int64_t u, int64_t v, int64_t fa, int64_t fb, int w);
+
 void fz_paint_image(fz_context *ctx, fz_pixmap * FZ_RESTRICT dst, const fz_irect * FZ_RESTRICT scissor, fz_pixmap * FZ_RESTRICT shape, fz_pixmap * FZ_RESTRICT group_alpha, fz_pixmap * FZ_RESTRICT img, fz_matrix ctm, int alpha, int lerp_allowed, const fz_overprint * FZ_RESTRICT eop);
 void fz_paint_image_with_color(fz_context *ctx, fz_pixmap * FZ_RESTRICT dst, const fz_irect * FZ_RESTRICT scissor, fz_pixmap * FZ_RESTRICT shape, fz_pixmap * FZ_RESTRICT group_alpha, fz_pixmap * FZ_RESTRICT img, fz_matrix ctm, const unsigned char * FZ_RESTRICT colorbv, int lerp_allowed, const fz_overprint * FZ_RESTRICT eop);
 
@@ -531,6 +531,18 @@ static void paint_solid_color_3_da(byte * FZ_RESTRICT dp, int n, int w, const by
 	TRACK_FN();
 	template_solid_color_3_da(dp, 4, w, color, 1);
 }
+
+static void paint_solid_color_3_da_simd(byte * FZ_RESTRICT dp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int sa = FZ_EXPAND(color[3]);
+	int done;
+	TRACK_FN();
+	if (sa == 0)
+		return;
+	done = fz_simd_solid_color_rgba(dp, w, color, sa);
+	if (done < w)
+		template_solid_color_3_da(dp + done * 4, 4, w - done, color, 1);
+}
 #endif /* FZ_PLOTTERS_RGB */
 
 #if FZ_PLOTTERS_CMYK
@@ -623,7 +635,7 @@ fz_get_solid_color_painter(int n, const byte * FZ_RESTRICT color, int da, const
 #if FZ_PLOTTERS_RGB
 		case 3:
 			if (da)
-				return paint_solid_color_3_da;
+				return fz_simd_level() ? paint_solid_color_3_da_simd : paint_solid_color_3_da;
 			else if (color[3] == 255)
 				return paint_solid_color_3;
 			else
@@ -1020,6 +1032,26 @@ paint_span_with_color_3_da_alpha(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT
 	TRACK_FN();
 	template_span_with_color_3_da_alpha(dp, mp, 4, w, color, 1);
 }
+
+static void
+paint_span_with_color_3_da_solid_simd(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int done;
+	TRACK_FN();
+	done = fz_simd_span_with_color_rgba(dp, mp, w, color, 256);
+	if (done < w)
+		template_span_with_color_3_da_solid(dp + done * 4, mp + done, 4, w - done, color, 1);
+}
+
+static void
+paint_span_with_color_3_da_alpha_simd(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int done;
+	TRACK_FN();
+	done = fz_simd_span_with_color_rgba(dp, mp, w, color, FZ_EXPAND(color[3]));
+	if (done < w)
+		template_span_with_color_3_da_alpha(dp + done * 4, mp + done, 4, w - done, color, 1);
+}
 #endif /* FZ_PLOTTERS_RGB */
 
 #if FZ_PLOTTERS_CMYK
@@ -1141,6 +1173,8 @@ fz_get_span_color_painter(int n, int da, const byte * FZ_RESTRICT color, const f
 			return da ? paint_span_with_color_1_da_alpha : paint_span_with_color_1_alpha;
 #if FZ_PLOTTERS_RGB
 	case 3:
+		if (da && fz_simd_level())
+			return alpha == 255 ? paint_span_with_color_3_da_solid_simd : paint_span_with_color_3_da_alpha_simd;
 		if (alpha == 255)
 			return da ? paint_span_with_color_3_da_solid : paint_span_with_color_3_solid;
 		else
@@ -1410,6 +1444,16 @@ paint_span_with_mask_3(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, const
 	TRACK_FN();
 	template_span_with_mask_3_general(dp, sp, 0, mp, w);
 }
+
+static void
+paint_span_with_mask_3_a_simd(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, const byte * FZ_RESTRICT mp, int w, int n, int a, const fz_overprint * FZ_RESTRICT eop)
+{
+	int done;
+	TRACK_FN();
+	done = fz_simd_span_with_mask_rgba(dp, sp, mp, w);
+	if (done < w)
+		template_span_with_mask_3_general(dp + done * 4, sp + done * 4, 1, mp + done, w - done);
+}
 #endif /* FZ_PLOTTERS_RGB */
 
 #if FZ_PLOTTERS_CMYK
@@ -1462,7 +1506,7 @@ fz_get_span_mask_painter(int a, int n)
 #if FZ_PLOTTERS_RGB
 		case 3:
 			if (a)
-				return paint_span_with_mask_3_a;
+				return fz_simd_level() ? paint_span_with_mask_3_a_simd : paint_span_with_mask_3_a;
 			else
 				return paint_span_with_mask_3;
 #endif /* FZ_PLOTTERS_RGB */
@@ -1956,6 +2000,26 @@ paint_span_3_da_sa_alpha(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT
 	template_span_3_with_alpha_general(dp, 1, sp, 1, w, alpha);
 }
 
+static void
+paint_span_3_da_sa_simd(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	int done;
+	TRACK_FN();
+	done = fz_simd_span_over_rgba(dp, sp, w);
+	if (done < w)
+		template_span_3_general(dp + done * 4, 1, sp + done * 4, 1, w - done);
+}
+
+static void
+paint_span_3_da_sa_alpha_simd(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	int done;
+	TRACK_FN();
+	done = fz_simd_span_over_alpha_rgba(dp, sp, w, alpha);
+	if (done < w)
+		template_span_3_with_alpha_general(dp + done * 4, 1, sp + done * 4, 1, w - done, alpha);
+}
+
 static void
 paint_span_3_da(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
 {
@@ -2195,9 +2259,9 @@ fz_get_span_painter(int da, int sa, int n, int alpha, const fz_overprint * FZ_RE
 			if (sa)
 			{
 				if (alpha == 255)
-					return paint_span_3_da_sa;
+					return fz_simd_level() ? paint_span_3_da_sa_simd : paint_span_3_da_sa;
 				else if (alpha > 0)
-					return paint_span_3_da_sa_alpha;
+					return fz_simd_level() ? paint_span_3_da_sa_alpha_simd : paint_span_3_da_sa_alpha;
 			}
 			else
 			{
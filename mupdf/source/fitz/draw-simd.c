@@ -0,0 +1,889 @@
+// Copyright (C) 2004-2021 Artifex Software, Inc.
+//
+// This file is part of MuPDF.
+//
+// MuPDF is free software: you can redistribute it and/or modify it under the
+// terms of the GNU Affero General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// MuPDF is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+// details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with MuPDF. If not, see <https://www.gnu.org/licenses/agpl-3.0.en.html>
+//
+// Alternative licensing terms are available from the licensor.
+// For commercial licensing, see <https://www.artifex.com/> or contact
+// Artifex Software, Inc., 39 Mesa Street, Suite 108A, San Francisco,
+// CA 94129, USA, for further information.
+
+
+#include "mupdf/fitz.h"
+
+#include "draw-imp.h"
+
+#include <string.h>
+
+/*
+	SIMD variants of the most common painters, for pixmaps with
+	3 colorants and alpha (RGBA/BGRA, 4 bytes per pixel).
+
+	The kernels here only do the bulk of a span and return the number
+	of pixels they painted; the scalar templates in draw-paint.c paint
+	the remainder. They must give exactly the same results as the scalar
+	code, which remains the reference implementation.
+
+	All blends are of the form (d * 256 + (s - d) * a) >> 8 or
+	s + ((d * a) >> 8) with 0 <= a <= 256. Their results always fit in
+	16 bits, so they can be calculated in 16 bit lanes with wrapping
+	multiplication even though the intermediate values don't.
+*/
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/* must match the fixed point precision in draw-affine.c */
+#define AFFINE_PREC 14
+#define AFFINE_ONE (((int64_t)1)<<AFFINE_PREC)
+#define AFFINE_MASK (AFFINE_ONE-1)
+#define AFFINE_HALF (((int64_t)1)<<(AFFINE_PREC-1))
+
+/*
+	The level is process wide as it only depends on the CPU.
+	-1 means not yet detected.
+*/
+static int simd_detected = -1;
+static int simd_level = -1;
+
+#ifdef SIMD_X86
+static void
+cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuidex(r, leaf, subleaf);
+	regs[0] = r[0]; regs[1] = r[1]; regs[2] = r[2]; regs[3] = r[3];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long
+xgetbv0(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+static int
+detect_simd_level(void)
+{
+#if defined(SIMD_X86)
+	unsigned int regs[4];
+	int level = FZ_SIMD_NONE;
+	cpuid(0, 0, regs);
+	if (regs[0] < 1)
+		return FZ_SIMD_NONE;
+	cpuid(1, 0, regs);
+	if (regs[3] & (1u << 26))
+		level = FZ_SIMD_SSE2;
+	/* AVX2 also needs the OS to save the ymm registers (OSXSAVE + XCR0) */
+	if (level == FZ_SIMD_SSE2 && (regs[2] & (1u << 27)) && (regs[2] & (1u << 28)) && (xgetbv0() & 6) == 6)
+	{
+		cpuid(0, 0, regs);
+		if (regs[0] >= 7)
+		{
+			cpuid(7, 0, regs);
+			if (regs[1] & (1u << 5))
+				level = FZ_SIMD_AVX2;
+		}
+	}
+	return level;
+#elif defined(SIMD_NEON)
+	return FZ_SIMD_NEON;
+#else
+	return FZ_SIMD_NONE;
+#endif
+}
+
+int
+fz_simd_level(void)
+{
+	if (simd_level < 0)
+	{
+		simd_detected = detect_simd_level();
+		simd_level = simd_detected;
+	}
+	return simd_level;
+}
+
+void
+fz_set_simd_level(int level)
+{
+	fz_simd_level();
+	if (level == FZ_SIMD_NONE || simd_detected == FZ_SIMD_NONE)
+		simd_level = FZ_SIMD_NONE;
+	else if (simd_detected == FZ_SIMD_NEON)
+		simd_level = FZ_SIMD_NEON;
+	else if (level == FZ_SIMD_NEON || level > simd_detected)
+		simd_level = simd_detected;
+	else
+		simd_level = level;
+}
+
+static fz_forceinline uint32_t
+load32(const unsigned char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static fz_forceinline void
+store32(unsigned char *p, uint32_t v)
+{
+	memcpy(p, &v, 4);
+}
+
+/* color with alpha set to 255, as in template_span_with_color_3_da_solid() */
+static fz_forceinline uint32_t
+opaque_color(const unsigned char *color)
+{
+	unsigned char c[4];
+	c[0] = color[0];
+	c[1] = color[1];
+	c[2] = color[2];
+	c[3] = 255;
+	return load32(c);
+}
+
+#ifdef SIMD_X86
+
+/* 4 mask values expanded (and scaled by sa) and repeated for every byte of 2 pixels each */
+static fz_forceinline void
+sse2_mask4(const unsigned char *mp, int sa, __m128i *lo, __m128i *hi)
+{
+	__m128i m = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)load32(mp)), _mm_setzero_si128());
+	m = _mm_add_epi16(m, _mm_srli_epi16(m, 7));
+	if (sa != 256)
+		m = _mm_mulhi_epu16(_mm_slli_epi16(m, 4), _mm_set1_epi16((short)(sa << 4)));
+	m = _mm_unpacklo_epi16(m, m);
+	*lo = _mm_unpacklo_epi32(m, m);
+	*hi = _mm_unpackhi_epi32(m, m);
+}
+
+/* FZ_BLEND(s, d, a) */
+static fz_forceinline __m128i
+sse2_blend(__m128i s, __m128i d, __m128i a)
+{
+	__m128i x = _mm_add_epi16(_mm_slli_epi16(d, 8), _mm_mullo_epi16(_mm_sub_epi16(s, d), a));
+	return _mm_srli_epi16(x, 8);
+}
+
+/* alpha of every pixel repeated for each of its bytes */
+static fz_forceinline __m128i
+sse2_alpha4(__m128i v)
+{
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+/* bytes of pixels that have an alpha of 0 */
+static fz_forceinline __m128i
+sse2_transparent(__m128i v)
+{
+	return _mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32((int)0xFF000000)), _mm_setzero_si128());
+}
+
+static fz_forceinline __m128i
+sse2_select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static int
+solid_color_sse2(unsigned char * FZ_RESTRICT dp, int w, const unsigned char * FZ_RESTRICT color, int sa)
+{
+	__m128i rgba = _mm_set1_epi32((int)opaque_color(color));
+	__m128i s = _mm_unpacklo_epi8(rgba, _mm_setzero_si128());
+	__m128i a = _mm_set1_epi16((short)sa);
+	int i;
+	if (sa == 256)
+	{
+		for (i = 0; i + 4 <= w; i += 4)
+			_mm_storeu_si128((__m128i *)(dp + i * 4), rgba);
+		return i;
+	}
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i *)(dp + i * 4));
+		__m128i lo = sse2_blend(s, _mm_unpacklo_epi8(d, _mm_setzero_si128()), a);
+		__m128i hi = sse2_blend(s, _mm_unpackhi_epi8(d, _mm_setzero_si128()), a);
+		_mm_storeu_si128((__m128i *)(dp + i * 4), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+static int
+span_with_color_sse2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT mp, int w, const unsigned char * FZ_RESTRICT color, int sa)
+{
+	__m128i rgba = _mm_set1_epi32((int)opaque_color(color));
+	__m128i s = _mm_unpacklo_epi8(rgba, _mm_setzero_si128());
+	int i;
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		uint32_t m = load32(mp + i);
+		__m128i d, mlo, mhi, lo, hi;
+		if (m == 0)
+			continue;
+		if (m == 0xFFFFFFFF && sa == 256)
+		{
+			_mm_storeu_si128((__m128i *)(dp + i * 4), rgba);
+			continue;
+		}
+		sse2_mask4(mp + i, sa, &mlo, &mhi);
+		d = _mm_loadu_si128((const __m128i *)(dp + i * 4));
+		lo = sse2_blend(s, _mm_unpacklo_epi8(d, _mm_setzero_si128()), mlo);
+		hi = sse2_blend(s, _mm_unpackhi_epi8(d, _mm_setzero_si128()), mhi);
+		_mm_storeu_si128((__m128i *)(dp + i * 4), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+static int
+span_with_mask_sse2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, const unsigned char * FZ_RESTRICT mp, int w)
+{
+	int i;
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		__m128i s, d, mlo, mhi, lo, hi, r;
+		if (load32(mp + i) == 0)
+			continue;
+		sse2_mask4(mp + i, 256, &mlo, &mhi);
+		s = _mm_loadu_si128((const __m128i *)(sp + i * 4));
+		d = _mm_loadu_si128((const __m128i *)(dp + i * 4));
+		lo = sse2_blend(_mm_unpacklo_epi8(s, _mm_setzero_si128()), _mm_unpacklo_epi8(d, _mm_setzero_si128()), mlo);
+		hi = sse2_blend(_mm_unpackhi_epi8(s, _mm_setzero_si128()), _mm_unpackhi_epi8(d, _mm_setzero_si128()), mhi);
+		r = _mm_packus_epi16(lo, hi);
+		/* transparent source pixels are skipped */
+		r = sse2_select(sse2_transparent(s), d, r);
+		_mm_storeu_si128((__m128i *)(dp + i * 4), r);
+	}
+	return i;
+}
+
+/* s + FZ_COMBINE(d, t) for 8 bytes, truncated to 8 bits like the scalar code */
+static fz_forceinline __m128i
+sse2_over(__m128i s, __m128i d, __m128i t)
+{
+	__m128i x = _mm_add_epi16(s, _mm_srli_epi16(_mm_mullo_epi16(d, t), 8));
+	return _mm_and_si128(x, _mm_set1_epi16(0xFF));
+}
+
+static int
+span_over_sse2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w)
+{
+	const __m128i k256 = _mm_set1_epi16(256);
+	int i;
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)(sp + i * 4));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dp + i * 4));
+		__m128i slo = _mm_unpacklo_epi8(s, _mm_setzero_si128());
+		__m128i shi = _mm_unpackhi_epi8(s, _mm_setzero_si128());
+		__m128i tlo = sse2_alpha4(slo);
+		__m128i thi = sse2_alpha4(shi);
+		__m128i r;
+		tlo = _mm_sub_epi16(k256, _mm_add_epi16(tlo, _mm_srli_epi16(tlo, 7)));
+		thi = _mm_sub_epi16(k256, _mm_add_epi16(thi, _mm_srli_epi16(thi, 7)));
+		r = _mm_packus_epi16(
+			sse2_over(slo, _mm_unpacklo_epi8(d, _mm_setzero_si128()), tlo),
+			sse2_over(shi, _mm_unpackhi_epi8(d, _mm_setzero_si128()), thi));
+		r = sse2_select(sse2_transparent(s), d, r);
+		_mm_storeu_si128((__m128i *)(dp + i * 4), r);
+	}
+	return i;
+}
+
+static int
+span_over_alpha_sse2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w, int alpha)
+{
+	const __m128i k255 = _mm_set1_epi16(255);
+	__m128i a = _mm_set1_epi16((short)FZ_EXPAND(alpha));
+	int i;
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)(sp + i * 4));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dp + i * 4));
+		/* FZ_COMBINE(s, alpha), its alpha is masa */
+		__m128i slo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, _mm_setzero_si128()), a), 8);
+		__m128i shi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, _mm_setzero_si128()), a), 8);
+		__m128i tlo = _mm_sub_epi16(k255, sse2_alpha4(slo));
+		__m128i thi = _mm_sub_epi16(k255, sse2_alpha4(shi));
+		tlo = _mm_add_epi16(tlo, _mm_srli_epi16(tlo, 7));
+		thi = _mm_add_epi16(thi, _mm_srli_epi16(thi, 7));
+		_mm_storeu_si128((__m128i *)(dp + i * 4), _mm_packus_epi16(
+			sse2_over(slo, _mm_unpacklo_epi8(d, _mm_setzero_si128()), tlo),
+			sse2_over(shi, _mm_unpackhi_epi8(d, _mm_setzero_si128()), thi)));
+	}
+	return i;
+}
+
+static fz_forceinline const unsigned char *
+sample_nearest4(const unsigned char *s, int64_t w, int64_t h, ptrdiff_t str, int64_t u, int64_t v)
+{
+	if (u < 0) u = 0;
+	if (v < 0) v = 0;
+	if (u >= (w>>AFFINE_PREC)) u = (w>>AFFINE_PREC) - 1;
+	if (v >= (h>>AFFINE_PREC)) v = (h>>AFFINE_PREC) - 1;
+	return s + v * str + u * 4;
+}
+
+/*
+	Bilinear interpolation of all 4 channels of a pixel at once.
+	lerp(a, b, f) = a + (((b - a) * f) >> PREC) = (a * (ONE - f) + b * f) >> PREC
+	which is a single _mm_madd_epi16() of interleaved (a, b) and (ONE - f, f).
+*/
+static int
+affine_lerp_sse2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int64_t sw, int64_t sh, ptrdiff_t ss, int64_t u, int64_t v, int64_t fa, int64_t fb, int w)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i k128 = _mm_set1_epi16(128);
+	int i;
+	for (i = 0; i < w; i++, dp += 4, u += fa, v += fb)
+	{
+		if (u + AFFINE_HALF >= 0 && u + AFFINE_ONE < sw && v + AFFINE_HALF >= 0 && v + AFFINE_ONE < sh)
+		{
+			int64_t ui = u >> AFFINE_PREC;
+			int64_t vi = v >> AFFINE_PREC;
+			int uf = (int)(u & AFFINE_MASK);
+			int vf = (int)(v & AFFINE_MASK);
+			__m128i a = _mm_cvtsi32_si128((int)load32(sample_nearest4(sp, sw, sh, ss, ui, vi)));
+			__m128i b = _mm_cvtsi32_si128((int)load32(sample_nearest4(sp, sw, sh, ss, ui+1, vi)));
+			__m128i c = _mm_cvtsi32_si128((int)load32(sample_nearest4(sp, sw, sh, ss, ui, vi+1)));
+			__m128i d = _mm_cvtsi32_si128((int)load32(sample_nearest4(sp, sw, sh, ss, ui+1, vi+1)));
+			__m128i fu = _mm_set1_epi32((uf << 16) | (int)(AFFINE_ONE - uf));
+			__m128i fv = _mm_set1_epi32((vf << 16) | (int)(AFFINE_ONE - vf));
+			__m128i top = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(a, b), zero), fu), AFFINE_PREC);
+			__m128i bot = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(c, d), zero), fu), AFFINE_PREC);
+			__m128i x = _mm_srai_epi32(_mm_madd_epi16(_mm_or_si128(top, _mm_slli_epi32(bot, 16)), fv), AFFINE_PREC);
+			int y = _mm_cvtsi128_si32(_mm_srli_si128(x, 12));
+			if (y != 0)
+			{
+				/* x + fz_mul255(dp, 255 - y) for all channels, alpha included */
+				__m128i dst = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)load32(dp)), zero);
+				__m128i m = _mm_add_epi16(_mm_mullo_epi16(dst, _mm_set1_epi16((short)(255 - y))), k128);
+				m = _mm_srli_epi16(_mm_add_epi16(m, _mm_srli_epi16(m, 8)), 8);
+				m = _mm_and_si128(_mm_add_epi16(_mm_packs_epi32(x, x), m), _mm_set1_epi16(0xFF));
+				store32(dp, (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(m, m)));
+			}
+		}
+	}
+	return w;
+}
+
+/* AVX2 versions of the above do 8 pixels at a time */
+
+TARGET_AVX2 static fz_forceinline void
+avx2_mask8(const unsigned char *mp, int sa, __m256i *lo, __m256i *hi)
+{
+	const __m128i idx0 = _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+	const __m128i idx1 = _mm_setr_epi8(4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+	__m128i m = _mm_loadl_epi64((const __m128i *)mp);
+	__m256i a = _mm256_cvtepu8_epi16(_mm_shuffle_epi8(m, idx0));
+	__m256i b = _mm256_cvtepu8_epi16(_mm_shuffle_epi8(m, idx1));
+	a = _mm256_add_epi16(a, _mm256_srli_epi16(a, 7));
+	b = _mm256_add_epi16(b, _mm256_srli_epi16(b, 7));
+	if (sa != 256)
+	{
+		__m256i s = _mm256_set1_epi16((short)(sa << 4));
+		a = _mm256_mulhi_epu16(_mm256_slli_epi16(a, 4), s);
+		b = _mm256_mulhi_epu16(_mm256_slli_epi16(b, 4), s);
+	}
+	*lo = a;
+	*hi = b;
+}
+
+TARGET_AVX2 static fz_forceinline __m256i
+avx2_blend(__m256i s, __m256i d, __m256i a)
+{
+	__m256i x = _mm256_add_epi16(_mm256_slli_epi16(d, 8), _mm256_mullo_epi16(_mm256_sub_epi16(s, d), a));
+	return _mm256_srli_epi16(x, 8);
+}
+
+/* packs 2 x 16 words into 32 bytes in order (_mm256_packus_epi16 works per 128 bit lane) */
+TARGET_AVX2 static fz_forceinline __m256i
+avx2_pack(__m256i lo, __m256i hi)
+{
+	return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+TARGET_AVX2 static fz_forceinline __m256i
+avx2_alpha4(__m256i v)
+{
+	v = _mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm256_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+TARGET_AVX2 static fz_forceinline __m256i
+avx2_transparent(__m256i v)
+{
+	return _mm256_cmpeq_epi32(_mm256_and_si256(v, _mm256_set1_epi32((int)0xFF000000)), _mm256_setzero_si256());
+}
+
+TARGET_AVX2 static fz_forceinline __m256i
+avx2_over(__m256i s, __m256i d, __m256i t)
+{
+	__m256i x = _mm256_add_epi16(s, _mm256_srli_epi16(_mm256_mullo_epi16(d, t), 8));
+	return _mm256_and_si256(x, _mm256_set1_epi16(0xFF));
+}
+
+#define AVX2_LO(v) _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v))
+#define AVX2_HI(v) _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1))
+
+TARGET_AVX2 static int
+solid_color_avx2(unsigned char * FZ_RESTRICT dp, int w, const unsigned char * FZ_RESTRICT color, int sa)
+{
+	__m256i rgba = _mm256_set1_epi32((int)opaque_color(color));
+	__m256i s = AVX2_LO(rgba);
+	__m256i a = _mm256_set1_epi16((short)sa);
+	int i;
+	if (sa == 256)
+	{
+		for (i = 0; i + 8 <= w; i += 8)
+			_mm256_storeu_si256((__m256i *)(dp + i * 4), rgba);
+		return i;
+	}
+	for (i = 0; i + 8 <= w; i += 8)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dp + i * 4));
+		_mm256_storeu_si256((__m256i *)(dp + i * 4), avx2_pack(avx2_blend(s, AVX2_LO(d), a), avx2_blend(s, AVX2_HI(d), a)));
+	}
+	return i;
+}
+
+TARGET_AVX2 static int
+span_with_color_avx2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT mp, int w, const unsigned char * FZ_RESTRICT color, int sa)
+{
+	__m256i rgba = _mm256_set1_epi32((int)opaque_color(color));
+	__m256i s = AVX2_LO(rgba);
+	int i;
+	for (i = 0; i + 8 <= w; i += 8)
+	{
+		uint64_t m;
+		__m256i d, mlo, mhi;
+		memcpy(&m, mp + i, 8);
+		if (m == 0)
+			continue;
+		if (m == ~(uint64_t)0 && sa == 256)
+		{
+			_mm256_storeu_si256((__m256i *)(dp + i * 4), rgba);
+			continue;
+		}
+		avx2_mask8(mp + i, sa, &mlo, &mhi);
+		d = _mm256_loadu_si256((const __m256i *)(dp + i * 4));
+		_mm256_storeu_si256((__m256i *)(dp + i * 4), avx2_pack(avx2_blend(s, AVX2_LO(d), mlo), avx2_blend(s, AVX2_HI(d), mhi)));
+	}
+	return i;
+}
+
+TARGET_AVX2 static int
+span_with_mask_avx2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, const unsigned char * FZ_RESTRICT mp, int w)
+{
+	int i;
+	for (i = 0; i + 8 <= w; i += 8)
+	{
+		uint64_t m;
+		__m256i s, d, mlo, mhi, r;
+		memcpy(&m, mp + i, 8);
+		if (m == 0)
+			continue;
+		avx2_mask8(mp + i, 256, &mlo, &mhi);
+		s = _mm256_loadu_si256((const __m256i *)(sp + i * 4));
+		d = _mm256_loadu_si256((const __m256i *)(dp + i * 4));
+		r = avx2_pack(avx2_blend(AVX2_LO(s), AVX2_LO(d), mlo), avx2_blend(AVX2_HI(s), AVX2_HI(d), mhi));
+		r = _mm256_blendv_epi8(r, d, avx2_transparent(s));
+		_mm256_storeu_si256((__m256i *)(dp + i * 4), r);
+	}
+	return i;
+}
+
+TARGET_AVX2 static int
+span_over_avx2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w)
+{
+	const __m256i k256 = _mm256_set1_epi16(256);
+	int i;
+	for (i = 0; i + 8 <= w; i += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)(sp + i * 4));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dp + i * 4));
+		__m256i slo = AVX2_LO(s);
+		__m256i shi = AVX2_HI(s);
+		__m256i tlo = avx2_alpha4(slo);
+		__m256i thi = avx2_alpha4(shi);
+		__m256i r;
+		tlo = _mm256_sub_epi16(k256, _mm256_add_epi16(tlo, _mm256_srli_epi16(tlo, 7)));
+		thi = _mm256_sub_epi16(k256, _mm256_add_epi16(thi, _mm256_srli_epi16(thi, 7)));
+		r = avx2_pack(avx2_over(slo, AVX2_LO(d), tlo), avx2_over(shi, AVX2_HI(d), thi));
+		r = _mm256_blendv_epi8(r, d, avx2_transparent(s));
+		_mm256_storeu_si256((__m256i *)(dp + i * 4), r);
+	}
+	return i;
+}
+
+TARGET_AVX2 static int
+span_over_alpha_avx2(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w, int alpha)
+{
+	const __m256i k255 = _mm256_set1_epi16(255);
+	__m256i a = _mm256_set1_epi16((short)FZ_EXPAND(alpha));
+	int i;
+	for (i = 0; i + 8 <= w; i += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)(sp + i * 4));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dp + i * 4));
+		__m256i slo = _mm256_srli_epi16(_mm256_mullo_epi16(AVX2_LO(s), a), 8);
+		__m256i shi = _mm256_srli_epi16(_mm256_mullo_epi16(AVX2_HI(s), a), 8);
+		__m256i tlo = _mm256_sub_epi16(k255, avx2_alpha4(slo));
+		__m256i thi = _mm256_sub_epi16(k255, avx2_alpha4(shi));
+		tlo = _mm256_add_epi16(tlo, _mm256_srli_epi16(tlo, 7));
+		thi = _mm256_add_epi16(thi, _mm256_srli_epi16(thi, 7));
+		_mm256_storeu_si256((__m256i *)(dp + i * 4), avx2_pack(avx2_over(slo, AVX2_LO(d), tlo), avx2_over(shi, AVX2_HI(d), thi)));
+	}
+	return i;
+}
+
+#endif /* SIMD_X86 */
+
+#ifdef SIMD_NEON
+
+static fz_forceinline uint8x16_t
+neon_load16(const unsigned char *p)
+{
+	return vld1q_u8(p);
+}
+
+/* 4 mask values expanded (and scaled by sa) and repeated for every byte of 2 pixels each */
+static fz_forceinline void
+neon_mask4(const unsigned char *mp, int sa, uint16x8_t *lo, uint16x8_t *hi)
+{
+	uint16x4_t m = vget_low_u16(vmovl_u8(vcreate_u8((uint64_t)load32(mp))));
+	m = vadd_u16(m, vshr_n_u16(m, 7));
+	if (sa != 256)
+		m = vshrn_n_u32(vmull_n_u16(m, (uint16_t)sa), 8);
+	*lo = vcombine_u16(vdup_lane_u16(m, 0), vdup_lane_u16(m, 1));
+	*hi = vcombine_u16(vdup_lane_u16(m, 2), vdup_lane_u16(m, 3));
+}
+
+static fz_forceinline uint16x8_t
+neon_blend(uint16x8_t s, uint16x8_t d, uint16x8_t a)
+{
+	return vshrq_n_u16(vaddq_u16(vshlq_n_u16(d, 8), vmulq_u16(vsubq_u16(s, d), a)), 8);
+}
+
+static fz_forceinline uint16x8_t
+neon_alpha4(uint16x8_t v)
+{
+	return vcombine_u16(vdup_lane_u16(vget_low_u16(v), 3), vdup_lane_u16(vget_high_u16(v), 3));
+}
+
+static fz_forceinline uint8x16_t
+neon_transparent(uint8x16_t v)
+{
+	return vreinterpretq_u8_u32(vceqq_u32(vandq_u32(vreinterpretq_u32_u8(v), vdupq_n_u32(0xFF000000)), vdupq_n_u32(0)));
+}
+
+static fz_forceinline uint16x8_t
+neon_over(uint16x8_t s, uint16x8_t d, uint16x8_t t)
+{
+	return vandq_u16(vaddq_u16(s, vshrq_n_u16(vmulq_u16(d, t), 8)), vdupq_n_u16(0xFF));
+}
+
+static fz_forceinline uint8x16_t
+neon_pack(uint16x8_t lo, uint16x8_t hi)
+{
+	return vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi));
+}
+
+#define NEON_LO(v) vmovl_u8(vget_low_u8(v))
+#define NEON_HI(v) vmovl_u8(vget_high_u8(v))
+
+static int
+solid_color_neon(unsigned char * FZ_RESTRICT dp, int w, const unsigned char * FZ_RESTRICT color, int sa)
+{
+	uint8x16_t rgba = vreinterpretq_u8_u32(vdupq_n_u32(opaque_color(color)));
+	uint16x8_t s = NEON_LO(rgba);
+	uint16x8_t a = vdupq_n_u16((uint16_t)sa);
+	int i;
+	if (sa == 256)
+	{
+		for (i = 0; i + 4 <= w; i += 4)
+			vst1q_u8(dp + i * 4, rgba);
+		return i;
+	}
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		uint8x16_t d = neon_load16(dp + i * 4);
+		vst1q_u8(dp + i * 4, neon_pack(neon_blend(s, NEON_LO(d), a), neon_blend(s, NEON_HI(d), a)));
+	}
+	return i;
+}
+
+static int
+span_with_color_neon(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT mp, int w, const unsigned char * FZ_RESTRICT color, int sa)
+{
+	uint8x16_t rgba = vreinterpretq_u8_u32(vdupq_n_u32(opaque_color(color)));
+	uint16x8_t s = NEON_LO(rgba);
+	int i;
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		uint32_t m = load32(mp + i);
+		uint16x8_t mlo, mhi;
+		uint8x16_t d;
+		if (m == 0)
+			continue;
+		if (m == 0xFFFFFFFF && sa == 256)
+		{
+			vst1q_u8(dp + i * 4, rgba);
+			continue;
+		}
+		neon_mask4(mp + i, sa, &mlo, &mhi);
+		d = neon_load16(dp + i * 4);
+		vst1q_u8(dp + i * 4, neon_pack(neon_blend(s, NEON_LO(d), mlo), neon_blend(s, NEON_HI(d), mhi)));
+	}
+	return i;
+}
+
+static int
+span_with_mask_neon(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, const unsigned char * FZ_RESTRICT mp, int w)
+{
+	int i;
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		uint16x8_t mlo, mhi;
+		uint8x16_t s, d, r;
+		if (load32(mp + i) == 0)
+			continue;
+		neon_mask4(mp + i, 256, &mlo, &mhi);
+		s = neon_load16(sp + i * 4);
+		d = neon_load16(dp + i * 4);
+		r = neon_pack(neon_blend(NEON_LO(s), NEON_LO(d), mlo), neon_blend(NEON_HI(s), NEON_HI(d), mhi));
+		vst1q_u8(dp + i * 4, vbslq_u8(neon_transparent(s), d, r));
+	}
+	return i;
+}
+
+static int
+span_over_neon(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w)
+{
+	const uint16x8_t k256 = vdupq_n_u16(256);
+	int i;
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		uint8x16_t s = neon_load16(sp + i * 4);
+		uint8x16_t d = neon_load16(dp + i * 4);
+		uint16x8_t slo = NEON_LO(s);
+		uint16x8_t shi = NEON_HI(s);
+		uint16x8_t tlo = neon_alpha4(slo);
+		uint16x8_t thi = neon_alpha4(shi);
+		uint8x16_t r;
+		tlo = vsubq_u16(k256, vaddq_u16(tlo, vshrq_n_u16(tlo, 7)));
+		thi = vsubq_u16(k256, vaddq_u16(thi, vshrq_n_u16(thi, 7)));
+		r = neon_pack(neon_over(slo, NEON_LO(d), tlo), neon_over(shi, NEON_HI(d), thi));
+		vst1q_u8(dp + i * 4, vbslq_u8(neon_transparent(s), d, r));
+	}
+	return i;
+}
+
+static int
+span_over_alpha_neon(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w, int alpha)
+{
+	const uint16x8_t k255 = vdupq_n_u16(255);
+	uint16x8_t a = vdupq_n_u16((uint16_t)FZ_EXPAND(alpha));
+	int i;
+	for (i = 0; i + 4 <= w; i += 4)
+	{
+		uint8x16_t s = neon_load16(sp + i * 4);
+		uint8x16_t d = neon_load16(dp + i * 4);
+		uint16x8_t slo = vshrq_n_u16(vmulq_u16(NEON_LO(s), a), 8);
+		uint16x8_t shi = vshrq_n_u16(vmulq_u16(NEON_HI(s), a), 8);
+		uint16x8_t tlo = vsubq_u16(k255, neon_alpha4(slo));
+		uint16x8_t thi = vsubq_u16(k255, neon_alpha4(shi));
+		tlo = vaddq_u16(tlo, vshrq_n_u16(tlo, 7));
+		thi = vaddq_u16(thi, vshrq_n_u16(thi, 7));
+		vst1q_u8(dp + i * 4, neon_pack(neon_over(slo, NEON_LO(d), tlo), neon_over(shi, NEON_HI(d), thi)));
+	}
+	return i;
+}
+
+static fz_forceinline const unsigned char *
+sample_nearest4(const unsigned char *s, int64_t w, int64_t h, ptrdiff_t str, int64_t u, int64_t v)
+{
+	if (u < 0) u = 0;
+	if (v < 0) v = 0;
+	if (u >= (w>>AFFINE_PREC)) u = (w>>AFFINE_PREC) - 1;
+	if (v >= (h>>AFFINE_PREC)) v = (h>>AFFINE_PREC) - 1;
+	return s + v * str + u * 4;
+}
+
+static fz_forceinline uint16x4_t
+neon_load4(const unsigned char *p)
+{
+	return vget_low_u16(vmovl_u8(vcreate_u8((uint64_t)load32(p))));
+}
+
+/* lerp(a, b, f) = (a * (ONE - f) + b * f) >> PREC, see affine_lerp_sse2() */
+static fz_forceinline uint16x4_t
+neon_lerp(uint16x4_t a, uint16x4_t b, int f)
+{
+	return vshrn_n_u32(vmlal_n_u16(vmull_n_u16(a, (uint16_t)(AFFINE_ONE - f)), b, (uint16_t)f), AFFINE_PREC);
+}
+
+static int
+affine_lerp_neon(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int64_t sw, int64_t sh, ptrdiff_t ss, int64_t u, int64_t v, int64_t fa, int64_t fb, int w)
+{
+	int i;
+	for (i = 0; i < w; i++, dp += 4, u += fa, v += fb)
+	{
+		if (u + AFFINE_HALF >= 0 && u + AFFINE_ONE < sw && v + AFFINE_HALF >= 0 && v + AFFINE_ONE < sh)
+		{
+			int64_t ui = u >> AFFINE_PREC;
+			int64_t vi = v >> AFFINE_PREC;
+			int uf = (int)(u & AFFINE_MASK);
+			int vf = (int)(v & AFFINE_MASK);
+			uint16x4_t top = neon_lerp(neon_load4(sample_nearest4(sp, sw, sh, ss, ui, vi)), neon_load4(sample_nearest4(sp, sw, sh, ss, ui+1, vi)), uf);
+			uint16x4_t bot = neon_lerp(neon_load4(sample_nearest4(sp, sw, sh, ss, ui, vi+1)), neon_load4(sample_nearest4(sp, sw, sh, ss, ui+1, vi+1)), uf);
+			uint16x4_t x = neon_lerp(top, bot, vf);
+			int y = vget_lane_u16(x, 3);
+			if (y != 0)
+			{
+				/* x + fz_mul255(dp, 255 - y) for all channels, alpha included */
+				uint16x4_t m = vadd_u16(vmul_n_u16(neon_load4(dp), (uint16_t)(255 - y)), vdup_n_u16(128));
+				m = vshr_n_u16(vadd_u16(m, vshr_n_u16(m, 8)), 8);
+				m = vand_u16(vadd_u16(x, m), vdup_n_u16(0xFF));
+				store32(dp, vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(m, m))), 0));
+			}
+		}
+	}
+	return w;
+}
+
+#endif /* SIMD_NEON */
+
+int
+fz_simd_solid_color_rgba(unsigned char * FZ_RESTRICT dp, int w, const unsigned char * FZ_RESTRICT color, int sa)
+{
+	switch (simd_level)
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return solid_color_avx2(dp, w, color, sa);
+	case FZ_SIMD_SSE2: return solid_color_sse2(dp, w, color, sa);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return solid_color_neon(dp, w, color, sa);
+#endif
+	default: return 0;
+	}
+}
+
+int
+fz_simd_span_with_color_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT mp, int w, const unsigned char * FZ_RESTRICT color, int sa)
+{
+	switch (simd_level)
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return span_with_color_avx2(dp, mp, w, color, sa);
+	case FZ_SIMD_SSE2: return span_with_color_sse2(dp, mp, w, color, sa);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return span_with_color_neon(dp, mp, w, color, sa);
+#endif
+	default: return 0;
+	}
+}
+
+int
+fz_simd_span_with_mask_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, const unsigned char * FZ_RESTRICT mp, int w)
+{
+	switch (simd_level)
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return span_with_mask_avx2(dp, sp, mp, w);
+	case FZ_SIMD_SSE2: return span_with_mask_sse2(dp, sp, mp, w);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return span_with_mask_neon(dp, sp, mp, w);
+#endif
+	default: return 0;
+	}
+}
+
+int
+fz_simd_span_over_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w)
+{
+	switch (simd_level)
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return span_over_avx2(dp, sp, w);
+	case FZ_SIMD_SSE2: return span_over_sse2(dp, sp, w);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return span_over_neon(dp, sp, w);
+#endif
+	default: return 0;
+	}
+}
+
+int
+fz_simd_span_over_alpha_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w, int alpha)
+{
+	switch (simd_level)
+	{
+#ifdef SIMD_X86
+	case FZ_SIMD_AVX2: return span_over_alpha_avx2(dp, sp, w, alpha);
+	case FZ_SIMD_SSE2: return span_over_alpha_sse2(dp, sp, w, alpha);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return span_over_alpha_neon(dp, sp, w, alpha);
+#endif
+	default: return 0;
+	}
+}
+
+int
+fz_simd_affine_lerp_rgba(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int64_t sw, int64_t sh, ptrdiff_t ss, int64_t u, int64_t v, int64_t fa, int64_t fb, int w)
+{
+	switch (simd_level)
+	{
+#ifdef SIMD_X86
+	/* a pixel fits in 128 bits, nothing to gain from AVX2 */
+	case FZ_SIMD_AVX2:
+	case FZ_SIMD_SSE2: return affine_lerp_sse2(dp, sp, sw, sh, ss, u, v, fa, fb, w);
+#endif
+#ifdef SIMD_NEON
+	case FZ_SIMD_NEON: return affine_lerp_neon(dp, sp, sw, sh, ss, u, v, fa, fb, w);
+#endif
+	default: return 0;
+	}
+}
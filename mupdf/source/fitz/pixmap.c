@@ -781,7 +781,13 @@ fz_premultiply_pixmap(fz_context *ctx, fz_pixmap *pix)
 
 	for (y = 0; y < pix->h; y++)
 	{
-		for (x = 0; x < pix->w; x++)
+		x = 0;
+		if (pix->n == 4)
+		{
+			x = (int)fz_simd_premultiply_rgba(s, pix->w);
+			s += x * 4;
+		}
+		for (; x < pix->w; x++)
 		{
 			a = s[pix->n - 1];
 			for (k = 0; k < pix->n - 1; k++)
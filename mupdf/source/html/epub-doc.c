@@ -316,7 +316,9 @@ epub_count_pages(fz_context *ctx, fz_document *doc_, int chapter)
 #define MAGIC_ACCEL_EPUB  0x62755065
 #define ACCEL_VERSION     0x00010001
 
-static void epub_load_accelerator(fz_context *ctx, epub_document *doc, fz_stream *accel)
+/* SumatraPDF: reading is separate from epub_load_accelerator() so that
+ * fz_merge_epub_accelerators() can use it. Returns NULL for bad data. */
+static epub_accelerator *read_accelerator(fz_context *ctx, fz_stream *accel)
 {
 	int v;
 	float w, h, em;
@@ -324,76 +326,70 @@ static void epub_load_accelerator(fz_context *ctx, epub_document *doc, fz_stream
 	epub_accelerator *acc = NULL;
 	uint32_t css_sum;
 	int use_doc_css;
-	int make_new = (accel == NULL);
 
 	fz_var(acc);
 
-	if (accel)
+	/* Try to read the accelerator data. If we fail silently give up. */
+	fz_try(ctx)
 	{
-		/* Try to read the accelerator data. If we fail silently give up. */
-		fz_try(ctx)
-		{
-			v = fz_read_int32_le(ctx, accel);
-			if (v != (int32_t)MAGIC_ACCELERATOR)
-			{
-				make_new = 1;
-				break;
-			}
+		v = fz_read_int32_le(ctx, accel);
+		if (v != (int32_t)MAGIC_ACCELERATOR)
+			break;
 
-			v = fz_read_int32_le(ctx, accel);
-			if (v != MAGIC_ACCEL_EPUB)
-			{
-				make_new = 1;
-				break;
-			}
+		v = fz_read_int32_le(ctx, accel);
+		if (v != MAGIC_ACCEL_EPUB)
+			break;
 
-			v = fz_read_int32_le(ctx, accel);
-			if (v != ACCEL_VERSION)
-			{
-				make_new = 1;
-				break;
-			}
+		v = fz_read_int32_le(ctx, accel);
+		if (v != ACCEL_VERSION)
+			break;
 
-			w = fz_read_float_le(ctx, accel);
-			h = fz_read_float_le(ctx, accel);
-			em = fz_read_float_le(ctx, accel);
-			css_sum = fz_read_uint32_le(ctx, accel);
-			use_doc_css = fz_read_int32_le(ctx, accel);
+		w = fz_read_float_le(ctx, accel);
+		h = fz_read_float_le(ctx, accel);
+		em = fz_read_float_le(ctx, accel);
+		css_sum = fz_read_uint32_le(ctx, accel);
+		use_doc_css = fz_read_int32_le(ctx, accel);
 
-			num_chapters = fz_read_int32_le(ctx, accel);
-			if (num_chapters <= 0)
-			{
-				make_new = 1;
-				break;
-			}
+		num_chapters = fz_read_int32_le(ctx, accel);
+		if (num_chapters <= 0)
+			break;
 
-			acc = fz_malloc_struct(ctx, epub_accelerator);
-			acc->pages_in_chapter = Memento_label(fz_malloc_array(ctx, num_chapters, int), "accel_pages_in_chapter");
-			acc->max_chapters = acc->num_chapters = num_chapters;
-			acc->layout_w = w;
-			acc->layout_h = h;
-			acc->layout_em = em;
-			acc->css_sum = css_sum;
-			acc->use_doc_css = use_doc_css;
-
-			for (v = 0; v < num_chapters; v++)
-				acc->pages_in_chapter[v] = fz_read_int32_le(ctx, accel);
-		}
-		fz_catch(ctx)
-		{
-			if (acc)
-				fz_free(ctx, acc->pages_in_chapter);
-			fz_free(ctx, acc);
-			/* Swallow the error and run unaccelerated */
-			fz_rethrow_if(ctx, FZ_ERROR_SYSTEM);
-			fz_report_error(ctx);
-			make_new = 1;
-		}
+		acc = fz_malloc_struct(ctx, epub_accelerator);
+		acc->pages_in_chapter = Memento_label(fz_malloc_array(ctx, num_chapters, int), "accel_pages_in_chapter");
+		acc->max_chapters = acc->num_chapters = num_chapters;
+		acc->layout_w = w;
+		acc->layout_h = h;
+		acc->layout_em = em;
+		acc->css_sum = css_sum;
+		acc->use_doc_css = use_doc_css;
+
+		for (v = 0; v < num_chapters; v++)
+			acc->pages_in_chapter[v] = fz_read_int32_le(ctx, accel);
 	}
+	fz_catch(ctx)
+	{
+		if (acc)
+			fz_free(ctx, acc->pages_in_chapter);
+		fz_free(ctx, acc);
+		acc = NULL;
+		/* Swallow the error and run unaccelerated */
+		fz_rethrow_if(ctx, FZ_ERROR_SYSTEM);
+		fz_report_error(ctx);
+	}
+
+	return acc;
+}
+
+static void epub_load_accelerator(fz_context *ctx, epub_document *doc, fz_stream *accel)
+{
+	epub_accelerator *acc = NULL;
+
+	if (accel)
+		acc = read_accelerator(ctx, accel);
 
 	/* If we aren't given an accelerator to load (or the one we're given
 	 * is bad) create a blank stub and we can fill it out as we go. */
-	if (make_new)
+	if (acc == NULL)
 	{
 		acc = fz_malloc_struct(ctx, epub_accelerator);
 		acc->css_sum = doc->css_sum;
@@ -959,28 +955,35 @@ epub_lookup_metadata(fz_context *ctx, fz_document *doc_, const char *key, char *
 	return -1;
 }
 
+static void
+write_accelerator(fz_context *ctx, epub_accelerator *acc, fz_output *out)
+{
+	int i;
+
+	fz_write_int32_le(ctx, out, MAGIC_ACCELERATOR);
+	fz_write_int32_le(ctx, out, MAGIC_ACCEL_EPUB);
+	fz_write_int32_le(ctx, out, ACCEL_VERSION);
+	fz_write_float_le(ctx, out, acc->layout_w);
+	fz_write_float_le(ctx, out, acc->layout_h);
+	fz_write_float_le(ctx, out, acc->layout_em);
+	fz_write_uint32_le(ctx, out, acc->css_sum);
+	fz_write_int32_le(ctx, out, acc->use_doc_css);
+	fz_write_int32_le(ctx, out, acc->num_chapters);
+	for (i = 0; i < acc->num_chapters; i++)
+		fz_write_int32_le(ctx, out, acc->pages_in_chapter[i]);
+}
+
 static void
 epub_output_accelerator(fz_context *ctx, fz_document *doc_, fz_output *out)
 {
 	epub_document *doc = (epub_document*)doc_;
-	int i;
 
 	fz_try(ctx)
 	{
 		if (doc->accel == NULL)
 			fz_throw(ctx, FZ_ERROR_ARGUMENT, "No accelerator data to write");
 
-		fz_write_int32_le(ctx, out, MAGIC_ACCELERATOR);
-		fz_write_int32_le(ctx, out, MAGIC_ACCEL_EPUB);
-		fz_write_int32_le(ctx, out, ACCEL_VERSION);
-		fz_write_float_le(ctx, out, doc->accel->layout_w);
-		fz_write_float_le(ctx, out, doc->accel->layout_h);
-		fz_write_float_le(ctx, out, doc->accel->layout_em);
-		fz_write_uint32_le(ctx, out, doc->accel->css_sum);
-		fz_write_int32_le(ctx, out, doc->accel->use_doc_css);
-		fz_write_int32_le(ctx, out, doc->accel->num_chapters);
-		for (i = 0; i < doc->accel->num_chapters; i++)
-			fz_write_int32_le(ctx, out, doc->accel->pages_in_chapter[i]);
+		write_accelerator(ctx, doc->accel, out);
 
 		fz_close_output(ctx, out);
 	}
@@ -990,6 +993,89 @@ epub_output_accelerator(fz_context *ctx, fz_document *doc_, fz_output *out)
 		fz_rethrow(ctx);
 }
 
+/* SumatraPDF: see fz_merge_epub_accelerators() in mupdf/fitz/document.h */
+fz_buffer *
+fz_merge_epub_accelerators(fz_context *ctx, fz_buffer **accels, int n)
+{
+	epub_accelerator **accs;
+	epub_accelerator merged = { 0 };
+	fz_buffer *res = NULL;
+	fz_output *out = NULL;
+	fz_stream *stm = NULL;
+	int i, k, first = -1;
+
+	accs = fz_calloc(ctx, n, sizeof(*accs));
+
+	fz_var(res);
+	fz_var(out);
+	fz_var(stm);
+
+	fz_try(ctx)
+	{
+		for (i = 0; i < n; i++)
+		{
+			if (accels[i] == NULL)
+				continue;
+			stm = fz_open_buffer(ctx, accels[i]);
+			accs[i] = read_accelerator(ctx, stm);
+			fz_drop_stream(ctx, stm);
+			stm = NULL;
+			if (accs[i] == NULL)
+				continue;
+			if (first < 0)
+				first = i;
+			if (accs[i]->num_chapters > merged.num_chapters)
+				merged.num_chapters = accs[i]->num_chapters;
+		}
+
+		if (first >= 0)
+		{
+			merged.layout_w = accs[first]->layout_w;
+			merged.layout_h = accs[first]->layout_h;
+			merged.layout_em = accs[first]->layout_em;
+			merged.css_sum = accs[first]->css_sum;
+			merged.use_doc_css = accs[first]->use_doc_css;
+			merged.max_chapters = merged.num_chapters;
+			merged.pages_in_chapter = fz_malloc_array(ctx, merged.num_chapters, int);
+
+			/* the first accelerator that knows the page count of a chapter wins */
+			for (k = 0; k < merged.num_chapters; k++)
+			{
+				int p = -1;
+				for (i = 0; i < n && p < 0; i++)
+					if (accs[i] && k < accs[i]->num_chapters)
+						p = accs[i]->pages_in_chapter[k];
+				merged.pages_in_chapter[k] = p;
+			}
+
+			res = fz_new_buffer(ctx, 40 + merged.num_chapters * 4);
+			out = fz_new_output_with_buffer(ctx, res);
+			write_accelerator(ctx, &merged, out);
+			fz_close_output(ctx, out);
+		}
+	}
+	fz_always(ctx)
+	{
+		fz_drop_stream(ctx, stm);
+		fz_drop_output(ctx, out);
+		fz_free(ctx, merged.pages_in_chapter);
+		for (i = 0; i < n; i++)
+		{
+			if (accs[i])
+				fz_free(ctx, accs[i]->pages_in_chapter);
+			fz_free(ctx, accs[i]);
+		}
+		fz_free(ctx, accs);
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_buffer(ctx, res);
+		fz_rethrow(ctx);
+	}
+
+	return res;
+}
+
 /* Takes ownership of zip. Will always eventually drop it.
  * Never takes ownership of accel. */
 static fz_document *
@@ -110,6 +110,8 @@ typedef struct
 	int len;
 	int cap;
 	struct keyval *items;
+	int *hash; /* index of items by key, see pdf_dict_build_hash */
+	int hash_mask;
 } pdf_obj_dict;
 
 typedef struct
@@ -2127,6 +2129,8 @@ pdf_new_dict(fz_context *ctx, pdf_document *doc, int initialcap)
 
 	obj->len = 0;
 	obj->cap = initialcap > 1 ? initialcap : 10;
+	obj->hash = NULL;
+	obj->hash_mask = 0;
 
 	fz_try(ctx)
 	{
@@ -2233,12 +2237,145 @@ pdf_dict_put_val_null(fz_context *ctx, pdf_obj *obj, int idx)
 	DICT(obj)->items[idx].v = PDF_NULL;
 }
 
+/*
+	Resource dictionaries of generated documents can have thousands of
+	entries (/Im1234, /F567) and every Do or Tf operator looks one of
+	them up. Dictionaries with at least pdf_dict_hash_min entries get an
+	open addressing index from the hash of the key name to the position
+	in items. It is built on the first lookup through pdf_dict_get(s),
+	kept up to date when keys are added and dropped when keys are
+	removed or reordered.
+*/
+static int pdf_dict_hash_min = 32;
+
+int
+pdf_dict_hash_threshold(void)
+{
+	return pdf_dict_hash_min;
+}
+
+void
+pdf_set_dict_hash_threshold(int len)
+{
+	pdf_dict_hash_min = len > 0 ? len : 1;
+}
+
+static const char *
+pdf_dict_key_name(pdf_obj *key)
+{
+	if (key < PDF_LIMIT)
+		return PDF_NAME_LIST[(intptr_t)key];
+	return NAME(key)->n;
+}
+
+/* FNV-1a */
+static unsigned int
+pdf_name_hash(const char *s)
+{
+	unsigned int h = 2166136261u;
+	while (*s)
+	{
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void
+pdf_dict_drop_hash(fz_context *ctx, pdf_obj *obj)
+{
+	fz_free(ctx, DICT(obj)->hash);
+	DICT(obj)->hash = NULL;
+	DICT(obj)->hash_mask = 0;
+}
+
+static void
+pdf_dict_hash_insert(pdf_obj *obj, int i)
+{
+	int *hash = DICT(obj)->hash;
+	unsigned int mask = DICT(obj)->hash_mask;
+	unsigned int h = pdf_name_hash(pdf_dict_key_name(DICT(obj)->items[i].k)) & mask;
+
+	while (hash[h] >= 0)
+		h = (h + 1) & mask;
+	hash[h] = i;
+}
+
+static void
+pdf_dict_build_hash(fz_context *ctx, pdf_obj *obj)
+{
+	int len = DICT(obj)->len;
+	int size = 64;
+	int i;
+
+	while (size < len * 2)
+		size <<= 1;
+
+	/* the index is only an accelerator, lookups work without it */
+	DICT(obj)->hash = fz_malloc_no_throw(ctx, size * sizeof(int));
+	if (!DICT(obj)->hash)
+		return;
+	memset(DICT(obj)->hash, 0xff, size * sizeof(int));
+	DICT(obj)->hash_mask = size - 1;
+
+	for (i = 0; i < len; i++)
+		pdf_dict_hash_insert(obj, i);
+}
+
+/* Keeps the index valid after inserting a key at position i. */
+static void
+pdf_dict_hash_inserted(fz_context *ctx, pdf_obj *obj, int i)
+{
+	int *hash = DICT(obj)->hash;
+	int size = DICT(obj)->hash_mask + 1;
+	int j;
+
+	if (DICT(obj)->len * 2 > size)
+	{
+		pdf_dict_drop_hash(ctx, obj);
+		return;
+	}
+	if (i < DICT(obj)->len - 1)
+	{
+		for (j = 0; j < size; j++)
+			if (hash[j] >= i)
+				hash[j]++;
+	}
+	pdf_dict_hash_insert(obj, i);
+}
+
+static int
+pdf_dict_hash_find(pdf_obj *obj, const char *key)
+{
+	int *hash = DICT(obj)->hash;
+	unsigned int mask = DICT(obj)->hash_mask;
+	unsigned int h = pdf_name_hash(key) & mask;
+	int i;
+
+	while ((i = hash[h]) >= 0)
+	{
+		if (!strcmp(pdf_dict_key_name(DICT(obj)->items[i].k), key))
+			return i;
+		h = (h + 1) & mask;
+	}
+	return -1;
+}
+
 /* Returns 0 <= i < len for key found. Returns -1-len < i <= -1 for key
  * not found, but with insertion point -1-i. */
 static int
 pdf_dict_finds(fz_context *ctx, pdf_obj *obj, const char *key)
 {
 	int len = DICT(obj)->len;
+	if (DICT(obj)->hash && len >= pdf_dict_hash_min)
+	{
+		int i = pdf_dict_hash_find(obj, key);
+		if (i >= 0)
+			return i;
+		if (!(obj->flags & PDF_FLAGS_SORTED))
+			return -1 - len;
+		/* the binary search below finds the insertion point */
+	}
 	if ((obj->flags & PDF_FLAGS_SORTED) && len > 0)
 	{
 		int l = 0;
@@ -2278,6 +2415,8 @@ static int
 pdf_dict_find(fz_context *ctx, pdf_obj *obj, pdf_obj *key)
 {
 	int len = DICT(obj)->len;
+	if (DICT(obj)->hash && len >= pdf_dict_hash_min)
+		return pdf_dict_finds(ctx, obj, PDF_NAME_LIST[(intptr_t)key]);
 	if ((obj->flags & PDF_FLAGS_SORTED) && len > 0)
 	{
 		int l = 0;
@@ -2338,6 +2477,8 @@ pdf_dict_gets(fz_context *ctx, pdf_obj *obj, const char *key)
 	if (!key)
 		return NULL;
 
+	if (!DICT(obj)->hash && DICT(obj)->len >= pdf_dict_hash_min)
+		pdf_dict_build_hash(ctx, obj);
 	i = pdf_dict_finds(ctx, obj, key);
 	if (i >= 0)
 		return DICT(obj)->items[i].v;
@@ -2405,6 +2546,8 @@ pdf_dict_get(fz_context *ctx, pdf_obj *obj, pdf_obj *key)
 	if (!OBJ_IS_NAME(key))
 		return NULL;
 
+	if (!DICT(obj)->hash && DICT(obj)->len >= pdf_dict_hash_min)
+		pdf_dict_build_hash(ctx, obj);
 	if (key < PDF_LIMIT)
 		i = pdf_dict_find(ctx, obj, key);
 	else
@@ -2485,6 +2628,8 @@ pdf_dict_get_put(fz_context *ctx, pdf_obj *obj, pdf_obj *key, pdf_obj *val, pdf_
 		DICT(obj)->items[i].k = pdf_keep_obj(ctx, key);
 		DICT(obj)->items[i].v = pdf_keep_obj(ctx, val);
 		DICT(obj)->len ++;
+		if (DICT(obj)->hash)
+			pdf_dict_hash_inserted(ctx, obj, i);
 	}
 }
 
@@ -2727,6 +2872,7 @@ pdf_dict_dels(fz_context *ctx, pdf_obj *obj, const char *key)
 		obj->flags &= ~PDF_FLAGS_SORTED;
 		DICT(obj)->items[i] = DICT(obj)->items[DICT(obj)->len-1];
 		DICT(obj)->len --;
+		pdf_dict_drop_hash(ctx, obj);
 	}
 }
 
@@ -2752,6 +2898,7 @@ pdf_sort_dict(fz_context *ctx, pdf_obj *obj)
 	{
 		qsort(DICT(obj)->items, DICT(obj)->len, sizeof(struct keyval), keyvalcmp);
 		obj->flags |= PDF_FLAGS_SORTED;
+		pdf_dict_drop_hash(ctx, obj);
 	}
 }
 
@@ -3047,6 +3194,7 @@ pdf_drop_dict(fz_context *ctx, pdf_obj *obj)
 		pdf_drop_obj(ctx, DICT(obj)->items[i].v);
 	}
 
+	fz_free(ctx, DICT(obj)->hash);
 	fz_free(ctx, DICT(obj)->items);
 	fz_free(ctx, obj);
 }
@@ -36,6 +36,59 @@ struct entry
 	int64_t stm_len;
 };
 
+/* Find the next "endstream" and leave the file positioned right after it
+ * (or at the end of the file). Stream data is searched in the stream's
+ * buffer instead of byte by byte, since for files without usable /Length
+ * entries (such as truncated ones) this is most of the time spent. */
+static void
+skip_to_endstream(fz_context *ctx, fz_stream *file)
+{
+	static const char endstream[] = "endstream";
+	size_t matched = 0;
+
+	while (1)
+	{
+		size_t avail = fz_available(ctx, file, 64 << 10);
+		unsigned char *p = file->rp;
+		unsigned char *end = p + avail;
+
+		if (avail == 0)
+			return;
+
+		while (p < end)
+		{
+			if (matched == 0)
+			{
+				p = memchr(p, 'e', end - p);
+				if (!p)
+				{
+					p = end;
+					break;
+				}
+				p++;
+				matched = 1;
+				continue;
+			}
+			if (*p == endstream[matched])
+			{
+				p++;
+				if (++matched == 9)
+				{
+					file->rp = p;
+					return;
+				}
+				continue;
+			}
+			/* "endstre" is the only partial match ending in a
+			 * prefix ("e") of "endstream" */
+			matched = matched == 7 ? 1 : 0;
+			if (matched == 0 && *p != 'e')
+				p++;
+		}
+		file->rp = p;
+	}
+}
+
 static void add_root(fz_context *ctx, pdf_obj *obj, pdf_obj ***roots, int *num_roots, int *max_roots)
 {
 	if (*num_roots == *max_roots)
@@ -199,16 +252,7 @@ pdf_repair_obj(fz_context *ctx, pdf_document *doc, pdf_lexbuf *buf, int64_t *stm
 			fz_seek(ctx, file, *stmofsp, 0);
 		}
 
-		(void)fz_read(ctx, file, (unsigned char *) buf->scratch, 9);
-
-		while (memcmp(buf->scratch, "endstream", 9) != 0)
-		{
-			c = fz_read_byte(ctx, file);
-			if (c == EOF)
-				break;
-			memmove(&buf->scratch[0], &buf->scratch[1], 8);
-			buf->scratch[8] = c;
-		}
+		skip_to_endstream(ctx, file);
 
 		if (stmlenp)
 			*stmlenp = fz_tell(ctx, file) - *stmofsp - 9;
@@ -603,6 +647,20 @@ pdf_repair_xref(fz_context *ctx, pdf_document *doc)
 			entry->stm_ofs = 0;
 		}
 
+		/* remember corrected lengths for pdf_output_repair_accelerator */
+		fz_free(ctx, doc->repaired_lengths);
+		doc->repaired_lengths = NULL;
+		doc->repaired_lengths_count = 0;
+		if (!encrypt)
+		{
+			n = 0;
+			for (i = 0; i < listlen; i++)
+				if (list[i].stm_len >= 0)
+					n++;
+			if (n > 0)
+				doc->repaired_lengths = fz_malloc_array(ctx, n, pdf_repaired_length);
+		}
+
 		for (i = 0; i < listlen; i++)
 		{
 			entry = pdf_get_populating_xref_entry(ctx, doc, list[i].num);
@@ -630,6 +688,10 @@ pdf_repair_xref(fz_context *ctx, pdf_document *doc)
 					pdf_drop_obj(ctx, dict);
 				fz_catch(ctx)
 					fz_rethrow(ctx);
+
+				doc->repaired_lengths[doc->repaired_lengths_count].num = list[i].num;
+				doc->repaired_lengths[doc->repaired_lengths_count].len = list[i].stm_len;
+				doc->repaired_lengths_count++;
 			}
 		}
 
@@ -774,3 +836,243 @@ pdf_repair_obj_stms(fz_context *ctx, pdf_document *doc)
 			fz_throw(ctx, FZ_ERROR_FORMAT, "invalid reference to non-object-stream: %d (%d 0 R)", (int)entry->ofs, i);
 	}
 }
+
+/*
+	Repair accelerators let the next open of a damaged file skip the
+	scan: they hold the repaired xref (including the objects found in
+	object streams), the repaired trailer and the corrected lengths of
+	streams whose /Length was wrong.
+*/
+
+#define MAGIC_ACCELERATOR 0xacce1e7a
+#define MAGIC_ACCEL_PDF   0x72666470
+#define ACCEL_VERSION     0x00010001
+
+static int64_t
+pdf_file_length(fz_context *ctx, pdf_document *doc)
+{
+	int64_t len;
+
+	fz_seek(ctx, doc->file, 0, SEEK_END);
+	len = fz_tell(ctx, doc->file);
+	fz_seek(ctx, doc->file, 0, SEEK_SET);
+	return len;
+}
+
+static void
+write_int64_le(fz_context *ctx, fz_output *out, int64_t x)
+{
+	fz_write_uint32_le(ctx, out, (unsigned int)x);
+	fz_write_uint32_le(ctx, out, (unsigned int)((uint64_t)x >> 32));
+}
+
+void
+pdf_output_repair_accelerator(fz_context *ctx, pdf_document *doc, fz_output *out)
+{
+	char *trailer = NULL;
+	size_t trailer_len;
+	int i, len;
+
+	fz_var(trailer);
+
+	fz_try(ctx)
+	{
+		if (!doc->repair_attempted || pdf_has_unsaved_changes(ctx, doc))
+			fz_throw(ctx, FZ_ERROR_ARGUMENT, "No repair data to write");
+
+		trailer = pdf_sprint_obj(ctx, NULL, 0, &trailer_len, pdf_trailer(ctx, doc), 1, 1);
+		len = pdf_xref_len(ctx, doc);
+
+		fz_write_int32_le(ctx, out, MAGIC_ACCELERATOR);
+		fz_write_int32_le(ctx, out, MAGIC_ACCEL_PDF);
+		fz_write_int32_le(ctx, out, ACCEL_VERSION);
+		write_int64_le(ctx, out, pdf_file_length(ctx, doc));
+
+		fz_write_int32_le(ctx, out, (int)trailer_len);
+		fz_write_data(ctx, out, trailer, trailer_len);
+
+		fz_write_int32_le(ctx, out, len);
+		for (i = 0; i < len; i++)
+		{
+			pdf_xref_entry *entry = pdf_get_xref_entry_no_null(ctx, doc, i);
+			fz_write_byte(ctx, out, entry->type);
+			fz_write_int32_le(ctx, out, entry->gen);
+			fz_write_int32_le(ctx, out, entry->num);
+			write_int64_le(ctx, out, entry->ofs);
+			write_int64_le(ctx, out, entry->stm_ofs);
+		}
+
+		fz_write_int32_le(ctx, out, doc->repaired_lengths_count);
+		for (i = 0; i < doc->repaired_lengths_count; i++)
+		{
+			fz_write_int32_le(ctx, out, doc->repaired_lengths[i].num);
+			write_int64_le(ctx, out, doc->repaired_lengths[i].len);
+		}
+
+		fz_close_output(ctx, out);
+	}
+	fz_always(ctx)
+	{
+		fz_free(ctx, trailer);
+		fz_drop_output(ctx, out);
+	}
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+}
+
+int
+pdf_load_repair_accelerator(fz_context *ctx, pdf_document *doc, fz_stream *accel)
+{
+	pdf_lexbuf lexbuf;
+	unsigned char *data = NULL;
+	fz_stream *stm = NULL;
+	pdf_obj *trailer = NULL;
+	pdf_xref_entry *table = NULL;
+	pdf_repaired_length *lengths = NULL;
+	pdf_xref_entry *entry;
+	int i, n, len = 0, num_lengths = 0;
+	int loaded = 0;
+
+	fz_var(data);
+	fz_var(stm);
+	fz_var(trailer);
+	fz_var(table);
+	fz_var(lengths);
+
+	pdf_lexbuf_init(ctx, &lexbuf, PDF_LEXBUF_SMALL);
+
+	/* Read everything before touching the document, so that bad data
+	 * leaves it ready for a regular repair. */
+	fz_try(ctx)
+	{
+		if (fz_read_int32_le(ctx, accel) != (int32_t)MAGIC_ACCELERATOR ||
+			fz_read_int32_le(ctx, accel) != MAGIC_ACCEL_PDF ||
+			fz_read_int32_le(ctx, accel) != ACCEL_VERSION)
+			fz_throw(ctx, FZ_ERROR_FORMAT, "not a repair accelerator");
+		if (fz_read_int64_le(ctx, accel) != pdf_file_length(ctx, doc))
+			fz_throw(ctx, FZ_ERROR_FORMAT, "repair accelerator is for a different file");
+
+		n = fz_read_int32_le(ctx, accel);
+		if (n <= 0 || n > (1 << 20))
+			fz_throw(ctx, FZ_ERROR_FORMAT, "invalid trailer in repair accelerator");
+		data = fz_malloc(ctx, n);
+		if (fz_read(ctx, accel, data, n) != (size_t)n)
+			fz_throw(ctx, FZ_ERROR_FORMAT, "truncated repair accelerator");
+		stm = fz_open_memory(ctx, data, n);
+		trailer = pdf_parse_stm_obj(ctx, doc, stm, &lexbuf);
+		if (!pdf_is_dict(ctx, trailer))
+			fz_throw(ctx, FZ_ERROR_FORMAT, "invalid trailer in repair accelerator");
+
+		len = fz_read_int32_le(ctx, accel);
+		if (len <= 0 || len > PDF_MAX_OBJECT_NUMBER + 1)
+			fz_throw(ctx, FZ_ERROR_FORMAT, "invalid xref in repair accelerator");
+		table = fz_malloc_struct_array(ctx, len, pdf_xref_entry);
+		for (i = 0; i < len; i++)
+		{
+			int type = fz_read_byte(ctx, accel);
+			if (type != 0 && type != 'f' && type != 'n' && type != 'o')
+				fz_throw(ctx, FZ_ERROR_FORMAT, "invalid xref entry in repair accelerator");
+			table[i].type = type;
+			table[i].gen = fz_read_int32_le(ctx, accel);
+			table[i].num = fz_read_int32_le(ctx, accel);
+			table[i].ofs = fz_read_int64_le(ctx, accel);
+			table[i].stm_ofs = fz_read_int64_le(ctx, accel);
+		}
+
+		num_lengths = fz_read_int32_le(ctx, accel);
+		if (num_lengths < 0 || num_lengths > len)
+			fz_throw(ctx, FZ_ERROR_FORMAT, "invalid stream lengths in repair accelerator");
+		if (num_lengths > 0)
+			lengths = fz_malloc_array(ctx, num_lengths, pdf_repaired_length);
+		for (i = 0; i < num_lengths; i++)
+		{
+			lengths[i].num = fz_read_int32_le(ctx, accel);
+			lengths[i].len = fz_read_int64_le(ctx, accel);
+			if (lengths[i].num <= 0 || lengths[i].num >= len || lengths[i].len < 0)
+				fz_throw(ctx, FZ_ERROR_FORMAT, "invalid stream lengths in repair accelerator");
+		}
+	}
+	fz_always(ctx)
+	{
+		fz_drop_stream(ctx, stm);
+		fz_free(ctx, data);
+		pdf_lexbuf_fin(ctx, &lexbuf);
+	}
+	fz_catch(ctx)
+	{
+		pdf_drop_obj(ctx, trailer);
+		fz_free(ctx, table);
+		fz_free(ctx, lengths);
+		fz_rethrow_if(ctx, FZ_ERROR_SYSTEM);
+		fz_report_error(ctx);
+		fz_warn(ctx, "ignoring repair accelerator");
+		return 0;
+	}
+
+	/* Same state as after pdf_repair_xref and pdf_repair_obj_stms */
+	doc->repair_attempted = 1;
+	doc->repair_in_progress = 1;
+
+	pdf_drop_page_tree_internal(ctx, doc);
+	doc->page_tree_broken = 0;
+	pdf_forget_xref(ctx, doc);
+
+	fz_try(ctx)
+	{
+		pdf_ensure_solid_xref(ctx, doc, len);
+		for (i = 0; i < len; i++)
+		{
+			entry = pdf_get_populating_xref_entry(ctx, doc, i);
+			entry->type = table[i].type;
+			entry->gen = table[i].gen;
+			entry->num = table[i].num;
+			entry->ofs = table[i].ofs;
+			entry->stm_ofs = table[i].stm_ofs;
+		}
+		pdf_set_populating_xref_trailer(ctx, doc, trailer);
+
+		for (i = 0; i < num_lengths; i++)
+		{
+			pdf_obj *dict, *old_obj = NULL;
+
+			dict = pdf_load_object(ctx, doc, lengths[i].num);
+			fz_try(ctx)
+			{
+				pdf_dict_get_put_drop(ctx, dict, PDF_NAME(Length), pdf_new_int(ctx, lengths[i].len), &old_obj);
+				if (old_obj)
+					orphan_object(ctx, doc, old_obj);
+			}
+			fz_always(ctx)
+				pdf_drop_obj(ctx, dict);
+			fz_catch(ctx)
+				fz_rethrow(ctx);
+		}
+
+		fz_free(ctx, doc->repaired_lengths);
+		doc->repaired_lengths = lengths;
+		doc->repaired_lengths_count = num_lengths;
+		lengths = NULL;
+		loaded = 1;
+	}
+	fz_always(ctx)
+	{
+		doc->repair_in_progress = 0;
+		pdf_drop_obj(ctx, trailer);
+		fz_free(ctx, table);
+		fz_free(ctx, lengths);
+	}
+	fz_catch(ctx)
+	{
+		/* SumatraPDF: a stale or corrupted accelerator (e.g. pointing at
+		 * objects that can't be loaded) must not make the file fail to
+		 * open. Start over so that pdf_repair_xref can run instead. */
+		fz_rethrow_if(ctx, FZ_ERROR_SYSTEM);
+		fz_report_error(ctx);
+		fz_warn(ctx, "ignoring repair accelerator");
+		pdf_forget_xref(ctx, doc);
+		doc->repair_attempted = 0;
+		loaded = 0;
+	}
+
+	return loaded;
+}
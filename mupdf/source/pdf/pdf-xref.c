@@ -1815,6 +1815,7 @@ pdf_init_document(fz_context *ctx, pdf_document *doc)
 {
 	pdf_obj *encrypt, *id;
 	int repaired = 0;
+	int accelerated = 0;
 
 	fz_try(ctx)
 	{
@@ -1872,7 +1873,11 @@ pdf_init_document(fz_context *ctx, pdf_document *doc)
 			/* pdf_repair_xref may access xref_index, so reset it properly */
 			if (doc->xref_index)
 				memset(doc->xref_index, 0, sizeof(int) * doc->max_xref_len);
-			pdf_repair_xref(ctx, doc);
+			if (doc->repair_accel)
+				accelerated = pdf_load_repair_accelerator(ctx, doc, doc->repair_accel);
+			doc->repair_accel_loaded = accelerated;
+			if (!accelerated)
+				pdf_repair_xref(ctx, doc);
 			pdf_prime_xref_index(ctx, doc);
 		}
 
@@ -1884,7 +1889,8 @@ pdf_init_document(fz_context *ctx, pdf_document *doc)
 		/* Allow lazy clients to read encrypted files with a blank password */
 		(void)pdf_authenticate_password(ctx, doc, "");
 
-		if (repaired)
+		/* the accelerator already has the repaired trailer and objects */
+		if (repaired && !accelerated)
 		{
 			pdf_repair_trailer(ctx, doc);
 		}
@@ -2033,6 +2039,7 @@ pdf_drop_document_imp(fz_context *ctx, pdf_document *doc)
 
 	pdf_drop_xref_sections(ctx, doc);
 	fz_free(ctx, doc->xref_index);
+	fz_free(ctx, doc->repaired_lengths);
 
 	fz_drop_stream(ctx, doc->file);
 	pdf_drop_crypt(ctx, doc->crypt);
@@ -3150,6 +3157,7 @@ pdf_new_document(fz_context *ctx, fz_stream *file)
 	doc->super.lookup_metadata = (fz_document_lookup_metadata_fn*)pdf_lookup_metadata;
 	doc->super.set_metadata = (fz_document_set_metadata_fn*)pdf_set_metadata;
 	doc->super.run_structure = (fz_document_run_structure_fn *)pdf_run_document_structure;
+	doc->super.output_accelerator = (fz_document_output_accelerator_fn *)pdf_output_repair_accelerator;
 
 	pdf_lexbuf_init(ctx, &doc->lexbuf.base, PDF_LEXBUF_LARGE);
 	doc->file = fz_keep_stream(ctx, file);
@@ -3160,14 +3168,20 @@ pdf_new_document(fz_context *ctx, fz_stream *file)
 	return doc;
 }
 
-pdf_document *
-pdf_open_document_with_stream(fz_context *ctx, fz_stream *file)
+static pdf_document *
+pdf_open_accelerated_document_with_stream(fz_context *ctx, fz_stream *file, fz_stream *accel)
 {
 	pdf_document *doc = pdf_new_document(ctx, file);
 	fz_try(ctx)
 	{
+		/* only used while opening, the caller keeps ownership */
+		doc->repair_accel = accel;
 		pdf_init_document(ctx, doc);
 	}
+	fz_always(ctx)
+	{
+		doc->repair_accel = NULL;
+	}
 	fz_catch(ctx)
 	{
 		/* fz_drop_document may clobber our error code/message so we have to stash them temporarily. */
@@ -3180,6 +3194,12 @@ pdf_open_document_with_stream(fz_context *ctx, fz_stream *file)
 	return doc;
 }
 
+pdf_document *
+pdf_open_document_with_stream(fz_context *ctx, fz_stream *file)
+{
+	return pdf_open_accelerated_document_with_stream(ctx, file, NULL);
+}
+
 /* Uncomment the following to test progressive loading. */
 /* #define TEST_PROGRESSIVE_HACK */
 
@@ -3736,7 +3756,7 @@ open_document(fz_context *ctx, fz_stream *file, fz_stream *accel, fz_archive *zi
 {
 	if (file == NULL)
 		return NULL;
-	return (fz_document *)pdf_open_document_with_stream(ctx, file);
+	return (fz_document *)pdf_open_accelerated_document_with_stream(ctx, file, accel);
 }
 
 fz_document_handler pdf_document_handler =
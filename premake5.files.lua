@@ -626,6 +626,7 @@ function sumatrapdf_files()
     "Flags.*",
     "FzImgReader.*",
     "GlobalPrefs.*",
+    "GlyphIndex.*",
     "HomePage.*",
     "Installer.*",
     "InstallerCommon.cpp",
@@ -659,6 +660,7 @@ function sumatrapdf_files()
     "Tabs.*",
     "Tester.*",
     "TextSearch.*",
+    "TextCacheFile.*",
     "TextSelection.*",
     "Theme.*",
     "Toolbar.*",
@@ -670,6 +672,9 @@ function sumatrapdf_files()
     "Widget.*",
     "WindowTab.*",
     "CpsLabAnnot.*",
+    "CpsLabExport.*",
+    "CpsLabExportJob.*",
+    "CpsLabMarkerNode.*",
 
     "ext/versions.txt",
     "scratch.txt",
@@ -811,6 +816,7 @@ function engines_files()
     "HtmlFormatter.*",
     "MobiDoc.*",
     "PdfCreator.*",
+    "PageLabels.*",
     "PalmDbReader.*",
   })
 end
@@ -841,6 +847,7 @@ function mupdf_files()
     "color-fast.c",
     "color-icc-create.c",
     "color-lcms.c",
+    "color-simd.c",
     "colorspace.c",
     "compress.c",
     "compressed-buffer.c",
@@ -865,6 +872,7 @@ function mupdf_files()
     "draw-path.c",
     "draw-rasterize.c",
     "draw-scale-simple.c",
+    "draw-simd.c",
     "draw-unpack.c",
     "encode-basic.c",
     "encode-fax.c",
@@ -1141,48 +1149,25 @@ function sizer_files()
 end
 
 function test_util_files()
+  -- utils, engines and mupdf come from their libraries (see test_util in premake5.lua)
   files_in_dir( "src/utils", {
-    "BaseUtil.*",
-    "BitManip.*",
-    "ByteOrderDecoder.*",
-    "CmdLineArgsIter.*",
-    "ColorUtil.*",
-    "CryptoUtil.*",
-    "CssParser.*",
-    "Dict.*",
-    "Dpi.*",
-    "FileUtil.*",
-    "GeomUtil.*",
-    "HtmlParserLookup.*",
-    "HtmlPrettyPrint.*",
-    "HtmlPullParser.*",
-    "JsonParser.*",
-    "Scoped.*",
-    "SettingsUtil.*",
-    "Log.*",
-    "StrconvUtil.*",
-    "StrFormat.*",
-    "StrUtil.*",
-    "StrVec.*",
-    "StrQueue.*",
-    "SquareTreeParser.*",
-    "TrivialHtmlParser.*",
-    "TempAllocator.*",
     "UtAssert.*",
-    "Vec.*",
-    "WinUtil.*",
-    "WinDynCalls.*",
     "tests/*"
   })
   files_in_dir("src", {
     --"StressTesting.*",
     --"AppTools.*",
+    "CpsLabMarkerNode.*",
     "CrashHandlerNoOp.cpp",
     "DisplayMode.*",
     "Flags.*",
+    "FzImgReader.*",
+    "PdfSync.*",
     "SumatraConfig.*",
     "SettingsStructs.*",
     "SumatraUnitTests.cpp",
+    "mui/Mui.*",
+    "mui/TextRender.*",
     "tools/test_util.cpp"
   })
 end
@@ -1198,6 +1183,18 @@ function engine_dump_files()
   })
 end
 
+function cpslab_export_files()
+  files_in_dir("src", {
+    "CrashHandlerNoOp.cpp",
+    "CpsLabExportJob.*",
+    "CpsLabExportTool.cpp",
+    "SumatraConfig.*",
+    "FzImgReader.*",
+    "mui/Mui.*",
+    "mui/TextRender.*"
+  })
+end
+
 function plugin_test_files()
     files {
         "src/tools/plugin-test.cpp",
@@ -1233,6 +1230,7 @@ function pdf_preview_files()
     "RegistryPreview.*",
     "MobiDoc.*",
     "MUPDF_Exports.cpp",
+    "PageLabels.*",
     "PalmDbReader.*",
     "PdfCreator.*",
     "SumatraConfig.*",
@@ -1257,6 +1255,7 @@ function search_filter_files()
     "EngineMupdf.*",
     "EngineMupdfImpl.*",
     "MobiDoc.*",
+    "PageLabels.*",
     "PalmDbReader.*",
     "RegistrySearchFilter.*",
   })
@@ -691,15 +691,40 @@ workspace "SumatraPDF"
       "version", "windowscodecs", "wininet"
     }
 
+  project "cpslabexport"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++latest"
+    regconf()
+    includedirs { "src", "src/wingui", "mupdf/include" }
+    disablewarnings { "4100", "4267", "4457" }
+    cpslab_export_files()
+    links_zlib()
+    links { "engines", "utils", "unrar", "mupdf", "unarrlib", "libwebp", "libdjvu", "dav1d", "libheif" }
+    links {
+      "comctl32", "gdiplus", "msimg32", "shlwapi",
+      "version", "windowscodecs", "wininet"
+    }
+
   project "test_util"
     kind "ConsoleApp"
     language "C++"
     cppdialect "C++latest"
     regconf()
     disablewarnings { "4838" }
-    includedirs { "src" }
+    includedirs { "src", "src/wingui", "mupdf/include" }
     test_util_files()
-    links { "gdiplus", "comctl32", "shlwapi", "Version", "wininet" }
+    synctex_files()
+    -- for synctex
+    disablewarnings { "4100", "4244", "4267", "4702", "4706", "4819" }
+    uses_zlib()
+    includedirs { "ext/synctex" }
+    links_zlib()
+    links { "engines", "utils", "unrar", "mupdf", "unarrlib", "libwebp", "libdjvu", "dav1d", "libheif" }
+    links {
+      "comctl32", "gdiplus", "msimg32", "shlwapi",
+      "version", "windowscodecs", "wininet"
+    }
 
   project "sizer"
     kind "ConsoleApp"
@@ -994,6 +994,22 @@ bool IsMoveableAnnotation(AnnotationType tp) {
     return IsAnnotationInList(tp, moveableAnnotations);
 }
 
+static void SetAnnotationDefaultAuthor(fz_context* ctx, pdf_annot* annot) {
+    if (!pdf_annot_has_author(ctx, annot)) {
+        return;
+    }
+    char* defAuthor = gGlobalPrefs->annotations.defaultAuthor;
+    // if "(none)" we don't set it
+    if (str::Eq(defAuthor, "(none)")) {
+        return;
+    }
+    const char* author = getuser();
+    if (!str::EmptyOrWhiteSpaceOnly(defAuthor)) {
+        author = defAuthor;
+    }
+    pdf_set_annot_author(ctx, annot, author);
+}
+
 Annotation* EngineMupdfCreateAnnotation(EngineBase* engine, AnnotationType typ, int pageNo, PointF pos) {
     static const float black[3] = {0, 0, 0};
 
@@ -1013,17 +1029,7 @@ Annotation* EngineMupdfCreateAnnotation(EngineBase* engine, AnnotationType typ,
             annot = pdf_create_annot(ctx, page, atyp);
 
             pdf_set_annot_modification_date(ctx, annot, time(nullptr));
-            if (pdf_annot_has_author(ctx, annot)) {
-                char* defAuthor = gGlobalPrefs->annotations.defaultAuthor;
-                // if "(none)" we don't set it
-                if (!str::Eq(defAuthor, "(none)")) {
-                    const char* author = getuser();
-                    if (!str::EmptyOrWhiteSpaceOnly(defAuthor)) {
-                        author = defAuthor;
-                    }
-                    pdf_set_annot_author(ctx, annot, author);
-                }
-            }
+            SetAnnotationDefaultAuthor(ctx, annot);
 
             switch (typ) {
                 case AnnotationType::Text:
@@ -1114,3 +1120,117 @@ Annotation* EngineMupdfCreateAnnotation(EngineBase* engine, AnnotationType typ,
     pdf_drop_annot(ctx, annot);
     return res;
 }
+
+// creates many highlight annotations in one go. Unlike EngineMupdfCreateAnnotation()
+// followed by SetQuadPointsAsRect() / SetColor() / SetContents() we don't regenerate
+// appearance streams after every property change: all properties are set first and
+// the appearances are synthesized once per page at the end
+bool EngineMupdfCreateHighlights(EngineBase* engine, const Vec<HighlightToCreate>& highlights, const Vec<RectF>& rects,
+                                 PdfColor col, const char* contents, Vec<Annotation*>& created) {
+    EngineMupdf* epdf = AsEngineMupdf(engine);
+    if (!epdf || !epdf->pdfdoc) {
+        return false;
+    }
+    fz_context* ctx = epdf->Ctx();
+
+    float color[3];
+    PdfColorToFloat(col, color);
+    float opacity = GetOpacityFloat(col);
+    time_t now = time(nullptr);
+
+    // loading pages takes its own locks so do it before taking ctxAccess
+    Vec<FzPageInfo*> pageInfos;
+    for (auto& h : highlights) {
+        pageInfos.Append(h.nRects > 0 ? epdf->GetFzPageInfo(h.pageNo, true) : nullptr);
+    }
+
+    Vec<fz_quad> quads;
+    Vec<pdf_annot*> annots;
+    Vec<FzPageInfo*> updatePages;
+    Vec<int> annotPageNos;
+    bool ok = true;
+    {
+        ScopedCritSec cs(epdf->ctxAccess);
+
+        int nHighlights = highlights.Size();
+        for (int hi = 0; hi < nHighlights; hi++) {
+            auto& h = highlights[hi];
+            if (h.nRects <= 0) {
+                continue;
+            }
+            ReportIf(h.firstRect < 0 || h.firstRect + h.nRects > rects.Size());
+            auto pageInfo = pageInfos[hi];
+            if (!pageInfo || !pageInfo->page) {
+                ok = false;
+                continue;
+            }
+            quads.Reset();
+            for (int i = h.firstRect; i < h.firstRect + h.nRects; i++) {
+                quads.Append(fz_quad_from_rect(ToFzRect(rects[i])));
+            }
+
+            pdf_annot* annot = nullptr;
+            fz_try(ctx) {
+                auto page = pdf_page_from_fz_page(ctx, pageInfo->page);
+                annot = pdf_create_annot(ctx, page, PDF_ANNOT_HIGHLIGHT);
+                pdf_set_annot_modification_date(ctx, annot, now);
+                SetAnnotationDefaultAuthor(ctx, annot);
+                pdf_set_annot_quad_points(ctx, annot, quads.Size(), quads.LendData());
+                if (col == 0) {
+                    pdf_set_annot_color(ctx, annot, 0, color);
+                } else {
+                    pdf_set_annot_color(ctx, annot, 3, color);
+                    pdf_set_annot_opacity(ctx, annot, opacity);
+                }
+                if (contents) {
+                    pdf_set_annot_contents(ctx, annot, contents);
+                }
+            }
+            fz_catch(ctx) {
+                fz_report_error(ctx);
+                logf("EngineMupdfCreateHighlights(): creating annotation on page %d failed\n", h.pageNo);
+                if (annot) {
+                    pdf_drop_annot(ctx, annot);
+                    annot = nullptr;
+                }
+                ok = false;
+            }
+            if (!annot) {
+                continue;
+            }
+            annots.Append(annot);
+            annotPageNos.Append(h.pageNo);
+            if (!updatePages.Contains(pageInfo)) {
+                updatePages.Append(pageInfo);
+            }
+        }
+
+        // the first pdf_update_page() resynthesizes every dirty annotation
+        // of all loaded pages, the others only confirm they're up to date
+        for (FzPageInfo* pageInfo : updatePages) {
+            fz_try(ctx) {
+                pdf_update_page(ctx, pdf_page_from_fz_page(ctx, pageInfo->page));
+            }
+            fz_catch(ctx) {
+                fz_report_error(ctx);
+                logf("EngineMupdfCreateHighlights(): pdf_update_page() for page %d failed\n", pageInfo->pageNo);
+            }
+        }
+    }
+
+    Vec<Annotation*> added;
+    int n = annots.Size();
+    for (int i = 0; i < n; i++) {
+        pdf_annot* annot = annots[i];
+        Annotation* res = MakeAnnotationWrapper(epdf, annot, annotPageNos[i]);
+        pdf_drop_annot(ctx, annot);
+        if (!res) {
+            ok = false;
+            continue;
+        }
+        added.Append(res);
+    }
+    MarkNotificationAsAdded(epdf, added);
+    created.Append(added);
+    return ok;
+}
@@ -71,6 +71,13 @@ RectF GetBounds(Annotation*);
 RectF GetRect(Annotation*);
 void SetRect(Annotation*, RectF);
 void SetQuadPointsAsRect(Annotation*, const Vec<RectF>&);
+
+// one highlight for EngineMupdfCreateHighlights(): covers rects[firstRect .. firstRect + nRects)
+struct HighlightToCreate {
+    int pageNo = 0;
+    int firstRect = 0;
+    int nRects = 0;
+};
 // Vec<Annotation*> FilterAnnotationsForPage(Vec<Annotation*>* annots, int pageNo);
 
 // EditAnnotations.cpp
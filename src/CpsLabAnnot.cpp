@@ -3,12 +3,14 @@
 
 #include <iomanip>
 #include <sstream>
-#include <map>
+#include <unordered_map>
+#include <vector>
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/WinUtil.h"
 #include "utils/FileUtil.h"
 #include "utils/JsonParser.h"
+#include "utils/Timer.h"
 #include "wingui/UIModels.h"
 #include "Settings.h"
 #include "DocController.h"
@@ -19,6 +21,7 @@
 #include "DisplayModel.h"
 #include "SumatraPDF.h"
 #include "TextSelection.h"
+#include "GlyphIndex.h"
 #include "TextSearch.h"
 #include "Annotation.h"
 #include "MainWindow.h"
@@ -27,6 +30,8 @@
 
 #include "CpsLabAnnot.h"
 
+#include "utils/Log.h"
+
 namespace cpslab {
 
 
@@ -42,32 +47,30 @@ const char* EXPORT_TEXT_BLOCKS = nullptr;
 // =============================================================
 //
 // =============================================================
-struct MarkFileParser : json::ValueVisitor {
+// pages of each word in a marker setup file (see MarkFileParser),
+// kept in MarkerNode::userArea() until the words are marked
+using WordPages = std::unordered_map<std::string, std::vector<int> >;
+
+struct MarkFileParser {
     /*
      *  { "Net": {"mark_color" : "coloe_code",
      *            "select_color" : "coloe_code",
-     *            "word" : ["xx", "",...] }
+     *            "word" : ["xx", "",...],
+     *            "netname" : [page_no, ...], ... },
+     *    "mark_color" : { "Net" : "coloe_code", ... },
+     *    "select_color" : { "Net" : "coloe_code", ... }
      *  }
+     *  Files with the pages of every word can be tens of MB, so they're read
+     *  token by token with json::Tokenizer instead of json::Parse(), which
+     *  builds a path string for every value.
      */
     WindowTab* tab;
     Vec<MarkerNode*> markerTable;
 
     MarkerNode* getMark(const char* keyword);
-    bool mark_color(const char* path, const char* value) ;
-    bool select_color(const char* path, const char* value) ;
-    bool words(const char* path, const char* value);
-    bool pages(const char* path, const char* value);
-    //
-    bool Visit(const char* path, const char* value, json::Type type) override;
     void Parse(const char* path);
 };
 
-void MarkFileParser::Parse(const char* path) {
-    ByteSlice data = file::ReadFile(path);
-    json::Parse(data, this);
-    data.Free();
-}
-
 MarkerNode* MarkFileParser::getMark(const char* keyword) {
     for(auto m : markerTable) {
         if (str::Eq(m->keyword.Get(), keyword)) {
@@ -80,84 +83,113 @@ MarkerNode* MarkFileParser::getMark(const char* keyword) {
     return m;
 }
 
-bool MarkFileParser::mark_color(const char* path, const char* value) {
-    AutoFreeStr keyword;
-    const char* prop = str::Parse(path, "/%s/mark_color", &keyword);
-    if (prop == nullptr) {
-        prop = str::Parse(path, "/mark_color/%s", &keyword);
-    }
-    if (prop == nullptr) {
-        return false;
-    }
-    MarkerNode* mark = getMark(keyword.Get());
-    mark->mark_color = 0xff000000 + std::strtol(value, nullptr, 16);
-    return true;
-}
-
-bool MarkFileParser::select_color(const char* path, const char* value) {
-    AutoFreeStr keyword;
-    const char* prop = str::Parse(path, "/%s/select_color", &keyword);
-    if (prop == nullptr) {
-        prop = str::Parse(path, "/select_color/%s", &keyword);
-    }
-    if (prop == nullptr) {
-        return false;
-    }
-    MarkerNode* mark = getMark(keyword.Get());
-    mark->select_color = 0xff000000 + std::strtol(value, nullptr, 16);
-    return true;
+static PdfColor ParseMarkColor(const std::string& value) {
+    return 0xff000000 + std::strtol(value.c_str(), nullptr, 16);
 }
 
-bool MarkFileParser::words(const char* path, const char* value) {
-    AutoFreeStr keyword;
-    int idx;
-    const char* prop = str::Parse(path, "/%s/word[%d]", &keyword, &idx);
-    if (prop == nullptr) {
-        return false;
+static int ParsePageNo(StrSpan s) {
+    // page numbers are integers, other numbers are truncated like atoi() does
+    const char* c = s.CStr();
+    const char* end = c + s.Len();
+    bool neg = c < end && *c == '-';
+    int n = 0;
+    for (c += neg ? 1 : 0; c < end && str::IsDigit(*c); c++) {
+        n = n * 10 + (*c - '0');
     }
-    MarkerNode* mark = getMark(keyword.Get());
-    mark->words.Append(value);
-    return true;
+    return neg ? -n : n;
 }
 
-bool MarkFileParser::pages(const char* path, const char* value) {
-    AutoFreeStr keyword;
-    AutoFreeStr word;
-    int idx;
-    const char* prop = str::Parse(path, "/%s/%s[%d]", &keyword, &word, &idx);
-    if (prop == nullptr) {
-        return false;
-    }
-    MarkerNode* mark = getMark(keyword.Get());
-    WCHAR* wsep = strconv::Utf8ToWStr(word.Get());
-    std::wstring name = wsep;
-    str::Free(wsep);
-    int page = std::atoi(value);
-    auto word_pages = static_cast<std::map<std::wstring, std::vector<int> >*>(mark->userArea());
-    if (word_pages == nullptr) {
-        word_pages = new std::map<std::wstring, std::vector<int> >;
-        mark->setUserArea((void*)word_pages);
-    }
-    if (word_pages->find(name) == word_pages->end()) {
-        mark->words.Append(word.Get());
+void MarkFileParser::Parse(const char* path) {
+    file::MappedFile file;
+    if (!file.Open(path)) {
+        return;
     }
-    (*word_pages)[name].push_back(page);
-    return true;
-}
-
-bool MarkFileParser::Visit(const char* path, const char* value, json::Type type) {
-    if (json::Type::String == type) {
-        if (this->mark_color(path, value))
-            return true;
-        if (this->select_color(path, value))
-            return true;
-        if (this->words(path, value))
-            return true;
-    } else if (json::Type::Number == type) {
-        if (this->pages(path, value))
-            return true;
+    json::Tokenizer tok((const char*)file.data, file.size);
+    str::Str unescaped; // text of the current token if it has escapes
+    auto tokenText = [&]() -> std::string {
+        if (!tok.hasEscapes) {
+            return std::string(tok.value.CStr(), tok.value.Len());
+        }
+        return std::string(unescaped.Get(), unescaped.size());
+    };
+
+    std::string topKey;             // keyword (or mark_color/select_color)
+    std::string subKey;             // word (or mark_color/select_color/word)
+    bool inSubArray = false;        // in the array value of subKey
+    MarkerNode* mark = nullptr;     // the node for topKey, created on demand
+    std::vector<int>* pages = nullptr;  // the pages of subKey, created on demand
+    for (json::TokenType type = tok.Next(); type != json::TokenType::End; type = tok.Next()) {
+        if (tok.hasEscapes) {
+            unescaped.Reset();
+            if (!json::Unescape(tok.value, unescaped)) {
+                return;
+            }
+        }
+        switch (type) {
+            case json::TokenType::Error:
+                return;
+            case json::TokenType::Key:
+                if (tok.depth == 1) {
+                    topKey = tokenText();
+                    mark = nullptr;
+                } else if (tok.depth == 2) {
+                    subKey = tokenText();
+                    pages = nullptr;
+                }
+                break;
+            case json::TokenType::ArrayStart:
+            case json::TokenType::ObjectStart:
+                if (tok.depth == 3) {
+                    inSubArray = type == json::TokenType::ArrayStart;
+                }
+                break;
+            case json::TokenType::String:
+                if (tok.depth == 2) {
+                    if (topKey == "mark_color") {
+                        getMark(subKey.c_str())->mark_color = ParseMarkColor(tokenText());
+                    } else if (topKey == "select_color") {
+                        getMark(subKey.c_str())->select_color = ParseMarkColor(tokenText());
+                    } else if (subKey == "mark_color") {
+                        getMark(topKey.c_str())->mark_color = ParseMarkColor(tokenText());
+                    } else if (subKey == "select_color") {
+                        getMark(topKey.c_str())->select_color = ParseMarkColor(tokenText());
+                    }
+                } else if (tok.depth == 3 && inSubArray && subKey == "word") {
+                    if (!mark) {
+                        mark = getMark(topKey.c_str());
+                    }
+                    if (tok.hasEscapes) {
+                        mark->words.Append(tokenText().c_str());
+                    } else {
+                        mark->words.Append(tok.value.CStr(), tok.value.Len());
+                    }
+                }
+                break;
+            case json::TokenType::Number:
+                if (tok.depth == 3 && inSubArray) {
+                    if (!pages) {
+                        if (!mark) {
+                            mark = getMark(topKey.c_str());
+                        }
+                        auto wordPages = static_cast<WordPages*>(mark->userArea());
+                        if (wordPages == nullptr) {
+                            wordPages = new WordPages;
+                            mark->setUserArea((void*)wordPages);
+                        }
+                        auto it = wordPages->find(subKey);
+                        if (it == wordPages->end()) {
+                            mark->words.Append(subKey.c_str(), (int)subKey.size());
+                            it = wordPages->emplace(subKey, std::vector<int>()).first;
+                        }
+                        pages = &it->second;
+                    }
+                    pages->push_back(ParsePageNo(tok.value));
+                }
+                break;
+            default:
+                break;
+        }
     }
-    return true;
 }
 
 // =============================================================
@@ -210,28 +242,6 @@ class WordBlock {
 // =============================================================
 //
 // =============================================================
-MarkerNode::MarkerNode(WindowTab* tab)
-    : tab_(tab), filePath_(), user_area_(nullptr), keyword(), mark_color(0xff00ffff), select_color(0xff00ffff),
-      words(), annotations(), mark_words(), rects(), pages(),
-      selected_words(), assoc_cells()
-{
-    mark_color = 0xff00ffff;
-    select_color = 0xff0000ff;
-}
-
-MarkerNode::~MarkerNode() {
-    for (auto a : annotations) {
-        DeleteAnnotation(a);
-    }
-}
-
-void* MarkerNode::userArea() {
-    return user_area_;
-}
-void MarkerNode::setUserArea(void* v) {
-    user_area_ = v;
-}
-
 const char* MarkerNode::selectWord(MainWindow* win, const int pageNo, char* wd, bool conti) {
 
     char* first_word = nullptr;
@@ -280,52 +290,6 @@ const char* MarkerNode::selectWords(MainWindow* win, StrVec& select_words, bool
     return first_word;
 }
 
-
-
-size_t MarkerNode::getMarkWordsByPageNo(const int pageNo, StrVec& result) {
-    int i = 0;
-    for (auto pno : pages) {
-        if (pno == pageNo) {
-            auto w = mark_words.at(i);
-            result.Append(w);
-        }
-        ++i;
-    }
-    return result.Size();
-}
-
-int MarkerNode::getPage(const char* cell, const int pageNo) {
-    int i = 0;
-    for (char* w : mark_words) {
-        if (str::Eq(cell, w)) {
-            int target_pageNo = pages.at(i);
-            if (0 < pageNo) {
-                if (pageNo <= target_pageNo) {
-                    return target_pageNo;
-                }
-            } else {
-                return target_pageNo;
-            }
-        }
-        ++i;
-    }
-    return -1;
-}
-
-bool MarkerNode::tExist(const int pageNo, const char* cell) {
-    int i = 0;
-    for (auto pno : pages) {
-        if (pno == pageNo) {
-            auto w = mark_words.at(i);
-            if (str::Eq(cell, w)) {
-                return true;
-            }
-        }
-        ++i;
-    }
-    return false;
-}
-
 // =============================================================
 //
 // =============================================================
@@ -407,19 +371,16 @@ MarkerNode* Markers::getMarker(const char* keyword) {
 size_t Markers::getMarkersByWord(const char* word, Vec<MarkerNode*>& result) {
     size_t n = 0;
     for (auto p : markerTable) {
-        for (auto w : p->words) {
-            if (str::Eq(w, word)) {
-                result.Append(p);
-                n++;
-                break;
-            }
+        if (p->hasWord(word)) {
+            result.Append(p);
+            n++;
         }
     }
     return n;
 }
 
 size_t Markers::getMarkersByWord(const WCHAR* word, Vec<MarkerNode*>& result) {
-    return getMarkersByWord(strconv::WStrToUtf8(word), result);
+    return getMarkersByWord(ToUtf8Temp(word), result);
 }
 
 size_t Markers::getMarkersByRect(Rect& r, Vec<MarkerNode*>& result, bool specified_object_only)
@@ -429,12 +390,9 @@ size_t Markers::getMarkersByRect(Rect& r, Vec<MarkerNode*>& result, bool specifi
         if (specified_object_only && !isSelection(p->keyword)) {
             continue;
         }
-        for (Rect pr : p->rects) {
-            if (r == pr) {
-                result.Append(p);
-                n++;
-                break;
-            }
+        if (p->hasRect(r)) {
+            result.Append(p);
+            n++;
         }
     }
     return n;
@@ -444,13 +402,9 @@ size_t Markers::getMarkersByTS(TextSelection* ts, Vec<MarkerNode*>& result) {
     size_t n = 0;
     for (auto p : markerTable) {
         for (int i = 0; i < ts->result.len; ++i) {
-            Rect r = ts->result.rects[i];
-            for (Rect pr : p->rects) {
-                if (r == pr) {
-                    result.Append(p);
-                    n++;
-                    break;
-                }
+            if (p->hasRect(ts->result.rects[i])) {
+                result.Append(p);
+                n++;
             }
         }
     }
@@ -715,19 +669,20 @@ bool IsWord(const WCHAR* begin, const size_t length) {
 }
 
 
-bool IsWord(const WCHAR* pageText, const Rect* coords, const WCHAR* begin, const WCHAR* end) {
+bool IsWord(const WCHAR* pageText, const PageGlyphs* glyphs, const WCHAR* begin, const WCHAR* end) {
     if (!isWordChar(*begin)) {
         return false;
     }
+    GlyphCursor coords(glyphs);
     // -----------------------------------------------------------------
     // Check wheter 'begin' is the beginning character of a word.
     // -----------------------------------------------------------------
-    Rect rect = coords[begin - pageText];   // boundary rectangle of 'begin' character.
+    Rect rect = coords.At((int)(begin - pageText));   // boundary rectangle of 'begin' character.
     if (begin != pageText) {
         if (isWordChar(*(begin - 1))) {
             // The previous character of 'begin' is also word-character.
             if (gGlobalPrefs->printableCharAsWordChar) {
-                Rect r = coords[begin - pageText - 1]; // boundary rectangle of the previous char of 'begin'.
+                Rect r = coords.At((int)(begin - pageText - 1)); // boundary rectangle of the previous char of 'begin'.
                 if (r.x == rect.x || r.y == rect.y) {
                     // 'begin' and 'begin-1' is on the same line.
                     // Then the 'begin' is not beginning of a word.
@@ -745,7 +700,7 @@ bool IsWord(const WCHAR* pageText, const Rect* coords, const WCHAR* begin, const
     // -----------------------------------------------------------------
     if (isWordChar(*(end))) {
         if (gGlobalPrefs->printableCharAsWordChar) {
-            Rect r = coords[end - pageText];
+            Rect r = coords.At((int)(end - pageText));
             if (r.x == rect.x || r.y == rect.y) {
                 return false;
             }
@@ -762,7 +717,7 @@ bool IsWord(const WCHAR* pageText, const Rect* coords, const WCHAR* begin, const
             return false;
         }
         if (gGlobalPrefs->printableCharAsWordChar) {
-            Rect r = coords[c - pageText];
+            Rect r = coords.At((int)(c - pageText));
             if (r.x != rect.x && r.y != rect.y) {
                 return false;
             }
@@ -776,7 +731,7 @@ bool IsWord(const WCHAR* pageText, const Rect* coords, const WCHAR* begin, const
 //
 // =============================================================
 const WCHAR* SelectWordAt(const DisplayModel* dm, int pageNo, const WCHAR* pageText,
-                          const Rect* coords, const WCHAR* src, const WCHAR* lineSep,
+                          const PageGlyphs* glyphs, const WCHAR* src, const WCHAR* lineSep,
                           str::WStr& result,
                           Markers* markers=nullptr,
                           bool specified_object_only=false) {
@@ -788,15 +743,16 @@ const WCHAR* SelectWordAt(const DisplayModel* dm, int pageNo, const WCHAR* pageT
     }
     // backword search the begin letter of 'word'.
     int lineSep_len = str::Len(lineSep);
+    GlyphCursor coords(glyphs);
     const WCHAR* begin = src;
-    Rect rect = coords[begin - pageText];
+    Rect rect = coords.At((int)(begin - pageText));
     for (; *begin; --begin) {
         if (!isWordChar(*begin)) {
             begin++;
             break;
         }
         if (gGlobalPrefs->printableCharAsWordChar) {
-            Rect r = coords[begin - pageText];
+            Rect r = coords.At((int)(begin - pageText));
             if (r.x != rect.x && r.y != rect.y) {
                 begin++;
                 break;
@@ -810,19 +766,19 @@ const WCHAR* SelectWordAt(const DisplayModel* dm, int pageNo, const WCHAR* pageT
             break;
         }
         if (gGlobalPrefs->printableCharAsWordChar) {
-            Rect r = coords[end - pageText];
+            Rect r = coords.At((int)(end - pageText));
             if (r.x != rect.x && r.y != rect.y) {
                 break;
             }
         }
     }
     /**/
-    rect = coords[begin - pageText]; // boundary rectangle of begin letter.
+    rect = coords.At((int)(begin - pageText)); // boundary rectangle of begin letter.
     int px = rect.x + rect.dx / 2.0;
     int py = rect.y + rect.dy / 2.0;
     dm->textSelection->StartAt(pageNo, px, py);
     /* */
-    rect = coords[end - pageText - 1]; // boundary rectangle of end letter.
+    rect = coords.At((int)(end - pageText - 1)); // boundary rectangle of end letter.
     px = rect.x + rect.dx;
     py = rect.y + rect.dy / 2.0;
     dm->textSelection->SelectUpTo(pageNo, px, py, !result.IsEmpty());
@@ -884,268 +840,6 @@ void CloseEvent(MainWindow* win) {
     }
 }
 
-// =============================================================
-std::string escape_json(const char c) {
-    std::string output = "";
-    switch (c) {
-        case '"':
-            output = "\\\"";
-            break;
-        case '\\':
-            output = "\\\\";
-            break;
-        case '\b':
-            output = "\\b";
-            break;
-        case '\f':
-            output = "\\f";
-            break;
-        case '\n':
-            output = "\\n";
-            break;
-        case '\r':
-            output = "\\r";
-            break;
-        case '\t':
-            output = "\\t";
-            break;
-        // Add other special characters as needed
-        default:
-            output = c;
-            break;
-    }
-    return output;
-}
-// =============================================================
-std::string base64_encode(const BYTE* data, size_t len) {
-    const std::string base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-    std::string result;
-    int i = 0;
-    int j = 0;
-    BYTE char_array_3[3];
-    BYTE char_array_4[4];
-
-    while (len--) {
-        char_array_3[i++] = *(data++);
-        if (i == 3) {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-
-            for (i = 0; (i < 4); i++) {
-                result += base64_chars[char_array_4[i]];
-            }
-            i = 0;
-        }
-    }
-
-    if (i) {
-        for (j = i; j < 3; j++) {
-            char_array_3[j] = '\0';
-        }
-
-        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-
-        for (j = 0; (j < i + 1); j++) {
-            result += base64_chars[char_array_4[j]];
-        }
-
-        while ((i++ < 3)) {
-            result += '=';
-        }
-    }
-
-    return result;
-}
-// =============================================================
-//
-// =============================================================
-void SaveBlocksToFile(MainWindow* win, const char* fname) {
-    DisplayModel* dm = win->AsFixed();
-    WCHAR* tmpFileW = ToWStrTemp(fname);
-    FILE* outFile = nullptr;
-    errno_t err = _wfopen_s(&outFile, tmpFileW, L"wb");
-    if (err != 0) {
-        return;
-    }
-    size_t n = 0;
-    std::fputs("[\n", outFile);
-    TmpAllocator alloc;
-    std::vector<std::pair<Vec<PageText*>, Vec<IPageElement*> > > blocks;
-    getBlocks(win, blocks);
-    size_t pageNo = 0;
-    for (auto page : blocks) {
-        pageNo++;
-        for (IPageElement* pageEl : page.second) { // images) {
-            Rect rect = pageEl->rect.Round();
-            RenderedBitmap* bmp = dm->GetEngine()->GetImageForPageElement(pageEl);
-            auto hbmp = bmp->GetBitmap();
-            if (!hbmp) {
-                continue;
-            }
-            auto imgData = SerializeBitmap(hbmp);
-            size_t len = imgData.size();
-            u8* data = imgData.data();
-            auto base64 = base64_encode(data, len);
-            if (0 < n) {
-                std::fputs(",\n", outFile);
-            }
-            std::fprintf(outFile, "{\"page\" : %d,\n", pageNo);
-            std::fprintf(outFile, "\"rect\" : [%d,%d,%d,%d],\n", rect.x, rect.y, rect.dx, rect.dy);
-            std::fputs("\"image\" : \"", outFile);
-            std::fputs(base64.c_str(), outFile);
-            std::fputs("\"}", outFile);
-            str::Free(data);
-            n++;
-        }
-    }
-    pageNo = 0;
-    for (auto page : blocks) {
-        pageNo++;
-        for (PageText* b : page.first) {
-            if (b->len == 0) {
-                continue;
-            }
-            int x1 = b->coords[0].x;
-            int y1 = b->coords[0].y;
-            int x2 = x1 + b->coords[0].dx;
-            int y2 = y1 + b->coords[0].dy;
-            for (int i = 0; i < b->len; i++) {
-                Rect r = b->coords[i];
-                if (!r.IsEmpty()) {
-                    x1 = r.x;
-                    y1 = r.y;
-                    x2 = x1 + r.dx;
-                    y2 = y1 + r.dy;
-                }
-            }
-            for (int i=0; i < b->len; i++) {
-                auto r = b->coords[i];
-                if (r.IsEmpty()) { continue; }
-                if (r.x < x1) x1 = r.x;
-                if (r.y < y1) y1 = r.y;
-                if (x2 < r.x + r.dx) x2 = r.x + r.dx;
-                if (y2 < r.y + r.dy) y2 = r.y + r.dy;
-            }
-            if (str::IsEmpty(b->text)) {
-                continue;
-            }
-            char* w = strconv::WStrToUtf8(b->text, b->len, &alloc);
-            if (0 < n) {
-                std::fputs(",\n", outFile);
-            }
-            std::fprintf(outFile, "{\"page\" : %d,\n", pageNo);
-            std::fprintf(outFile, "\"rect\" : [%d,%d,%d,%d],\n", x1, y1, x2 - x1, y2 - y1);
-            std::fputs("\"en\" : \"", outFile);
-            for (auto c = w; *c; c++) {
-                std::fputs(escape_json(*c).c_str(), outFile);
-            }
-            std::fputs("\"}", outFile);
-            delete b;
-            n++;
-        }
-    }
-    std::fputs("\n]\n", outFile);
-    std::fclose(outFile);
-}
-
-// =============================================================
-//
-// =============================================================
-void SaveWordsToFile(MainWindow* win, const char* fname) {
-    StrVec word_vec;
-    DisplayModel* dm = win->AsFixed();
-    int pageCount = dm->PageCount();
-    TmpAllocator alloc;
-    for (int pageNo = 1; pageNo <= pageCount; pageNo++) {
-        Rect* coords;
-        const WCHAR* pageText = dm->textCache->GetTextForPage(pageNo, nullptr, &coords);
-        if (str::IsEmpty(pageText)) {
-            continue;
-        }
-        for (const WCHAR* src = pageText; *src;) {
-            if (*src == '\n') {
-                src++;
-                continue;
-            }
-            if (!isWordChar(*src)) {
-                src++;
-                continue;
-            }
-            // forword search the end letter of 'word'.
-            const WCHAR* begin = src;
-            Rect rect = coords[begin - pageText];
-            const WCHAR* end = src;
-            for (; *end; ++end) {
-                if (!isWordChar(*end)) {
-                    break;
-                }
-                if (gGlobalPrefs->printableCharAsWordChar) {
-                    Rect r = coords[end - pageText];
-                    if (r.x != rect.x && r.y != rect.y) {
-                        break;
-                    }
-                }
-            }
-            char* w = strconv::WStrToUtf8(begin, end - begin, &alloc);
-            //char* w = ToUtf8(begin, end - begin);
-            word_vec.Append(w);
-            //str::Free(w);
-            src = end;
-        }
-    }
-    Sort(word_vec);
-    //
-    StrVec words;
-    char* prev = nullptr;
-    for (auto sel : word_vec) {
-        if (prev == nullptr || !str::Eq(prev, sel)) {
-            words.Append(sel);
-            prev = sel;
-        }
-    }
-    //
-    FILE* outFile = nullptr;
-    WCHAR* tmpFileW = ToWStrTemp(fname);
-    errno_t err = _wfopen_s(&outFile, tmpFileW, L"wb");
-    if (err == 0) {
-        for (auto sel : words) {
-            std::fputs(sel, outFile);
-            std::fputs("\n", outFile);
-        }
-        std::fclose(outFile);
-    }
-}
-
-// =============================================================
-//
-// =============================================================
-void SaveTextToFile(MainWindow* win, const char* fname) {
-    DisplayModel* dm = win->AsFixed();
-    int pageCount = dm->PageCount();
-    str::WStr result;
-    for (int pageNo = 1; pageNo <= pageCount; pageNo++) {
-        const WCHAR* pageText = dm->textCache->GetTextForPage(pageNo);
-        if (str::IsEmpty(pageText)) {
-            continue;
-        }
-        result.Append(pageText, str::Len(pageText));
-    }
-    char* text = ToUtf8(result.Get());
-    FILE* outFile = nullptr;
-    WCHAR* tmpFileW = ToWStrTemp(fname);
-    errno_t err = _wfopen_s(&outFile, tmpFileW, L"wb");
-    if (err == 0) {
-        std::fwrite(text, 1, std::strlen(text), outFile);
-        std::fclose(outFile);
-    }
-    str::Free(text);
-}
-
 // =============================================================
 //
 // =============================================================
@@ -1153,6 +847,7 @@ const char* base_MarkWords(MainWindow* win, const char* save_as=nullptr) {
     WindowTab* tab = win->CurrentTab();
     DisplayModel* dm = tab->AsFixed();
     auto engine = dm->GetEngine();
+    auto timeStart = TimeGet();
     // ---------------------------------------------
     std::vector<WordBlock*> word_blocks;
     const char* sep = "\r\n";
@@ -1171,17 +866,16 @@ const char* base_MarkWords(MainWindow* win, const char* save_as=nullptr) {
         annot_key_content.AppendChar('@');
         // -- ClearSearchResult ------------
         DeleteOldSelectionInfo(win, true);
-        RepaintAsync(win, 0);
         // - Select all words in PDF file -----------------------
         dm->textSearch->SetDirection(TextSearchDirection::Forward);
         bool conti = false;
-        auto wp = static_cast<std::map<std::wstring, std::vector<int> >*>(marker_node->userArea());
+        auto wp = static_cast<WordPages*>(marker_node->userArea());
         if (wp != nullptr) {
             have_page_numbers = true;
             for (auto word : marker_node->words) {
                 const WCHAR* wsep = strconv::Utf8ToWStr(word);
                 auto pages = word_block->add(wsep);
-                auto word_pages = (*wp)[std::wstring(wsep)];
+                auto& word_pages = (*wp)[word];
                 for (auto pg = word_pages.begin(); pg != word_pages.end(); ++pg) {
                     TextSel* sel = dm->textSearch->FindFirst((*pg), wsep, nullptr, conti);
                     if (!sel) {
@@ -1200,7 +894,6 @@ const char* base_MarkWords(MainWindow* win, const char* save_as=nullptr) {
                             marker_node->mark_words.Append(word);
                         }
                         dm->textSelection->CopySelection(dm->textSearch, conti);
-                        UpdateTextSelection(win, false);
                         conti = true;
                         sel = dm->textSearch->FindNext(nullptr, conti, true /* only in page */);
                     } while (sel);
@@ -1232,13 +925,17 @@ loop_break:
                         marker_node->mark_words.Append(word);
                     }
                     dm->textSelection->CopySelection(dm->textSearch, conti);
-                    UpdateTextSelection(win, false);
                     conti = true;
                     sel = dm->textSearch->FindNext(nullptr, conti);
                 } while (sel);
                 str::Free(wsep);
             }
         }
+        // selectionOnPage is rebuilt from the whole text selection, so do it
+        // once after all words were found instead of after every match.
+        if (conti) {
+            UpdateTextSelection(win, false);
+        }
         // -- Create 'Annotation' for each page. -------------
         Vec<SelectionOnPage>* selections = tab->selectionOnPage;
         if (selections != nullptr) {
@@ -1260,10 +957,12 @@ loop_break:
                 }
             }
             Vec<RectF> rects;   // rectangle for selected words.
+            Vec<HighlightToCreate> highlights;  // one highlight per page.
             marker_node->rects.Reset();
             for (auto pageno : pageNos) {
-                // -- create annotation ----------------------------
-                rects.Reset();
+                HighlightToCreate h;
+                h.pageNo = pageno;
+                h.firstRect = rects.Size();
                 for (auto& sel : *selections) {
                     if (pageno != sel.pageNo) {
                         continue;
@@ -1271,12 +970,14 @@ loop_break:
                     rects.Append(sel.rect);
                     marker_node->rects.Append(sel.rect.Round());
                 }
-                Annotation* annot = EngineMupdfCreateAnnotation(engine, AnnotationType::Highlight, pageno, PointF{});
-                SetQuadPointsAsRect(annot, rects);
-                SetColor(annot, marker_node->mark_color); // Acua
-                SetContents(annot, annot_key_content.Get());
-                marker_node->annotations.Append(annot);
+                h.nRects = rects.Size() - h.firstRect;
+                highlights.Append(h);
             }
+            // -- create annotations of all pages at once ------
+            EngineMupdfCreateHighlights(engine, highlights, rects, marker_node->mark_color, // Acua
+                                        annot_key_content.Get(), marker_node->annotations);
+            // rects were re-created, possibly with the same count
+            marker_node->invalidateIndex();
             tab->askedToSaveAnnotations = true;
             DeleteOldSelectionInfo(win, true);
         }
@@ -1343,6 +1044,8 @@ loop_break:
     for (auto wb : word_blocks) { delete wb; }
     // ---------------------------------------------
     dm->textSearch->wordSearch = false;
+    RepaintAsync(win, 0);
+    logf("MarkWords: %d markers in %.2f ms\n", tab->markers->markerTable.Size(), TimeSinceInMs(timeStart));
     // SetSelectedWordToFindEdit(win, markedWords);
     return first_word;
 }
@@ -1392,8 +1095,9 @@ const char* MarkWords(MainWindow* win, StrVec& words) {
 //
 // =============================================================
 char* GetTextInRegion(const DisplayModel* dm, int pageNo, const Rect regionI, const char* lineSep) {
-    Rect* coords;
-    const WCHAR* pageText = dm->textCache->GetTextForPage(pageNo, nullptr, &coords);
+    const PageGlyphs* glyphs;
+    const PageGlyphIndex* index = dm->textCache->GetGlyphIndex(pageNo, &glyphs);
+    const WCHAR* pageText = dm->textCache->GetTextForPage(pageNo);
     if (str::IsEmpty(pageText)) {
         return nullptr;
     }
@@ -1401,24 +1105,36 @@ char* GetTextInRegion(const DisplayModel* dm, int pageNo, const Rect regionI, co
     int wsep_len = str::Len(wsep);
     str::WStr result;
     const WCHAR* begin = nullptr;
+    Vec<int> candidates;
+    GlyphIndexQueryRect(index, regionI, candidates);
+    int nextCandidate = 0;
     for (const WCHAR* src = pageText; *src; ) {
         if (begin == nullptr) {
+            // letters outside of the region don't matter until a word has been started
+            int i = (int)(src - pageText);
+            while (nextCandidate < candidates.Size() && candidates[nextCandidate] < i) {
+                nextCandidate++;
+            }
+            if (nextCandidate == candidates.Size()) {
+                break;
+            }
+            src = pageText + candidates[nextCandidate];
             begin = src;
         }
-        Rect rect = coords[src - pageText]; // boundary rectangle of this 'letter'.
+        Rect rect = glyphs->At((int)(src - pageText)); // boundary rectangle of this 'letter'.
         Rect isect = regionI.Intersect(rect);
         if (isect.IsEmpty() || 1.0 * isect.dx * isect.dy / (rect.dx * rect.dy) < 0.3) {
             if (begin < src) {
                 result.Append(begin, src - begin); // append 'word' to result.
                 result.Append(wsep, wsep_len);
-                Rect r = coords[begin - pageText]; // boundary rectangle of this 'letter'.
+                Rect r = glyphs->At((int)(begin - pageText)); // boundary rectangle of this 'letter'.
                 int px = r.x + r.dx / 2.0;
                 int py = r.y + r.dy / 2.0;
                 dm->textSelection->StartAt(pageNo, px, py);
-                r = coords[src - pageText - 1];
+                r = glyphs->At((int)(src - pageText - 1));
                 if (r.IsEmpty()) {
                     // Rect is empty when *src is 'return' code.
-                    r = coords[src - pageText - 2];
+                    r = glyphs->At((int)(src - pageText - 2));
                 }
                 px = r.x + r.dx;
                 py = r.y + r.dy / 2.0;
@@ -1433,14 +1149,14 @@ char* GetTextInRegion(const DisplayModel* dm, int pageNo, const Rect regionI, co
             } else if (begin != nullptr) {
                 result.Append(begin, src - begin); // append 'word' to result.
                 result.Append(wsep, wsep_len);
-                Rect r = coords[begin - pageText]; // boundary rectangle of this 'letter'.
+                Rect r = glyphs->At((int)(begin - pageText)); // boundary rectangle of this 'letter'.
                 int px = r.x + r.dx / 2.0;
                 int py = r.y + r.dy / 2.0;
                 dm->textSelection->StartAt(pageNo, px, py);
-                r = coords[src - pageText - 1];
+                r = glyphs->At((int)(src - pageText - 1));
                 if (r.IsEmpty()) {
                     // Rect is empty when *src is 'return' code.
-                    r = coords[src - pageText - 2];
+                    r = glyphs->At((int)(src - pageText - 2));
                 }
                 px = r.x + r.dx;
                 py = r.y + r.dy / 2.0;
@@ -1457,24 +1173,31 @@ char* GetTextInRegion(const DisplayModel* dm, int pageNo, const Rect regionI, co
 //
 // =============================================================
 char* GetWordsInRegion(const DisplayModel* dm, int pageNo, const Rect regionI, const char* lineSep, Markers* markers) {
-    Rect* coords;
-    const WCHAR* pageText = dm->textCache->GetTextForPage(pageNo, nullptr, &coords);
+    const PageGlyphs* glyphs;
+    const PageGlyphIndex* index = dm->textCache->GetGlyphIndex(pageNo, &glyphs);
+    const WCHAR* pageText = dm->textCache->GetTextForPage(pageNo);
     if (str::IsEmpty(pageText)) {
         return nullptr;
     }
     const WCHAR* wsep = strconv::Utf8ToWStr(lineSep);
     str::WStr result;
-    for (const WCHAR* src = pageText; *src; ) {
-        if (*src == '\n') { ++src; continue; }
-        if (!isWordChar(*src)) { ++src; continue; }
+    Vec<int> candidates;
+    GlyphIndexQueryRect(index, regionI, candidates);
+    const WCHAR* src = pageText;
+    for (int i : candidates) {
+        if (pageText + i < src) {
+            continue;       // part of an already selected word.
+        }
+        src = pageText + i;
+        if (*src == '\n') { continue; }
+        if (!isWordChar(*src)) { continue; }
         /* check whether this 'letter' is intersect with the regionI */
-        Rect rect = coords[src - pageText]; // boundary rectangle of this 'letter'.
+        Rect rect = glyphs->At(i); // boundary rectangle of this 'letter'.
         Rect isect = regionI.Intersect(rect);
         if (isect.IsEmpty() || 1.0 * isect.dx * isect.dy / (rect.dx * rect.dy) < 0.3) {
-            ++src;
             continue;       // not intersected.
         }
-        src = SelectWordAt(dm, pageNo, pageText, coords, src, wsep, result, markers, true);
+        src = SelectWordAt(dm, pageNo, pageText, glyphs, src, wsep, result, markers, true);
     }
     str::Free(wsep);
     WCHAR* ws = result.Get();
@@ -1485,8 +1208,9 @@ char* GetWordsInRegion(const DisplayModel* dm, int pageNo, const Rect regionI, c
 //
 // =============================================================
 char* GetWordsInCircle(const DisplayModel* dm, int pageNo, const Rect regionI, const char* lineSep, Markers* markers) {
-    Rect* coords;
-    const WCHAR* pageText = dm->textCache->GetTextForPage(pageNo, nullptr, &coords);
+    const PageGlyphs* glyphs;
+    const PageGlyphIndex* index = dm->textCache->GetGlyphIndex(pageNo, &glyphs);
+    const WCHAR* pageText = dm->textCache->GetTextForPage(pageNo);
     if (str::IsEmpty(pageText)) {
         return nullptr;
     }
@@ -1496,31 +1220,38 @@ char* GetWordsInCircle(const DisplayModel* dm, int pageNo, const Rect regionI, c
     float sqrr = pow(radius, 2);
     int cx = regionI.x + regionI.dx / 2;
     int cy = regionI.y + regionI.dy / 2;
-    for (const WCHAR* src = pageText; *src; ) {
-        if (*src == '\n') { ++src; continue; }
-        if (!isWordChar(*src)) { ++src; continue; }
+    /* only letters within radius of the region can pass the checks below */
+    Vec<int> candidates;
+    Rect query(regionI.x - radius, regionI.y - radius, regionI.dx + 2 * radius, regionI.dy + 2 * radius);
+    GlyphIndexQueryRect(index, query, candidates);
+    const WCHAR* src = pageText;
+    for (int i : candidates) {
+        if (pageText + i < src) {
+            continue;       // part of an already selected word.
+        }
+        src = pageText + i;
+        if (*src == '\n') { continue; }
+        if (!isWordChar(*src)) { continue; }
         /* check whether this 'letter' is intersect with the circle */
-        Rect rect = coords[src - pageText]; // boundary rectangle of this 'letter'.
+        Rect rect = glyphs->At(i); // boundary rectangle of this 'letter'.
         Rect rc;
         if (0 < rect.dx) rc = Rect(rect.x - radius, rect.y, rect.dx + 2 * radius, rect.dy);
         else             rc = Rect(rect.x + radius, rect.y, rect.dx - 2 * radius, rect.dy);
         Rect isect = regionI.Intersect(rc);
         if (isect.IsEmpty() || 1.0 * isect.dx * isect.dy / (rect.dx * rect.dy) < 0.3) {
-            ++src;
             continue;
         }
         if (0 < rect.dy) rc = Rect(rect.x, rect.y - radius, rect.dx, rect.dy + 2 * radius);
         else             rc = Rect(rect.x, rect.y + radius, rect.dx, rect.dy - 2 * radius);
         isect = regionI.Intersect(rc);
         if (isect.IsEmpty() || 1.0 * isect.dx * isect.dy / (rect.dx * rect.dy) < 0.3) {
-            ++src;
             continue;
         }
-        if (sqrr <= pow(rect.x           - cx, 2) + pow(rect.y           - cy, 2)) {++src; continue;}
-        if (sqrr <= pow(rect.x + rect.dx - cx, 2) + pow(rect.y           - cy, 2)) {++src; continue;}
-        if (sqrr <= pow(rect.x           - cx, 2) + pow(rect.y + rect.dy - cy, 2)) {++src; continue;}
-        if (sqrr <= pow(rect.x + rect.dx - cx, 2) + pow(rect.y + rect.dy - cy, 2)) {++src; continue;}
-        src = SelectWordAt(dm, pageNo, pageText, coords, src, wsep, result, markers, true);
+        if (sqrr <= pow(rect.x           - cx, 2) + pow(rect.y           - cy, 2)) {continue;}
+        if (sqrr <= pow(rect.x + rect.dx - cx, 2) + pow(rect.y           - cy, 2)) {continue;}
+        if (sqrr <= pow(rect.x           - cx, 2) + pow(rect.y + rect.dy - cy, 2)) {continue;}
+        if (sqrr <= pow(rect.x + rect.dx - cx, 2) + pow(rect.y + rect.dy - cy, 2)) {continue;}
+        src = SelectWordAt(dm, pageNo, pageText, glyphs, src, wsep, result, markers, true);
     }
     str::Free(wsep);
     WCHAR* ws = result.Get();
@@ -1588,14 +1319,16 @@ void sendSelectText(MainWindow* win, bool conti) {
         Rect regionI = sel.rect.Round();
         if (0 < dm->textSelection->result.len) {
             pageNo = dm->textSelection->startPage;
-            Rect* coords;
-            dm->textCache->GetTextForPage(pageNo, nullptr, &coords);
-            int x1 = coords[dm->textSelection->startGlyph].x;
-            int y1 = coords[dm->textSelection->startGlyph].y;
-            int x2 = x1 + coords[dm->textSelection->startGlyph].dx;
-            int y2 = y1 + coords[dm->textSelection->startGlyph].dy;
+            const PageGlyphs* glyphs;
+            dm->textCache->GetGlyphsForPage(pageNo, nullptr, &glyphs);
+            GlyphCursor coords(glyphs);
+            Rect start = coords.At(dm->textSelection->startGlyph);
+            int x1 = start.x;
+            int y1 = start.y;
+            int x2 = x1 + start.dx;
+            int y2 = y1 + start.dy;
             for (auto i = dm->textSelection->startGlyph; i <= dm->textSelection->endGlyph; i++) {
-                auto r = coords[i];
+                auto r = coords.At(i);
                 if (r.IsEmpty()) { continue; }
                 if (r.x < x1) x1 = r.x;
                 if (r.y < y1) y1 = r.y;
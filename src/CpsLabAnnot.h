@@ -8,10 +8,12 @@ struct DisplayModel;
 struct TextSelection;
 struct TextSel;
 struct Rect;
+struct PageGlyphs;
 
 namespace cpslab {
 
 class Markers;
+struct MarkerIndex;
 enum class CpsMode;
 
 extern CpsMode MODE;
@@ -22,10 +24,7 @@ extern WCHAR* PDFSYNC_DDE_SERVICE;
 extern WCHAR* PDFSYNC_DDE_TOPIC;
 extern const char* EXPORT_TEXT_BLOCKS;
 
-extern void SaveWordsToFile(MainWindow* win, const char* fname);
-extern void SaveTextToFile(MainWindow* win, const char* fname);
-extern void SaveBlocksToFile(MainWindow* win, const char* fname);
-extern bool IsWord(const WCHAR* pageText, const Rect* coords, const WCHAR* begin, const WCHAR* end);
+extern bool IsWord(const WCHAR* pageText, const PageGlyphs* glyphs, const WCHAR* begin, const WCHAR* end);
 extern const char* MarkWords(MainWindow* win);
 extern const char* MarkWords(MainWindow* win, const char* json_file);
 extern const char* MarkWords(MainWindow* win, StrVec& words);
@@ -62,6 +61,7 @@ class MarkerNode
     WindowTab*  tab_;
     AutoFreeStr filePath_;
     void* user_area_;
+    MarkerIndex* index_;        // lookup tables over words, mark_words/pages and rects.
 
   public:
     AutoFreeStr keyword;        // [Cell|Net|Pin| etc..]
@@ -87,6 +87,12 @@ class MarkerNode
     size_t getMarkWordsByPageNo(const int pageNo, StrVec& result);
     int getPage(const char* word, const int pageNo=-1);
     bool tExist(const int pageNo, const char* word);
+    bool hasWord(const char* word);
+    bool hasRect(const Rect& r);
+    void invalidateIndex();
+
+  private:
+    MarkerIndex* getIndex();
 
   public:
     void* userArea();
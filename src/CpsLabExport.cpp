@@ -0,0 +1,166 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+#include "utils/BaseUtil.h"
+#include "utils/ScopedWin.h"
+#include "utils/FileUtil.h"
+#include "utils/ThreadUtil.h"
+#include "utils/UITask.h"
+#include "utils/WinUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "Settings.h"
+#include "DocController.h"
+#include "EngineBase.h"
+#include "GlobalPrefs.h"
+#include "DisplayModel.h"
+#include "MainWindow.h"
+
+#include "CpsLabAnnot.h"
+#include "CpsLabExportJob.h"
+#include "CpsLabExport.h"
+
+#include "utils/Log.h"
+
+namespace cpslab {
+
+static void NotifyExportDone(const char* path, ExportState state) {
+    if (USERAPP_DDE_SERVICE == nullptr || USERAPP_DDE_TOPIC == nullptr) {
+        return;
+    }
+    str::Str cmd;
+    cmd.AppendFmt("[ExportDone(\"%s\", \"%s\")]", path, ExportStateName(state));
+    DDEExecute(USERAPP_DDE_SERVICE, USERAPP_DDE_TOPIC, ToWStrTemp(cmd.Get()));
+}
+
+// the last export to each path, so that its status can be queried
+static Vec<ExportJob*> gExportJobs;
+static Mutex gExportJobsMutex;
+
+static int FindExportJobIdx(const char* path) {
+    for (int i = 0; i < gExportJobs.Size(); i++) {
+        if (path::IsSame(GetExportJobPath(gExportJobs[i]), path)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool StartExport(EngineBase* engine, ExportKind kind, const char* path) {
+    if (!engine || str::IsEmpty(path)) {
+        return false;
+    }
+    gExportJobsMutex.Lock();
+    int idx = FindExportJobIdx(path);
+    if (idx >= 0) {
+        ExportJob* prev = gExportJobs[idx];
+        if (GetExportJobState(prev) == ExportState::Running) {
+            gExportJobsMutex.Unlock();
+            logf("StartExport: '%s' is already being exported\n", path);
+            return false;
+        }
+        gExportJobs.RemoveAt(idx);
+        ReleaseExportJob(prev);
+    }
+
+    ExportJobArgs args;
+    args.engine = engine;
+    args.kind = kind;
+    args.path = path;
+    args.printableCharAsWordChar = gGlobalPrefs->printableCharAsWordChar;
+    args.onFinished = [](const char* path, ExportState state) {
+        char* pathCopy = str::Dup(path);
+        uitask::Post(TaskExportDone, [pathCopy, state] {
+            NotifyExportDone(pathCopy, state);
+            str::Free(pathCopy);
+        });
+    };
+    ExportJob* job = StartExportJob(args);
+    if (job) {
+        gExportJobs.Append(job);
+    }
+    gExportJobsMutex.Unlock();
+    return job != nullptr;
+}
+
+bool CancelExport(const char* path) {
+    bool ok = false;
+    gExportJobsMutex.Lock();
+    int idx = FindExportJobIdx(path);
+    if (idx >= 0) {
+        ExportJob* job = gExportJobs[idx];
+        ok = GetExportJobState(job) == ExportState::Running;
+        CancelExportJob(job);
+    }
+    gExportJobsMutex.Unlock();
+    return ok;
+}
+
+bool GetExportStatus(const char* path, str::Str& status) {
+    bool ok = false;
+    gExportJobsMutex.Lock();
+    int idx = FindExportJobIdx(path);
+    if (idx >= 0) {
+        int pagesDone = 0;
+        int nPages = 0;
+        auto state = GetExportJobState(gExportJobs[idx], &pagesDone, &nPages);
+        if (state == ExportState::Running) {
+            status.AppendFmt("running %d/%d", pagesDone, nPages);
+        } else {
+            status.Append(ExportStateName(state));
+        }
+        ok = true;
+    }
+    gExportJobsMutex.Unlock();
+    return ok;
+}
+
+// called on exit. Waits a bit for the cancelled exports to clean up
+void CancelAllExports() {
+    gExportJobsMutex.Lock();
+    for (ExportJob* job : gExportJobs) {
+        CancelExportJob(job);
+    }
+    for (ExportJob* job : gExportJobs) {
+        WaitForExportJob(job, 2000);
+        ReleaseExportJob(job);
+    }
+    gExportJobs.Reset();
+    gExportJobsMutex.Unlock();
+}
+
+// =============================================================
+//
+// =============================================================
+static void ExportToFile(MainWindow* win, ExportKind kind, const char* fname) {
+    DisplayModel* dm = win->AsFixed();
+    if (!dm) {
+        return;
+    }
+    ExportJobArgs args;
+    args.engine = dm->GetEngine();
+    args.kind = kind;
+    args.path = fname;
+    args.printableCharAsWordChar = gGlobalPrefs->printableCharAsWordChar;
+    ExportJob* job = StartExportJob(args);
+    if (!job) {
+        return;
+    }
+    WaitForExportJob(job);
+    ReleaseExportJob(job);
+}
+
+void SaveBlocksToFile(MainWindow* win, const char* fname) {
+    ExportToFile(win, ExportKind::Blocks, fname);
+}
+
+void SaveWordsToFile(MainWindow* win, const char* fname) {
+    ExportToFile(win, ExportKind::Words, fname);
+}
+
+void SaveTextToFile(MainWindow* win, const char* fname) {
+    ExportToFile(win, ExportKind::Text, fname);
+}
+
+} // namespace cpslab
@@ -0,0 +1,27 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// background exports for the GetText / GetWord / GetBlock DDE commands
+// (see CpsLabExportJob.h)
+
+struct MainWindow;
+
+namespace cpslab {
+
+// starts exporting in the background. When done, the user application is notified
+// with [ExportDone("<path>", "done|cancelled|failed")] (see USERAPP_DDE_SERVICE).
+// returns false if the file can't be created or an export to path is still running
+bool StartExport(EngineBase* engine, ExportKind kind, const char* path);
+// returns false if there's no running export to path
+bool CancelExport(const char* path);
+// "running <pages done>/<pages>", "done", "cancelled" or "failed"
+// returns false if there was no export to path
+bool GetExportStatus(const char* path, str::Str& status);
+void CancelAllExports();
+
+// synchronous versions
+void SaveWordsToFile(MainWindow* win, const char* fname);
+void SaveTextToFile(MainWindow* win, const char* fname);
+void SaveBlocksToFile(MainWindow* win, const char* fname);
+
+} // namespace cpslab
@@ -0,0 +1,626 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+#include "utils/BaseUtil.h"
+#include "utils/ScopedWin.h"
+#include "utils/Dict.h"
+#include "utils/FileUtil.h"
+#include "utils/ThreadUtil.h"
+#include "utils/WinUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "DocController.h"
+#include "EngineBase.h"
+
+#include "CpsLabExportJob.h"
+
+#include "utils/Log.h"
+
+namespace cpslab {
+
+// =============================================================
+// for each byte, the character following '\\' when escaping it for json,
+// 0 if it doesn't need escaping
+struct JsonEscapeTable {
+    char esc[256]{};
+    JsonEscapeTable() {
+        esc['"'] = '"';
+        esc['\\'] = '\\';
+        esc['\b'] = 'b';
+        esc['\f'] = 'f';
+        esc['\n'] = 'n';
+        esc['\r'] = 'r';
+        esc['\t'] = 't';
+    }
+};
+
+static const JsonEscapeTable gJsonEscape;
+
+// appends runs of characters that don't need escaping at once
+static void AppendJsonEscaped(str::Str& out, const char* s, size_t len) {
+    const char* end = s + len;
+    const char* run = s;
+    char esc[2] = {'\\', 0};
+    for (; s < end; s++) {
+        char c = gJsonEscape.esc[(u8)*s];
+        if (c == 0) {
+            continue;
+        }
+        out.Append(run, s - run);
+        esc[1] = c;
+        out.Append(esc, 2);
+        run = s + 1;
+    }
+    out.Append(run, end - run);
+}
+
+// =============================================================
+// base64 characters for every 12 bit value, so that 3 input bytes
+// are encoded with 2 lookups
+struct Base64PairTable {
+    char pairs[4096][2];
+    Base64PairTable() {
+        const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 4096; i++) {
+            pairs[i][0] = chars[i >> 6];
+            pairs[i][1] = chars[i & 0x3f];
+        }
+    }
+};
+
+static const Base64PairTable gBase64;
+
+static char* EncodeBase64Group(char* dst, const u8* d) {
+    u32 v = ((u32)d[0] << 16) | ((u32)d[1] << 8) | d[2];
+    memcpy(dst, gBase64.pairs[v >> 12], 2);
+    memcpy(dst + 2, gBase64.pairs[v & 0xfff], 2);
+    return dst + 4;
+}
+
+// encodes into a fixed buffer, 12 input bytes per iteration, and appends it
+// to out in large chunks
+static void AppendBase64(str::Str& out, const u8* data, size_t len) {
+    constexpr size_t kChunkIn = 3 * 1024;
+    char buf[kChunkIn / 3 * 4];
+    while (len >= 3) {
+        size_t n = std::min(len, kChunkIn);
+        n -= n % 3;
+        const u8* d = data;
+        const u8* end = data + n;
+        char* dst = buf;
+        for (; d + 12 <= end; d += 12) {
+            dst = EncodeBase64Group(dst, d);
+            dst = EncodeBase64Group(dst, d + 3);
+            dst = EncodeBase64Group(dst, d + 6);
+            dst = EncodeBase64Group(dst, d + 9);
+        }
+        for (; d < end; d += 3) {
+            dst = EncodeBase64Group(dst, d);
+        }
+        out.Append(buf, dst - buf);
+        data += n;
+        len -= n;
+    }
+    if (len > 0) {
+        u8 last[3]{};
+        memcpy(last, data, len);
+        EncodeBase64Group(buf, last);
+        buf[3] = '=';
+        if (len == 1) {
+            buf[2] = '=';
+        }
+        out.Append(buf, 4);
+    }
+}
+
+// collects small writes in a large buffer, reused for the whole export, and
+// writes it with a single call once it's full. Big writes go straight to the file
+struct ExportOutput {
+    static constexpr size_t kBufSize = 1024 * 1024;
+
+    FILE* f = nullptr;
+    char* buf = nullptr;
+    size_t len = 0;
+
+    explicit ExportOutput(FILE* f) : f(f) {
+        buf = AllocArray<char>(kBufSize);
+    }
+    ~ExportOutput() {
+        free(buf);
+    }
+    void Write(const char* s, size_t n) {
+        if (len + n > kBufSize) {
+            Flush();
+        }
+        if (n >= kBufSize || !buf) {
+            std::fwrite(s, 1, n, f);
+            return;
+        }
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+    void Write(const char* s) {
+        Write(s, str::Len(s));
+    }
+    void Write(const str::Str& s) {
+        Write(s.Get(), s.size());
+    }
+    void Flush() {
+        if (len > 0) {
+            std::fwrite(buf, 1, len, f);
+            len = 0;
+        }
+    }
+};
+
+// =============================================================
+//
+// =============================================================
+// how many pages workers may extract ahead of the writer.
+// Pages that weren't written yet are kept in memory
+constexpr int kMaxPagesAhead = 32;
+constexpr int kMaxExportWorkers = 4;
+// encoding images takes most of the time of a blocks export, it scales further
+constexpr int kMaxBlocksExportWorkers = 8;
+
+// result of exporting a single page, created by a worker
+struct ExportPage {
+    // Text: utf8 text of the page
+    // Blocks: image entries, separated by ",\n"
+    str::Str text;
+    int nImages = 0;
+    // Blocks: text block entries, separated by ",\n"
+    str::Str blocks;
+    int nBlocks = 0;
+    // Words: words of the page not yet seen by the worker that exported it
+    StrVec words;
+};
+
+struct ExportJob {
+    // one reference for each worker, the writer and whoever started the job
+    AtomicRefCount refCount;
+
+    ExportKind kind = ExportKind::Text;
+    AutoFreeStr path;
+    // holds a reference so that the document can be closed while exporting.
+    // Pages are extracted directly instead of through DisplayModel::textCache
+    // which only lives as long as the document is open
+    EngineBase* engine = nullptr;
+    FILE* outFile = nullptr;
+    int nPages = 0;
+    bool printableCharAsWordChar = false;
+    std::function<void(const char* path, ExportState)> onFinished;
+
+    // set by the workers, freed by the writer once consumed
+    ExportPage** pages = nullptr;
+    AtomicInt nextPage; // 0-based index of the next page to be claimed by a worker
+    AtomicInt nWritten; // pages consumed by the writer
+    AtomicInt nWorkers; // workers still running
+    AtomicInt cancelRequested;
+    AtomicInt state; // ExportState
+
+    HANDLE pageDone = nullptr;    // a worker finished a page or exited
+    HANDLE pageWritten = nullptr; // the writer consumed a page
+    HANDLE finished = nullptr;    // set once state is no longer Running
+
+    ExportJob() = default;
+    ~ExportJob();
+};
+
+ExportJob::~ExportJob() {
+    if (pages) {
+        for (int i = 0; i < nPages; i++) {
+            delete pages[i];
+        }
+        free(pages);
+    }
+    if (engine) {
+        engine->Release();
+    }
+    SafeCloseHandle(&pageDone);
+    SafeCloseHandle(&pageWritten);
+    SafeCloseHandle(&finished);
+}
+
+void ReleaseExportJob(ExportJob* job) {
+    if (job->refCount.Dec()) {
+        delete job;
+    }
+}
+
+// same as isWordChar() in TextSelection.cpp, which depends on gGlobalPrefs
+static bool IsExportWordChar(WCHAR c, bool printableCharAsWordChar) {
+    if (printableCharAsWordChar) {
+        if (c == '\n') {
+            return false;
+        }
+        if (str::IsNonCharacter(c)) {
+            return false;
+        }
+        if (isspace(c)) {
+            return false;
+        }
+        return true;
+    }
+    return IsCharAlphaNumeric(c) || c == '_';
+}
+
+static bool WasExportCancelled(ExportJob* job) {
+    return job->cancelRequested.Get() != 0;
+}
+
+static ExportPage* GetExportPage(ExportJob* job, int pageIdx) {
+    return (ExportPage*)InterlockedCompareExchangePointer((void**)&job->pages[pageIdx], nullptr, nullptr);
+}
+
+static void ExportPageText(ExportJob* job, int pageNo, ExportPage* page) {
+    PageText pt = job->engine->ExtractPageText(pageNo);
+    if (!str::IsEmpty(pt.text)) {
+        // converting page by page gives the same utf8 as converting all pages at once
+        char* text = ToUtf8(pt.text);
+        page->text.Append(text);
+        str::Free(text);
+    }
+    FreePageText(&pt);
+}
+
+// words are converted into a local buffer and only copied when they're new
+static void AppendNewWord(dict::MapStrToInt* seen, StrVec& words, const WCHAR* s, int len) {
+    char buf[512];
+    int n = WideCharToMultiByte(CP_UTF8, 0, s, len, buf, (int)dimof(buf) - 1, nullptr, nullptr);
+    char* w = buf;
+    if (n > 0) {
+        buf[n] = 0;
+    } else {
+        w = strconv::WStrToUtf8(s, len);
+    }
+    if (seen->Insert(w, 0)) {
+        words.Append(w);
+    }
+    if (w != buf) {
+        str::Free(w);
+    }
+}
+
+// seen are the words the worker already exported from previous pages
+static void ExportPageWords(ExportJob* job, int pageNo, ExportPage* page, dict::MapStrToInt* seen) {
+    PageText pt = job->engine->ExtractPageText(pageNo);
+    if (str::IsEmpty(pt.text)) {
+        FreePageText(&pt);
+        return;
+    }
+    const WCHAR* pageText = pt.text;
+    const Rect* coords = pt.coords;
+    bool printableCharAsWordChar = job->printableCharAsWordChar;
+    for (const WCHAR* src = pageText; *src;) {
+        if (*src == '\n') {
+            src++;
+            continue;
+        }
+        if (!IsExportWordChar(*src, printableCharAsWordChar)) {
+            src++;
+            continue;
+        }
+        // forword search the end letter of 'word'.
+        const WCHAR* begin = src;
+        Rect rect = coords[begin - pageText];
+        const WCHAR* end = src;
+        for (; *end; ++end) {
+            if (!IsExportWordChar(*end, printableCharAsWordChar)) {
+                break;
+            }
+            if (printableCharAsWordChar) {
+                Rect r = coords[end - pageText];
+                if (r.x != rect.x && r.y != rect.y) {
+                    break;
+                }
+            }
+        }
+        AppendNewWord(seen, page->words, begin, (int)(end - begin));
+        src = end;
+    }
+    FreePageText(&pt);
+}
+
+static void ExportPageBlocks(ExportJob* job, int pageNo, ExportPage* page) {
+    Vec<PageText*> blocks;
+    Vec<IPageElement*> images;
+    job->engine->ExtractPageBlocks(pageNo, blocks, images);
+
+    for (IPageElement* pageEl : images) {
+        if (WasExportCancelled(job)) {
+            break;
+        }
+        Rect rect = pageEl->rect.Round();
+        RenderedBitmap* bmp = job->engine->GetImageForPageElement(pageEl);
+        HBITMAP hbmp = bmp ? bmp->GetBitmap() : nullptr;
+        if (!hbmp) {
+            delete bmp;
+            continue;
+        }
+        auto imgData = SerializeBitmap(hbmp);
+        delete bmp;
+
+        if (page->nImages > 0) {
+            page->text.Append(",\n");
+        }
+        page->text.AppendFmt("{\"page\" : %d,\n", pageNo);
+        page->text.AppendFmt("\"rect\" : [%d,%d,%d,%d],\n", rect.x, rect.y, rect.dx, rect.dy);
+        page->text.Append("\"image\" : \"");
+        AppendBase64(page->text, imgData.data(), imgData.size());
+        page->text.Append("\"}");
+        page->nImages++;
+        str::Free(imgData.data());
+    }
+
+    for (PageText* b : blocks) {
+        if (b->len == 0 || str::IsEmpty(b->text)) {
+            FreePageText(b);
+            delete b;
+            continue;
+        }
+        int x1 = b->coords[0].x;
+        int y1 = b->coords[0].y;
+        int x2 = x1 + b->coords[0].dx;
+        int y2 = y1 + b->coords[0].dy;
+        for (int i = 0; i < b->len; i++) {
+            Rect r = b->coords[i];
+            if (!r.IsEmpty()) {
+                x1 = r.x;
+                y1 = r.y;
+                x2 = x1 + r.dx;
+                y2 = y1 + r.dy;
+            }
+        }
+        for (int i = 0; i < b->len; i++) {
+            auto r = b->coords[i];
+            if (r.IsEmpty()) {
+                continue;
+            }
+            if (r.x < x1) x1 = r.x;
+            if (r.y < y1) y1 = r.y;
+            if (x2 < r.x + r.dx) x2 = r.x + r.dx;
+            if (y2 < r.y + r.dy) y2 = r.y + r.dy;
+        }
+        char* w = strconv::WStrToUtf8(b->text, b->len);
+        if (page->nBlocks > 0) {
+            page->blocks.Append(",\n");
+        }
+        page->blocks.AppendFmt("{\"page\" : %d,\n", pageNo);
+        page->blocks.AppendFmt("\"rect\" : [%d,%d,%d,%d],\n", x1, y1, x2 - x1, y2 - y1);
+        page->blocks.Append("\"en\" : \"");
+        AppendJsonEscaped(page->blocks, w, str::Len(w));
+        page->blocks.Append("\"}");
+        page->nBlocks++;
+        str::Free(w);
+        FreePageText(b);
+        delete b;
+    }
+}
+
+static void ExportWorker(ExportJob* job) {
+    dict::MapStrToInt* seenWords = nullptr;
+    if (job->kind == ExportKind::Words) {
+        seenWords = new dict::MapStrToInt(4 * 1024);
+    }
+    while (!WasExportCancelled(job)) {
+        // don't get too far ahead of the writer
+        while (job->nextPage.Get() >= job->nWritten.Get() + kMaxPagesAhead && !WasExportCancelled(job)) {
+            WaitForSingleObject(job->pageWritten, 100);
+        }
+        int pageIdx = job->nextPage.Inc() - 1;
+        if (pageIdx >= job->nPages || WasExportCancelled(job)) {
+            break;
+        }
+        int pageNo = pageIdx + 1;
+        auto page = new ExportPage();
+        switch (job->kind) {
+            case ExportKind::Text:
+                ExportPageText(job, pageNo, page);
+                break;
+            case ExportKind::Words:
+                ExportPageWords(job, pageNo, page, seenWords);
+                break;
+            case ExportKind::Blocks:
+                ExportPageBlocks(job, pageNo, page);
+                break;
+        }
+        InterlockedExchangePointer((void**)&job->pages[pageIdx], page);
+        SetEvent(job->pageDone);
+    }
+    delete seenWords;
+    job->nWorkers.Dec();
+    SetEvent(job->pageDone);
+    ReleaseExportJob(job);
+}
+
+const char* ExportStateName(ExportState state) {
+    switch (state) {
+        case ExportState::Running:
+            return "running";
+        case ExportState::Done:
+            return "done";
+        case ExportState::Cancelled:
+            return "cancelled";
+        default:
+            return "failed";
+    }
+}
+
+// waits for the page to be exported and takes ownership of it
+// returns nullptr if the export was cancelled
+static ExportPage* WaitForExportPage(ExportJob* job, int pageIdx) {
+    while (!WasExportCancelled(job)) {
+        ExportPage* page = GetExportPage(job, pageIdx);
+        if (page) {
+            job->pages[pageIdx] = nullptr;
+            return page;
+        }
+        WaitForSingleObject(job->pageDone, 100);
+    }
+    return nullptr;
+}
+
+static void ExportWriter(ExportJob* job) {
+    FILE* outFile = job->outFile;
+    ExportOutput out(outFile);
+    int nPages = job->nPages;
+    int n = 0;
+    // the unique words of all pages, only those get sorted
+    dict::MapStrToInt uniqueWords;
+    Vec<const char*> words;
+    Vec<ExportPage*> blockPages;
+    bool ok = true;
+
+    if (job->kind == ExportKind::Blocks) {
+        out.Write("[\n");
+    }
+    for (int pageIdx = 0; pageIdx < nPages; pageIdx++) {
+        ExportPage* page = WaitForExportPage(job, pageIdx);
+        if (!page) {
+            break;
+        }
+        switch (job->kind) {
+            case ExportKind::Text:
+                out.Write(page->text);
+                delete page;
+                break;
+            case ExportKind::Words:
+                for (char* w : page->words) {
+                    const char* interned = nullptr;
+                    if (uniqueWords.Insert(w, 0, nullptr, &interned)) {
+                        words.Append(interned);
+                    }
+                }
+                delete page;
+                break;
+            case ExportKind::Blocks:
+                // all images come before the first text block
+                if (page->nImages > 0) {
+                    if (0 < n) {
+                        out.Write(",\n");
+                    }
+                    out.Write(page->text);
+                    n += page->nImages;
+                }
+                page->text.Reset();
+                blockPages.Append(page);
+                break;
+        }
+        job->nWritten.Inc();
+        SetEvent(job->pageWritten);
+    }
+
+    bool cancelled = WasExportCancelled(job);
+    if (!cancelled) {
+        if (job->kind == ExportKind::Words) {
+            std::sort(words.begin(), words.end(), [](const char* w1, const char* w2) { return strcmp(w1, w2) < 0; });
+            for (const char* w : words) {
+                out.Write(w);
+                out.Write("\n");
+            }
+        } else if (job->kind == ExportKind::Blocks) {
+            for (ExportPage* page : blockPages) {
+                if (page->nBlocks > 0) {
+                    if (0 < n) {
+                        out.Write(",\n");
+                    }
+                    out.Write(page->blocks);
+                    n += page->nBlocks;
+                }
+            }
+            out.Write("\n]\n");
+        }
+        out.Flush();
+        ok = !std::ferror(outFile);
+    }
+    DeleteVecMembers(blockPages);
+    std::fclose(outFile);
+    job->outFile = nullptr;
+    if (cancelled || !ok) {
+        // a partial export would look like a complete one to the reader
+        file::Delete(job->path);
+    }
+
+    ExportState state = cancelled ? ExportState::Cancelled : ok ? ExportState::Done : ExportState::Failed;
+    logf("ExportWriter: '%s' %s\n", job->path.Get(), ExportStateName(state));
+    job->state.Set((int)state);
+    SetEvent(job->finished);
+
+    if (job->onFinished) {
+        job->onFinished(job->path, state);
+    }
+    ReleaseExportJob(job);
+}
+
+ExportJob* StartExportJob(const ExportJobArgs& args) {
+    EngineBase* engine = args.engine;
+    const char* path = args.path;
+    FILE* outFile = nullptr;
+    WCHAR* pathW = ToWStrTemp(path);
+    errno_t err = _wfopen_s(&outFile, pathW, L"wb");
+    if (err != 0 || !outFile) {
+        logf("StartExportJob: failed to create '%s'\n", path);
+        return nullptr;
+    }
+    // ExportOutput does the buffering
+    setvbuf(outFile, nullptr, _IONBF, 0);
+
+    auto job = new ExportJob();
+    job->kind = args.kind;
+    job->path.SetCopy(path);
+    job->engine = engine;
+    engine->AddRef();
+    job->outFile = outFile;
+    job->nPages = engine->PageCount();
+    job->printableCharAsWordChar = args.printableCharAsWordChar;
+    job->onFinished = args.onFinished;
+    job->pages = AllocArray<ExportPage*>(job->nPages);
+    job->pageDone = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    job->pageWritten = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    job->finished = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    job->state.Set((int)ExportState::Running);
+
+    int nWorkers = args.nWorkers;
+    if (nWorkers <= 0) {
+        SYSTEM_INFO si{};
+        GetSystemInfo(&si);
+        int maxWorkers = (args.kind == ExportKind::Blocks) ? kMaxBlocksExportWorkers : kMaxExportWorkers;
+        nWorkers = std::clamp((int)si.dwNumberOfProcessors - 1, 1, maxWorkers);
+    }
+    nWorkers = std::clamp(job->nPages, 1, nWorkers);
+    job->nWorkers.Set(nWorkers);
+    for (int i = 0; i < nWorkers; i++) {
+        job->refCount.Add();
+        RunAsync([job] { ExportWorker(job); }, "ExportWorkerThread");
+    }
+    job->refCount.Add();
+    RunAsync([job] { ExportWriter(job); }, "ExportWriterThread");
+    return job;
+}
+
+void CancelExportJob(ExportJob* job) {
+    job->cancelRequested.Inc();
+}
+
+ExportState WaitForExportJob(ExportJob* job, DWORD timeoutMs) {
+    WaitForSingleObject(job->finished, timeoutMs);
+    return (ExportState)job->state.Get();
+}
+
+ExportState GetExportJobState(ExportJob* job, int* pagesDoneOut, int* nPagesOut) {
+    if (pagesDoneOut) {
+        *pagesDoneOut = job->nWritten.Get();
+    }
+    if (nPagesOut) {
+        *nPagesOut = job->nPages;
+    }
+    return (ExportState)job->state.Get();
+}
+
+const char* GetExportJobPath(ExportJob* job) {
+    return job->path;
+}
+
+} // namespace cpslab
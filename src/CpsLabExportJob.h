@@ -0,0 +1,52 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// exports text, words or blocks of a document to a file.
+// Pages are extracted by a few worker threads, one page per task, and a writer
+// thread streams the results to the file in page order, so the output is the
+// same as when extracting the pages one after another.
+// Only depends on the engine layer so that it can be used without the UI
+// (see CpsLabExport.h for the UI side and CpsLabExportTool.cpp)
+
+class EngineBase;
+
+namespace cpslab {
+
+enum class ExportKind {
+    Text = 0,   // GetText: text of all pages
+    Words = 1,  // GetWord: sorted list of unique words
+    Blocks = 2, // GetBlock: json with images and text blocks
+};
+
+enum class ExportState {
+    Running = 0,
+    Done = 1,
+    Cancelled = 2,
+    Failed = 3,
+};
+
+struct ExportJob;
+
+struct ExportJobArgs {
+    EngineBase* engine = nullptr;
+    ExportKind kind = ExportKind::Text;
+    const char* path = nullptr;
+    // number of page workers, 0 to pick one based on the number of cores
+    int nWorkers = 0;
+    // GlobalPrefs.printableCharAsWordChar, decides what's a word for ExportKind::Words
+    bool printableCharAsWordChar = false;
+    // called on the writer thread once the job is no longer running
+    std::function<void(const char* path, ExportState)> onFinished;
+};
+
+// returns nullptr if the file can't be created. The caller owns a reference
+// to the job and must call ReleaseExportJob()
+ExportJob* StartExportJob(const ExportJobArgs&);
+void ReleaseExportJob(ExportJob*);
+void CancelExportJob(ExportJob*);
+ExportState WaitForExportJob(ExportJob*, DWORD timeoutMs = INFINITE);
+ExportState GetExportJobState(ExportJob*, int* pagesDoneOut = nullptr, int* nPagesOut = nullptr);
+const char* GetExportJobPath(ExportJob*);
+const char* ExportStateName(ExportState);
+
+} // namespace cpslab
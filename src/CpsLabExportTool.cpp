@@ -0,0 +1,288 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// cpslabexport: headless version of the GetText / GetWord / GetBlock exports.
+// Writes <name>.txt, <name>.words.txt and <name>.blocks.json for each document,
+// exporting several documents in parallel, and reports the throughput.
+
+#include "utils/BaseUtil.h"
+#include "utils/ScopedWin.h"
+#include "utils/CmdLineArgsIter.h"
+#include "utils/DirIter.h"
+#include "utils/FileUtil.h"
+#include "utils/GdiPlusUtil.h"
+#include "utils/GuessFileType.h"
+#include "utils/ThreadUtil.h"
+#include "utils/Timer.h"
+#include "utils/WinUtil.h"
+#include "mui/Mui.h"
+
+#include "wingui/UIModels.h"
+
+#include "DocController.h"
+#include "EngineBase.h"
+#include "EngineAll.h"
+
+#include "CpsLabExportJob.h"
+
+using namespace cpslab;
+
+#define Out(msg, ...) printf(msg, __VA_ARGS__)
+#define ErrOut(msg, ...) fprintf(stderr, msg "\n", __VA_ARGS__)
+
+struct ExportKindInfo {
+    ExportKind kind;
+    const char* flag;
+    const char* ext;
+};
+
+static ExportKindInfo gExportKinds[] = {
+    {ExportKind::Text, "-text", ".txt"},
+    {ExportKind::Words, "-words", ".words.txt"},
+    {ExportKind::Blocks, "-blocks", ".blocks.json"},
+};
+
+struct BatchExport {
+    StrVec files;
+    // for each file, its output path under outDir without the extension:
+    // the path relative to the directory it was found in, or the base name
+    StrVec outNames;
+    const char* outDir = nullptr;
+    bool kinds[dimof(gExportKinds)]{};
+    // page workers per document. With several documents exported at once,
+    // one per document keeps all cores busy without oversubscribing them
+    int nPageWorkers = 0;
+    bool printableCharAsWordChar = false;
+
+    AtomicInt nextFile;
+    AtomicInt nFailed;
+
+    // protects stdout and the totals
+    Mutex mutex;
+    i64 totalPages = 0;
+    i64 totalBytes = 0;
+};
+
+static TempStr ExportPathTemp(BatchExport* batch, int fileIdx, const char* ext) {
+    TempStr base;
+    if (batch->outDir) {
+        base = path::JoinTemp(batch->outDir, batch->outNames.At(fileIdx));
+    } else {
+        base = path::GetPathNoExtTemp(batch->files.At(fileIdx));
+    }
+    return str::JoinTemp(base, ext);
+}
+
+static void ExportFile(BatchExport* batch, int fileIdx) {
+    const char* filePath = batch->files.At(fileIdx);
+    auto timeStart = TimeGet();
+    EngineBase* engine = CreateEngineFromFile(filePath, nullptr, false);
+    if (!engine) {
+        batch->mutex.Lock();
+        ErrOut("Error: Couldn't create an engine for %s!", filePath);
+        batch->mutex.Unlock();
+        batch->nFailed.Inc();
+        return;
+    }
+
+    int nPages = engine->PageCount();
+    i64 nBytes = 0;
+    bool ok = true;
+    for (int i = 0; i < dimof(gExportKinds); i++) {
+        if (!batch->kinds[i]) {
+            continue;
+        }
+        ExportJobArgs args;
+        args.engine = engine;
+        args.kind = gExportKinds[i].kind;
+        args.path = ExportPathTemp(batch, fileIdx, gExportKinds[i].ext);
+        if (batch->outDir && !dir::CreateForFile(args.path)) {
+            batch->mutex.Lock();
+            ErrOut("Error: Couldn't create directory for %s!", args.path);
+            batch->mutex.Unlock();
+            ok = false;
+            continue;
+        }
+        args.nWorkers = batch->nPageWorkers;
+        args.printableCharAsWordChar = batch->printableCharAsWordChar;
+        ExportJob* job = StartExportJob(args);
+        if (!job) {
+            ok = false;
+            continue;
+        }
+        ExportState state = WaitForExportJob(job);
+        ReleaseExportJob(job);
+        if (state != ExportState::Done) {
+            ok = false;
+            continue;
+        }
+        i64 size = file::GetSize(args.path);
+        nBytes += std::max(size, (i64)0);
+    }
+    engine->Release();
+    double durMs = TimeSinceInMs(timeStart);
+
+    if (!ok) {
+        batch->nFailed.Inc();
+    }
+    batch->mutex.Lock();
+    batch->totalPages += nPages;
+    batch->totalBytes += nBytes;
+    Out("%s: %d pages, %lld bytes in %.2f ms%s\n", filePath, nPages, nBytes, durMs, ok ? "" : " (failed)");
+    batch->mutex.Unlock();
+}
+
+static DWORD WINAPI ExportFilesThread(LPVOID data) {
+    BatchExport* batch = (BatchExport*)data;
+    while (true) {
+        int idx = batch->nextFile.Inc() - 1;
+        if (idx >= batch->files.Size()) {
+            break;
+        }
+        ExportFile(batch, idx);
+        ResetTempAllocator();
+    }
+    DestroyTempAllocator();
+    return 0;
+}
+
+static void CollectFiles(const char* path, BatchExport* batch) {
+    if (!dir::Exists(path)) {
+        batch->files.Append(path);
+        batch->outNames.Append(path::GetPathNoExtTemp(path::GetBaseNameTemp(path)));
+        return;
+    }
+    size_t rootLen = str::Len(path);
+    DirTraverse(path, true, [batch, rootLen](WIN32_FIND_DATAW*, const char* filePath) -> bool {
+        Kind kind = GuessFileTypeFromName(filePath);
+        if (!IsSupportedFileType(kind, true)) {
+            return true;
+        }
+        // keep the directory structure so that a/x.pdf and b/x.pdf don't
+        // end up in the same output files
+        const char* relPath = filePath + rootLen;
+        while (path::IsSep(*relPath)) {
+            relPath++;
+        }
+        batch->files.Append(filePath);
+        batch->outNames.Append(path::GetPathNoExtTemp(relPath));
+        return true;
+    });
+}
+
+// output names can still collide for files named explicitly (a/x.pdf b/x.pdf)
+// or given twice, which would make their exports overwrite each other
+static int ReportOutNameCollisions(BatchExport* batch) {
+    StrVec names;
+    for (const char* name : batch->outNames) {
+        names.Append(name);
+    }
+    SortNoCase(names);
+    int nCollisions = 0;
+    for (int i = 1; i < names.Size(); i++) {
+        if (str::EqI(names.At(i - 1), names.At(i))) {
+            ErrOut("Error: several files would be exported to %s in %s!", names.At(i), batch->outDir);
+            nCollisions++;
+        }
+    }
+    return nCollisions;
+}
+
+int main(int, char**) {
+    setlocale(LC_ALL, "C");
+    DisableDataExecution();
+
+    CmdLineArgsIter argList(GetCommandLine());
+    int nArgs = argList.nArgs;
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int nCores = std::max((int)si.dwNumberOfProcessors, 1);
+
+    BatchExport batch;
+    int nThreads = nCores;
+    bool anyKind = false;
+
+    for (int i = 1; i < nArgs; i++) {
+        const char* arg = argList.at(i);
+        bool isKind = false;
+        for (int k = 0; k < dimof(gExportKinds); k++) {
+            if (str::Eq(arg, gExportKinds[k].flag)) {
+                batch.kinds[k] = true;
+                anyKind = isKind = true;
+            }
+        }
+        if (isKind) {
+            continue;
+        }
+        if (str::Eq(arg, "-j") && i + 1 < nArgs) {
+            nThreads = atoi(argList.at(++i));
+        } else if (str::Eq(arg, "-out") && i + 1 < nArgs && !batch.outDir) {
+            batch.outDir = argList.at(++i);
+        } else if (str::Eq(arg, "-printable")) {
+            // same as GlobalPrefs.printableCharAsWordChar
+            batch.printableCharAsWordChar = true;
+        } else if (arg[0] == '-') {
+            goto Usage;
+        } else {
+            CollectFiles(arg, &batch);
+        }
+    }
+    if (batch.files.Size() == 0) {
+    Usage:
+        ErrOut("%s [-text][-words][-blocks][-printable][-j <n>][-out <dir>] <file or directory>...",
+               path::GetBaseNameTemp(argList.args[0]));
+        return 2;
+    }
+    if (!anyKind) {
+        for (bool& kind : batch.kinds) {
+            kind = true;
+        }
+    }
+    if (batch.outDir && ReportOutNameCollisions(&batch) > 0) {
+        return 1;
+    }
+    if (batch.outDir && !dir::CreateAll(batch.outDir)) {
+        ErrOut("Error: Couldn't create directory %s!", batch.outDir);
+        return 1;
+    }
+
+    // each document being exported keeps an engine and a bounded number of
+    // extracted pages in memory, so memory use grows with -j, not with the input
+    nThreads = std::clamp(nThreads, 1, std::min(batch.files.Size(), MAXIMUM_WAIT_OBJECTS));
+    batch.nPageWorkers = (nThreads > 1) ? 1 : 0;
+
+    ScopedGdiPlus gdiPlus;
+    ScopedMui miniMui;
+
+    auto timeStart = TimeGet();
+    Vec<HANDLE> threads;
+    for (int i = 0; i < nThreads; i++) {
+        HANDLE h = CreateThread(nullptr, 0, ExportFilesThread, &batch, 0, nullptr);
+        if (h) {
+            threads.Append(h);
+        }
+    }
+    if (threads.Size() == 0) {
+        ExportFilesThread(&batch);
+    } else {
+        WaitForMultipleObjects((DWORD)threads.Size(), threads.LendData(), TRUE, INFINITE);
+    }
+    for (HANDLE h : threads) {
+        CloseHandle(h);
+    }
+    double durMs = TimeSinceInMs(timeStart);
+
+    double secs = std::max(durMs / 1000.0, 0.001);
+    double mb = (double)batch.totalBytes / (1024.0 * 1024.0);
+    Out("%d files, %lld pages, %.2f MB in %.2f ms with %d threads\n", batch.files.Size(), batch.totalPages, mb, durMs,
+        nThreads);
+    Out("%.1f pages/sec, %.2f MB/s\n", (double)batch.totalPages / secs, mb / secs);
+
+    int nFailed = batch.nFailed.Get();
+    if (nFailed > 0) {
+        ErrOut("Error: %d files failed", nFailed);
+        return 1;
+    }
+    return 0;
+}
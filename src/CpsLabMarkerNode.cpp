@@ -0,0 +1,166 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// the parts of cpslab::MarkerNode that don't need a window: the marked
+// words, rects and pages and the lookups over them
+
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "utils/BaseUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "DocController.h"
+#include "EngineBase.h"
+#include "Annotation.h"
+
+#include "CpsLabAnnot.h"
+
+namespace cpslab {
+
+struct RectHash {
+    size_t operator()(const Rect& r) const {
+        u64 h = ((u64)(u32)r.x << 32 | (u32)r.y) * 0x9e3779b97f4a7c15ull;
+        h ^= ((u64)(u32)r.dx << 32 | (u32)r.dy) + (h << 6) + (h >> 2);
+        return (size_t)h;
+    }
+};
+
+// Hashed lookups over the public vectors of a MarkerNode, so that selecting
+// among tens of thousands of marked words doesn't scan all of them.
+// The vectors are appended to directly (see base_MarkWords()), so the index
+// is rebuilt when their sizes change or after invalidateIndex().
+struct MarkerIndex {
+    int nWords = -1;
+    int nMarkWords = -1;
+    int nRects = -1;
+    std::unordered_set<std::string_view> words;
+    // indexes into mark_words/pages, in the order they were added
+    std::unordered_map<std::string_view, std::vector<int> > wordOccurrences;
+    std::unordered_map<int, std::vector<int> > pageOccurrences;
+    std::unordered_set<Rect, RectHash> rects;
+};
+
+MarkerIndex* MarkerNode::getIndex() {
+    MarkerIndex* idx = index_;
+    if (idx == nullptr) {
+        idx = index_ = new MarkerIndex();
+    }
+    if (idx->nWords != words.Size()) {
+        idx->words.clear();
+        idx->words.reserve(words.Size());
+        for (char* w : words) {
+            idx->words.insert(w);
+        }
+        idx->nWords = words.Size();
+    }
+    if (idx->nMarkWords != mark_words.Size()) {
+        idx->wordOccurrences.clear();
+        idx->pageOccurrences.clear();
+        int n = std::min(mark_words.Size(), pages.Size());
+        for (int i = 0; i < n; i++) {
+            idx->wordOccurrences[mark_words[i]].push_back(i);
+            idx->pageOccurrences[pages[i]].push_back(i);
+        }
+        idx->nMarkWords = mark_words.Size();
+    }
+    if (idx->nRects != rects.Size()) {
+        idx->rects.clear();
+        idx->rects.reserve(rects.Size());
+        for (Rect& r : rects) {
+            idx->rects.insert(r);
+        }
+        idx->nRects = rects.Size();
+    }
+    return idx;
+}
+
+void MarkerNode::invalidateIndex() {
+    delete index_;
+    index_ = nullptr;
+}
+
+bool MarkerNode::hasWord(const char* word) {
+    return word != nullptr && getIndex()->words.count(word) > 0;
+}
+
+bool MarkerNode::hasRect(const Rect& r) {
+    return getIndex()->rects.count(r) > 0;
+}
+
+MarkerNode::MarkerNode(WindowTab* tab)
+    : tab_(tab), filePath_(), user_area_(nullptr), index_(nullptr), keyword(), mark_color(0xff00ffff), select_color(0xff00ffff),
+      words(), annotations(), mark_words(), rects(), pages(),
+      selected_words(), assoc_cells()
+{
+    mark_color = 0xff00ffff;
+    select_color = 0xff0000ff;
+}
+
+MarkerNode::~MarkerNode() {
+    for (auto a : annotations) {
+        DeleteAnnotation(a);
+    }
+    delete index_;
+}
+
+void* MarkerNode::userArea() {
+    return user_area_;
+}
+void MarkerNode::setUserArea(void* v) {
+    user_area_ = v;
+}
+
+size_t MarkerNode::getMarkWordsByPageNo(const int pageNo, StrVec& result) {
+    MarkerIndex* idx = getIndex();
+    auto it = idx->pageOccurrences.find(pageNo);
+    if (it != idx->pageOccurrences.end()) {
+        for (int i : it->second) {
+            result.Append(mark_words.at(i));
+        }
+    }
+    return result.Size();
+}
+
+int MarkerNode::getPage(const char* cell, const int pageNo) {
+    if (cell == nullptr) {
+        return -1;
+    }
+    MarkerIndex* idx = getIndex();
+    auto it = idx->wordOccurrences.find(cell);
+    if (it == idx->wordOccurrences.end()) {
+        return -1;
+    }
+    for (int i : it->second) {
+        int target_pageNo = pages.at(i);
+        if (0 < pageNo) {
+            if (pageNo <= target_pageNo) {
+                return target_pageNo;
+            }
+        } else {
+            return target_pageNo;
+        }
+    }
+    return -1;
+}
+
+bool MarkerNode::tExist(const int pageNo, const char* cell) {
+    if (cell == nullptr) {
+        return false;
+    }
+    MarkerIndex* idx = getIndex();
+    auto it = idx->wordOccurrences.find(cell);
+    if (it == idx->wordOccurrences.end()) {
+        return false;
+    }
+    for (int i : it->second) {
+        if (pages.at(i) == pageNo) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // end of namespace cpslab
@@ -66,8 +66,14 @@
 #include "utils/Log.h"
 
 // if true, we pre-render the pages right before and after the visible pages
+// and load the pages after those ahead of time
 static bool gPredictiveRender = true;
 
+// how many pages are loaded ahead of time at most and for how
+// much time of scrolling at the current speed
+constexpr int kMaxPrefetchPages = 8;
+constexpr float kPrefetchAheadSecs = 0.5f;
+
 static int ColumnsFromDisplayMode(DisplayMode displayMode) {
     if (!IsSingle(displayMode)) {
         return 2;
@@ -1132,6 +1138,7 @@ void DisplayModel::RenderVisibleParts() {
         if (lastVisiblePage < PageCount()) {
             cb->RequestRendering(lastVisiblePage + 1);
         }
+        PrefetchPagesAhead(firstVisiblePage, lastVisiblePage);
     }
 
     // request the visible pages last so that the above requested
@@ -1141,6 +1148,47 @@ void DisplayModel::RenderVisibleParts() {
     }
 }
 
+// requests loading the pages after the pre-rendered ones in the direction
+// the user is scrolling in, the more of them the faster they're scrolling
+void DisplayModel::PrefetchPagesAhead(int firstVisiblePage, int lastVisiblePage) {
+    // include how far the first visible page has been scrolled out of view
+    PageInfo* pageInfo = GetPageInfo(firstVisiblePage);
+    float pos = (float)firstVisiblePage;
+    if (pageInfo->pos.dy > 0 && pageInfo->pageOnScreen.y < 0) {
+        pos += std::min(-pageInfo->pageOnScreen.y / (float)pageInfo->pos.dy, 1.f);
+    }
+    double dtMs = TimeSinceInMs(prefetchScrollTime);
+    if (dtMs > 1000 || prefetchScrollPos == 0) {
+        // (re)starting to scroll
+        scrollPagesPerSec = 0;
+        prefetchScrollPos = pos;
+        prefetchScrollTime = TimeGet();
+    } else if (dtMs >= 5) {
+        float pagesPerSec = (pos - prefetchScrollPos) * 1000.f / (float)dtMs;
+        // smooth out uneven intervals between scroll events
+        scrollPagesPerSec = (scrollPagesPerSec + pagesPerSec) / 2;
+        prefetchScrollPos = pos;
+        prefetchScrollTime = TimeGet();
+    }
+
+    int columns = ColumnsFromDisplayMode(GetDisplayMode());
+    int n = columns * (1 + (int)(fabsf(scrollPagesPerSec) * kPrefetchAheadSecs));
+    n = std::min(n, kMaxPrefetchPages);
+    // pages right next to the visible ones are already being pre-rendered
+    Vec<int> pageNos;
+    if (scrollPagesPerSec < -0.1f) {
+        for (int pageNo = firstVisiblePage - columns - 1; pageNo >= 1 && (int)pageNos.Size() < n; pageNo--) {
+            pageNos.Append(pageNo);
+        }
+    } else {
+        for (int pageNo = lastVisiblePage + columns + 1; pageNo <= PageCount() && (int)pageNos.Size() < n;
+             pageNo++) {
+            pageNos.Append(pageNo);
+        }
+    }
+    cb->RequestPrefetch(pageNos);
+}
+
 void DisplayModel::SetViewPortSize(Size newViewPortSize) {
     ScrollState ss;
 
@@ -1680,8 +1728,7 @@ void DisplayModel::RotateBy(int newRotation) {
 /* Given <region> (in user coordinates ) on page <pageNo>, copies text in that region
  * into a newly allocated buffer (which the caller needs to free()). */
 char* DisplayModel::GetTextInRegion(int pageNo, RectF region) const {
-    Rect* coords;
-    const WCHAR* pageText = textCache->GetTextForPage(pageNo, nullptr, &coords);
+    const WCHAR* pageText = textCache->GetTextForPage(pageNo);
     if (str::IsEmpty(pageText)) {
         return nullptr;
     }
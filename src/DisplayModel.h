@@ -205,6 +205,7 @@ struct DisplayModel : DocController {
     Point GetContentStart(int pageNo) const;
     void RecalcVisibleParts() const;
     void RenderVisibleParts();
+    void PrefetchPagesAhead(int firstVisiblePage, int lastVisiblePage);
     void AddNavPoint();
     RectF GetContentBox(int pageNo) const;
     void CalcZoomReal(float zoomVirtual);
@@ -261,4 +262,10 @@ struct DisplayModel : DocController {
 
     /* allow resizing a window without triggering a new rendering (needed for window destruction) */
     bool dontRenderFlag = false;
+
+    /* scroll position (in pages) at the last call to PrefetchPagesAhead() and
+       the scroll speed (in pages per second) used to predict which pages to load */
+    float prefetchScrollPos = 0;
+    float scrollPagesPerSec = 0;
+    LARGE_INTEGER prefetchScrollTime{};
 };
@@ -38,6 +38,8 @@ struct DocControllerCallback {
     virtual void Repaint() = 0;
     virtual void UpdateScrollbars(Size canvas) = 0;
     virtual void RequestRendering(int pageNo) = 0;
+    // load pages ahead of rendering them (replaces previously requested pages)
+    virtual void RequestPrefetch(const Vec<int>& pageNos) = 0;
     virtual void CleanUp(DisplayModel* dm) = 0;
     virtual void RenderThumbnail(DisplayModel* dm, Size size, const onBitmapRenderedCb&) = 0;
     // ChmModel //
@@ -2,6 +2,7 @@
    License: GPLv3 */
 
 struct Annotation;
+struct HighlightToCreate;
 enum class AnnotationType;
 struct PasswordUI;
 struct FileArgs;
@@ -55,12 +56,18 @@ EngineBase* CreateEngineMupdfFromData(const ByteSlice& data, const char* nameHin
 ByteSlice LoadEmbeddedPDFFile(const char* path);
 const char* ParseEmbeddedStreamNumber(const char* path, int* streamNoOut);
 Annotation* EngineMupdfCreateAnnotation(EngineBase*, AnnotationType type, int pageNo, PointF pos);
+bool EngineMupdfCreateHighlights(EngineBase*, const Vec<HighlightToCreate>&, const Vec<RectF>& rects, PdfColor col,
+                                 const char* contents, Vec<Annotation*>& created);
 void EngineMupdfGetAnnotations(EngineBase*, Vec<Annotation*>&);
 bool EngineMupdfHasUnsavedAnnotations(EngineBase*);
 bool EngineMupdfSupportsAnnotations(EngineBase*);
 bool EngineMupdfSaveUpdated(EngineBase* engine, const char* path, std::function<void(const char*)> showErrorFunc);
 Annotation* EngineMupdfGetAnnotationAtPos(EngineBase*, int pageNo, PointF pos, Annotation*);
 ByteSlice EngineMupdfLoadAttachment(EngineBase*, int attachmentNo);
+void EnableMupdfSharedStore(size_t maxStore);
+void DestroyMupdfSharedStore();
+void SetMupdfAcceleratorDir(const char* dir);
+void SetMupdfLayoutThreadCount(int n);
 
 /* EnginePs.cpp */
 
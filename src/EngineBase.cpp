@@ -98,18 +98,45 @@ TocItem::TocItem(TocItem* parent, const char* title, int pageNo) {
     this->parent = parent;
 }
 
+// deletes the items, their children and following siblings without recursion
+// so that deep or long outlines can't overflow the stack
+static void DeleteTocItems(TocItem* first) {
+    Vec<TocItem*> toDelete;
+    if (first) {
+        toDelete.Append(first);
+    }
+    while (toDelete.Size() > 0) {
+        TocItem* ti = toDelete.Pop();
+        if (ti->child) {
+            toDelete.Append(ti->child);
+        }
+        if (ti->next) {
+            toDelete.Append(ti->next);
+        }
+        ti->child = nullptr;
+        ti->next = nullptr;
+        if (ti->inArena) {
+            // the memory is freed with TocTree::arena
+            ti->~TocItem();
+        } else {
+            delete ti;
+        }
+    }
+}
+
 TocItem::~TocItem() {
-    delete child;
+    TocItem* toDelete = child;
+    child = nullptr;
+    DeleteTocItems(toDelete);
+    toDelete = next;
+    next = nullptr;
+    DeleteTocItems(toDelete);
     if (!destNotOwned) {
         delete dest;
     }
-    while (next) {
-        TocItem* tmp = next->next;
-        next->next = nullptr;
-        delete next;
-        next = tmp;
+    if (!inArena) {
+        str::Free(title);
     }
-    str::Free(title);
     str::Free(engineFilePath);
 }
 
@@ -138,6 +165,7 @@ void TocItem::AddChild(TocItem* newChild) {
 
 // regular delete is recursive, this deletes only this item
 void TocItem::DeleteJustSelf() {
+    ReportIf(inArena);
     child = nullptr;
     next = nullptr;
     parent = nullptr;
@@ -148,6 +176,9 @@ void TocItem::DeleteJustSelf() {
 // (the result is owned by the TocItem and MUST NOT be deleted)
 // TODO: rename to GetDestination()
 IPageDestination* TocItem::GetPageDestination() const {
+    if (!dest && destResolver) {
+        dest = destResolver->ResolveTocDest((TocItem*)this);
+    }
     return dest;
 }
 
@@ -194,7 +225,7 @@ bool TocItem::IsExpanded() {
 }
 
 bool TocItem::PageNumbersMatch() const {
-    int destPageNo = PageDestGetPageNo(dest);
+    int destPageNo = PageDestGetPageNo(GetPageDestination());
     if (destPageNo <= 0) {
         return true; // TODO: should be false?
     }
@@ -205,12 +236,27 @@ bool TocItem::PageNumbersMatch() const {
     return true;
 }
 
-TocTree::TocTree(TocItem* root) {
+TocTree::TocTree() {
+    // fewer, bigger blocks for outlines with many thousands of items
+    arena.minBlockSize = 64 * 1024;
+}
+
+TocTree::TocTree(TocItem* root) : TocTree() {
     this->root = root;
 }
 
 TocTree::~TocTree() {
-    delete root;
+    DeleteTocItems(root);
+}
+
+TocItem* TocTree::NewItem(TocItem* parent, const char* title, int pageNo) {
+    void* mem = arena.Alloc(sizeof(TocItem));
+    auto res = new (mem) TocItem();
+    res->title = title ? str::Dup(&arena, title) : nullptr;
+    res->pageNo = pageNo;
+    res->parent = parent;
+    res->inArena = true;
+    return res;
 }
 
 TreeItem TocTree::Root() {
@@ -259,40 +305,37 @@ HTREEITEM TocTree::GetHandle(TreeItem ti) {
     return tocItem->hItem;
 }
 
-// TODO: speed up by removing recursion
-bool VisitTocTree(TocItem* ti, const std::function<bool(TocItem*)>& f) {
-    bool cont;
+// visits ti, its children and its following siblings in document order.
+// Stops as soon as f returns false
+bool VisitTocTreeWithParent(TocItem* ti, const std::function<bool(TocItem* ti, TocItem* parent)>& f) {
+    // siblings to continue with once the children of an item are visited
+    Vec<TocItem*> nextItems;
+    Vec<TocItem*> nextParents;
+    TocItem* parent = nullptr;
     while (ti) {
-        cont = f(ti);
-        if (cont && ti->child) {
-            cont = VisitTocTree(ti->child, f);
-        }
-        if (!cont) {
+        if (!f(ti, parent)) {
             return false;
         }
-        ti = ti->next;
-    }
-    return true;
-}
-
-static bool VisitTocTreeWithParentRecursive(TocItem* ti, TocItem* parent,
-                                            const std::function<bool(TocItem* ti, TocItem* parent)>& f) {
-    bool cont;
-    while (ti) {
-        cont = f(ti, parent);
-        if (cont && ti->child) {
-            cont = VisitTocTreeWithParentRecursive(ti->child, ti, f);
-        }
-        if (!cont) {
-            return false;
+        if (ti->child) {
+            if (ti->next) {
+                nextItems.Append(ti->next);
+                nextParents.Append(parent);
+            }
+            parent = ti;
+            ti = ti->child;
+            continue;
         }
         ti = ti->next;
+        if (!ti && nextItems.Size() > 0) {
+            ti = nextItems.Pop();
+            parent = nextParents.Pop();
+        }
     }
     return true;
 }
 
-bool VisitTocTreeWithParent(TocItem* ti, const std::function<bool(TocItem* ti, TocItem* parent)>& f) {
-    return VisitTocTreeWithParentRecursive(ti, nullptr, f);
+bool VisitTocTree(TocItem* ti, const std::function<bool(TocItem*)>& f) {
+    return VisitTocTreeWithParent(ti, [&f](TocItem* ti, TocItem*) -> bool { return f(ti); });
 }
 
 static bool setTocItemParent(TocItem* ti, TocItem* parent) {
@@ -403,6 +446,18 @@ char* EngineBase::GetDecryptionKey() const {
     return str::Dup(decryptionKey);
 }
 
+bool EngineBase::GetFingerprint(u8*) {
+    return false;
+}
+
+bool EngineBase::GetReflowLayout(float*, float*, float*) {
+    return false;
+}
+
+bool EngineBase::PreloadPage(int, float, int) {
+    return false;
+}
+
 const char* EngineBase::FilePath() const {
     return fileNameBase;
 }
@@ -280,6 +280,15 @@ extern Kind kindTocFzLink;
 extern Kind kindTocFzOutlineAttachment;
 extern Kind kindTocDjvu;
 
+struct TocItem;
+
+// creates TocItem::dest when it's first needed, so that documents with
+// huge outlines don't create a destination for every item when loading
+struct TocDestResolver {
+    virtual ~TocDestResolver() = default;
+    virtual IPageDestination* ResolveTocDest(TocItem*) = 0;
+};
+
 // an item in a document's Table of Content
 struct TocItem {
     HTREEITEM hItem = nullptr;
@@ -309,8 +318,14 @@ struct TocItem {
     int fontFlags = 0; // fontBitBold, fontBitItalic
     COLORREF color{ColorUnset};
 
-    IPageDestination* dest = nullptr;
+    // if nullptr, GetPageDestination() asks destResolver to create it from destData
+    mutable IPageDestination* dest = nullptr;
     bool destNotOwned = false;
+    TocDestResolver* destResolver = nullptr;
+    void* destData = nullptr;
+
+    // allocated with TocTree::NewItem(), freed together with the tree
+    bool inArena = false;
 
     // first child item
     TocItem* child = nullptr;
@@ -352,11 +367,15 @@ struct TocItem {
 
 struct TocTree : TreeModel {
     TocItem* root = nullptr;
+    // items and titles of NewItem()
+    PoolAllocator arena;
 
-    TocTree() = default;
+    TocTree();
     explicit TocTree(TocItem* root);
     ~TocTree() override;
 
+    TocItem* NewItem(TocItem* parent, const char* title, int pageNo);
+
     // TreeModel
     TreeItem Root() override;
 
@@ -524,10 +543,23 @@ class EngineBase {
     // caller must free() the result
     char* GetDecryptionKey() const;
 
+    // MD5 of the document's content, used as a key for on-disk caches
+    // returns false if the engine doesn't support it
+    virtual bool GetFingerprint(u8 digestOut[16]);
+
+    // page and font size reflowable documents (EPUB etc.) were laid out with.
+    // returns false for documents with a fixed layout
+    virtual bool GetReflowLayout(float* dx, float* dy, float* fontDy);
+
     // loads the given page so that the time required can be measured
     // without also measuring rendering times
     virtual bool BenchLoadPage(int pageNo) = 0;
 
+    // loads the given page and the fonts and images it needs when rendered at
+    // zoom/rotation so that RenderPage() only has to rasterize. called on a
+    // worker thread ahead of rendering. returns false if there was nothing to load
+    virtual bool PreloadPage(int pageNo, float zoom, int rotation);
+
     // the name of the file this engine handles
     const char* FilePath() const;
 
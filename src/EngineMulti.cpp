@@ -57,6 +57,7 @@ class EngineMulti : public EngineBase {
     TempStr GetPropertyTemp(const char* name) override;
 
     bool BenchLoadPage(int pageNo) override;
+    bool PreloadPage(int pageNo, float zoom, int rotation) override;
 
     Vec<IPageElement*> GetElements(int pageNo) override;
     IPageElement* GetElementAtPos(int pageNo, PointF pt) override;
@@ -150,6 +151,11 @@ bool EngineMulti::BenchLoadPage(int pageNo) {
     return e->BenchLoadPage(pageNo);
 }
 
+bool EngineMulti::PreloadPage(int pageNo, float zoom, int rotation) {
+    EngineBase* e = PageToEngine(pageNo);
+    return e->PreloadPage(pageNo, zoom, rotation);
+}
+
 Vec<IPageElement*> EngineMulti::GetElements(int pageNo) {
     EngineBase* e = PageToEngine(pageNo);
     return e->GetElements(pageNo);
@@ -274,42 +280,42 @@ static void CalcEndPageNo(TocItem* root, int nPages) {
 }
 #endif
 
+// clones ti and its following siblings. Only recurses into children so
+// that outlines with many siblings can't overflow the stack
 static TocItem* CloneTocItemRecur(TocItem* ti, bool removeUnchecked) {
-    if (ti == nullptr) {
-        return nullptr;
-    }
-    if (removeUnchecked && ti->isUnchecked) {
-        TocItem* next = ti->next;
-        while (next && next->isUnchecked) {
-            next = next->next;
+    TocItem* first = nullptr;
+    TocItem* last = nullptr;
+    for (; ti; ti = ti->next) {
+        if (removeUnchecked && ti->isUnchecked) {
+            continue;
         }
-        return CloneTocItemRecur(next, removeUnchecked);
-    }
-    TocItem* res = new TocItem();
-    res->parent = ti->parent;
-    res->title = str::Dup(ti->title);
-    res->isOpenDefault = ti->isOpenDefault;
-    res->isOpenToggled = ti->isOpenToggled;
-    res->isUnchecked = ti->isUnchecked;
-    res->pageNo = ti->pageNo;
-    res->id = ti->id;
-    res->fontFlags = ti->fontFlags;
-    res->color = ti->color;
-    res->dest = ti->dest;
-    res->destNotOwned = true;
-    res->child = CloneTocItemRecur(ti->child, removeUnchecked);
-
-    res->nPages = ti->nPages;
-    res->engineFilePath = str::Dup(ti->engineFilePath);
-
-    TocItem* next = ti->next;
-    if (removeUnchecked) {
-        while (next && next->isUnchecked) {
-            next = next->next;
+        TocItem* res = new TocItem();
+        res->parent = ti->parent;
+        res->title = str::Dup(ti->title);
+        res->isOpenDefault = ti->isOpenDefault;
+        res->isOpenToggled = ti->isOpenToggled;
+        res->isUnchecked = ti->isUnchecked;
+        res->pageNo = ti->pageNo;
+        res->id = ti->id;
+        res->fontFlags = ti->fontFlags;
+        res->color = ti->color;
+        // page numbers of the destinations are adjusted in updateTocItemsPageNo()
+        // so they have to exist
+        res->dest = ti->GetPageDestination();
+        res->destNotOwned = true;
+        res->child = CloneTocItemRecur(ti->child, removeUnchecked);
+
+        res->nPages = ti->nPages;
+        res->engineFilePath = str::Dup(ti->engineFilePath);
+
+        if (last) {
+            last->next = res;
+        } else {
+            first = res;
         }
+        last = res;
     }
-    res->next = CloneTocItemRecur(next, removeUnchecked);
-    return res;
+    return first;
 }
 
 TocItem* CreateWrapperItem(EngineBase* engine) {
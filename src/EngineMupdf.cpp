@@ -8,8 +8,13 @@ extern "C" {
 #include "../mupdf/source/pdf/pdf-annot-imp.h"
 }
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #include "utils/BaseUtil.h"
 #include "utils/Archive.h"
+#include "utils/CryptoUtil.h"
 #include "utils/ScopedWin.h"
 #include "utils/FileUtil.h"
 #include "utils/GdiPlusUtil.h"
@@ -30,6 +35,7 @@ extern "C" {
 #include "EngineBase.h"
 #include "EngineMupdf.h"
 #include "EngineAll.h"
+#include "PageLabels.h"
 #include "EbookBase.h"
 #include "EbookDoc.h"
 #include "SumatraConfig.h"
@@ -55,6 +61,7 @@ constexpr i64 kMaxMemoryFileSize = 32 * 1024 * 1024;
 
 // in mupdf_load_system_font.c
 extern "C" void drop_cached_fonts_for_ctx(fz_context*);
+extern "C" void set_shared_fonts_ctx(fz_context*);
 extern "C" void pdf_install_load_system_font_funcs(fz_context* ctx);
 
 static AnnotationType AnnotationTypeFromPdfAnnot(enum pdf_annot_type tp) {
@@ -244,11 +251,6 @@ static PageElementDestination* NewLinkDestination(int srcPageNo, fz_context* ctx
     return res;
 }
 
-struct LinkRectList {
-    StrVec links;
-    Vec<fz_rect> coords;
-};
-
 fz_rect ToFzRect(RectF rect) {
     fz_rect result = {(float)rect.x, (float)rect.y, (float)(rect.x + rect.dx), (float)(rect.y + rect.dy)};
     return result;
@@ -258,10 +260,6 @@ RectF ToRectF(fz_rect rect) {
     return RectF::FromXY(rect.x0, rect.y0, rect.x1, rect.y1);
 }
 
-static bool IsPointInRect(fz_rect rect, fz_point pt) {
-    return ToRectF(rect).Contains(PointF(pt.x, pt.y));
-}
-
 fz_matrix FzCreateViewCtm(fz_rect mediabox, float zoom, int rotation) {
     fz_matrix ctm = fz_pre_scale(fz_rotate((float)rotation), zoom, zoom);
 
@@ -461,7 +459,8 @@ static fz_stream* FzOpenFile2(fz_context* ctx, const char* path) {
     return stm;
 }
 
-static void FzStreamFingerprint(fz_context* ctx, fz_stream* stm, u8 digest[16]) {
+// returns false (and a zeroed digest) if the stream can't be read
+static bool FzStreamFingerprint(fz_context* ctx, fz_stream* stm, u8 digest[16]) {
     i64 fileLen = -1;
     fz_buffer* buf = nullptr;
 
@@ -475,7 +474,7 @@ static void FzStreamFingerprint(fz_context* ctx, fz_stream* stm, u8 digest[16])
         fz_warn(ctx, "couldn't read stream data, using a nullptr fingerprint instead");
         ZeroMemory(digest, 16);
         fz_report_error(ctx);
-        return;
+        return false;
     }
     ReportIf(nullptr == buf);
     u8* data;
@@ -487,6 +486,7 @@ static void FzStreamFingerprint(fz_context* ctx, fz_stream* stm, u8 digest[16])
     fz_md5_init(&md5);
     fz_md5_update(&md5, data, size);
     fz_md5_final(&md5, digest);
+    return true;
 }
 
 static ByteSlice FzExtractStreamData(fz_context* ctx, fz_stream* stream) {
@@ -664,10 +664,10 @@ static const WCHAR* LinkifyFindEnd(const WCHAR* start, WCHAR prevChar) {
     return end;
 }
 
-static const WCHAR* LinkifyMultilineText(LinkRectList* list, const WCHAR* pageText, const WCHAR* start,
+static const WCHAR* LinkifyMultilineText(LinkRectList& list, const WCHAR* pageText, const WCHAR* start,
                                          const WCHAR* next, Rect* coords) {
-    int lastIx = list->coords.Size() - 1;
-    char* uri = list->links.At(lastIx);
+    int lastIx = list.coords.Size() - 1;
+    char* uri = list.links.At(lastIx);
     const WCHAR* end = next;
     bool multiline = false;
 
@@ -678,15 +678,15 @@ static const WCHAR* LinkifyMultilineText(LinkRectList* list, const WCHAR* pageTe
         char* part = ToUtf8Temp(next, end - next);
         uri = str::JoinTemp(uri, part);
         Rect bbox = coords[next - pageText].Union(coords[end - pageText - 1]);
-        list->coords.Append(ToFzRect(ToRectF(bbox)));
+        list.coords.Append(ToFzRect(ToRectF(bbox)));
 
         next = end + 1;
     } while (multiline);
 
     // update the link URL for all partial links
-    list->links.SetAt(lastIx, uri);
-    for (int i = lastIx + 1; i < list->coords.Size(); i++) {
-        list->links.Append(uri);
+    list.links.SetAt(lastIx, uri);
+    for (int i = lastIx + 1; i < list.coords.Size(); i++) {
+        list.links.Append(uri);
     }
 
     return end;
@@ -732,12 +732,80 @@ static const WCHAR* LinkifyEmailAddress(const WCHAR* start) {
     return end;
 }
 
-// caller needs to delete the result
-// TODO: return Vec<IPageElement*> directly
-static LinkRectList* LinkifyText(const WCHAR* pageText, Rect* coords) {
-    LinkRectList* list = new LinkRectList;
+// every link LinkifyText() detects contains one of these within its first 7 chars:
+// the '@' of an email address, the ':' of "http(s)://" or "mailto:" or the '.' of "www."
+static bool IsLinkifyCandidate(const WCHAR* pageText, const WCHAR* s) {
+    switch (*s) {
+        case '@':
+            return true;
+        case ':':
+            return s[1] == '/' && s[2] == '/' || s - pageText >= 6 && str::StartsWith(s - 6, L"mailto:");
+        case '.':
+            return s - pageText >= 3 && s[-1] == 'w' && s[-2] == 'w' && s[-3] == 'w';
+    }
+    return false;
+}
+// how far LinkifyText() may start before a candidate ("mailto:")
+constexpr int kLinkifyMaxCandidateOffset = 6;
+
+// returns the first candidate in [s, end) or nullptr
+static const WCHAR* LinkifyFindCandidate(const WCHAR* pageText, const WCHAR* s, const WCHAR* end) {
+#if defined(_M_IX86) || defined(_M_X64)
+    // most text contains none of '@', ':' and '.', so compare 8 chars at a time
+    const __m128i at = _mm_set1_epi16('@');
+    const __m128i colon = _mm_set1_epi16(':');
+    const __m128i dot = _mm_set1_epi16('.');
+    for (; end - s >= 8; s += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)s);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi16(v, at), _mm_cmpeq_epi16(v, colon));
+        m = _mm_or_si128(m, _mm_cmpeq_epi16(v, dot));
+        // one bit per byte, so each matching char sets two bits
+        uint bits = (uint)_mm_movemask_epi8(m) & 0x5555;
+        while (bits) {
+            int i = 0;
+            while (!(bits & (1u << (i * 2)))) {
+                i++;
+            }
+            if (IsLinkifyCandidate(pageText, s + i)) {
+                return s + i;
+            }
+            bits &= ~(1u << (i * 2));
+        }
+    }
+#endif
+    for (; s < end; s++) {
+        if (IsLinkifyCandidate(pageText, s)) {
+            return s;
+        }
+    }
+    return nullptr;
+}
+
+// quick check for pages that can't contain any links
+bool LinkifyHasCandidates(const WCHAR* pageText, int len) {
+    return LinkifyFindCandidate(pageText, pageText, pageText + len) != nullptr;
+}
+
+// appends all URLs and email addresses in pageText to list.
+// only the parts of the text around candidates (see IsLinkifyCandidate) are
+// looked at more closely, unless skipToCandidates is false
+void LinkifyText(LinkRectList& list, const WCHAR* pageText, int len, Rect* coords, bool skipToCandidates) {
+    const WCHAR* textEnd = pageText + len;
+    const WCHAR* candidate = nullptr;
 
     for (const WCHAR* start = pageText; *start; start++) {
+        if (skipToCandidates) {
+            if (!candidate || candidate < start) {
+                candidate = LinkifyFindCandidate(pageText, start, textEnd);
+                if (!candidate) {
+                    break;
+                }
+            }
+            if (candidate - start > kLinkifyMaxCandidateOffset) {
+                start = candidate - kLinkifyMaxCandidateOffset;
+            }
+        }
+
         const WCHAR* end = nullptr;
         bool multiline = false;
         const WCHAR* protocol = nullptr;
@@ -777,17 +845,15 @@ static LinkRectList* LinkifyText(const WCHAR* pageText, Rect* coords) {
             char* proto = ToUtf8Temp(protocol);
             uri = str::JoinTemp(proto, part);
         }
-        list->links.Append(uri);
+        list.links.Append(uri);
         Rect bbox = coords[start - pageText].Union(coords[end - pageText - 1]);
-        list->coords.Append(ToFzRect(ToRectF(bbox)));
+        list.coords.Append(ToFzRect(ToRectF(bbox)));
         if (multiline) {
             end = LinkifyMultilineText(list, pageText, start, end + 1, coords);
         }
 
         start = end;
     }
-
-    return list;
 }
 
 // try to produce an 8-bit palette for saving some memory
@@ -967,57 +1033,89 @@ RenderedBitmap* NewRenderedFzPixmap(fz_context* ctx, fz_pixmap* pixmap) {
     return new RenderedBitmap(hbmp, Size(w, h), hMap);
 }
 
-static TocItem* NewTocItemWithDestination(TocItem* parent, char* title, IPageDestination* dest) {
-    auto res = new TocItem(parent, title, 0);
-    res->dest = dest;
-    return res;
-}
-
-// TODO: could be optimized
-static bool RectFullyContains(RectF r1, RectF r2) {
-    return r1.Contains(r2.TL()) && r1.Contains(r2.BR());
-}
+// aim for about this many elements per grid cell
+constexpr int kElementsPerGridCell = 2;
+constexpr int kMaxElementsGridSize = 128;
 
-// if an elements fully obscures another, remove it from the list
-static bool RemoveHeWhoFullyContains(Vec<IPageElement*>& els) {
-    int n = els.Size();
-    ReportIf(n < 2);
-    for (int i = 0; i < n; i++) {
-        RectF r1 = els[i]->GetRect();
-        for (int j = 0; j < n; j++) {
-            if (j == i) {
-                continue; // skip checking against self
-            }
-            auto r2 = els[j]->GetRect();
-            if (RectFullyContains(r1, r2)) {
-                // logfa("el %d fully obscures %d\n", i, j);
-                els.RemoveAtFast(i);
-                return true;
-            }
+static void ForEachGridCell(const FzRectGrid& grid, RectF r, const std::function<void(int)>& fn) {
+    float cellDx = grid.bounds.dx / grid.cols;
+    float cellDy = grid.bounds.dy / grid.rows;
+    int col0 = std::clamp((int)floorf((r.x - grid.bounds.x) / cellDx), 0, grid.cols - 1);
+    int col1 = std::clamp((int)floorf((r.x + r.dx - grid.bounds.x) / cellDx), 0, grid.cols - 1);
+    int row0 = std::clamp((int)floorf((r.y - grid.bounds.y) / cellDy), 0, grid.rows - 1);
+    int row1 = std::clamp((int)floorf((r.y + r.dy - grid.bounds.y) / cellDy), 0, grid.rows - 1);
+    for (int row = row0; row <= row1; row++) {
+        for (int col = col0; col <= col1; col++) {
+            fn(row * grid.cols + col);
         }
     }
-    return false;
 }
 
-// if we have multiple elements at the same position, pick the one
-// that is fully obscured by all other elements
-// if not fully obscured, return the first one
-static IPageElement* PickBestElement(Vec<IPageElement*>& els) {
-    if (els.Size() == 0) {
-        return nullptr;
+static void BuildRectGrid(FzRectGrid& grid, const Vec<RectF>& rects) {
+    grid.cellStart.Reset();
+    grid.items.Reset();
+    grid.cols = 0;
+    grid.rows = 0;
+    int n = rects.Size();
+    if (n == 0) {
+        return;
+    }
+    RectF bounds = rects[0];
+    for (const RectF& r : rects) {
+        float x1 = std::max(bounds.x + bounds.dx, r.x + r.dx);
+        float y1 = std::max(bounds.y + bounds.dy, r.y + r.dy);
+        bounds.x = std::min(bounds.x, r.x);
+        bounds.y = std::min(bounds.y, r.y);
+        bounds.dx = x1 - bounds.x;
+        bounds.dy = y1 - bounds.y;
+    }
+    bounds.dx = std::max(bounds.dx, 1.f);
+    bounds.dy = std::max(bounds.dy, 1.f);
+    grid.bounds = bounds;
+
+    double nCells = std::max(1.0, (double)n / kElementsPerGridCell);
+    double aspect = (double)bounds.dx / (double)bounds.dy;
+    grid.cols = std::clamp((int)sqrt(nCells * aspect), 1, kMaxElementsGridSize);
+    grid.rows = std::clamp((int)(nCells / grid.cols), 1, kMaxElementsGridSize);
+
+    // count items per cell, then fill them in, in order of rects
+    int cellCount = grid.cols * grid.rows;
+    Vec<int>& cellStart = grid.cellStart;
+    cellStart.AppendBlanks(cellCount + 1);
+    for (const RectF& r : rects) {
+        ForEachGridCell(grid, r, [&](int cell) { cellStart[cell + 1]++; });
+    }
+    for (int i = 0; i < cellCount; i++) {
+        cellStart[i + 1] += cellStart[i];
+    }
+    grid.items.AppendBlanks(cellStart[cellCount]);
+    Vec<int> fill;
+    fill.AppendBlanks(cellCount);
+    for (int i = 0; i < n; i++) {
+        ForEachGridCell(grid, rects[i], [&](int cell) { grid.items[cellStart[cell] + fill[cell]++] = i; });
     }
+}
 
-Encore:
-    int n = els.Size();
-    if (n == 1) {
-        return els[0];
+// returns items whose rects might contain pt, in the order of rects
+static void QueryRectGrid(const FzRectGrid& grid, PointF pt, Vec<int>& res) {
+    if (grid.cols == 0 || !grid.bounds.Contains(pt)) {
+        return;
     }
-    bool didRemove = RemoveHeWhoFullyContains(els);
-    if (didRemove) {
-        ReportIf(els.Size() != n - 1);
-        goto Encore;
+    float cellDx = grid.bounds.dx / grid.cols;
+    float cellDy = grid.bounds.dy / grid.rows;
+    int col = std::clamp((int)floorf((pt.x - grid.bounds.x) / cellDx), 0, grid.cols - 1);
+    int row = std::clamp((int)floorf((pt.y - grid.bounds.y) / cellDy), 0, grid.rows - 1);
+    int cell = row * grid.cols + col;
+    for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++) {
+        res.Append(grid.items[k]);
     }
-    return els[0];
+}
+
+// when several elements are at the same position, the smallest one is the
+// most specific, e.g. a link inside an image. It's also the one that can't
+// fully contain any other. On ties, the first one wins
+static bool IsBetterHit(RectF r, RectF best, bool hasBest) {
+    return !hasBest || r.dx * r.dy < best.dx * best.dy;
 }
 
 // don't delete the result
@@ -1025,47 +1123,22 @@ NO_INLINE static IPageElement* FzGetElementAtPos(FzPageInfo* pageInfo, PointF pt
     if (!pageInfo) {
         return nullptr;
     }
-    Vec<IPageElement*> res;
-
-    for (auto pel : pageInfo->links) {
-        if (pel->GetRect().Contains(pt)) {
-            res.Append(pel);
-        }
-    }
-
-    for (auto* pel : pageInfo->autoLinks) {
-        if (pel->GetRect().Contains(pt)) {
-            res.Append(pel);
-        }
-    }
+    Vec<int> candidates;
+    QueryRectGrid(pageInfo->elementsGrid, pt, candidates);
 
-    for (auto* pel : pageInfo->comments) {
-        if (pel->GetRect().Contains(pt)) {
-            res.Append(pel);
+    IPageElement* res = nullptr;
+    RectF resRect;
+    for (int i : candidates) {
+        RectF r = pageInfo->hitTestRects[i];
+        if (r.Contains(pt) && IsBetterHit(r, resRect, res != nullptr)) {
+            res = pageInfo->hitTestElements[i];
+            resRect = r;
         }
     }
-
-    size_t imageIdx = 0;
-    fz_point p = {(float)pt.x, (float)pt.y};
-    for (auto& img : pageInfo->images) {
-        fz_rect ir = img->rect;
-        if (IsPointInRect(ir, p)) {
-            res.Append(img->imageElement);
-        }
-        imageIdx++;
-    }
-
-    if (false) {
-        int i = 0;
-        for (auto&& el : res) {
-            Rect r = el->GetRect().Round();
-            logfa("el %d: pos: %d-%d, size: %d-%d, kind: %s\n", (int)i, r.x, r.y, r.dx, r.dy, el->GetKind());
-            i++;
-        }
-    }
-    return PickBestElement(res);
+    return res;
 }
 
+// must be called while holding pagesAccess
 static void BuildElementsInfo(FzPageInfo* pageInfo) {
     if (!pageInfo || !pageInfo->elementsNeedRebuilding) {
         return;
@@ -1095,24 +1168,154 @@ static void BuildElementsInfo(FzPageInfo* pageInfo) {
         els.Append(comment);
     }
     els.Reverse();
+
+    auto& hitEls = pageInfo->hitTestElements;
+    auto& hitRects = pageInfo->hitTestRects;
+    hitEls.Reset();
+    hitRects.Reset();
+    for (auto pel : pageInfo->links) {
+        hitEls.Append(pel);
+        hitRects.Append(pel->GetRect());
+    }
+    for (auto pel : pageInfo->autoLinks) {
+        hitEls.Append(pel);
+        hitRects.Append(pel->GetRect());
+    }
+    for (auto pel : pageInfo->comments) {
+        hitEls.Append(pel);
+        hitRects.Append(pel->GetRect());
+    }
+    for (auto& img : pageInfo->images) {
+        hitEls.Append(img->imageElement);
+        hitRects.Append(ToRectF(img->rect));
+    }
+    BuildRectGrid(pageInfo->elementsGrid, hitRects);
+
+    Vec<RectF> annotRects;
+    for (auto annot : pageInfo->annotations) {
+        annotRects.Append(annot->bounds);
+    }
+    BuildRectGrid(pageInfo->annotationsGrid, annotRects);
+}
+
+// same as LinkifyHasCandidates() but directly on the stext, so that pages without
+// links don't have to be converted to WCHAR text at all
+static bool FzStextHasLinkifyCandidates(fz_stext_page* stext) {
+    for (fz_stext_block* block = stext->first_block; block; block = block->next) {
+        if (block->type != FZ_STEXT_BLOCK_TEXT) {
+            continue;
+        }
+        for (fz_stext_line* line = block->u.t.first_line; line; line = line->next) {
+            // the last (ASCII) chars on the line, most recent in the lowest byte
+            u64 last = 0;
+            for (fz_stext_char* c = line->first_char; c; c = c->next) {
+                if (c->c == '@') {
+                    return true;
+                }
+                if (c->c == ':' && (c->next && c->next->c == '/' || (last & 0xffffffffffff) == 0x6d61696c746f)) {
+                    // "://" or "mailto:"
+                    return true;
+                }
+                if (c->c == '.' && (last & 0xffffff) == 0x777777) {
+                    // "www."
+                    return true;
+                }
+                last = last << 8 | (c->c < 0x80 ? (u64)c->c : 0);
+            }
+        }
+    }
+    return false;
 }
 
-static void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
+// auto-detected links of recently loaded pages, so that they don't have to be
+// detected again when a document is reloaded or cloned (e.g. for printing)
+struct CachedPageLinks {
+    char* docKey = nullptr;
+    int pageNo = 0;
+    LinkRectList list;
+    ~CachedPageLinks() {
+        str::Free(docKey);
+    }
+};
+
+constexpr int kMaxCachedPageLinks = 1024;
+// least recently added first
+static Vec<CachedPageLinks*> gCachedPageLinks;
+static SRWLOCK gCachedPageLinksLock = SRWLOCK_INIT;
+
+static bool GetCachedPageLinks(const char* docKey, int pageNo, LinkRectList& list) {
+    AcquireSRWLockShared(&gCachedPageLinksLock);
+    bool found = false;
+    for (auto cached : gCachedPageLinks) {
+        if (cached->pageNo == pageNo && str::Eq(cached->docKey, docKey)) {
+            list.links = cached->list.links;
+            list.coords = cached->list.coords;
+            found = true;
+            break;
+        }
+    }
+    ReleaseSRWLockShared(&gCachedPageLinksLock);
+    return found;
+}
+
+static void CachePageLinks(const char* docKey, int pageNo, const LinkRectList& list) {
+    auto cached = new CachedPageLinks();
+    cached->docKey = str::Dup(docKey);
+    cached->pageNo = pageNo;
+    cached->list.links = list.links;
+    cached->list.coords = list.coords;
+    AcquireSRWLockExclusive(&gCachedPageLinksLock);
+    if (gCachedPageLinks.Size() >= kMaxCachedPageLinks) {
+        delete gCachedPageLinks.PopAt(0);
+    }
+    gCachedPageLinks.Append(cached);
+    ReleaseSRWLockExclusive(&gCachedPageLinksLock);
+}
+
+// the links depend on the file, which is identified by path, size and
+// modification time (hashing the whole file would be slower than linkifying),
+// and for reflowable documents on the layout, which decides what's on a page
+static TempStr GetLinksCacheKeyTemp(EngineMupdf* e) {
+    const char* filePath = e->FilePath();
+    if (!filePath) {
+        return nullptr;
+    }
+    i64 size = file::GetSize(filePath);
+    if (size <= 0) {
+        return nullptr;
+    }
+    FILETIME mtime = file::GetModificationTime(filePath);
+    return str::FormatTemp("%s|%llx|%08x%08x|%dx%d-%d", filePath, (long long)size, (uint)mtime.dwHighDateTime,
+                           (uint)mtime.dwLowDateTime, (int)(e->layoutDx * 100), (int)(e->layoutDy * 100),
+                           (int)(e->layoutFontDy * 100));
+}
+
+// docKey is nullptr for documents not loaded from a file
+static void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext, const char* docKey) {
     if (!pageInfo || !stext) {
         return;
     }
-
-    Rect* coords;
-    WCHAR* pageText = FzTextPageToStr(stext, &coords);
-    if (!pageText) {
+    if (!FzStextHasLinkifyCandidates(stext)) {
         return;
     }
 
-    LinkRectList* list = LinkifyText(pageText, coords);
-    free(pageText);
+    LinkRectList list;
+    if (!docKey || !GetCachedPageLinks(docKey, pageInfo->pageNo, list)) {
+        Rect* coords;
+        WCHAR* pageText = FzTextPageToStr(stext, &coords);
+        if (!pageText) {
+            return;
+        }
+        LinkifyText(list, pageText, (int)str::Len(pageText), coords);
+        free(pageText);
+        free(coords);
+        if (docKey) {
+            CachePageLinks(docKey, pageInfo->pageNo, list);
+        }
+    }
 
-    for (int i = 0; i < list->links.Size(); i++) {
-        fz_rect bbox = list->coords.at(i);
+    for (int i = 0; i < list.links.Size(); i++) {
+        fz_rect bbox = list.coords.at(i);
         bool overlaps = false;
         for (auto pel : pageInfo->links) {
             overlaps = FzRectOverlap(bbox, pel->GetRect()) >= 0.25f;
@@ -1121,7 +1324,7 @@ static void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
             continue;
         }
 
-        char* uri = list->links[i];
+        char* uri = list.links[i];
         if (!uri) {
             continue;
         }
@@ -1132,8 +1335,6 @@ static void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
         pel->rect = ToRectF(bbox);
         pageInfo->autoLinks.Append(pel);
     }
-    delete list;
-    free(coords);
 }
 
 static void FzFindImagePositions(fz_context* ctx, int pageNo, Vec<FitzPageImageInfo*>& images, fz_stext_page* stext) {
@@ -1331,51 +1532,13 @@ static fz_outline* PdfLoadAttachments(fz_context* ctx, pdf_document* doc, const
     return root.next;
 }
 
-struct PageLabelInfo {
-    int startAt = 0;
-    int countFrom = 0;
-    const char* type = nullptr;
-    pdf_obj* prefix = nullptr;
-};
-
-int CmpPageLabelInfo(const void* a, const void* b) {
-    return ((PageLabelInfo*)a)->startAt - ((PageLabelInfo*)b)->startAt;
-}
-
-static TempStr FormatPageLabelTemp(const char* type, int pageNo, const char* prefix) {
-    if (str::Eq(type, "D")) {
-        return str::FormatTemp("%s%d", prefix, pageNo);
-    }
-    if (str::EqI(type, "R")) {
-        // roman numbering style
-        TempStr number = str::FormatRomanNumeralTemp(pageNo);
-        if (*type == 'r') {
-            str::ToLowerInPlace(number);
-        }
-        return str::FormatTemp("%s%s", prefix, number);
-    }
-    if (str::EqI(type, "A")) {
-        // alphabetic numbering style (A..Z, AA..ZZ, AAA..ZZZ, ...)
-        str::Str number;
-        number.AppendChar('A' + (pageNo - 1) % 26);
-        for (int i = 0; i < (pageNo - 1) / 26; i++) {
-            number.AppendChar(number.at(0));
-        }
-        if (*type == 'a') {
-            str::ToLowerInPlace(number.Get());
-        }
-        return str::FormatTemp("%s%s", prefix, number.Get());
-    }
-    return str::DupTemp(prefix);
-}
-
-void BuildPageLabelRec(fz_context* ctx, pdf_obj* node, int pageCount, Vec<PageLabelInfo>& data) {
+static void BuildPageLabelsRec(fz_context* ctx, pdf_obj* node, PageLabels* labels) {
     pdf_obj* obj;
     if ((obj = pdf_dict_gets(ctx, node, "Kids")) != nullptr && !pdf_mark_obj(ctx, node)) {
         int n = pdf_array_len(ctx, obj);
         for (int i = 0; i < n; i++) {
             auto arr = pdf_array_get(ctx, obj, i);
-            BuildPageLabelRec(ctx, arr, pageCount, data);
+            BuildPageLabelsRec(ctx, arr, labels);
         }
         pdf_unmark_obj(ctx, node);
         return;
@@ -1387,19 +1550,15 @@ void BuildPageLabelRec(fz_context* ctx, pdf_obj* node, int pageCount, Vec<PageLa
     int n = pdf_array_len(ctx, obj);
     for (int i = 0; i < n; i += 2) {
         pdf_obj* info = pdf_array_get(ctx, obj, i + 1);
-        PageLabelInfo pli;
-        pli.startAt = pdf_to_int(ctx, pdf_array_get(ctx, obj, i)) + 1;
-        if (pli.startAt < 1) {
+        int startAt = pdf_to_int(ctx, pdf_array_get(ctx, obj, i)) + 1;
+        if (startAt < 1) {
             continue;
         }
-
-        pli.type = pdf_to_name(ctx, pdf_dict_gets(ctx, info, "S"));
-        pli.prefix = pdf_dict_gets(ctx, info, "P");
-        pli.countFrom = pdf_to_int(ctx, pdf_dict_gets(ctx, info, "St"));
-        if (pli.countFrom < 1) {
-            pli.countFrom = 1;
-        }
-        data.Append(pli);
+        const char* style = pdf_to_name(ctx, pdf_dict_gets(ctx, info, "S"));
+        pdf_obj* prefixObj = pdf_dict_gets(ctx, info, "P");
+        TempStr prefix = prefixObj ? PdfToUtf8Temp(ctx, prefixObj) : nullptr;
+        int countFrom = pdf_to_int(ctx, pdf_dict_gets(ctx, info, "St"));
+        labels->AddRange(startAt, style, prefix, countFrom);
     }
 }
 
@@ -1408,79 +1567,17 @@ void BuildPageLabelRec(fz_context* ctx, pdf_obj* node, int pageCount, Vec<PageLa
 // not sure if we should do it, it's unexpected behavior
 static bool gEnsureUniqueLabels = false;
 
-static void EnsureLabelsUnique(StrVec* labels) {
-    if (!gEnsureUniqueLabels) {
-        return;
-    }
-    // ensure that all page labels are unique (by appending a number to duplicates)
-    StrVec dups(*labels);
-    Sort(dups);
-    int nDups = dups.Size();
-    for (int i = 1; i < nDups; i++) {
-        char* s = dups.At(i);
-        if (!str::Eq(s, dups.At(i - 1))) {
-            continue;
-        }
-        int idx = labels->Find(s), counter = 0;
-        while ((idx = labels->Find(s, idx + 1)) != -1) {
-            TempStr unique = nullptr;
-            do {
-                unique = str::FormatTemp("%s.%d", s, ++counter);
-            } while (labels->Contains(unique));
-            labels->SetAt(idx, unique);
-        }
-        nDups = dups.Size();
-        for (; i + 1 < nDups && str::Eq(dups.At(i), dups.At(i + 1)); i++) {
-            // no-op
-        }
-    }
-}
-
-static StrVec* BuildPageLabelVec(fz_context* ctx, pdf_obj* root, int pageCount) {
-    Vec<PageLabelInfo> data;
-    BuildPageLabelRec(ctx, root, pageCount, data);
-    data.Sort(CmpPageLabelInfo);
-
-    size_t n = data.size();
-    if (n == 0) {
-        return nullptr;
-    }
-
-    PageLabelInfo& pli = data.at(0);
-    if (n == 1 && pli.startAt == 1 && pli.countFrom == 1 && !pli.prefix && str::Eq(pli.type, "D")) {
-        // this is the default case, no need for special treatment
+// returns nullptr if the labels are just page numbers
+static PageLabels* BuildPageLabels(fz_context* ctx, pdf_obj* root, int pageCount) {
+    auto labels = new PageLabels(pageCount);
+    BuildPageLabelsRec(ctx, root, labels);
+    if (!labels->Finish(gEnsureUniqueLabels)) {
+        delete labels;
         return nullptr;
     }
-
-    StrVec* labels = new StrVec();
-    for (int i = 0; i < pageCount; i++) {
-        labels->Append("");
-    }
-
-    for (size_t i = 0; i < n; i++) {
-        pli = data.at(i);
-        if (pli.startAt > pageCount) {
-            break;
-        }
-        int secLen = pageCount + 1 - pli.startAt;
-        if (i < n - 1 && data.at(i + 1).startAt <= pageCount) {
-            secLen = data.at(i + 1).startAt - pli.startAt;
-        }
-        TempStr prefix = PdfToUtf8Temp(ctx, data.at(i).prefix);
-        for (int j = 0; j < secLen; j++) {
-            int idx = pli.startAt + j - 1;
-            TempStr label = FormatPageLabelTemp(pli.type, pli.countFrom + j, prefix);
-            labels->SetAt(idx, label);
-        }
-    }
-
-    for (int idx = 0; (idx = labels->Find(nullptr, idx)) != -1; idx++) {
-        labels->SetAt(idx, "");
-    }
-
-    EnsureLabelsUnique(labels);
     return labels;
 }
+
 struct PageTreeStackItem {
     pdf_obj* kids = nullptr;
     int i = -1;
@@ -1527,6 +1624,289 @@ struct ContextThreadID {
 static Vec<ContextThreadID>* gPerThreadContexts;
 static CRITICAL_SECTION gPerThreadContextsCs;
 
+// when enabled (EnableMupdfSharedStore()), every EngineMupdf (including clones
+// made for printing) is created by cloning a single root context instead of
+// getting its own fz_new_context(). Cloned contexts share the root's fz_store
+// (decoded images, fonts, parsed objects), glyph cache, font and colorspace
+// contexts, so there's one memory budget for the whole process and the store
+// evicts least recently used items regardless of which document they belong to
+static fz_context* gSharedStoreCtx = nullptr;
+static CRITICAL_SECTION gSharedStoreMutexes[FZ_LOCK_MAX];
+static fz_locks_context gSharedStoreLocksCtx;
+
+static void fz_lock_shared_store_cs(void*, int lock) {
+    EnterCriticalSection(&gSharedStoreMutexes[lock]);
+}
+
+static void fz_unlock_shared_store_cs(void*, int lock) {
+    LeaveCriticalSection(&gSharedStoreMutexes[lock]);
+}
+
+// must be called before the first EngineMupdf is created
+void EnableMupdfSharedStore(size_t maxStore) {
+    if (gSharedStoreCtx) {
+        return;
+    }
+    for (size_t i = 0; i < dimof(gSharedStoreMutexes); i++) {
+        InitializeCriticalSection(&gSharedStoreMutexes[i]);
+    }
+    gSharedStoreLocksCtx.user = nullptr;
+    gSharedStoreLocksCtx.lock = fz_lock_shared_store_cs;
+    gSharedStoreLocksCtx.unlock = fz_unlock_shared_store_cs;
+    gSharedStoreCtx = fz_new_context(nullptr, &gSharedStoreLocksCtx, maxStore);
+    if (!gSharedStoreCtx) {
+        logf("EnableMupdfSharedStore: fz_new_context() failed\n");
+        return;
+    }
+    InstallFitzErrorCallbacks(gSharedStoreCtx);
+    pdf_install_load_system_font_funcs(gSharedStoreCtx);
+    fz_register_document_handlers(gSharedStoreCtx);
+    // system fonts are loaded once for all engines instead of once per engine
+    set_shared_fonts_ctx(gSharedStoreCtx);
+    logf("EnableMupdfSharedStore: max store %d MB\n", (int)(maxStore >> 20));
+}
+
+// must only be called once all engines are released: their cloned
+// contexts use the locks destroyed here
+void DestroyMupdfSharedStore() {
+    if (!gSharedStoreCtx) {
+        return;
+    }
+    set_shared_fonts_ctx(nullptr);
+    // fonts still used by engines keep their own reference to the font data
+    drop_cached_fonts_for_ctx(gSharedStoreCtx);
+    fz_drop_context(gSharedStoreCtx);
+    gSharedStoreCtx = nullptr;
+    for (size_t i = 0; i < dimof(gSharedStoreMutexes); i++) {
+        DeleteCriticalSection(&gSharedStoreMutexes[i]);
+    }
+}
+
+// if set, layout accelerators of reflowable documents (page counts of
+// each chapter) and repair data of damaged PDFs are cached in this
+// directory, see SaveAccelerator()
+static char* gAcceleratorDir = nullptr;
+
+void SetMupdfAcceleratorDir(const char* dir) {
+    str::ReplaceWithCopy(&gAcceleratorDir, dir);
+}
+
+// accelerators are only valid for the same layout size, so that is part of the name
+static TempStr GetLayoutAcceleratorPathTemp(const u8 digest[16], float dx, float dy, float fontDy) {
+    if (!gAcceleratorDir) {
+        return nullptr;
+    }
+    AutoFreeStr fingerPrint = str::MemToHex(digest, 16);
+    TempStr name = str::FormatTemp("%s-%dx%d-%d.layout", fingerPrint.Get(), (int)(dx * 100), (int)(dy * 100),
+                                   (int)(fontDy * 100));
+    return path::JoinTemp(gAcceleratorDir, name);
+}
+
+// repair data is only valid for the exact same file. hashing a huge damaged
+// file would take about as long as repairing it, so it's keyed by path,
+// size and modification time instead
+static TempStr GetRepairAcceleratorPathTemp(const char* filePath) {
+    if (!gAcceleratorDir || !filePath) {
+        return nullptr;
+    }
+    i64 size = file::GetSize(filePath);
+    if (size <= 0) {
+        return nullptr;
+    }
+    FILETIME mtime = file::GetModificationTime(filePath);
+    u8 digest[16];
+    CalcMD5Digest(filePath, (int)str::Len(filePath), digest);
+    AutoFreeStr pathHash = str::MemToHex(digest, 16);
+    TempStr name = str::FormatTemp("%s-%llx-%08x%08x.repair", pathHash.Get(), (long long)size,
+                                   (uint)mtime.dwHighDateTime, (uint)mtime.dwLowDateTime);
+    return path::JoinTemp(gAcceleratorDir, name);
+}
+
+// returns nullptr on failure
+static fz_document* OpenAcceleratedDocument(fz_context* ctx, const char* nameHint, fz_stream* stm, fz_stream* accel,
+                                            bool rewind, float dx, float dy, float fontDy) {
+    fz_document* doc = nullptr;
+    fz_var(doc);
+    fz_try(ctx) {
+        if (rewind) {
+            fz_seek(ctx, stm, 0, 0);
+        }
+        doc = fz_open_accelerated_document_with_stream(ctx, nameHint, stm, accel);
+        fz_layout_document(ctx, doc, dx, dy, fontDy);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        fz_drop_document(ctx, doc);
+        doc = nullptr;
+    }
+    return doc;
+}
+
+static void SaveAccelerator(EngineMupdf* e) {
+    if (!e->acceleratorPath) {
+        return;
+    }
+    const char* path = e->acceleratorPath;
+    if (!dir::CreateForFile(path)) {
+        return;
+    }
+    auto ctx = e->Ctx();
+    ScopedCritSec scope(e->ctxAccess);
+    if (!fz_document_supports_accelerator(ctx, e->_doc)) {
+        return;
+    }
+    // write to a temporary file first so that a crash can't leave a half-written file
+    TempStr tmpPath = str::JoinTemp(path, ".tmp");
+    bool ok = true;
+    fz_try(ctx) {
+        fz_output_accelerator(ctx, e->_doc, fz_new_output_with_path(ctx, tmpPath, 0));
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        ok = false;
+    }
+    if (ok) {
+        ok = MoveFileExW(ToWStrTemp(tmpPath), ToWStrTemp(path), MOVEFILE_REPLACE_EXISTING);
+    }
+    if (!ok) {
+        file::Delete(tmpPath);
+        logf("SaveAccelerator: failed to write '%s'\n", path);
+    }
+}
+
+// number of threads used to lay out chapters of EPUB documents, 0 means
+// depending on document size and number of processors
+static int gLayoutThreadCount = 0;
+
+// every layout thread opens its own instance of the document, which only
+// pays off for big documents
+constexpr i64 kLayoutBytesPerThread = 256 * 1024;
+constexpr int kMaxLayoutThreads = 8;
+
+void SetMupdfLayoutThreadCount(int n) {
+    gLayoutThreadCount = n;
+}
+
+static int GetLayoutThreadCount(i64 docSize) {
+    int n = gLayoutThreadCount;
+    if (n <= 0) {
+        SYSTEM_INFO si{};
+        GetSystemInfo(&si);
+        n = std::min((int)si.dwNumberOfProcessors, kMaxLayoutThreads);
+        n = (int)std::min((i64)n, docSize / kLayoutBytesPerThread);
+    }
+    return std::clamp(n, 1, (int)MAXIMUM_WAIT_OBJECTS);
+}
+
+// mupdf documents can't be used from multiple threads so to lay out chapters
+// in parallel each worker opens its own instance of the document on a cloned
+// context and lays out every nThreads-th chapter. The page counts are written
+// to an accelerator and merged with fz_merge_epub_accelerators()
+struct LayoutWorker {
+    fz_context* ctx = nullptr;
+    fz_buffer* data = nullptr;
+    const char* nameHint = nullptr;
+    float dx = 0;
+    float dy = 0;
+    float fontDy = 0;
+    int threadNo = 0;
+    int nThreads = 0;
+    // accelerator with page counts of chapters laid out by this worker (-1 for others)
+    fz_buffer* accel = nullptr;
+};
+
+static DWORD WINAPI LayoutWorkerThread(void* data) {
+    auto w = (LayoutWorker*)data;
+    auto ctx = w->ctx;
+    fz_stream* stm = nullptr;
+    fz_document* doc = nullptr;
+    fz_var(stm);
+    fz_var(doc);
+    fz_try(ctx) {
+        stm = fz_open_buffer(ctx, w->data);
+        doc = fz_open_document_with_stream(ctx, w->nameHint, stm);
+        fz_layout_document(ctx, doc, w->dx, w->dy, w->fontDy);
+        int nChapters = fz_count_chapters(ctx, doc);
+        for (int i = w->threadNo; i < nChapters; i += w->nThreads) {
+            fz_count_chapter_pages(ctx, doc, i);
+        }
+        w->accel = fz_new_buffer(ctx, 64 + nChapters * 4);
+        fz_output_accelerator(ctx, doc, fz_new_output_with_buffer(ctx, w->accel));
+    }
+    fz_always(ctx) {
+        fz_drop_document(ctx, doc);
+        fz_drop_stream(ctx, stm);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        fz_drop_buffer(ctx, w->accel);
+        w->accel = nullptr;
+    }
+    return 0;
+}
+
+// lays out all chapters of an EPUB document (given as data) on nThreads threads
+// returns an accelerator with page counts of all chapters or nullptr on failure
+static fz_buffer* LayoutChaptersInParallel(fz_context* ctx, fz_buffer* data, const char* nameHint, float dx, float dy,
+                                           float fontDy, int nThreads) {
+    auto timeStart = TimeGet();
+    auto workers = new LayoutWorker[nThreads];
+    HANDLE threads[MAXIMUM_WAIT_OBJECTS]{};
+    int nStarted = 0;
+    for (int i = 0; i < nThreads; i++) {
+        auto& w = workers[i];
+        w.ctx = fz_clone_context(ctx);
+        if (!w.ctx) {
+            break;
+        }
+        w.data = data;
+        w.nameHint = nameHint;
+        w.dx = dx;
+        w.dy = dy;
+        w.fontDy = fontDy;
+        w.threadNo = i;
+        nStarted++;
+    }
+    // workers must know the final number of threads before any of them starts
+    for (int i = 0; i < nStarted; i++) {
+        workers[i].nThreads = nStarted;
+        threads[i] = CreateThread(nullptr, 0, LayoutWorkerThread, &workers[i], 0, nullptr);
+    }
+    for (int i = 0; i < nStarted; i++) {
+        if (!threads[i]) {
+            // couldn't create a thread, do its share of work on this thread
+            LayoutWorkerThread(&workers[i]);
+        }
+    }
+    for (int i = 0; i < nStarted; i++) {
+        if (threads[i]) {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+    }
+
+    fz_buffer* accels[MAXIMUM_WAIT_OBJECTS]{};
+    for (int i = 0; i < nStarted; i++) {
+        accels[i] = workers[i].accel;
+    }
+    fz_buffer* res = nullptr;
+    fz_try(ctx) {
+        res = fz_merge_epub_accelerators(ctx, accels, nStarted);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        res = nullptr;
+    }
+
+    for (int i = 0; i < nStarted; i++) {
+        fz_drop_buffer(ctx, workers[i].accel);
+        fz_drop_context(workers[i].ctx);
+    }
+    delete[] workers;
+    logf("LayoutChaptersInParallel: laid out chapters on %d threads in %.2f ms\n", nStarted, TimeSinceInMs(timeStart));
+    return res;
+}
+
 void InitializeEngineMupdf() {
     ReportIf(gPerThreadContexts);
     InitializeCriticalSection(&gPerThreadContextsCs);
@@ -1576,6 +1956,14 @@ EngineMupdf::EngineMupdf() {
     fz_locks_ctx.user = this;
     fz_locks_ctx.lock = fz_lock_context_cs;
     fz_locks_ctx.unlock = fz_unlock_context_cs;
+    if (gSharedStoreCtx) {
+        // error callbacks, system font loader and document handlers
+        // are inherited from the shared root context.
+        // note: in this mode mutexes[] are not used by mupdf, so ctxAccess
+        // only serializes access to this engine's document
+        _ctx = fz_clone_context(gSharedStoreCtx);
+        return;
+    }
     _ctx = fz_new_context(nullptr, &fz_locks_ctx, FZ_STORE_DEFAULT);
     InstallFitzErrorCallbacks(_ctx);
 
@@ -1599,6 +1987,7 @@ EngineMupdf::~EngineMupdf() {
         if (pi->retainedLinks) {
             fz_drop_link(ctx, pi->retainedLinks);
         }
+        fz_drop_display_list(ctx, pi->contentsList);
         if (pi->page) {
             fz_drop_page(ctx, pi->page);
         }
@@ -1616,12 +2005,15 @@ EngineMupdf::~EngineMupdf() {
     }
 
     fz_drop_document(ctx, _doc);
+    // no-op for contexts cloned from the shared store, their fonts are cached with the root
     drop_cached_fonts_for_ctx(ctx);
     fz_drop_context(ctx);
 
     delete pageLabels;
     delete tocTree;
     DeleteVecMembers(pages);
+    str::Free(acceleratorPath);
+    str::Free(linksCacheKey);
 
     for (size_t i = 0; i < dimof(mutexes); i++) {
         DeleteCriticalSection(&mutexes[i]);
@@ -1744,6 +2136,43 @@ ByteSlice LoadEmbeddedPDFFile(const char* filePath) {
     return res;
 }
 
+bool EngineMupdf::GetReflowLayout(float* dx, float* dy, float* fontDy) {
+    if (layoutDx == 0) {
+        return false;
+    }
+    *dx = layoutDx;
+    *dy = layoutDy;
+    *fontDy = layoutFontDy;
+    return true;
+}
+
+bool EngineMupdf::GetFingerprint(u8 digestOut[16]) {
+    ScopedCritSec scope(ctxAccess);
+    if (!hasFingerprint) {
+        if (pdfdoc) {
+            // a zeroed digest would be shared by all documents that can't be read
+            if (!FzStreamFingerprint(Ctx(), pdfdoc->file, fingerprint)) {
+                return false;
+            }
+        } else {
+            // non-PDF documents don't keep their stream around
+            const char* path = FilePath();
+            if (!path || !file::Exists(path)) {
+                return false;
+            }
+            ByteSlice d = file::ReadFile(path);
+            if (d.empty()) {
+                return false;
+            }
+            CalcMD5Digest(d.data(), (int)d.size(), fingerprint);
+            d.Free();
+        }
+        hasFingerprint = true;
+    }
+    memcpy(digestOut, fingerprint, sizeof(fingerprint));
+    return true;
+}
+
 static ByteSlice TxtFileToHTML(const char* path) {
     ByteSlice fd = file::ReadFileWithAllocator(path, GetTempAllocator());
     if (fd.empty()) {
@@ -1980,29 +2409,111 @@ bool EngineMupdf::LoadFromStream(fz_stream* stm, const char* nameHint, PasswordU
         fz_set_user_css(ctx, custom_css);
     }
 
-    float dx, dy, fontDy;
-    _doc = nullptr;
-    fz_var(dx);
-    fz_var(dy);
-    fz_var(fontDy);
-    fz_try(ctx) {
-        _doc = fz_open_document_with_stream(ctx, nameHint, stm);
-        pdfdoc = pdf_specifics(ctx, _doc);
-        dx = DpiScale(ldx, displayDPI);
-        dy = DpiScale(ldy, displayDPI);
-        fontDy = DpiScale(lfontDy, displayDPI);
-        fz_layout_document(ctx, _doc, dx, dy, fontDy);
+    float dx = DpiScale(ldx, displayDPI);
+    float dy = DpiScale(ldy, displayDPI);
+    float fontDy = DpiScale(lfontDy, displayDPI);
+
+    // for EPUB, mupdf has to lay out all chapters to know the number of pages
+    // unless given an accelerator from a previous time the document was opened
+    fz_stream* accel = nullptr;
+    TempStr accelPath = nullptr;
+    // damaged PDFs are repaired by scanning the whole file, which can be
+    // skipped if the results of a previous repair were saved
+    TempStr repairPath = nullptr;
+    if (gAcceleratorDir && str::EndsWithI(nameHint, ".epub")) {
+        hasFingerprint = FzStreamFingerprint(ctx, stm, fingerprint);
+        if (hasFingerprint) {
+            accelPath = GetLayoutAcceleratorPathTemp(fingerprint, dx, dy, fontDy);
+        }
+    } else if (FilePath() && GuessFileTypeFromName(FilePath()) == kindFilePDF) {
+        repairPath = GetRepairAcceleratorPathTemp(FilePath());
     }
-    fz_always(ctx) {
-        fz_drop_stream(ctx, stm);
+    TempStr path = accelPath ? accelPath : repairPath;
+    if (path && file::Exists(path)) {
+        fz_try(ctx) {
+            accel = fz_open_file(ctx, path);
+        }
+        fz_catch(ctx) {
+            fz_report_error(ctx);
+            accel = nullptr;
+        }
     }
-    fz_catch(ctx) {
-        fz_report_error(ctx);
-        _doc = nullptr;
+    if (path && !accel) {
+        str::ReplaceWithCopy(&acceleratorPath, path);
     }
+    bool accelFromFile = accel != nullptr;
+
+    // stream has to be rewound if it was read for fingerprinting or parallel layout
+    bool rewind = accelPath != nullptr;
+    auto timeStart = TimeGet();
+    // without an accelerator, lay out chapters of big documents on multiple threads to build one
+    if (!accel && str::EndsWithI(nameHint, ".epub")) {
+        fz_buffer* data = nullptr;
+        fz_buffer* merged = nullptr;
+        fz_var(data);
+        fz_var(merged);
+        fz_var(accel);
+        rewind = true;
+        fz_try(ctx) {
+            fz_seek(ctx, stm, 0, 2);
+            int nLayoutThreads = GetLayoutThreadCount(fz_tell(ctx, stm));
+            fz_seek(ctx, stm, 0, 0);
+            if (nLayoutThreads > 1) {
+                data = fz_read_all(ctx, stm, 0);
+                merged = LayoutChaptersInParallel(ctx, data, nameHint, dx, dy, fontDy, nLayoutThreads);
+            }
+            if (merged) {
+                accel = fz_open_buffer(ctx, merged);
+            }
+        }
+        fz_always(ctx) {
+            fz_drop_buffer(ctx, merged);
+            fz_drop_buffer(ctx, data);
+        }
+        fz_catch(ctx) {
+            fz_report_error(ctx);
+            accel = nullptr;
+        }
+    }
+
+    _doc = OpenAcceleratedDocument(ctx, nameHint, stm, accel, rewind, dx, dy, fontDy);
+    pdfdoc = _doc ? pdf_specifics(ctx, _doc) : nullptr;
+
+    // a stale or damaged accelerator must not prevent opening the document and
+    // one that was rejected (so the damaged PDF was scanned) should be replaced
+    bool badAccel = accel && !_doc;
+    if (accelFromFile && pdfdoc && pdf_was_repaired(ctx, pdfdoc) && !pdfdoc->repair_accel_loaded) {
+        badAccel = true;
+    }
+    fz_drop_stream(ctx, accel);
+    if (badAccel) {
+        if (accelFromFile) {
+            logf("EngineMupdf::LoadFromStream: deleting bad accelerator '%s'\n", path);
+            file::Delete(path);
+            str::ReplaceWithCopy(&acceleratorPath, path);
+        }
+        if (!_doc) {
+            _doc = OpenAcceleratedDocument(ctx, nameHint, stm, nullptr, true, dx, dy, fontDy);
+            pdfdoc = _doc ? pdf_specifics(ctx, _doc) : nullptr;
+        }
+    }
+    fz_drop_stream(ctx, stm);
     if (!_doc) {
         return false;
     }
+    if (fz_is_document_reflowable(ctx, _doc)) {
+        layoutDx = dx;
+        layoutDy = dy;
+        layoutFontDy = fontDy;
+    }
+    if (accelPath) {
+        logf("EngineMupdf::LoadFromStream: opened '%s' in %.2f ms, %s accelerator\n", nameHint,
+             TimeSinceInMs(timeStart), acceleratorPath ? "without" : "with");
+    }
+    if (repairPath && pdfdoc && pdf_was_repaired(ctx, pdfdoc)) {
+        logf("EngineMupdf::LoadFromStream: opened damaged '%s' in %.2f ms, %s saved repair data\n", nameHint,
+             TimeSinceInMs(timeStart), acceleratorPath ? "without" : "with");
+    }
 
     docStream = stm;
 
@@ -2018,7 +2529,10 @@ bool EngineMupdf::LoadFromStream(fz_stream* stm, const char* nameHint, PasswordU
     // TODO: make this work for non-PDF formats?
     u8 digest[16 + 32]{};
     if (pdfdoc) {
-        FzStreamFingerprint(ctx, pdfdoc->file, digest);
+        if (FzStreamFingerprint(ctx, pdfdoc->file, digest)) {
+            memcpy(fingerprint, digest, sizeof(fingerprint));
+            hasFingerprint = true;
+        }
     }
 
     bool ok = false;
@@ -2140,7 +2654,16 @@ static void FinishNonPDFLoading(EngineMupdf* e) {
     ScopedCritSec scope(e->ctxAccess);
 
     auto ctx = e->Ctx();
+    // all pages of reflowable documents have the layout size, so only the
+    // first page has to be loaded (which only lays out the first chapter)
+    bool sameSize = fz_is_document_reflowable(ctx, e->_doc);
     for (int i = 0; i < e->pageCount; i++) {
+        if (sameSize && i > 0) {
+            FzPageInfo* pageInfo = e->pages.at(i);
+            pageInfo->mediabox = e->pages.at(0)->mediabox;
+            pageInfo->pageNo = i + 1;
+            continue;
+        }
         fz_rect mbox{};
         fz_matrix page_ctm{};
         fz_page* page = nullptr;
@@ -2212,6 +2735,8 @@ bool EngineMupdf::FinishLoading() {
     }
     if (!pdfdoc) {
         FinishNonPDFLoading(this);
+        // fz_count_pages() has laid out all chapters so the accelerator is complete
+        SaveAccelerator(this);
         return true;
     }
 
@@ -2315,7 +2840,7 @@ bool EngineMupdf::FinishLoading() {
     fz_try(ctx) {
         labels = pdf_dict_getp(ctx, pdf_trailer(ctx, pdfdoc), "Root/PageLabels");
         if (labels) {
-            pageLabels = BuildPageLabelVec(ctx, labels, PageCount());
+            pageLabels = BuildPageLabels(ctx, labels, PageCount());
         }
     }
     fz_catch(ctx) {
@@ -2329,6 +2854,11 @@ bool EngineMupdf::FinishLoading() {
     // TODO: support javascript
     ReportIf(pdf_js_supported(ctx, pdfdoc));
 
+    // pages and outline might also have triggered a repair
+    if (pdf_was_repaired(ctx, pdfdoc)) {
+        SaveAccelerator(this);
+    }
+
     return true;
 }
 
@@ -2343,11 +2873,63 @@ static NO_INLINE IPageDestination* DestFromAttachment(EngineMupdf* engine, fz_ou
     return dest;
 }
 
-TocItem* EngineMupdf::BuildTocTree(TocItem* parent, fz_outline* outline, int& idCounter, bool isAttachment) {
-    TocItem* root = nullptr;
-    TocItem* curr = nullptr;
+IPageDestination* MupdfTocDests::ResolveTocDest(TocItem* item) {
+    auto outline = (fz_outline*)item->destData;
+    if (!outline) {
+        return nullptr;
+    }
+    if (isAttachment) {
+        return DestFromAttachment(engine, outline);
+    }
+    ScopedCritSec cs(engine->ctxAccess);
+    IPageDestination* dest = NewPageDestinationMupdf(engine->Ctx(), engine->_doc, nullptr, outline);
+    int destPageNo = PageDestGetPageNo(dest);
+    if (destPageNo > 0 && destPageNo != item->pageNo) {
+        logf("ResolveTocDest: pageNo: %d, dest->pageNo: %d\n", item->pageNo, destPageNo);
+    }
+    return dest;
+}
+
+// mupdf resolves the destinations of pdf outlines when loading them,
+// so there's no need to resolve their links again
+static int OutlinePageNo(fz_context* ctx, fz_document* doc, bool isPdf, fz_outline* outline) {
+    if (!isPdf || outline->page.page < 0) {
+        return FzGetPageNo(ctx, doc, nullptr, outline);
+    }
+    int pageNo = -1;
+    fz_var(pageNo);
+    fz_try(ctx) {
+        pageNo = fz_page_number_from_location(ctx, doc, outline->page);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        pageNo = -1;
+    }
+    return pageNo < 0 ? -1 : pageNo + 1;
+}
+
+// items are allocated in the tree's arena and their destinations are only
+// created when needed (see MupdfTocDests). Built without recursion, ids are
+// assigned in document order as before because they're persisted in FileState::tocState
+TocItem* EngineMupdf::BuildTocTree(TocTree* tree, fz_outline* outline, int& idCounter, bool isAttachment) {
+    // siblings to continue with after the children of an item: the outline
+    // item, the parent of its TocItem and the TocItem before it
+    struct Pending {
+        fz_outline* outline;
+        TocItem* parent;
+        TocItem* prev;
+    };
+    Vec<Pending> pending;
+
+    TocItem* first = nullptr;
+    TocItem* parent = nullptr;
+    TocItem* prev = nullptr;
+    MupdfTocDests* dests = isAttachment ? &attachmentDests : &outlineDests;
+    dests->engine = this;
+    dests->isAttachment = isAttachment;
 
     auto ctx = Ctx();
+    bool isPdf = pdfdoc != nullptr;
     while (outline) {
         char* name = nullptr;
         WCHAR* nameW = nullptr;
@@ -2358,26 +2940,16 @@ TocItem* EngineMupdf::BuildTocTree(TocItem* parent, fz_outline* outline, int& id
             name = ToUtf8(nameW);
             str::Free(nameW);
         }
-        if (!name) {
-            name = str::Dup("");
-        }
-
-        int pageNo = FzGetPageNo(ctx, _doc, nullptr, outline);
 
-        IPageDestination* dest = nullptr;
-        if (isAttachment) {
-            dest = DestFromAttachment(this, outline);
-        } else {
-            dest = NewPageDestinationMupdf(ctx, _doc, nullptr, outline);
-        }
-        TocItem* item = NewTocItemWithDestination(parent, name, dest);
-
-        free(name);
+        // for attachments, outline->page is a stream number
+        int pageNo = OutlinePageNo(ctx, _doc, isPdf && !isAttachment, outline);
+        TocItem* item = tree->NewItem(parent, name ? name : "", pageNo);
+        str::Free(name);
+        item->destResolver = dests;
+        item->destData = outline;
         item->isOpenDefault = outline->is_open;
         item->id = ++idCounter;
         item->fontFlags = 0; // TODO: had outline->flags; but mupdf changed outline
-        item->pageNo = pageNo;
-        ReportIf(!isAttachment && !item->PageNumbersMatch());
 
         // TODO: had outline->n_color and outline->color but mupdf changed outline
         /*
@@ -2386,25 +2958,33 @@ TocItem* EngineMupdf::BuildTocTree(TocItem* parent, fz_outline* outline, int& id
         }
         */
 
-        if (outline->down) {
-            item->child = BuildTocTree(item, outline->down, idCounter, isAttachment);
+        if (prev) {
+            prev->next = item;
+        } else if (parent) {
+            parent->child = item;
+        } else {
+            first = item;
         }
 
-        if (!root) {
-            root = item;
-            curr = item;
-        } else {
-            ReportIf(!curr);
-            if (curr) {
-                curr->next = item;
+        if (outline->down) {
+            if (outline->next) {
+                pending.Append({outline->next, parent, item});
             }
-            curr = item;
+            parent = item;
+            prev = nullptr;
+            outline = outline->down;
+            continue;
         }
-
+        prev = item;
         outline = outline->next;
+        if (!outline && pending.Size() > 0) {
+            Pending p = pending.Pop();
+            outline = p.outline;
+            parent = p.parent;
+            prev = p.prev;
+        }
     }
-
-    return root;
+    return first;
 }
 
 // TODO: maybe build in FinishLoading
@@ -2420,15 +3000,16 @@ TocTree* EngineMupdf::GetToc() {
 
     ScopedCritSec cs(ctxAccess);
 
+    auto tree = new TocTree();
     TocItem* root = nullptr;
     TocItem* att = nullptr;
     if (outline) {
-        root = BuildTocTree(nullptr, outline, idCounter, false);
+        root = BuildTocTree(tree, outline, idCounter, false);
     }
     if (!attachments) {
         goto MakeTree;
     }
-    att = BuildTocTree(nullptr, attachments, idCounter, true);
+    att = BuildTocTree(tree, attachments, idCounter, true);
     if (root) {
         root->AddSiblingAtEnd(att);
     } else {
@@ -2436,11 +3017,13 @@ TocTree* EngineMupdf::GetToc() {
     }
 MakeTree:
     if (!root) {
+        delete tree;
         return nullptr;
     }
-    TocItem* realRoot = new TocItem();
+    TocItem* realRoot = tree->NewItem(nullptr, nullptr, 0);
     realRoot->child = root;
-    tocTree = new TocTree(realRoot);
+    tree->root = realRoot;
+    tocTree = tree;
     return tocTree;
 }
 
@@ -2746,6 +3329,8 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* co
     ReportIf(pageInfo->pageNo != pageNo);
 
     pageInfo->fullyLoaded = true;
+    // links, auto-links and images are added below
+    pageInfo->elementsNeedRebuilding = true;
 
     fz_stext_page* stext = nullptr;
     fz_var(stext);
@@ -2771,7 +3356,10 @@ FzPageInfo* EngineMupdf::GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* co
         return pageInfo;
     }
 
-    FzLinkifyPageText(pageInfo, stext);
+    if (!linksCacheKey) {
+        linksCacheKey = str::Dup(GetLinksCacheKeyTemp(this));
+    }
+    FzLinkifyPageText(pageInfo, stext, linksCacheKey);
     FzFindImagePositions(ctx, pageNo, pageInfo->images, stext);
     fz_drop_stext_page(ctx, stext);
     return pageInfo;
@@ -2859,6 +3447,62 @@ RectF EngineMupdf::Transform(const RectF& rect, int pageNo, float zoom, int rota
     return ToRectF(rect2);
 }
 
+// number of pages for which the contents are kept as display lists. that's enough
+// for the visible and pre-rendered pages in all layouts
+constexpr int kMaxContentsLists = 8;
+
+// records the page contents (without annotations, which can be modified)
+// into a display list on first use, so that rendering low-resolution previews
+// and then tiles of the same page only interprets the contents once.
+// must be called with ctxAccess held. the list is owned by pageInfo
+fz_display_list* EngineMupdf::GetContentsList(FzPageInfo* pageInfo, fz_cookie* cookie) {
+    if (pageInfo->contentsList) {
+        pagesWithList.Remove(pageInfo);
+        pagesWithList.Append(pageInfo);
+        return pageInfo->contentsList;
+    }
+
+    auto ctx = Ctx();
+    fz_page* page = pageInfo->page;
+    fz_display_list* list = nullptr;
+    fz_device* dev = nullptr;
+    fz_var(list);
+    fz_var(dev);
+    fz_try(ctx) {
+        list = fz_new_display_list(ctx, fz_bound_page(ctx, page));
+        dev = fz_new_list_device(ctx, list);
+        if (pdfdoc) {
+            pdf_page* pdfpage = pdf_page_from_fz_page(ctx, page);
+            pdf_run_page_contents_with_usage(ctx, pdfpage, dev, fz_identity, "View", cookie);
+        } else {
+            fz_run_page_contents(ctx, page, dev, fz_identity, cookie);
+        }
+        fz_close_device(ctx, dev);
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+        fz_drop_display_list(ctx, list);
+        return nullptr;
+    }
+    // an aborted rendering leaves an incomplete list
+    if (cookie && cookie->abort) {
+        fz_drop_display_list(ctx, list);
+        return nullptr;
+    }
+
+    if ((int)pagesWithList.Size() >= kMaxContentsLists) {
+        FzPageInfo* oldest = pagesWithList.PopAt(0);
+        fz_drop_display_list(ctx, oldest->contentsList);
+        oldest->contentsList = nullptr;
+    }
+    pageInfo->contentsList = list;
+    pagesWithList.Append(pageInfo);
+    return list;
+}
+
 RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
     auto ctx = Ctx();
     auto pageNo = args.pageNo;
@@ -2920,7 +3564,17 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
             // TODO: in printing different style. old code use pdf_run_page_with_usage(), with usage ="View"
             // or "Print". "Export" is not used
             dev = fz_new_draw_device(ctx, ctm, pix);
-            pdf_run_page_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+            fz_display_list* list = nullptr;
+            if (args.target == RenderTarget::View) {
+                list = GetContentsList(pageInfo, fzcookie);
+            }
+            if (list) {
+                fz_run_display_list(ctx, list, dev, fz_identity, pRect, fzcookie);
+                pdf_run_page_annots_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+                pdf_run_page_widgets_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+            } else {
+                pdf_run_page_with_usage(ctx, pdfpage, dev, fz_identity, usage, fzcookie);
+            }
             bitmap = NewRenderedFzPixmap(ctx, pix);
             fz_close_device(ctx, dev);
         }
@@ -2944,7 +3598,12 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
             // fz_clear_pixmap(ctx, pix);
             // fz_fill_pixmap_with_color(ctx, pix, )
             dev = fz_new_draw_device(ctx, ctm, pix);
-            fz_run_page_contents(ctx, page, dev, fz_identity, NULL);
+            fz_display_list* list = GetContentsList(pageInfo, fzcookie);
+            if (list) {
+                fz_run_display_list(ctx, list, dev, fz_identity, pRect, fzcookie);
+            } else {
+                fz_run_page_contents(ctx, page, dev, fz_identity, NULL);
+            }
             fz_close_device(ctx, dev);
             fz_drop_device(ctx, dev);
             bitmap = NewRenderedFzPixmap(ctx, pix);
@@ -2965,7 +3624,13 @@ RenderedBitmap* EngineMupdf::RenderPage(RenderPageArgs& args) {
 // don't delete the result
 IPageElement* EngineMupdf::GetElementAtPos(int pageNo, PointF pt) {
     FzPageInfo* pageInfo = GetFzPageInfoCanFail(pageNo);
-    return FzGetElementAtPos(pageInfo, pt);
+    if (!pageInfo || !TryEnterCriticalSection(&pagesAccess)) {
+        return nullptr;
+    }
+    BuildElementsInfo(pageInfo);
+    IPageElement* res = FzGetElementAtPos(pageInfo, pt);
+    LeaveCriticalSection(&pagesAccess);
+    return res;
 }
 
 // TOOD: optimize by returning reference or pointer so that
@@ -2976,6 +3641,7 @@ Vec<IPageElement*> EngineMupdf::GetElements(int pageNo) {
         return Vec<IPageElement*>();
     }
 
+    ScopedCritSec scope(&pagesAccess);
     BuildElementsInfo(pageInfo);
     return pageInfo->allElements;
 }
@@ -3053,6 +3719,71 @@ bool EngineMupdf::BenchLoadPage(int pageNo) {
     return GetFzPageInfo(pageNo, false) != nullptr;
 }
 
+// decodes an image the same way the draw device does, which leaves the
+// decoded (and possibly subsampled) tile in the store for rendering
+static void PreloadImage(fz_context* ctx, fz_image* image, fz_matrix ctm) {
+    fz_pixmap* pix = nullptr;
+    fz_var(pix);
+    fz_try(ctx) {
+        int dx, dy;
+        pix = fz_get_pixmap_from_image(ctx, image, nullptr, &ctm, &dx, &dy);
+    }
+    fz_always(ctx) {
+        fz_drop_pixmap(ctx, pix);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+    }
+}
+
+static void PreloadFillImage(fz_context* ctx, fz_device*, fz_image* image, fz_matrix ctm, float, fz_color_params) {
+    PreloadImage(ctx, image, ctm);
+}
+
+static void PreloadFillImageMask(fz_context* ctx, fz_device*, fz_image* image, fz_matrix ctm, fz_colorspace*,
+                                 const float*, float, fz_color_params) {
+    PreloadImage(ctx, image, ctm);
+}
+
+static void PreloadClipImageMask(fz_context* ctx, fz_device*, fz_image* image, fz_matrix ctm, fz_rect) {
+    PreloadImage(ctx, image, ctm);
+}
+
+// loading fully also runs the page through the stext device, which loads
+// all fonts. images are only decoded when drawn, so for pages with images
+// the content is run once more to decode them at the resolution they'll
+// be rendered at
+bool EngineMupdf::PreloadPage(int pageNo, float zoom, int rotation) {
+    FzPageInfo* pageInfo = GetFzPageInfo(pageNo, false);
+    if (!pageInfo || !pageInfo->page) {
+        return false;
+    }
+    if (pageInfo->images.Size() == 0) {
+        return true;
+    }
+
+    auto ctx = Ctx();
+    ScopedCritSec cs(ctxAccess);
+    fz_device* dev = nullptr;
+    fz_var(dev);
+    fz_try(ctx) {
+        dev = fz_new_device_of_size(ctx, sizeof(fz_device));
+        dev->fill_image = PreloadFillImage;
+        dev->fill_image_mask = PreloadFillImageMask;
+        dev->clip_image_mask = PreloadClipImageMask;
+        fz_page* page = pageInfo->page;
+        fz_run_page(ctx, page, dev, viewctm(page, zoom, rotation), nullptr);
+        fz_close_device(ctx, dev);
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+    }
+    fz_catch(ctx) {
+        fz_report_error(ctx);
+    }
+    return true;
+}
+
 fz_matrix EngineMupdf::viewctm(int pageNo, float zoom, int rotation) {
     const fz_rect tmpRc = ToFzRect(PageMediabox(pageNo));
     return FzCreateViewCtm(tmpRc, zoom, rotation);
@@ -3643,8 +4374,7 @@ TempStr EngineMupdf::GetPageLabeTemp(int pageNo) const {
         return EngineBase::GetPageLabeTemp(pageNo);
     }
 
-    char* res = pageLabels->At(pageNo - 1);
-    return res;
+    return pageLabels->GetLabelTemp(pageNo);
 }
 
 int EngineMupdf::GetPageByLabel(const char* label) const {
@@ -3654,7 +4384,7 @@ int EngineMupdf::GetPageByLabel(const char* label) const {
     }
     int pageNo = 0;
     if (pageLabels) {
-        pageNo = pageLabels->Find(label) + 1;
+        pageNo = pageLabels->GetPageByLabel(label);
     }
 
     if (!pageNo) {
@@ -3816,27 +4546,6 @@ ByteSlice EngineMupdfLoadAttachment(EngineBase* engine, int attachmentNo) {
     return res;
 }
 
-// if an elements fully obscures another, remove it from the list
-static bool RemoveHeWhoFullyContains(Vec<Annotation*>& els) {
-    int n = els.Size();
-    ReportIf(n < 2);
-    for (int i = 0; i < n; i++) {
-        RectF r1 = els[i]->bounds;
-        for (int j = 0; j < n; j++) {
-            if (j == i) {
-                continue; // skip checking against self
-            }
-            RectF r2 = els[j]->bounds;
-            if (RectFullyContains(r1, r2)) {
-                // logfa("el %d fully obscures %d\n", i, j);
-                els.RemoveAtFast(i);
-                return true;
-            }
-        }
-    }
-    return false;
-}
-
 Annotation* EngineMupdfGetAnnotationAtPos(EngineBase* engine, int pageNo, PointF pos, Annotation* preferredAnnot) {
     EngineMupdf* epdf = AsEngineMupdf(engine);
     if (!epdf->pdfdoc) {
@@ -3847,37 +4556,28 @@ Annotation* EngineMupdfGetAnnotationAtPos(EngineBase* engine, int pageNo, PointF
         return nullptr;
     }
 
+    ScopedCritSec ps(&epdf->pagesAccess);
     ScopedCritSec cs(epdf->ctxAccess);
-    Vec<Annotation*> els;
-    for (auto& annot : pi->annotations) {
-        auto& atp = annot->type;
+    BuildElementsInfo(pi);
+    Vec<int> candidates;
+    QueryRectGrid(pi->annotationsGrid, pos, candidates);
+
+    // pick the best
+    Annotation* res = nullptr;
+    for (int i : candidates) {
+        Annotation* annot = pi->annotations[i];
         RectF bounds = annot->bounds;
         if (!bounds.Contains(pos)) {
             continue;
         }
-        els.Append(annot);
-    }
-    if (els.Size() == 0) {
-        return nullptr;
-    }
-    for (const auto& a : els) {
-        if (a == preferredAnnot) {
+        if (annot == preferredAnnot) {
             return preferredAnnot;
         }
+        if (IsBetterHit(bounds, res ? res->bounds : RectF(), res != nullptr)) {
+            res = annot;
+        }
     }
-
-    // pick the best
-Encore:
-    int n = els.Size();
-    if (n == 1) {
-        return els[0];
-    }
-    bool didRemove = RemoveHeWhoFullyContains(els);
-    if (didRemove) {
-        ReportIf(els.Size() != n - 1);
-        goto Encore;
-    }
-    return els[0];
+    return res;
 }
 
 // Note: this code is compiled in release mode even if debug build so
@@ -3937,6 +4637,38 @@ NO_INLINE void MarkNotificationAsModified(EngineMupdf* e, Annotation* annot, Ann
     pageInfo->elementsNeedRebuilding = true;
 }
 
+// like MarkNotificationAsModified(AnnotationChange::Add) for many annotations
+// at once, but comments are only rebuilt once per affected page
+NO_INLINE void MarkNotificationAsAdded(EngineMupdf* e, const Vec<Annotation*>& annots) {
+    if (annots.IsEmpty()) {
+        return;
+    }
+    e->modifiedAnnotations = true;
+    if (!e->pdfdoc) {
+        return;
+    }
+
+    ScopedCritSec scope(&e->pagesAccess);
+    Vec<int> pageNos;
+    for (Annotation* annot : annots) {
+        int pageNo = annot->pageNo;
+        ReportIf(pageNo < 1 || pageNo > e->pageCount);
+        FzPageInfo* pageInfo = e->pages[pageNo - 1];
+        ReportIf(pageInfo->annotations.Find(annot) >= 0); // shouldn't exist
+        pageInfo->annotations.Append(annot);
+        if (!pageNos.Contains(pageNo)) {
+            pageNos.Append(pageNo);
+        }
+    }
+    auto ctx = e->Ctx();
+    for (int pageNo : pageNos) {
+        FzPageInfo* pageInfo = e->pages[pageNo - 1];
+        ValidateAnnotationsInSync(e, pageInfo);
+        RebuildCommentsFromAnnotations(ctx, pageInfo);
+        pageInfo->elementsNeedRebuilding = true;
+    }
+}
+
 // creates Annotation wrapper around pdf_annot
 Annotation* MakeAnnotationWrapper(EngineMupdf* engine, pdf_annot* annot, int pageNo) {
     ReportIf(pageNo < 1);
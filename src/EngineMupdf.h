@@ -2,6 +2,7 @@
    License: GPLv3 */
 
 struct Annotation;
+struct PageLabels;
 
 struct FitzPageImageInfo {
     fz_rect rect = fz_unit_rect;
@@ -12,6 +13,17 @@ struct FitzPageImageInfo {
     }
 };
 
+// uniform grid over rects of page elements, for point queries.
+// items are indexes into the Vec the grid was built from
+struct FzRectGrid {
+    RectF bounds{};
+    int cols = 0;
+    int rows = 0;
+    // items of cell i are items[cellStart[i]] .. items[cellStart[i + 1] - 1]
+    Vec<int> cellStart;
+    Vec<int> items;
+};
+
 struct FzPageInfo {
     int pageNo = 0; // 1-based
     fz_page* page = nullptr;
@@ -28,6 +40,14 @@ struct FzPageInfo {
     Vec<IPageElement*> comments;
 
     Vec<IPageElement*> allElements;
+    // links, autoLinks, comments and images (in that order) and their rects,
+    // indexed by elementsGrid
+    Vec<IPageElement*> hitTestElements;
+    Vec<RectF> hitTestRects;
+    FzRectGrid elementsGrid;
+    // indexes into annotations
+    FzRectGrid annotationsGrid;
+    // set when any of the above must be re-built by BuildElementsInfo()
     bool elementsNeedRebuilding = true;
 
     RectF mediabox{};
@@ -36,6 +56,21 @@ struct FzPageInfo {
     // if false, only loaded page (fast)
     // if true, loaded expensive info (extracted text etc.)
     bool fullyLoaded = false;
+
+    // page contents (without annotations) recorded when the page was rendered,
+    // so that previews and tiles don't all have to interpret the contents again.
+    // only kept for the most recently rendered pages
+    fz_display_list* contentsList = nullptr;
+};
+
+class EngineMupdf;
+
+// creates the destinations of outline or attachment items on first use
+struct MupdfTocDests : TocDestResolver {
+    EngineMupdf* engine = nullptr;
+    bool isAttachment = false;
+
+    IPageDestination* ResolveTocDest(TocItem*) override;
 };
 
 class EngineMupdf : public EngineBase {
@@ -61,6 +96,7 @@ class EngineMupdf : public EngineBase {
     TempStr GetPropertyTemp(const char* name) override;
 
     bool BenchLoadPage(int pageNo) override;
+    bool PreloadPage(int pageNo, float zoom, int rotation) override;
 
     Vec<IPageElement*> GetElements(int pageNo) override;
     IPageElement* GetElementAtPos(int pageNo, PointF pt) override;
@@ -74,6 +110,9 @@ class EngineMupdf : public EngineBase {
     TempStr GetPageLabeTemp(int pageNo) const override;
     int GetPageByLabel(const char* label) const override;
 
+    bool GetFingerprint(u8 digestOut[16]) override;
+    bool GetReflowLayout(float* dx, float* dy, float* fontDy) override;
+
     fz_context* Ctx() const;
 
     // make sure to never ask for pagesAccess in an ctxAccess
@@ -90,12 +129,31 @@ class EngineMupdf : public EngineBase {
     pdf_document* pdfdoc = nullptr;
     fz_stream* docStream = nullptr;
     Vec<FzPageInfo*> pages;
+    // pages with a contentsList, least recently rendered first
+    Vec<FzPageInfo*> pagesWithList;
     fz_outline* outline = nullptr;
     fz_outline* attachments = nullptr;
     pdf_obj* pdfInfo = nullptr;
-    StrVec* pageLabels = nullptr;
+    PageLabels* pageLabels = nullptr;
 
     TocTree* tocTree = nullptr;
+    MupdfTocDests outlineDests;
+    MupdfTocDests attachmentDests;
+
+    // MD5 of the file, calculated on demand
+    u8 fingerprint[16]{};
+    bool hasFingerprint = false;
+
+    // where to save the layout accelerator (EPUB) or repair data (damaged PDF)
+    // after loading, if there wasn't one
+    char* acceleratorPath = nullptr;
+
+    // identifies the file in the cache of auto-detected links, calculated on demand
+    char* linksCacheKey = nullptr;
+    // page size and font size of reflowable documents (EPUB etc.), 0 for others
+    float layoutDx = 0;
+    float layoutDy = 0;
+    float layoutFontDy = 0;
 
     // used to track "dirty" state of annotations. not perfect because if we add and delete
     // the same annotation, we should be back to 0
@@ -112,9 +170,10 @@ class EngineMupdf : public EngineBase {
     FzPageInfo* GetFzPageInfoCanFail(int pageNo);
     FzPageInfo* GetFzPageInfoFast(int pageNo);
     FzPageInfo* GetFzPageInfo(int pageNo, bool loadQuick, fz_cookie* cookie = nullptr);
+    fz_display_list* GetContentsList(FzPageInfo* pageInfo, fz_cookie* cookie);
     fz_matrix viewctm(int pageNo, float zoom, int rotation);
     fz_matrix viewctm(fz_page* page, float zoom, int rotation) const;
-    TocItem* BuildTocTree(TocItem* parent, fz_outline* outline, int& idCounter, bool isAttachment);
+    TocItem* BuildTocTree(TocTree* tree, fz_outline* outline, int& idCounter, bool isAttachment);
     TempStr ExtractFontListTemp();
 
     ByteSlice LoadStreamFromPDFFile(const char* filePath);
@@ -122,10 +181,22 @@ class EngineMupdf : public EngineBase {
 
 EngineMupdf* AsEngineMupdf(EngineBase* engine);
 
+// URLs and email addresses found in page text by LinkifyText(). a link that
+// continues on the next line has one entry per line, all with the same URL
+struct LinkRectList {
+    StrVec links;
+    Vec<fz_rect> coords;
+};
+
+bool LinkifyHasCandidates(const WCHAR* pageText, int len);
+// skipToCandidates is only for comparing against the unfiltered scan
+void LinkifyText(LinkRectList& list, const WCHAR* pageText, int len, Rect* coords, bool skipToCandidates = true);
+
 fz_rect ToFzRect(RectF rect);
 RectF ToRectF(fz_rect rect);
 RenderedBitmap* NewRenderedFzPixmap(fz_context* ctx, fz_pixmap* pixmap);
 void MarkNotificationAsModified(EngineMupdf*, Annotation*, AnnotationChange = AnnotationChange::Modify);
+void MarkNotificationAsAdded(EngineMupdf*, const Vec<Annotation*>& annots);
 Annotation* MakeAnnotationWrapper(EngineMupdf* engine, pdf_annot* annot, int pageNo);
 
 void InitializeEngineMupdf();
@@ -39,6 +39,7 @@
     V(WithPreview, "with-preview")               \
     V(Rand, "rand")                              \
     V(Regress, "regress")                        \
+    V(FastScroll, "fast-scroll")                 \
     V(Extract, "x")                              \
     V(Tester, "tester")                          \
     V(TestApp, "testapp")                        \
@@ -93,7 +94,9 @@
     V(UserAppDDETopic, "userapp-dde-topic")      \
     V(UserAppDDEDebugTopic, "userapp-dde-debug-topic") \
     V(DocumentMode, "document-mode") \
-    V(ExportTextBlocks, "export-text-blocks")
+    V(ExportTextBlocks, "export-text-blocks")    \
+    V(SharedStore, "shared-store")               \
+    V(PerfTest, "perf-test")
 
 #define MAKE_ARG(__arg, __name) __arg,
 #define MAKE_STR(__arg, __name) __name "\0"
@@ -458,6 +461,10 @@ void ParseFlags(const WCHAR* cmdLine, Flags& i) {
             i.stressRandomizeFiles = true;
             continue;
         }
+        if (arg == Arg::FastScroll) {
+            i.stressFastScroll = true;
+            continue;
+        }
         if (arg == Arg::Regress) {
             i.regress = true;
             continue;
@@ -724,6 +731,16 @@ void ParseFlags(const WCHAR* cmdLine, Flags& i) {
             i.export_text_blocks = str::Dup(param);
             continue;
         }
+        if (arg == Arg::SharedStore) {
+            // -shared-store <MB>
+            i.sharedStoreMB = paramInt;
+            continue;
+        }
+        if (arg == Arg::PerfTest) {
+            // -perf-test <name>, see RunPerfTest()
+            i.perfTest = str::Dup(param);
+            continue;
+        }
         // again, argName is any of the known args, so assume it's a file starting with '-'
         args.RewindParam();
 
@@ -768,4 +785,5 @@ Flags::~Flags() {
     str::Free(pdfsync_dde_topic);
     str::Free(userapp_dde_service);
     str::Free(userapp_dde_topic);
+    str::Free(perfTest);
 }
@@ -78,6 +78,9 @@ struct Flags {
     int stressTestCycles = 1;
     int stressParallelCount = 1;
     bool stressRandomizeFiles = false;
+    // scroll through documents instead of jumping between pages
+    // and measure how long it takes for pages to be rendered
+    bool stressFastScroll = false;
     int stressTestMax = 0;
 
     // related to testing
@@ -134,6 +137,10 @@ struct Flags {
 #endif
     bool document_mode = false;  // CPS Lab.
     char* export_text_blocks = nullptr;  // CPS Lab.
+    // if > 0, all mupdf engines share one store of that many MB
+    int sharedStoreMB = 0;
+    // name of a performance test to run (debug builds only)
+    char* perfTest = nullptr;
 
     Flags() = default;
     ~Flags();
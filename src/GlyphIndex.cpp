@@ -0,0 +1,264 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+#include "utils/BaseUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "DocController.h"
+#include "EngineBase.h"
+#include "TextSelection.h"
+#include "GlyphIndex.h"
+
+// aim for about this many glyphs per cell
+constexpr int kGlyphsPerCell = 2;
+constexpr int kMaxGridSize = 256;
+
+// glyphs without a box (e.g. line breaks) are never hit
+static bool IsIndexedGlyph(const Rect& r) {
+    return r.x || r.dx;
+}
+
+// glyph boxes can have negative dx/dy
+static Rect NormalizeRect(const Rect& r) {
+    int x0 = std::min(r.x, r.x + r.dx);
+    int y0 = std::min(r.y, r.y + r.dy);
+    return Rect(x0, y0, abs(r.dx), abs(r.dy));
+}
+
+static int FloorDiv(int a, int b) {
+    int q = a / b;
+    if ((a % b != 0) && (a < 0)) {
+        q--;
+    }
+    return q;
+}
+
+static int CellCol(const PageGlyphIndex* idx, int x) {
+    return FloorDiv(x - idx->bounds.x, idx->cellDx);
+}
+
+static int CellRow(const PageGlyphIndex* idx, int y) {
+    return FloorDiv(y - idx->bounds.y, idx->cellDy);
+}
+
+// calls fn(cellNo) for all cells overlapped by r, which must be normalized
+template <typename Fn>
+static void ForEachCell(const PageGlyphIndex* idx, const Rect& r, const Fn& fn) {
+    int col0 = std::max(CellCol(idx, r.x), 0);
+    int col1 = std::min(CellCol(idx, r.x + r.dx), idx->cols - 1);
+    int row0 = std::max(CellRow(idx, r.y), 0);
+    int row1 = std::min(CellRow(idx, r.y + r.dy), idx->rows - 1);
+    for (int row = row0; row <= row1; row++) {
+        for (int col = col0; col <= col1; col++) {
+            fn(row * idx->cols + col);
+        }
+    }
+}
+
+PageGlyphIndex* NewPageGlyphIndex(const PageGlyphs* glyphs) {
+    auto idx = new PageGlyphIndex();
+    int n = glyphs->len;
+    GlyphCursor cursor(glyphs);
+    int nIndexed = 0;
+    for (int i = 0; i < n; i++) {
+        Rect r = cursor.At(i);
+        if (!IsIndexedGlyph(r)) {
+            continue;
+        }
+        Rect nr = NormalizeRect(r);
+        if (nIndexed == 0) {
+            idx->bounds = nr;
+        } else {
+            // Rect::Union() ignores empty rects, zero-width glyphs must count
+            int x1 = std::max(idx->bounds.x + idx->bounds.dx, nr.x + nr.dx);
+            int y1 = std::max(idx->bounds.y + idx->bounds.dy, nr.y + nr.dy);
+            idx->bounds.x = std::min(idx->bounds.x, nr.x);
+            idx->bounds.y = std::min(idx->bounds.y, nr.y);
+            idx->bounds.dx = x1 - idx->bounds.x;
+            idx->bounds.dy = y1 - idx->bounds.y;
+        }
+        nIndexed++;
+    }
+    if (nIndexed == 0) {
+        return idx;
+    }
+
+    // pick a cell shape that roughly follows the aspect ratio of the text
+    int dx = std::max(idx->bounds.dx, 1);
+    int dy = std::max(idx->bounds.dy, 1);
+    double nCells = std::max(1.0, (double)nIndexed / kGlyphsPerCell);
+    double aspect = (double)dx / (double)dy;
+    idx->cols = std::clamp((int)sqrt(nCells * aspect), 1, kMaxGridSize);
+    idx->rows = std::clamp((int)(nCells / idx->cols), 1, kMaxGridSize);
+    idx->cellDx = std::max((dx + idx->cols - 1) / idx->cols, 1);
+    idx->cellDy = std::max((dy + idx->rows - 1) / idx->rows, 1);
+
+    // compressed sparse rows: count glyphs per cell, then fill
+    int cellCount = idx->cols * idx->rows;
+    idx->cellStart = AllocArray<int>((size_t)cellCount + 1);
+    cursor = GlyphCursor(glyphs);
+    for (int i = 0; i < n; i++) {
+        Rect r = cursor.At(i);
+        if (IsIndexedGlyph(r)) {
+            ForEachCell(idx, NormalizeRect(r), [&](int cell) { idx->cellStart[cell + 1]++; });
+        }
+    }
+    for (int i = 0; i < cellCount; i++) {
+        idx->cellStart[i + 1] += idx->cellStart[i];
+    }
+    idx->glyphs = AllocArray<int>((size_t)idx->cellStart[cellCount] + 1);
+    int* fill = AllocArray<int>((size_t)cellCount);
+    cursor = GlyphCursor(glyphs);
+    for (int i = 0; i < n; i++) {
+        Rect r = cursor.At(i);
+        if (IsIndexedGlyph(r)) {
+            ForEachCell(idx, NormalizeRect(r), [&](int cell) {
+                idx->glyphs[idx->cellStart[cell] + fill[cell]++] = i;
+            });
+        }
+    }
+    free(fill);
+    return idx;
+}
+
+void FreePageGlyphIndex(PageGlyphIndex* idx) {
+    if (!idx) {
+        return;
+    }
+    free(idx->cellStart);
+    free(idx->glyphs);
+    delete idx;
+}
+
+size_t PageGlyphIndex::MemSize() const {
+    if (!cellStart) {
+        return sizeof(*this);
+    }
+    int cellCount = cols * rows;
+    return sizeof(*this) + ((size_t)cellCount + 1 + cellStart[cellCount]) * sizeof(int);
+}
+
+// (dist, glyph index) pairs are compared lexicographically, so that the
+// result is the same as the one of a linear scan in glyph order
+static bool IsCloser(uint dist, int i, uint bestDist, int best) {
+    return best < 0 || dist < bestDist || (dist == bestDist && i < best);
+}
+
+static uint GlyphDistSq(const Rect& r, double x, double y) {
+    return distSq((int)x - r.x - r.dx / 2, (int)y - r.y - r.dy / 2);
+}
+
+// returns the index of the glyph closest to (x, y) or -1 if no glyph has a box.
+// glyphs containing the point are preferred over those merely close to it
+int GlyphIndexFindClosest(const PageGlyphIndex* idx, const PageGlyphs* glyphs, double x, double y) {
+    if (idx->cols == 0) {
+        return -1;
+    }
+    int best = -1;
+    uint bestDist = UINT_MAX;
+
+    // glyphs containing the point can only be in the point's cell
+    Point pti = ToPoint(PointF(x, y));
+    int col = CellCol(idx, pti.x);
+    int row = CellRow(idx, pti.y);
+    if (col >= 0 && col < idx->cols && row >= 0 && row < idx->rows) {
+        int cell = row * idx->cols + col;
+        for (int k = idx->cellStart[cell]; k < idx->cellStart[cell + 1]; k++) {
+            int i = idx->glyphs[k];
+            Rect r = glyphs->At(i);
+            if (!r.Contains(pti)) {
+                continue;
+            }
+            uint dist = GlyphDistSq(r, x, y);
+            if (IsCloser(dist, i, bestDist, best)) {
+                best = i;
+                bestDist = dist;
+            }
+        }
+    }
+    if (best >= 0) {
+        return best;
+    }
+
+    // otherwise search rings of cells around the point's cell until no closer
+    // glyph center can be in the remaining rings
+    int px = (int)x;
+    int py = (int)y;
+    int gx = CellCol(idx, px);
+    int gy = CellRow(idx, py);
+    // rings closer than this don't contain any cells of the grid
+    int firstRing = std::max(std::max(-gx, gx - (idx->cols - 1)), std::max(-gy, gy - (idx->rows - 1)));
+    for (int ring = std::max(firstRing, 0);; ring++) {
+        if (best >= 0 && ring > 0) {
+            // the point is inside the square of cells already searched
+            int left = idx->bounds.x + (gx - ring + 1) * idx->cellDx;
+            int right = idx->bounds.x + (gx + ring) * idx->cellDx;
+            int top = idx->bounds.y + (gy - ring + 1) * idx->cellDy;
+            int bottom = idx->bounds.y + (gy + ring) * idx->cellDy;
+            i64 minDist = std::min(std::min(px - left, right - px), std::min(py - top, bottom - py));
+            if (minDist > 0 && (u64)(minDist * minDist) > (u64)bestDist) {
+                break;
+            }
+        }
+        auto searchCell = [&](int c, int r) {
+            if (c < 0 || c >= idx->cols || r < 0 || r >= idx->rows) {
+                return;
+            }
+            int cell = r * idx->cols + c;
+            for (int k = idx->cellStart[cell]; k < idx->cellStart[cell + 1]; k++) {
+                int i = idx->glyphs[k];
+                uint dist = GlyphDistSq(glyphs->At(i), x, y);
+                if (IsCloser(dist, i, bestDist, best)) {
+                    best = i;
+                    bestDist = dist;
+                }
+            }
+        };
+        int col0 = std::max(gx - ring, 0);
+        int col1 = std::min(gx + ring, idx->cols - 1);
+        int row0 = std::max(gy - ring, 0);
+        int row1 = std::min(gy + ring, idx->rows - 1);
+        for (int c = col0; c <= col1; c++) {
+            searchCell(c, gy - ring);
+            if (ring > 0) {
+                searchCell(c, gy + ring);
+            }
+        }
+        for (int r = std::max(gy - ring + 1, row0); r <= std::min(gy + ring - 1, row1); r++) {
+            searchCell(gx - ring, r);
+            if (ring > 0) {
+                searchCell(gx + ring, r);
+            }
+        }
+        bool coversGrid = gx - ring <= 0 && gx + ring >= idx->cols - 1 && gy - ring <= 0 && gy + ring >= idx->rows - 1;
+        if (coversGrid) {
+            break;
+        }
+    }
+    return best;
+}
+
+// returns (sorted) indexes of glyphs whose boxes might intersect r
+void GlyphIndexQueryRect(const PageGlyphIndex* idx, Rect r, Vec<int>& res) {
+    res.Reset();
+    if (idx->cols == 0) {
+        return;
+    }
+    ForEachCell(idx, NormalizeRect(r), [&](int cell) {
+        for (int k = idx->cellStart[cell]; k < idx->cellStart[cell + 1]; k++) {
+            res.Append(idx->glyphs[k]);
+        }
+    });
+    // glyphs spanning several cells are listed more than once
+    std::sort(res.begin(), res.end());
+    int n = 0;
+    for (int i = 0; i < res.Size(); i++) {
+        if (n == 0 || res[n - 1] != res[i]) {
+            res[n++] = res[i];
+        }
+    }
+    if (n < res.Size()) {
+        res.RemoveAt(n, res.size() - n);
+    }
+}
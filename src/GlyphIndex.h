@@ -0,0 +1,25 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// uniform grid over the glyph boxes of a page, for hit-testing and
+// region queries without scanning all glyphs of the page.
+// built lazily by DocumentTextCache::GetGlyphIndex()
+struct PageGlyphIndex {
+    // union of all indexed glyph boxes
+    Rect bounds;
+    int cols = 0;
+    int rows = 0;
+    int cellDx = 1;
+    int cellDy = 1;
+    // glyphs of cell i are glyphs[cellStart[i]] .. glyphs[cellStart[i + 1] - 1]
+    int* cellStart = nullptr;
+    int* glyphs = nullptr;
+
+    size_t MemSize() const;
+};
+
+PageGlyphIndex* NewPageGlyphIndex(const PageGlyphs* glyphs);
+void FreePageGlyphIndex(PageGlyphIndex*);
+
+int GlyphIndexFindClosest(const PageGlyphIndex* idx, const PageGlyphs* glyphs, double x, double y);
+void GlyphIndexQueryRect(const PageGlyphIndex* idx, Rect r, Vec<int>& res);
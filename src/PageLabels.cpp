@@ -0,0 +1,309 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+#include "utils/BaseUtil.h"
+#include "utils/Dict.h"
+
+#include "PageLabels.h"
+
+static TempStr FormatPageLabelTemp(char style, int pageNo, const char* prefix) {
+    if (style == 'D') {
+        return str::FormatTemp("%s%d", prefix, pageNo);
+    }
+    if (style == 'R' || style == 'r') {
+        // roman numbering style
+        TempStr number = str::FormatRomanNumeralTemp(pageNo);
+        if (style == 'r') {
+            str::ToLowerInPlace(number);
+        }
+        return str::FormatTemp("%s%s", prefix, number);
+    }
+    if (style == 'A' || style == 'a') {
+        // alphabetic numbering style (A..Z, AA..ZZ, AAA..ZZZ, ...)
+        str::Str number;
+        number.AppendChar('A' + (pageNo - 1) % 26);
+        for (int i = 0; i < (pageNo - 1) / 26; i++) {
+            number.AppendChar(number.at(0));
+        }
+        if (style == 'a') {
+            str::ToLowerInPlace(number.Get());
+        }
+        return str::FormatTemp("%s%s", prefix, number.Get());
+    }
+    return str::DupTemp(prefix);
+}
+
+static int RomanDigitValue(char c) {
+    switch (c) {
+        case 'I':
+            return 1;
+        case 'V':
+            return 5;
+        case 'X':
+            return 10;
+        case 'L':
+            return 50;
+        case 'C':
+            return 100;
+        case 'D':
+            return 500;
+        case 'M':
+            return 1000;
+    }
+    return 0;
+}
+
+// reverts FormatPageLabelTemp(style, n, "") by returning n.
+// returns -1 if s isn't formatted that way (and 0 for an empty s and no style)
+static int ParseLabelNumber(char style, const char* s) {
+    if (style == 0) {
+        return *s ? -1 : 0;
+    }
+    if (style == 'D') {
+        // no sign, no leading zeros
+        if (*s < '1' || *s > '9') {
+            return -1;
+        }
+        i64 n = 0;
+        for (; *s; s++) {
+            if (*s < '0' || *s > '9') {
+                return -1;
+            }
+            n = n * 10 + (*s - '0');
+            if (n > INT_MAX) {
+                return -1;
+            }
+        }
+        return (int)n;
+    }
+    if (style == 'R' || style == 'r') {
+        bool lower = style == 'r';
+        i64 n = 0;
+        for (const char* c = s; *c; c++) {
+            if (lower != (*c >= 'a' && *c <= 'z')) {
+                return -1;
+            }
+            int val = RomanDigitValue(lower ? (char)(*c - 'a' + 'A') : *c);
+            if (val == 0) {
+                return -1;
+            }
+            int next = c[1] ? RomanDigitValue(lower ? (char)(c[1] - 'a' + 'A') : c[1]) : 0;
+            n += (val < next) ? -val : val;
+            if (n > INT_MAX) {
+                return -1;
+            }
+        }
+        // only accept the numerals FormatRomanNumeralTemp() creates
+        if (n < 1 || !str::EqI(str::FormatRomanNumeralTemp((int)n), s)) {
+            return -1;
+        }
+        return (int)n;
+    }
+    if (style == 'A' || style == 'a') {
+        char first = (style == 'A') ? 'A' : 'a';
+        char c = *s;
+        if (c < first || c > first + 25) {
+            return -1;
+        }
+        size_t len = str::Len(s);
+        for (size_t i = 1; i < len; i++) {
+            if (s[i] != c) {
+                return -1;
+            }
+        }
+        if (len > (size_t)(INT_MAX / 26)) {
+            return -1;
+        }
+        return (int)(len - 1) * 26 + (c - first) + 1;
+    }
+    return -1;
+}
+
+// compares prefix with the first n chars of s the way strcmp() would
+static int CmpPrefix(const char* prefix, const char* s, size_t n) {
+    int res = strncmp(prefix, s, n);
+    if (res != 0) {
+        return res;
+    }
+    return prefix[n] ? 1 : 0;
+}
+
+PageLabels::PageLabels(int pageCount) {
+    this->pageCount = pageCount;
+}
+
+PageLabels::~PageLabels() {
+    delete relabeledPages;
+}
+
+void PageLabels::AddRange(int startAt, const char* style, const char* prefix, int countFrom) {
+    if (startAt < 1) {
+        return;
+    }
+    PageLabelRange r;
+    r.startAt = startAt;
+    // the numbers of all pages must fit in an int
+    r.countFrom = std::clamp(countFrom, 1, INT_MAX - pageCount);
+    if (str::Eq(style, "D") || str::Eq(style, "R") || str::Eq(style, "r") || str::Eq(style, "A") ||
+        str::Eq(style, "a")) {
+        r.style = *style;
+    }
+    r.prefix = prefix ? str::Dup(&allocator, prefix) : nullptr;
+    ranges.Append(r);
+}
+
+bool PageLabels::Finish(bool ensureUnique) {
+    int n = ranges.Size();
+    if (n == 0) {
+        return false;
+    }
+    PageLabelRange& r0 = ranges[0];
+    if (n == 1 && r0.startAt == 1 && r0.countFrom == 1 && !r0.prefix && r0.style == 'D') {
+        // this is the default case, no need for special treatment
+        return false;
+    }
+
+    std::stable_sort(ranges.begin(), ranges.end(),
+                     [](const PageLabelRange& a, const PageLabelRange& b) { return a.startAt < b.startAt; });
+    Vec<PageLabelRange> used;
+    for (int i = 0; i < n; i++) {
+        PageLabelRange r = ranges[i];
+        if (r.startAt > pageCount) {
+            break;
+        }
+        if (i + 1 < n && ranges[i + 1].startAt == r.startAt) {
+            // replaced by the next range
+            continue;
+        }
+        if (!r.prefix) {
+            r.prefix = "";
+        }
+        used.Append(r);
+    }
+    if (used.Size() == 0 || used[0].startAt > 1) {
+        // pages before the first range have empty labels
+        PageLabelRange empty;
+        empty.startAt = 1;
+        empty.prefix = "";
+        used.InsertAt(0, empty);
+    }
+    ranges.Reset();
+    ranges.Append(used);
+
+    byPrefix.Reset();
+    for (int i = 0; i < ranges.Size(); i++) {
+        byPrefix.Append(i);
+    }
+    std::sort(byPrefix.begin(), byPrefix.end(), [this](int a, int b) {
+        int cmp = strcmp(ranges[a].prefix, ranges[b].prefix);
+        return cmp != 0 ? cmp < 0 : a < b;
+    });
+
+    if (!ensureUnique) {
+        return true;
+    }
+    // give the later pages with the same label a unique one (by appending a number)
+    // counters are by the first page with the label, allocated once there's a duplicate
+    Vec<int> counters;
+    for (int pageNo = 1; pageNo <= pageCount; pageNo++) {
+        TempStr label = GetLabelTemp(pageNo);
+        int firstPageNo = GetPageByOriginalLabel(label);
+        if (firstPageNo == pageNo) {
+            continue;
+        }
+        if (!relabeledPages) {
+            relabeledPages = new dict::MapStrToInt(64);
+            counters.AppendBlanks(pageCount + 1);
+        }
+        TempStr unique = nullptr;
+        do {
+            unique = str::FormatTemp("%s.%d", label, ++counters[firstPageNo]);
+        } while (GetPageByLabel(unique) != 0);
+        const char* key = nullptr;
+        relabeledPages->Insert(unique, pageNo, nullptr, &key);
+        relabeled.Append({pageNo, key});
+    }
+    return true;
+}
+
+int PageLabels::RangeLen(int rangeIdx) const {
+    int end = (rangeIdx + 1 < ranges.Size()) ? ranges[rangeIdx + 1].startAt : pageCount + 1;
+    return end - ranges[rangeIdx].startAt;
+}
+
+// index of the range pageNo belongs to
+int PageLabels::FindRange(int pageNo) const {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), pageNo,
+                               [](int pageNo, const PageLabelRange& r) { return pageNo < r.startAt; });
+    return (int)(it - ranges.begin()) - 1;
+}
+
+TempStr PageLabels::GetLabelTemp(int pageNo) const {
+    if (pageNo < 1 || pageNo > pageCount || ranges.Size() == 0) {
+        return nullptr;
+    }
+    if (relabeled.Size() > 0) {
+        auto it = std::lower_bound(relabeled.begin(), relabeled.end(), pageNo,
+                                   [](const Relabeled& r, int pageNo) { return r.pageNo < pageNo; });
+        if (it != relabeled.end() && it->pageNo == pageNo) {
+            return str::DupTemp(it->label);
+        }
+    }
+    const PageLabelRange& r = ranges[FindRange(pageNo)];
+    return FormatPageLabelTemp(r.style, r.countFrom + (pageNo - r.startAt), r.prefix);
+}
+
+// a label is <prefix><number>: for each way of splitting the label, binary
+// search the ranges with that prefix and check if the number is in them
+int PageLabels::GetPageByOriginalLabel(const char* label) const {
+    int res = 0;
+    int nRanges = byPrefix.Size();
+    size_t len = str::Len(label);
+    for (size_t prefixLen = 0; prefixLen <= len; prefixLen++) {
+        // first range with a prefix >= label[0..prefixLen]
+        int lo = 0;
+        int hi = nRanges;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (CmpPrefix(ranges[byPrefix[mid]].prefix, label, prefixLen) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        const char* number = label + prefixLen;
+        for (int i = lo; i < nRanges; i++) {
+            int rangeIdx = byPrefix[i];
+            const PageLabelRange& r = ranges[rangeIdx];
+            if (CmpPrefix(r.prefix, label, prefixLen) != 0) {
+                break;
+            }
+            int n = ParseLabelNumber(r.style, number);
+            if (n < 0) {
+                continue;
+            }
+            int pageNo = r.startAt;
+            if (r.style != 0) {
+                if (n < r.countFrom || n - r.countFrom >= RangeLen(rangeIdx)) {
+                    continue;
+                }
+                pageNo += n - r.countFrom;
+            }
+            if (res == 0 || pageNo < res) {
+                res = pageNo;
+            }
+        }
+    }
+    return res;
+}
+
+int PageLabels::GetPageByLabel(const char* label) const {
+    if (!label) {
+        return 0;
+    }
+    int pageNo = 0;
+    if (relabeledPages && relabeledPages->Get(label, &pageNo)) {
+        return pageNo;
+    }
+    return GetPageByOriginalLabel(label);
+}
@@ -0,0 +1,58 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// page labels of a pdf document (/PageLabels in the catalog), kept as the few
+// ranges they're defined by instead of a string per page. Labels are formatted
+// on demand and GetPageByLabel() parses the label and binary searches the ranges
+
+namespace dict {
+class MapStrToInt;
+}
+
+struct PageLabelRange {
+    // first page of the range (1-based)
+    int startAt = 0;
+    // number of the first page in the range (/St)
+    int countFrom = 1;
+    // numbering style (/S): 'D', 'R', 'r', 'A', 'a' or 0 for just the prefix
+    char style = 0;
+    // /P, nullptr if not set
+    const char* prefix = nullptr;
+};
+
+struct PageLabels {
+    int pageCount = 0;
+    // sorted by startAt, the first one starts at page 1. Set up by Finish()
+    Vec<PageLabelRange> ranges;
+    // indexes into ranges sorted by prefix, to find the ranges a label can belong to
+    Vec<int> byPrefix;
+
+    // pages whose label is changed by Finish(true) because an earlier page
+    // has the same label. Only set if the document has such duplicates
+    struct Relabeled {
+        int pageNo;
+        const char* label;
+    };
+    Vec<Relabeled> relabeled; // sorted by pageNo
+    dict::MapStrToInt* relabeledPages = nullptr;
+
+    PoolAllocator allocator;
+
+    explicit PageLabels(int pageCount);
+    ~PageLabels();
+
+    // startAt is 1-based, style is the name of /S (can be nullptr)
+    void AddRange(int startAt, const char* style, const char* prefix, int countFrom);
+    // call after adding all ranges. Returns false if the labels are just page numbers.
+    // if ensureUnique, duplicate labels get a ".<n>" suffix
+    bool Finish(bool ensureUnique);
+
+    TempStr GetLabelTemp(int pageNo) const;
+    // the first page with this label, 0 if there's none
+    int GetPageByLabel(const char* label) const;
+
+  private:
+    int RangeLen(int rangeIdx) const;
+    int FindRange(int pageNo) const;
+    int GetPageByOriginalLabel(const char* label) const;
+};
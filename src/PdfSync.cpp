@@ -5,6 +5,7 @@
 #include <synctex_parser.h>
 #include "utils/WinUtil.h"
 #include "utils/FileUtil.h"
+#include "utils/Timer.h"
 #include "utils/ZipUtil.h"
 
 #include "wingui/UIModels.h"
@@ -40,6 +41,36 @@ struct PdfsyncPoint {
     UINT page, x, y;
 };
 
+// a point of a sheet in pdf coordinates (y not inversed)
+struct PdfsyncSheetPoint {
+    int x, y;
+    UINT point; // index into points
+};
+
+// everything parsed from a .pdfsync file plus lookup tables over it,
+// so that forward and inverse search don't have to scan all lines and points
+struct PdfsyncIndex {
+    StrVec srcfiles;                 // source file names
+    Vec<PdfsyncLine> lines;          // record-to-line mapping
+    Vec<PdfsyncPoint> points;        // record-to-point mapping
+    Vec<PdfsyncFileIndex> fileIndex; // start and end of entries for a file in <lines>
+    Vec<size_t> sheetIndex;          // start of entries for a sheet in <points>
+
+    // indexes into lines, by file, line number and order of declaration
+    Vec<UINT> fileLines;
+    // start and end of the entries for a file in <fileLines>
+    Vec<PdfsyncFileIndex> fileLinesIndex;
+    // indexes into lines and points, by record and order of declaration
+    Vec<UINT> linesByRecord;
+    Vec<UINT> pointsByRecord;
+    // points of each sheet, sorted by y
+    Vec<PdfsyncSheetPoint> sheetPoints;
+    // start of the points of a sheet in <sheetPoints> (one more entry than sheetIndex)
+    Vec<size_t> sheetPointsIndex;
+
+    void BuildLookupTables();
+};
+
 // Synchronizer based on .pdfsync file generated with the pdfsync tex package
 class Pdfsync : public Synchronizer {
   public:
@@ -47,19 +78,21 @@ class Pdfsync : public Synchronizer {
         ReportIf(!str::EndsWithI(syncfilename, ".pdfsync"));
     }
 
+    ~Pdfsync() override {
+        delete index;
+    }
+
     int DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line, int* col) override;
     int SourceToDoc(const char* srcfilename, int line, int col, int* page, Vec<Rect>& rects) override;
 
   private:
     int RebuildIndexIfNeeded();
+    PdfsyncIndex* ParseIndex(const char* data, size_t len);
     UINT SourceToRecord(const char* srcfilename, int line, int col, Vec<size_t>& records);
 
-    EngineBase* engine;              // needed for converting between coordinate systems
-    StrVec srcfiles;                 // source file names
-    Vec<PdfsyncLine> lines;          // record-to-line mapping
-    Vec<PdfsyncPoint> points;        // record-to-point mapping
-    Vec<PdfsyncFileIndex> fileIndex; // start and end of entries for a file in <lines>
-    Vec<size_t> sheetIndex;          // start of entries for a sheet in <points>
+    EngineBase* engine; // needed for converting between coordinate systems
+    // kept until a changed file was parsed successfully
+    PdfsyncIndex* index = nullptr;
 };
 
 // Synchronizer based on .synctex file generated with SyncTex
@@ -156,64 +189,67 @@ int Synchronizer::Create(const char* path, EngineBase* engine, Synchronizer** sy
     return PDFSYNCERR_SYNCFILE_NOTFOUND;
 }
 
+// convert a coordinate from the sync file into a PDF coordinate
+#define SYNC_TO_PDF_COORDINATE(c) (c / 65781.76)
+
+// both dx*dx + dy*dy < PDFSYNC_EPSILON_SQUARE and dy < PDFSYNC_EPSILON_Y imply dy <= kMaxDy,
+// so DocToSource() only has to look at the points within kMaxDy vertically
+constexpr int kMaxDy = 28;
+static_assert(kMaxDy * kMaxDy < PDFSYNC_EPSILON_SQUARE && (kMaxDy + 1) * (kMaxDy + 1) >= PDFSYNC_EPSILON_SQUARE);
+static_assert(PDFSYNC_EPSILON_Y <= kMaxDy + 1);
+
 // PDFSYNC synchronizer
 
-// move to the next line in a list of zero-terminated lines
-static char* Advance0Line(char* line, char* end) {
-    line += str::Leni(line);
-    // skip all zeroes until the next non-empty line
-    for (; line < end && !*line; line++) {
+// returns the next non-empty line (not zero-terminated) and its length in lenOut
+static const char* NextSyncLine(const char*& curr, const char* end, size_t* lenOut) {
+    for (; curr < end && (*curr == '\r' || *curr == '\n'); curr++) {
         ;
     }
-    return line < end ? line : nullptr;
-}
-
-// see http://itexmac.sourceforge.net/pdfsync.html for the specification
-int Pdfsync::RebuildIndexIfNeeded() {
-    if (!NeedsToRebuildIndex()) {
-        return PDFSYNCERR_SUCCESS;
+    if (curr >= end) {
+        return nullptr;
     }
-
-    ByteSlice data = file::ReadFile(syncFilePath);
-    if (!data) {
-        return PDFSYNCERR_SYNCFILE_CANNOT_BE_OPENED;
+    const char* line = curr;
+    for (; curr < end && *curr != '\r' && *curr != '\n'; curr++) {
+        ;
     }
+    *lenOut = (size_t)(curr - line);
+    return line;
+}
 
-    char* line = (char*)data.Get();
-    // convert the file data into a list of zero-terminated strings
-    str::TransCharsInPlace(line, "\r\n", "\0\0");
+// see http://itexmac.sourceforge.net/pdfsync.html for the specification
+// returns nullptr if data isn't a pdfsync file
+PdfsyncIndex* Pdfsync::ParseIndex(const char* data, size_t len) {
+    const char* dataEnd = data + len;
+    const char* curr = data;
 
     // parse preamble (jobname and version marker)
-    char* dataEnd = line + data.size();
-
+    for (; curr < dataEnd && *curr != '\r' && *curr != '\n'; curr++) {
+        ;
+    }
+    char* jobLine = str::DupTemp(data, (size_t)(curr - data));
     // replace star by spaces (TeX uses stars instead of spaces in filenames)
-    str::TransCharsInPlace(line, "*/", " \\");
-    AutoFreeStr jobName = strconv::AnsiToUtf8(line);
+    str::TransCharsInPlace(jobLine, "*/", " \\");
+    AutoFreeStr jobName = strconv::AnsiToUtf8(jobLine);
     jobName.Set(str::Join(jobName, ".tex"));
     jobName.Set(PrependDir(jobName));
 
-    line = Advance0Line(line, dataEnd);
+    size_t lineLen = 0;
+    const char* line = NextSyncLine(curr, dataEnd, &lineLen);
     UINT versionNumber = 0;
-    if (!line || !str::Parse(line, "version %u", &versionNumber) || versionNumber != 1) {
-        return PDFSYNCERR_SYNCFILE_CANNOT_BE_OPENED;
+    if (!line || !str::Parse(line, lineLen, "version %u", &versionNumber) || versionNumber != 1) {
+        return nullptr;
     }
 
-    // reset synchronizer database
-    srcfiles.Reset();
-    lines.Reset();
-    points.Reset();
-    fileIndex.Reset();
-    sheetIndex.Reset();
-
+    PdfsyncIndex* idx = new PdfsyncIndex();
     Vec<size_t> filestack;
     int page = 1;
-    sheetIndex.Append(0);
+    idx->sheetIndex.Append(0);
 
     // add the initial tex file to the source file stack
-    filestack.Append((size_t)srcfiles.Size());
-    srcfiles.Append(jobName);
+    filestack.Append((size_t)idx->srcfiles.Size());
+    idx->srcfiles.Append(jobName);
     PdfsyncFileIndex findex{};
-    fileIndex.Append(findex);
+    idx->fileIndex.Append(findex);
 
     PdfsyncLine psline;
     PdfsyncPoint pspoint;
@@ -221,25 +257,25 @@ int Pdfsync::RebuildIndexIfNeeded() {
     // parse data
     int maxPageNo = engine->PageCount();
     while (true) {
-        line = Advance0Line(line, dataEnd);
+        line = NextSyncLine(curr, dataEnd, &lineLen);
         if (!line) {
             break;
         }
         switch (*line) {
             case 'l':
                 psline.file = filestack.Last();
-                if (str::Parse(line, "l %u %u %u", &psline.record, &psline.line, &psline.column)) {
-                    lines.Append(psline);
-                } else if (str::Parse(line, "l %u %u", &psline.record, &psline.line)) {
+                if (str::Parse(line, lineLen, "l %u %u %u", &psline.record, &psline.line, &psline.column)) {
+                    idx->lines.Append(psline);
+                } else if (str::Parse(line, lineLen, "l %u %u", &psline.record, &psline.line)) {
                     psline.column = 0;
-                    lines.Append(psline);
+                    idx->lines.Append(psline);
                 }
                 // else dbg("Bad 'l' line in the pdfsync file");
                 break;
 
             case 's':
-                if (str::Parse(line, "s %u", &page)) {
-                    sheetIndex.Append(points.size());
+                if (str::Parse(line, lineLen, "s %u", &page)) {
+                    idx->sheetIndex.Append(idx->points.size());
                 }
                 // else dbg("Bad 's' line in the pdfsync file");
                 // if (0 == page || page > maxPageNo)
@@ -250,16 +286,16 @@ int Pdfsync::RebuildIndexIfNeeded() {
                 pspoint.page = page;
                 if (0 == page || page > maxPageNo) {
                     /* ignore point for invalid page number */;
-                } else if (str::Parse(line, "p %u %u %u", &pspoint.record, &pspoint.x, &pspoint.y)) {
-                    points.Append(pspoint);
-                } else if (str::Parse(line, "p* %u %u %u", &pspoint.record, &pspoint.x, &pspoint.y)) {
-                    points.Append(pspoint);
+                } else if (str::Parse(line, lineLen, "p %u %u %u", &pspoint.record, &pspoint.x, &pspoint.y)) {
+                    idx->points.Append(pspoint);
+                } else if (str::Parse(line, lineLen, "p* %u %u %u", &pspoint.record, &pspoint.x, &pspoint.y)) {
+                    idx->points.Append(pspoint);
                 }
                 // else dbg("Bad 'p' line in the pdfsync file");
                 break;
 
             case '(': {
-                AutoFreeStr filename(strconv::AnsiToUtf8(line + 1));
+                AutoFreeStr filename(strconv::AnsiToUtf8(str::DupTemp(line + 1, lineLen - 1)));
                 // if the filename contains quotes then remove them
                 // TODO: this should never happen!?
                 if (filename[0] == '"' && filename[str::Leni(filename) - 1] == '"') {
@@ -277,15 +313,15 @@ int Pdfsync::RebuildIndexIfNeeded() {
                     filename = PrependDir(filename);
                 }
 
-                filestack.Append((size_t)srcfiles.Size());
-                srcfiles.Append(filename);
-                findex.start = findex.end = lines.size();
-                fileIndex.Append(findex);
+                filestack.Append((size_t)idx->srcfiles.Size());
+                idx->srcfiles.Append(filename);
+                findex.start = findex.end = idx->lines.size();
+                idx->fileIndex.Append(findex);
             } break;
 
             case ')':
                 if (filestack.size() > 1) {
-                    fileIndex.at(filestack.Pop()).end = lines.size();
+                    idx->fileIndex.at(filestack.Pop()).end = idx->lines.size();
                 }
                 // else dbg("Unbalanced ')' line in the pdfsync file");
                 break;
@@ -296,17 +332,89 @@ int Pdfsync::RebuildIndexIfNeeded() {
         }
     }
 
-    fileIndex.at(0).end = lines.size();
+    idx->fileIndex.at(0).end = idx->lines.size();
     ReportIf(filestack.size() != 1);
 
-    return MarkIndexWasRebuilt();
+    idx->BuildLookupTables();
+    return idx;
 }
 
-// convert a coordinate from the sync file into a PDF coordinate
-#define SYNC_TO_PDF_COORDINATE(c) (c / 65781.76)
+void PdfsyncIndex::BuildLookupTables() {
+    // lines of a file, by line number. Only the lines within the scope of the file
+    // (a file that is never closed has no lines)
+    fileLinesIndex.AppendBlanks(srcfiles.Size());
+    for (int isrc = 0; isrc < srcfiles.Size(); isrc++) {
+        size_t start = fileLines.size();
+        for (size_t i = fileIndex[isrc].start; i < fileIndex[isrc].end; i++) {
+            if (lines[i].file == (size_t)isrc) {
+                fileLines.Append((UINT)i);
+            }
+        }
+        std::stable_sort(fileLines.begin() + start, fileLines.end(),
+                         [this](size_t a, size_t b) { return lines[a].line < lines[b].line; });
+        fileLinesIndex[isrc] = {start, fileLines.size()};
+    }
 
-static int cmpLineRecords(const void* a, const void* b) {
-    return ((PdfsyncLine*)a)->record - ((PdfsyncLine*)b)->record;
+    for (size_t i = 0; i < lines.size(); i++) {
+        linesByRecord.Append((UINT)i);
+    }
+    std::stable_sort(linesByRecord.begin(), linesByRecord.end(),
+                     [this](size_t a, size_t b) { return lines[a].record < lines[b].record; });
+    for (size_t i = 0; i < points.size(); i++) {
+        pointsByRecord.Append((UINT)i);
+    }
+    std::stable_sort(pointsByRecord.begin(), pointsByRecord.end(),
+                     [this](size_t a, size_t b) { return points[a].record < points[b].record; });
+
+    // points of a sheet start at sheetIndex[pageNo] and end at the first point of another page
+    for (int pageNo = 0; pageNo < sheetIndex.Size(); pageNo++) {
+        size_t start = sheetPoints.size();
+        sheetPointsIndex.Append(start);
+        if (pageNo == 0) {
+            continue;
+        }
+        for (size_t i = sheetIndex[pageNo]; i < points.size() && points[i].page == (UINT)pageNo; i++) {
+            int x = (int)SYNC_TO_PDF_COORDINATE(points[i].x);
+            int y = (int)SYNC_TO_PDF_COORDINATE(points[i].y);
+            sheetPoints.Append({x, y, (UINT)i});
+        }
+        std::sort(sheetPoints.begin() + start, sheetPoints.end(),
+                  [](const PdfsyncSheetPoint& a, const PdfsyncSheetPoint& b) {
+                      return a.y != b.y ? a.y < b.y : a.point < b.point;
+                  });
+    }
+    sheetPointsIndex.Append(sheetPoints.size());
+}
+
+int Pdfsync::RebuildIndexIfNeeded() {
+    if (!NeedsToRebuildIndex()) {
+        return PDFSYNCERR_SUCCESS;
+    }
+
+    // read rather than map the file so that TeX can overwrite it at any time
+    ByteSlice data = file::ReadFile(syncFilePath);
+    if (data.empty()) {
+        data.Free();
+        // keep using the index of the previous version of the file
+        return index ? PDFSYNCERR_SUCCESS : PDFSYNCERR_SYNCFILE_CANNOT_BE_OPENED;
+    }
+    size_t size = data.size();
+    u32 hash = MurmurHash2(data.data(), size);
+    if (index && size == indexedSize && hash == indexedHash) {
+        data.Free();
+        return MarkIndexWasRebuilt();
+    }
+
+    PdfsyncIndex* newIndex = ParseIndex((const char*)data.data(), size);
+    data.Free();
+    if (!newIndex) {
+        return index ? PDFSYNCERR_SUCCESS : PDFSYNCERR_SYNCFILE_CANNOT_BE_OPENED;
+    }
+    delete index;
+    index = newIndex;
+    indexedSize = size;
+    indexedHash = hash;
+    return MarkIndexWasRebuilt();
 }
 
 int Pdfsync::DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line, int* col) {
@@ -317,7 +425,7 @@ int Pdfsync::DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line,
 
     // find the entry in the index corresponding to this page
     int nPages = engine->PageCount();
-    if (pageNo == 0 || pageNo >= sheetIndex.Size() || pageNo > nPages) {
+    if (pageNo <= 0 || pageNo >= index->sheetIndex.Size() || pageNo > nPages) {
         return PDFSYNCERR_INVALID_PAGE_NUMBER;
     }
 
@@ -327,52 +435,57 @@ int Pdfsync::DocToSource(int pageNo, Point pt, AutoFreeStr& filename, int* line,
 
     // distance to the closest pdf location (in the range <PDFSYNC_EPSILON_SQUARE)
     UINT closest_xydist = UINT_MAX;
-    UINT selected_record = UINT_MAX;
-    // If no record is found within a distance^2 of PDFSYNC_EPSILON_SQUARE
-    // (selected_record == -1) then we pick up the record that is closest
-    // vertically to the hit-point.
-    UINT closest_ydist = UINT_MAX;        // vertical distance between the hit point and the vertically-closest record
-    UINT closest_xdist = UINT_MAX;        // horizontal distance between the hit point and the vertically-closest record
-    UINT closest_ydist_record = UINT_MAX; // vertically-closest record
-
-    // read all the sections of 'p' declarations for this pdf sheet
-    for (size_t i = sheetIndex.at((size_t)pageNo); i < points.size() && points.at(i).page == (uint)pageNo; i++) {
-        // check whether it is closer than the closest point found so far
-        UINT dx = abs(pt.x - (int)SYNC_TO_PDF_COORDINATE(points.at(i).x));
-        UINT dy = abs(pt.y - (int)SYNC_TO_PDF_COORDINATE(points.at(i).y));
+    UINT closest_xypoint = UINT_MAX;
+    // If no point is found within a distance^2 of PDFSYNC_EPSILON_SQUARE
+    // then we pick up the point that is closest vertically to the hit-point.
+    UINT closest_ydist = UINT_MAX;  // vertical distance between the hit point and the vertically-closest point
+    UINT closest_xdist = UINT_MAX;  // horizontal distance between the hit point and the vertically-closest point
+    UINT closest_ypoint = UINT_MAX; // vertically-closest point
+    // (for points at the same distance, the one declared first wins)
+
+    PdfsyncSheetPoint* first = index->sheetPoints.begin() + index->sheetPointsIndex[pageNo];
+    PdfsyncSheetPoint* last = index->sheetPoints.begin() + index->sheetPointsIndex[pageNo + 1];
+    PdfsyncSheetPoint* sp = std::lower_bound(first, last, pt.y - kMaxDy,
+                                             [](const PdfsyncSheetPoint& p, int y) { return p.y < y; });
+    for (; sp < last && sp->y <= pt.y + kMaxDy; sp++) {
+        UINT dx = abs(pt.x - sp->x);
+        UINT dy = abs(pt.y - sp->y);
         UINT dist = dx * dx + dy * dy;
-        if (dist < PDFSYNC_EPSILON_SQUARE && dist < closest_xydist) {
-            selected_record = points.at(i).record;
+        if (dist < PDFSYNC_EPSILON_SQUARE &&
+            (dist < closest_xydist || (dist == closest_xydist && sp->point < closest_xypoint))) {
+            closest_xypoint = sp->point;
             closest_xydist = dist;
-        } else if ((closest_xydist == UINT_MAX) && dy < PDFSYNC_EPSILON_Y &&
-                   (dy < closest_ydist || (dy == closest_ydist && dx < closest_xdist))) {
-            closest_ydist_record = points.at(i).record;
+        }
+        if (dy < PDFSYNC_EPSILON_Y &&
+            (dy < closest_ydist ||
+             (dy == closest_ydist && (dx < closest_xdist || (dx == closest_xdist && sp->point < closest_ypoint))))) {
+            closest_ypoint = sp->point;
             closest_ydist = dy;
             closest_xdist = dx;
         }
     }
 
-    if (selected_record == UINT_MAX) {
-        selected_record = closest_ydist_record;
-    }
-    if (selected_record == UINT_MAX) {
+    UINT selected_point = closest_xypoint != UINT_MAX ? closest_xypoint : closest_ypoint;
+    if (selected_point == UINT_MAX) {
         return PDFSYNCERR_NO_SYNC_AT_LOCATION; // no record was found close enough to the hit point
     }
+    UINT selected_record = index->points[(size_t)selected_point].record;
 
     // We have a record number, we need to find its declaration ('l ...') in the syncfile
-    PdfsyncLine cmp;
-    cmp.record = selected_record;
-    PdfsyncLine* found =
-        (PdfsyncLine*)bsearch(&cmp, lines.LendData(), lines.size(), sizeof(PdfsyncLine), cmpLineRecords);
+    Vec<PdfsyncLine>& lines = index->lines;
+    UINT* lr = std::lower_bound(index->linesByRecord.begin(), index->linesByRecord.end(), selected_record,
+                                [&lines](size_t i, UINT record) { return lines[i].record < record; });
+    bool found = lr < index->linesByRecord.end() && lines[(size_t)*lr].record == selected_record;
     ReportIf(!found);
     if (!found) {
         return PDFSYNCERR_NO_SYNC_AT_LOCATION;
     }
 
-    char* path = srcfiles[found->file];
+    const PdfsyncLine& psline = lines[(size_t)*lr];
+    char* path = index->srcfiles[psline.file];
     filename.SetCopy(path);
-    *line = (int)found->line;
-    *col = (int)found->column;
+    *line = (int)psline.line;
+    *col = (int)psline.column;
     if (*col < 0) {
         *col = 0;
     }
@@ -407,6 +520,7 @@ UINT Pdfsync::SourceToRecord(const char* srcfilename, int line, int, Vec<size_t>
     }
 
     // find the source file entry
+    StrVec& srcfiles = index->srcfiles;
     int isrc;
     for (isrc = 0; isrc < srcfiles.Size(); isrc++) {
         char* path = srcfiles[isrc];
@@ -418,28 +532,25 @@ UINT Pdfsync::SourceToRecord(const char* srcfilename, int line, int, Vec<size_t>
         return PDFSYNCERR_UNKNOWN_SOURCEFILE;
     }
 
-    if (fileIndex.at(isrc).start == fileIndex.at(isrc).end) {
+    if (index->fileIndex.at(isrc).start == index->fileIndex.at(isrc).end) {
         return PDFSYNCERR_NORECORD_IN_SOURCEFILE; // there is not any record declaration for that particular source file
     }
 
-    // look for sections belonging to the specified file
-    // starting with the first section that is declared within the scope of the file.
-    UINT min_distance = EPSILON_LINE; // distance to the closest record
-    size_t lineIx = (size_t)-1;       // closest record-line index
-
-    for (size_t isec = fileIndex.at(isrc).start; isec < fileIndex.at(isrc).end; isec++) {
-        // does this section belong to the desired file?
-        if (lines.at(isec).file != (size_t)isrc) {
-            continue;
-        }
-
-        UINT d = abs((int)lines.at(isec).line - (int)line);
-        if (d < min_distance) {
-            min_distance = d;
-            lineIx = isec;
-            if (0 == d) {
-                break; // We have found a record for the requested line!
-            }
+    // look for the closest line with a record, in the lines of the file sorted by line number.
+    // Of the lines at the same distance, the one declared first is used
+    Vec<PdfsyncLine>& lines = index->lines;
+    UINT* first = index->fileLines.begin() + index->fileLinesIndex[isrc].start;
+    UINT* last = index->fileLines.begin() + index->fileLinesIndex[isrc].end;
+    auto firstLineIx = [&](int lineNo) -> size_t {
+        UINT* fl =
+            std::lower_bound(first, last, lineNo, [&lines](size_t i, int n) { return (int)lines[i].line < n; });
+        return (fl < last && (int)lines[(size_t)*fl].line == lineNo) ? *fl : (size_t)-1;
+    };
+    size_t lineIx = (size_t)-1; // closest record-line index
+    for (int d = 0; d < EPSILON_LINE && lineIx == (size_t)-1; d++) {
+        lineIx = firstLineIx(line - d);
+        if (d > 0) {
+            lineIx = std::min(lineIx, firstLineIx(line + d));
         }
     }
     if (lineIx == (size_t)-1) {
@@ -466,16 +577,32 @@ int Pdfsync::SourceToDoc(const char* srcfilename, int line, int col, int* page,
         return ret;
     }
 
+    // the points of the found records, in order of declaration
+    Vec<PdfsyncPoint>& points = index->points;
+    Vec<UINT> found_points;
+    for (size_t record : found_records) {
+        UINT* pr = std::lower_bound(index->pointsByRecord.begin(), index->pointsByRecord.end(), record,
+                                    [&points](size_t i, size_t rec) { return points[i].record < rec; });
+        for (; pr < index->pointsByRecord.end() && points[(size_t)*pr].record == record; pr++) {
+            found_points.Append(*pr);
+        }
+    }
+    std::sort(found_points.begin(), found_points.end());
+
     rects.Reset();
 
     // records have been found for the desired source position:
     // we now find the page and positions in the PDF corresponding to these found records
-    int firstPage = UINT_MAX;
-    for (PdfsyncPoint& p : points) {
-        if (!found_records.Contains(p.record)) {
+    int firstPage = -1;
+    UINT prevPoint = UINT_MAX;
+    for (UINT i : found_points) {
+        // a record can be found more than once
+        if (i == prevPoint) {
             continue;
         }
-        if (firstPage != UINT_MAX && firstPage != (int)p.page) {
+        prevPoint = i;
+        PdfsyncPoint& p = points[(size_t)i];
+        if (firstPage != -1 && firstPage != (int)p.page) {
             continue;
         }
         firstPage = *page = (int)p.page;
@@ -493,88 +620,64 @@ int Pdfsync::SourceToDoc(const char* srcfilename, int line, int col, int* page,
     return PDFSYNCERR_NOSYNCPOINT_FOR_LINERECORD;
 }
 
-// returns path of ungzipped file
-TempStr ungzipToFile(char* path) {
-    // to see if we can read when gzopen in synctex_scanner_new_with_output_file cannot
-    ByteSlice compr = file::ReadFile(path);
-    if (compr.IsEmpty()) {
-        logf("ungzip: file::ReadFile() '%s' failed\n", path);
-        return nullptr;
+// SYNCTEX synchronizer
+
+// content of the .synctex file or, if there's none, of the .synctex.gz file
+// inflated in memory. The data is malloc()ed and zero-terminated
+static ByteSlice ReadSyncTexData(const char* syncPath) {
+    if (file::Exists(syncPath)) {
+        return file::ReadFile(syncPath);
     }
-    logf("ungzip: file::ReadFile() did read '%s'\n", path);
-    ByteSlice uncompr = Ungzip(compr);
+    // Note: https://github.com/sumatrapdfreader/sumatrapdf/discussions/2640#discussioncomment-2861368
+    // reported failure to gzopen() a large (12 MB) .synctex.gz, so we don't let synctex_parser.c read it
+    TempStr pathGz = str::JoinTemp(syncPath, ".gz");
+    ByteSlice compr = file::ReadFile(pathGz);
+    if (compr.empty()) {
+        compr.Free();
+        return {};
+    }
+    ByteSlice data = Ungzip(compr);
     compr.Free();
-    if (uncompr.IsEmpty()) {
-        return nullptr;
-    }
-    TempStr destPath = str::JoinTemp(path, ".sum.synctex");
-    bool ok = file::WriteFile(destPath, uncompr);
-    uncompr.Free();
-    if (!ok) {
-        return nullptr;
-    }
-    return destPath;
+    return data;
 }
 
-// SYNCTEX synchronizer
-
 int SyncTex::RebuildIndexIfNeeded() {
     if (!NeedsToRebuildIndex()) {
         logfa("SyncTex::RebuildIndexIfNeeded: no need to rebuild\n");
         return PDFSYNCERR_SUCCESS;
     }
-    synctex_scanner_free(scanner);
-    scanner = nullptr;
-    i64 fsize;
-    TempStr pathNoExt;
-    TempStr pathSyncGz;
-    bool didRepeat = false;
-
-    TempStr syncPathTemp = str::DupTemp(syncFilePath.Get());
-Repeat:
-    TempWStr ws = ToWStrTemp(syncPathTemp);
-    AutoFreeStr pathAnsi = strconv::WStrToAnsi(ws);
-    scanner = synctex_scanner_new_with_output_file(pathAnsi, nullptr, 1);
-    if (scanner) {
-        logfa("synctex_scanner_new_with_output_file: ok for pathAnsi '%s'\n", pathAnsi.Get());
-        goto Exit;
-    }
-    if (!str::Eq(syncPathTemp, pathAnsi)) {
-        logfa("synctex_scanner_new_with_output_file: retrying for syncFilePath '%s'\n", syncPathTemp);
-        scanner = synctex_scanner_new_with_output_file(syncPathTemp, nullptr, 1);
-    }
-    if (scanner) {
-        logfa("synctex_scanner_new_with_output_file: ok forsyncFilePath '%s'\n", syncPathTemp);
-        goto Exit;
-    }
-    if (didRepeat) {
-        logfa("synctex_scanner_new_with_output_file: failed for '%s'\n", pathAnsi.Get());
-        return PDFSYNCERR_SYNCFILE_NOTFOUND;
-    }
 
-    // Note: https://github.com/sumatrapdfreader/sumatrapdf/discussions/2640#discussioncomment-2861368
-    // reported failure to parse a large (12 MB) .synctex.gz even though file exists
-    pathNoExt = path::GetPathNoExtTemp(syncFilePath);
-    pathSyncGz = str::JoinTemp(pathNoExt, ".synctex.gz");
-    if (!file::Exists(pathSyncGz)) {
-        logfa("synctex_scanner_new_with_output_file: failed for '%s'\n", pathAnsi.Get());
-        return PDFSYNCERR_SYNCFILE_NOTFOUND;
+    auto timeStart = TimeGet();
+    ByteSlice data = ReadSyncTexData(syncFilePath);
+    if (data.size() == 0) {
+        data.Free();
+        logfa("SyncTex::RebuildIndexIfNeeded: couldn't read '%s' or '%s.gz'\n", syncFilePath.Get(),
+              syncFilePath.Get());
+        // keep using the scanner of the previous version of the file
+        return scanner ? PDFSYNCERR_SUCCESS : PDFSYNCERR_SYNCFILE_NOTFOUND;
+    }
+    size_t size = data.size();
+    u32 hash = MurmurHash2(data.data(), size);
+    if (scanner && size == indexedSize && hash == indexedHash) {
+        data.Free();
+        logfa("SyncTex::RebuildIndexIfNeeded: '%s' didn't change\n", syncFilePath.Get());
+        return MarkIndexWasRebuilt();
+    }
+
+    // synctex_parser.c resolves relative source paths against the path of the .synctex file
+    TempWStr ws = ToWStrTemp(syncFilePath);
+    char* pathAnsi = strconv::WStrToAnsi(ws);
+    // takes ownership of pathAnsi and data
+    synctex_scanner_t newScanner = synctex_scanner_new_with_data(pathAnsi, (char*)data.data(), size);
+    if (!newScanner) {
+        logfa("SyncTex::RebuildIndexIfNeeded: failed to parse '%s'\n", syncFilePath.Get());
+        return scanner ? PDFSYNCERR_SUCCESS : PDFSYNCERR_SYNCFILE_CANNOT_BE_OPENED;
     }
-    fsize = file::GetSize(pathSyncGz);
-    logf("SyncTex::RebuildIndexIfNeeded: trying to uncompress %s, size: %d\n", pathSyncGz, (int)fsize);
-
-    syncPathTemp = ungzipToFile(pathSyncGz);
-    if (!syncPathTemp) {
-        logfa("SyncTex::RebuildIndexIfNeeded: ungzipToFile('%s') failecd\n", pathSyncGz);
-        goto Exit;
-    }
-    fsize = file::GetSize(syncPathTemp);
-    logfa("SyncTex::RebuildIndexIfNeeded: retrying with uncompressed version '%s' of size %d\n", syncPathTemp, fsize);
-
-    didRepeat = true;
-    goto Repeat;
-
-Exit:
+    synctex_scanner_free(scanner);
+    scanner = newScanner;
+    indexedSize = size;
+    indexedHash = hash;
+    logfa("SyncTex::RebuildIndexIfNeeded: parsed %d bytes in %.2f ms\n", (int)size, TimeSinceInMs(timeStart));
     return MarkIndexWasRebuilt();
 }
 
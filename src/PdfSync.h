@@ -50,6 +50,11 @@ class Synchronizer {
     int MarkIndexWasRebuilt();
     char* PrependDir(const char* filename) const;
 
+    // size and hash of the data the index was built from. A sync file rewritten
+    // with the same content (e.g. when recompiling unchanged sources) isn't parsed again
+    size_t indexedSize = 0;
+    u32 indexedHash = 0;
+
     AutoFreeStr syncFilePath; // path to the synchronization file
 
   public:
@@ -30,6 +30,10 @@
 
 bool gShowTileLayout = false;
 
+// if true, pages get a quick low-resolution preview rendered before their
+// tiles at the current zoom, see RenderCache::RequestPreview
+static bool gRenderPreviews = true;
+
 RenderCache::RenderCache() {
     // enable when debugging RenderCache logic
     // gEnableDbgLog = true;
@@ -46,6 +50,10 @@ RenderCache::RenderCache() {
     startRendering = CreateEvent(nullptr, FALSE, FALSE, nullptr);
     renderThread = CreateThread(nullptr, 0, RenderCacheThread, this, 0, nullptr);
     ReportIf(nullptr == renderThread);
+
+    startPrefetching = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    prefetchThread = CreateThread(nullptr, 0, PrefetchThread, this, 0, nullptr);
+    ReportIf(nullptr == prefetchThread);
 }
 
 RenderCache::~RenderCache() {
@@ -54,6 +62,8 @@ RenderCache::~RenderCache() {
 
     CloseHandle(renderThread);
     CloseHandle(startRendering);
+    CloseHandle(prefetchThread);
+    CloseHandle(startPrefetching);
     if (curReq || 0 != requestCount || cacheCount != 0) {
         logf("RenderCache::~RenderCache: curReq: 0x%p, requestCount: %d, cacheCount: %d\n", curReq, requestCount,
              cacheCount);
@@ -172,6 +182,19 @@ void RenderCache::Add(PageRenderRequest& req, RenderedBitmap* bmp) {
     req.rotation = NormalizeRotation(req.rotation);
     ReportIf(cacheCount > MAX_BITMAPS_CACHED);
 
+    if (req.preview) {
+        // don't replace a sharper rendering that finished in the meantime
+        BitmapCacheEntry* entry = Find(req.dm, req.pageNo, req.rotation, kInvalidZoom, &req.tile);
+        bool isSharper = entry && entry->zoom > req.zoom && !entry->outOfDate;
+        if (entry) {
+            DropCacheEntry(entry);
+        }
+        if (isSharper) {
+            delete bmp;
+            return;
+        }
+    }
+
     /* It's possible there still is a cached bitmap with different zoom/rotation */
     FreePage(req.dm, req.pageNo, &req.tile);
 
@@ -281,6 +304,19 @@ void RenderCache::FreeForDisplayModel(DisplayModel* dm) {
     FreePage(dm);
 }
 
+// called when a document is closed
+void RenderCache::FreePrefetchedPages(DisplayModel* dm) {
+    ScopedCritSec scope(&requestAccess);
+    int nPages = prefetchedPages.Size();
+    for (int i = nPages - 1; i >= 0; i--) {
+        if (prefetchedPages[i].dm == dm) {
+            prefetchedPages.RemoveAt(i);
+            prefetchUnused++;
+        }
+    }
+    LogPrefetchStats();
+}
+
 void RenderCache::FreeNotVisible() {
     FreePage();
 }
@@ -357,6 +393,20 @@ USHORT RenderCache::GetTileRes(DisplayModel* dm, int pageNo) const {
     return std::min(res, (USHORT)30);
 }
 
+// a quarter of the resolution of the page at the current zoom
+// but no larger than half a tile
+float RenderCache::GetPreviewZoom(DisplayModel* dm, int pageNo) const {
+    auto engine = dm->GetEngine();
+    float zoom = dm->GetZoomReal(pageNo);
+    RectF pixelbox = engine->Transform(engine->PageMediabox(pageNo), pageNo, zoom, dm->GetRotation());
+    float scale = 0.25f;
+    if (pixelbox.dx > 0 && pixelbox.dy > 0) {
+        scale = std::min(scale, maxTileSize.dx / 2.f / pixelbox.dx);
+        scale = std::min(scale, maxTileSize.dy / 2.f / pixelbox.dy);
+    }
+    return zoom * scale;
+}
+
 // get the maximum resolution available for the given page
 USHORT RenderCache::GetMaxTileRes(DisplayModel* dm, int pageNo, int rotation) {
     ScopedCritSec scope(&cacheAccess);
@@ -427,7 +477,7 @@ void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition ti
     int rotation = NormalizeRotation(dm->GetRotation());
     float zoom = dm->GetZoomReal(pageNo);
 
-    if (curReq && (curReq->pageNo == pageNo) && (curReq->dm == dm) && (curReq->tile == tile)) {
+    if (curReq && !curReq->preview && (curReq->pageNo == pageNo) && (curReq->dm == dm) && (curReq->tile == tile)) {
         if ((curReq->zoom == zoom) && (curReq->rotation == rotation)) {
             /* we're already rendering exactly the same page */
             return;
@@ -444,7 +494,7 @@ void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition ti
 
     for (int i = 0; i < requestCount; i++) {
         PageRenderRequest* req = &(requests[i]);
-        if ((req->pageNo == pageNo) && (req->dm == dm) && (req->tile == tile)) {
+        if (!req->preview && (req->pageNo == pageNo) && (req->dm == dm) && (req->tile == tile)) {
             if ((req->zoom == zoom) && (req->rotation == rotation)) {
                 /* Request with exactly the same parameters already queued for
                    rendering. Move it to the top of the queue so that it'll
@@ -472,6 +522,47 @@ void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition ti
     Render(dm, pageNo, rotation, zoom, &tile);
 }
 
+/* Render the whole page at low resolution, so that there's something to show right
+   away, e.g. after zooming in on a heavy page. Previews are rendered before anything
+   else and are replaced by the tiles at the current zoom. For most documents, the
+   engine keeps the page contents from the preview, so that they don't have to be
+   interpreted again for the tiles. */
+void RenderCache::RequestPreview(DisplayModel* dm, int pageNo) {
+    if (!dm || dm->dontRenderFlag) {
+        return;
+    }
+    int rotation = NormalizeRotation(dm->GetRotation());
+    float zoom = GetPreviewZoom(dm, pageNo);
+    TilePosition tile(0, 0, 0);
+
+    // a rendering at resolution 0 is shown scaled until the tiles at the
+    // current zoom are ready (see PaintTile), so only replace it if it'd
+    // have to be scaled up a lot more than a preview
+    BitmapCacheEntry* entry = Find(dm, pageNo, rotation, kInvalidZoom, &tile);
+    if (entry) {
+        bool isGoodEnough = !entry->outOfDate && entry->zoom * 2 >= zoom;
+        DropCacheEntry(entry);
+        if (isGoodEnough) {
+            return;
+        }
+    }
+
+    ScopedCritSec scope(&requestAccess);
+    if (curReq && curReq->preview && curReq->dm == dm && curReq->pageNo == pageNo) {
+        return;
+    }
+    for (int i = 0; i < requestCount; i++) {
+        PageRenderRequest* req = &(requests[i]);
+        if (req->preview && req->dm == dm && req->pageNo == pageNo) {
+            req->zoom = zoom;
+            req->rotation = rotation;
+            req->pageRect = GetTileRectUser(dm->GetEngine(), pageNo, rotation, zoom, tile);
+            return;
+        }
+    }
+    Render(dm, pageNo, rotation, zoom, &tile, nullptr, nullptr, true);
+}
+
 void RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom, RectF pageRect,
                          RenderingCallback& callback) {
     bool ok = Render(dm, pageNo, rotation, zoom, nullptr, &pageRect, &callback);
@@ -481,7 +572,7 @@ void RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
 }
 
 bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition* tile, RectF* pageRect,
-                         RenderingCallback* renderCb) {
+                         RenderingCallback* renderCb, bool preview) {
     logf("RenderCache::Render(): pageNo %d\n", pageNo);
     ReportIf(!dm);
     if (!dm || dm->dontRenderFlag) {
@@ -527,6 +618,7 @@ bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
     newRequest->abort = false;
     newRequest->abortCookie = nullptr;
     newRequest->timestamp = GetTickCount();
+    newRequest->preview = preview;
     newRequest->renderCb = renderCb;
 
     SetEvent(startRendering);
@@ -537,12 +629,12 @@ bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
 int RenderCache::GetRenderDelay(DisplayModel* dm, int pageNo, TilePosition tile) {
     ScopedCritSec scope(&requestAccess);
 
-    if (curReq && curReq->pageNo == pageNo && curReq->dm == dm && curReq->tile == tile) {
+    if (curReq && !curReq->preview && curReq->pageNo == pageNo && curReq->dm == dm && curReq->tile == tile) {
         return GetTickCount() - curReq->timestamp;
     }
 
     for (int i = 0; i < requestCount; i++) {
-        if (requests[i].pageNo == pageNo && requests[i].dm == dm && requests[i].tile == tile) {
+        if (!requests[i].preview && requests[i].pageNo == pageNo && requests[i].dm == dm && requests[i].tile == tile) {
             return GetTickCount() - requests[i].timestamp;
         }
     }
@@ -559,8 +651,17 @@ bool RenderCache::GetNextRequest(PageRenderRequest* req) {
 
     ReportIf(requestCount < 0);
     ReportIf(requestCount > MAX_PAGE_REQUESTS);
+    // requests are processed LIFO, except that previews go first
+    int idx = requestCount - 1;
+    for (int i = requestCount - 1; i >= 0; i--) {
+        if (requests[i].preview) {
+            idx = i;
+            break;
+        }
+    }
+    *req = requests[idx];
     requestCount--;
-    *req = requests[requestCount];
+    memmove(&(requests[idx]), &(requests[idx + 1]), sizeof(PageRenderRequest) * (requestCount - idx));
     curReq = req;
     ReportIf(requestCount < 0);
     ReportIf(req->abort);
@@ -583,6 +684,7 @@ bool RenderCache::ClearCurrentRequest() {
 /* TODO: this might take some time, would be good to show a dialog to let the
    user know he has to wait until we finish */
 void RenderCache::CancelRendering(DisplayModel* dm) {
+    CancelPrefetch(dm);
     ClearQueueForDisplayModel(dm);
 
     for (;;) {
@@ -608,8 +710,10 @@ void RenderCache::ClearQueueForDisplayModel(DisplayModel* dm, int pageNo, TilePo
     int curPos = 0;
     for (int i = 0; i < reqCount; i++) {
         PageRenderRequest* req = &(requests[i]);
+        // previews are for the whole page, so they stay when clearing other tiles
         bool shouldRemove = req->dm == dm && (pageNo == kInvalidPageNo || req->pageNo == pageNo) &&
-                            (!tile || req->tile.res != tile->res || !IsTileVisible(dm, req->pageNo, *tile, 0.5));
+                            (!tile || !req->preview && (req->tile.res != tile->res ||
+                                                        !IsTileVisible(dm, req->pageNo, *tile, 0.5)));
         if (i != curPos) {
             requests[curPos] = requests[i];
         }
@@ -624,6 +728,110 @@ void RenderCache::ClearQueueForDisplayModel(DisplayModel* dm, int pageNo, TilePo
     }
 }
 
+void RenderCache::RequestPrefetch(DisplayModel* dm, const Vec<int>& pageNos) {
+    ScopedCritSec scope(&requestAccess);
+    if (!dm || dm->dontRenderFlag) {
+        return;
+    }
+    int curPos = 0;
+    for (int i = 0; i < prefetchCount; i++) {
+        if (prefetchRequests[i].dm != dm) {
+            prefetchRequests[curPos++] = prefetchRequests[i];
+        }
+    }
+    prefetchCount = curPos;
+
+    int rotation = NormalizeRotation(dm->GetRotation());
+    for (int pageNo : pageNos) {
+        if (prefetchCount == MAX_PREFETCH_REQUESTS) {
+            break;
+        }
+        PagePrefetchRequest* req = &prefetchRequests[prefetchCount++];
+        req->dm = dm;
+        req->pageNo = pageNo;
+        req->rotation = rotation;
+        req->zoom = dm->GetZoomReal(pageNo);
+    }
+    if (prefetchCount > 0) {
+        SetEvent(startPrefetching);
+    }
+}
+
+/* Remove pages of <dm> from the prefetch queue and wait until
+   the page being prefetched (if it's one of <dm>) is loaded */
+void RenderCache::CancelPrefetch(DisplayModel* dm) {
+    for (;;) {
+        EnterCriticalSection(&requestAccess);
+        int curPos = 0;
+        for (int i = 0; i < prefetchCount; i++) {
+            if (prefetchRequests[i].dm != dm) {
+                prefetchRequests[curPos++] = prefetchRequests[i];
+            }
+        }
+        prefetchCount = curPos;
+        bool isPrefetching = curPrefetchDm == dm;
+        LeaveCriticalSection(&requestAccess);
+        if (!isPrefetching) {
+            return;
+        }
+        // loading a single page can't be aborted but doesn't take long
+        Sleep(10);
+    }
+}
+
+// pages are prefetched front to back (in the order they've been
+// requested in) and only while there's nothing to render
+bool RenderCache::GetNextPrefetchRequest(PagePrefetchRequest* req) {
+    ScopedCritSec scope(&requestAccess);
+    curPrefetchDm = nullptr;
+    if (prefetchCount == 0 || requestCount > 0 || curReq) {
+        return false;
+    }
+    *req = prefetchRequests[0];
+    prefetchCount--;
+    memmove(&prefetchRequests[0], &prefetchRequests[1], sizeof(PagePrefetchRequest) * prefetchCount);
+    curPrefetchDm = req->dm;
+    return true;
+}
+
+void RenderCache::AddPrefetchedPage(DisplayModel* dm, int pageNo, double loadMs) {
+    ScopedCritSec scope(&requestAccess);
+    if (prefetchedPages.Size() == MAX_PREFETCHED_PAGES) {
+        prefetchedPages.RemoveAt(0);
+        prefetchUnused++;
+    }
+    prefetchedPages.Append({dm, pageNo, loadMs});
+}
+
+// called by the render thread before rendering a page. <wasLoaded> is
+// false if the render thread has to load the page itself
+void RenderCache::CountPageLoad(DisplayModel* dm, int pageNo, bool wasLoaded) {
+    ScopedCritSec scope(&requestAccess);
+    int nPages = prefetchedPages.Size();
+    for (int i = 0; i < nPages; i++) {
+        PrefetchedPage& p = prefetchedPages[i];
+        if (p.dm == dm && p.pageNo == pageNo) {
+            prefetchHits++;
+            prefetchSavedMs += p.loadMs;
+            prefetchedPages.RemoveAt(i);
+            return;
+        }
+    }
+    if (!wasLoaded) {
+        prefetchMisses++;
+    }
+}
+
+void RenderCache::LogPrefetchStats() {
+    ScopedCritSec scope(&requestAccess);
+    int nLoads = prefetchHits + prefetchMisses;
+    if (nLoads == 0) {
+        return;
+    }
+    logfa("RenderCache: prefetched %d of %d loaded pages (%.1f%%), saved %.2f ms of rendering, %d pages unused\n",
+          prefetchHits, nLoads, prefetchHits * 100.0 / nLoads, prefetchSavedMs, prefetchUnused);
+}
+
 void RenderCache::AbortCurrentRequest() {
     ScopedCritSec scope(&requestAccess);
     if (!curReq) {
@@ -642,6 +850,8 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
 
     for (;;) {
         if (cache->ClearCurrentRequest()) {
+            // the engine is free for loading pages ahead of time
+            SetEvent(cache->startPrefetching);
             DWORD waitResult = WaitForSingleObject(cache->startRendering, INFINITE);
             // Is it not a page render request?
             if (WAIT_OBJECT_0 != waitResult) {
@@ -668,8 +878,13 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
         // make sure that we have extracted page text for
         // all rendered pages to allow text selection and
         // searching without any further delays
-        if (!dm->textCache->HasTextForPage(req.pageNo)) {
-            dm->textCache->GetTextForPage(req.pageNo);
+        // (but show previews as soon as possible)
+        if (!req.preview) {
+            bool wasLoaded = dm->textCache->HasTextForPage(req.pageNo);
+            cache->CountPageLoad(dm, req.pageNo, wasLoaded);
+            if (!wasLoaded) {
+                dm->textCache->GetTextForPage(req.pageNo);
+            }
         }
 
         ReportIf(req.abortCookie != nullptr);
@@ -696,6 +911,8 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
             // the callback must free the RenderedBitmap
             req.renderCb->Callback(bmp);
             req.renderCb = (RenderingCallback*)1; // will crash if accessed again, which should not happen
+        } else if (req.preview && !bmp) {
+            // the tiles will be rendered (and fail) anyway
         } else {
             // don't replace colors for individual images
             if (bmp && !engine->IsImageCollection()) {
@@ -710,6 +927,37 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
     DestroyTempAllocator();
 }
 
+// loads pages the user is likely to scroll to next (see
+// DisplayModel::RenderVisibleParts) while the render thread is idle
+DWORD WINAPI RenderCache::PrefetchThread(LPVOID data) {
+    RenderCache* cache = (RenderCache*)data;
+    PagePrefetchRequest req;
+
+    for (;;) {
+        if (!cache->GetNextPrefetchRequest(&req)) {
+            WaitForSingleObject(cache->startPrefetching, INFINITE);
+            continue;
+        }
+
+        // pages with extracted text have already been loaded by
+        // the render thread or an earlier prefetch
+        auto dm = req.dm;
+        if (dm->dontRenderFlag || dm->textCache->HasTextForPage(req.pageNo)) {
+            continue;
+        }
+
+        EngineBase* engine = dm->GetEngine();
+        engine->AddRef();
+        auto timeStart = TimeGet();
+        engine->PreloadPage(req.pageNo, req.zoom, req.rotation);
+        dm->textCache->GetTextForPage(req.pageNo);
+        cache->AddPrefetchedPage(dm, req.pageNo, TimeSinceInMs(timeStart));
+        engine->Release();
+        ResetTempAllocator();
+    }
+    DestroyTempAllocator();
+}
+
 // TODO: conceptually, RenderCache is not the right place for code that paints
 //       (this is the only place that knows about Tiles, though)
 int RenderCache::PaintTile(HDC hdc, Rect bounds, DisplayModel* dm, int pageNo, TilePosition tile, Rect tileOnScreen,
@@ -875,6 +1123,11 @@ int RenderCache::Paint(HDC hdc, Rect bounds, DisplayModel* dm, int pageNo, PageI
         }
     }
 
+    // at resolution 0, the preview would compete with the page itself
+    if (neededScaling && gRenderPreviews && targetRes > 0) {
+        RequestPreview(dm, pageNo);
+    }
+
 #ifdef CONSERVE_MEMORY
     if (!neededScaling) {
         if (renderOutOfDateCue) {
@@ -12,6 +12,10 @@ constexpr int RENDER_DELAY_UNDEFINED = std::numeric_limits<int>::max() - 2;
 // TODO: this should be based on amount of memory taken by rendered pages
 // i.e. one big page can use as much memory as lots of small pages
 #define MAX_BITMAPS_CACHED 64
+// how many pages ahead of the visible ones can be waiting to be loaded
+#define MAX_PREFETCH_REQUESTS 8
+// how many loaded but not yet rendered pages are tracked for statistics
+#define MAX_PREFETCHED_PAGES 32
 
 struct PageInfo;
 
@@ -83,11 +87,29 @@ struct PageRenderRequest {
     bool abort = false;
     AbortCookie* abortCookie = nullptr;
     DWORD timestamp = 0;
+    // a quick low-resolution rendering of the whole page (tile 0/0/0) that
+    // is shown scaled up until the tiles at the current zoom are rendered
+    bool preview = false;
     // owned by the PageRenderRequest (use it before reusing the request)
     // on rendering success, the callback gets handed the RenderedBitmap
     RenderingCallback* renderCb = nullptr;
 };
 
+/* A page to be loaded (but not rendered) ahead of time by the prefetch
+   thread, so that the render thread only has to rasterize it */
+struct PagePrefetchRequest {
+    DisplayModel* dm = nullptr;
+    int pageNo = 0;
+    int rotation = 0;
+    float zoom = 0.f;
+};
+
+struct PrefetchedPage {
+    DisplayModel* dm = nullptr;
+    int pageNo = 0;
+    double loadMs = 0;
+};
+
 struct RenderCache {
     BitmapCacheEntry* cache[MAX_BITMAPS_CACHED]{};
     int cacheCount = 0;
@@ -101,6 +123,22 @@ struct RenderCache {
     CRITICAL_SECTION requestAccess;
     HANDLE renderThread = nullptr;
 
+    // protected by requestAccess. pages are only prefetched while
+    // the render queue is empty
+    PagePrefetchRequest prefetchRequests[MAX_PREFETCH_REQUESTS]{};
+    int prefetchCount = 0;
+    DisplayModel* curPrefetchDm = nullptr;
+    Vec<PrefetchedPage> prefetchedPages;
+    HANDLE prefetchThread = nullptr;
+    HANDLE startPrefetching = nullptr;
+
+    // pages which were already loaded when the render thread got to them (and how
+    // long loading them took), pages it had to load itself and pages loaded in vain
+    int prefetchHits = 0;
+    double prefetchSavedMs = 0;
+    int prefetchMisses = 0;
+    int prefetchUnused = 0;
+
     Size maxTileSize{};
     bool isRemoteSession = false;
 
@@ -116,8 +154,13 @@ struct RenderCache {
     ~RenderCache();
 
     void RequestRendering(DisplayModel* dm, int pageNo);
+    void RequestPreview(DisplayModel* dm, int pageNo);
     void Render(DisplayModel* dm, int pageNo, int rotation, float zoom, RectF pageRect, RenderingCallback& callback);
     void CancelRendering(DisplayModel* dm);
+    // replaces the pages waiting to be prefetched for dm
+    void RequestPrefetch(DisplayModel* dm, const Vec<int>& pageNos);
+    void CancelPrefetch(DisplayModel* dm);
+    void FreePrefetchedPages(DisplayModel* dm);
     bool Exists(DisplayModel* dm, int pageNo, int rotation, float zoom = kInvalidZoom, TilePosition* tile = nullptr);
     void FreeForDisplayModel(DisplayModel* dm);
     void KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm);
@@ -132,6 +175,7 @@ struct RenderCache {
     void Add(PageRenderRequest& req, RenderedBitmap* bmp);
 
     USHORT GetTileRes(DisplayModel* dm, int pageNo) const;
+    float GetPreviewZoom(DisplayModel* dm, int pageNo) const;
     USHORT GetMaxTileRes(DisplayModel* dm, int pageNo, int rotation);
     bool ReduceTileSize();
 
@@ -141,12 +185,18 @@ struct RenderCache {
     int GetRenderDelay(DisplayModel* dm, int pageNo, TilePosition tile);
     void RequestRendering(DisplayModel* dm, int pageNo, TilePosition tile, bool clearQueueForPage = true);
     bool Render(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition* tile = nullptr,
-                RectF* pageRect = nullptr, RenderingCallback* renderCb = nullptr);
+                RectF* pageRect = nullptr, RenderingCallback* renderCb = nullptr, bool preview = false);
     void ClearQueueForDisplayModel(DisplayModel* dm, int pageNo = kInvalidPageNo, TilePosition* tile = nullptr);
     void AbortCurrentRequest();
 
     static DWORD WINAPI RenderCacheThread(LPVOID data);
 
+    bool GetNextPrefetchRequest(PagePrefetchRequest* req);
+    void AddPrefetchedPage(DisplayModel* dm, int pageNo, double loadMs);
+    void CountPageLoad(DisplayModel* dm, int pageNo, bool wasLoaded);
+    void LogPrefetchStats();
+    static DWORD WINAPI PrefetchThread(LPVOID data);
+
     BitmapCacheEntry* Find(DisplayModel* dm, int pageNo, int rotation, float zoom = kInvalidZoom,
                            TilePosition* tile = nullptr);
     bool DropCacheEntry(BitmapCacheEntry* entry);
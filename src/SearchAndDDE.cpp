@@ -39,6 +39,8 @@
 #include "SumatraDialogs.h"
 #include "Translations.h"
 #include "CPSLabAnnot.h"
+#include "CpsLabExportJob.h"
+#include "CpsLabExport.h"
 #include "AppSettings.h"
 
 #include "utils/Log.h"
@@ -1145,12 +1147,34 @@ static const char* HandleGetFileStateCmd(HWND hwnd, const char* cmd, bool* ack,
     return next;
 }
 
+/*
+ CPS Lab.
+[GetExportState("<textFileName>")]
+returns "running <pages done>/<pages>", "done", "cancelled" or "failed"
+*/
+static const char* HandleGetExportStateCmd(const char* cmd, bool* ack, str::Str& res) {
+    AutoFreeStr txtFile;
+    const char* next = str::Parse(cmd, "[GetExportState(\"%s\")]", &txtFile);
+    if (!next) {
+        return nullptr;
+    }
+    if (!cpslab::GetExportStatus(txtFile, res)) {
+        res.Append("error: no export");
+    }
+    *ack = true;
+    return next;
+}
+
 
 
 /*
  CPS Lab.
 [GetText("<pdffilepath>", "<textFileName>", "<pageNo>")]
 [GetText("<pdffilepath>", "<textFileName>)]
+[GetWord("<pdffilepath>", "<textFileName>)]
+[GetBlock("<pdffilepath>", "<textFileName>)]
+The export runs in the background, see GetExportState, CancelExport
+and the ExportDone notification.
 */
 static const char* HandleGetTextCmd(const char* cmd, bool* ack) {
     AutoFreeStr pdfFile ;
@@ -1186,15 +1210,32 @@ static const char* HandleGetTextCmd(const char* cmd, bool* ack) {
         }
     }
 
+    DisplayModel* dm = win->AsFixed();
+    if (!dm) {
+        return next;
+    }
+
+    cpslab::ExportKind kind = cpslab::ExportKind::Text;
     if (get_block) {
-        cpslab::SaveBlocksToFile(win, txtFile.Get());
+        kind = cpslab::ExportKind::Blocks;
+    } else if (get_word) {
+        kind = cpslab::ExportKind::Words;
     }
-    else if (get_word) {
-        cpslab::SaveWordsToFile(win, txtFile.Get());
-    } else {
-        cpslab::SaveTextToFile(win, txtFile.Get());
+    *ack = cpslab::StartExport(dm->GetEngine(), kind, txtFile.Get());
+    return next;
+}
+
+/*
+ CPS Lab.
+[CancelExport("<textFileName>")]
+*/
+static const char* HandleCancelExportCmd(const char* cmd, bool* ack) {
+    AutoFreeStr txtFile;
+    const char* next = str::Parse(cmd, "[CancelExport(\"%s\")]", &txtFile);
+    if (!next) {
+        return nullptr;
     }
-    *ack = true;
+    *ack = cpslab::CancelExport(txtFile);
     return next;
 }
 
@@ -1435,6 +1476,9 @@ static bool HandleExecuteCmds(HWND hwnd, const char* cmd) {
         if (!nextCmd) {
             nextCmd = HandleGetTextCmd(cmd, &didHandle);
         }
+        if (!nextCmd) {
+            nextCmd = HandleCancelExportCmd(cmd, &didHandle);
+        }
         if (!nextCmd) {
             nextCmd = HandleMarkWordCmd(cmd, &didHandle);
         }
@@ -1468,6 +1512,9 @@ static bool HandleRequestCmds(HWND hwnd, const char* cmd, str::Str& rsp) {
         }
 
         const char* nextCmd = HandleGetFileStateCmd(hwnd, cmd, &didHandle, rsp);
+        if (!nextCmd) {
+            nextCmd = HandleGetExportStateCmd(cmd, &didHandle, rsp);
+        }
         if (!nextCmd) {
             AutoFreeStr tmp;
             nextCmd = str::Parse(cmd, "%s]", &tmp);
@@ -428,6 +428,16 @@ struct StressTest {
     int fileIndex = 0;
     bool gotToc = false;
 
+    // with -fast-scroll: time (since scrolling started) at which pages became
+    // visible and how long it then took to render them (-1 if not yet)
+    bool fastScroll = false;
+    LARGE_INTEGER scrollStartTime = {};
+    double scrollEndMs = -1;
+    Vec<double> pageVisibleMs;
+    Vec<double> pageLatencyMs;
+    int prefetchHitsStart = 0;
+    int prefetchMissesStart = 0;
+
     // owned by StressTest
     TestFileProvider* fileProvider = nullptr;
 
@@ -516,6 +526,23 @@ static void Start(StressTest* st, const char* path, const char* filter, const ch
     }
 }
 
+static void StartFastScroll(StressTest* st) {
+    auto ctrl = st->win->ctrl;
+    // fit width makes pages tall, so that there's more scrolling per page
+    ctrl->SetZoomVirtual(kZoomFitWidth, nullptr);
+    int nPages = ctrl->PageCount();
+    st->pageVisibleMs.Reset();
+    st->pageLatencyMs.Reset();
+    for (int i = 0; i < nPages; i++) {
+        st->pageVisibleMs.Append(-1);
+        st->pageLatencyMs.Append(-1);
+    }
+    st->scrollEndMs = -1;
+    st->prefetchHitsStart = gRenderCache->prefetchHits;
+    st->prefetchMissesStart = gRenderCache->prefetchMisses;
+    st->scrollStartTime = TimeGet();
+}
+
 static bool OpenFile(StressTest* st, const char* fileName) {
     printf("%s\n", fileName);
     fflush(stdout);
@@ -575,6 +602,12 @@ static bool OpenFile(StressTest* st, const char* fileName) {
         SetSidebarVisibility(st->win, st->win->tocVisible, gGlobalPrefs->showFavorites);
     }
 
+    if (st->fastScroll) {
+        StartFastScroll(st);
+        ++st->nFilesProcessed;
+        return true;
+    }
+
     st->nSlowPages = 0;
     st->pagesToRender.Clear();
     constexpr int nMaxPages = 32;
@@ -778,6 +811,89 @@ static bool GoToNextPage(StressTest* st) {
     return true;
 }
 
+static void ReportFastScroll(StressTest* st) {
+    Vec<double> latencies;
+    int nSkipped = 0;
+    int nPages = st->pageLatencyMs.Size();
+    for (int i = 0; i < nPages; i++) {
+        if (st->pageLatencyMs[i] >= 0) {
+            latencies.Append(st->pageLatencyMs[i]);
+        } else if (st->pageVisibleMs[i] >= 0) {
+            nSkipped++;
+        }
+    }
+    int nRendered = latencies.Size();
+    if (nRendered == 0) {
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (double ms : latencies) {
+        total += ms;
+    }
+    int nHits = gRenderCache->prefetchHits - st->prefetchHitsStart;
+    int nMisses = gRenderCache->prefetchMisses - st->prefetchMissesStart;
+    TempStr s = str::FormatTemp(
+        "Scrolled in %d ms: %d pages rendered after avg %d ms, median %d ms, 90%% %d ms, max %d ms, %d scrolled "
+        "past before being rendered, %d of %d pages prefetched",
+        (int)TimeSinceInMs(st->scrollStartTime), nRendered, (int)(total / nRendered), (int)latencies[nRendered / 2],
+        (int)latencies[nRendered * 9 / 10], (int)latencies.Last(), nSkipped, nHits, nHits + nMisses);
+    printf("%s\n", s);
+    fflush(stdout);
+    logfa("%s\n", s);
+    NotificationCreateArgs args;
+    args.hwndParent = st->win->hwndCanvas;
+    args.msg = s;
+    args.groupId = kNotifGroupStressTestBenchmark;
+    ShowNotification(args);
+}
+
+// scrolls down a third of the window on every tick, which is about as fast
+// as dragging the scrollbar, and records when each page got rendered after
+// becoming visible. returns false if the stress test has finished
+static bool FastScrollStep(StressTest* st) {
+    DisplayModel* dm = st->win->AsFixed();
+    double nowMs = TimeSinceInMs(st->scrollStartTime);
+    bool allRendered = true;
+    int nPages = std::min(dm->PageCount(), (int)st->pageLatencyMs.Size());
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        if (!dm->PageVisible(pageNo)) {
+            continue;
+        }
+        int i = pageNo - 1;
+        if (st->pageVisibleMs[i] < 0) {
+            st->pageVisibleMs[i] = nowMs;
+        }
+        if (st->pageLatencyMs[i] >= 0) {
+            continue;
+        }
+        if (!dm->ShouldCacheRendering(pageNo) || gRenderCache->Exists(dm, pageNo, dm->GetRotation())) {
+            st->pageLatencyMs[i] = nowMs - st->pageVisibleMs[i];
+        } else {
+            allRendered = false;
+        }
+    }
+
+    int yBefore = dm->yOffset();
+    dm->ScrollYBy(dm->GetViewPort().dy / 3, false);
+    if (dm->yOffset() != yBefore) {
+        return true;
+    }
+    // at the end of the document, wait (at most 3 seconds) for the last pages
+    if (st->scrollEndMs < 0) {
+        st->scrollEndMs = nowMs;
+    }
+    if (!allRendered && nowMs - st->scrollEndMs < 3.0 * 1000) {
+        return true;
+    }
+    ReportFastScroll(st);
+    if (GoToNextFile(st)) {
+        return true;
+    }
+    Finished(st, true);
+    return false;
+}
+
 static void OnTimer(StressTest* st, int timerIdGot) {
     DisplayModel* dm;
     bool didRender;
@@ -802,6 +918,13 @@ static void OnTimer(StressTest* st, int timerIdGot) {
         goto Next;
     }
 
+    if (st->fastScroll) {
+        if (!FastScrollStep(st)) {
+            return;
+        }
+        goto Next;
+    }
+
     // For non-image files, we detect if a page was rendered by checking the cache
     // (but we don't wait more than 3 seconds).
     // Image files are always fully rendered in WM_PAINT, so we know the page
@@ -889,6 +1012,7 @@ void StartStressTest(Flags* i, MainWindow* win) {
             // dst will be deleted when the stress ends
             win = windows[j];
             StressTest* dst = new StressTest(win, i->exitWhenDone);
+            dst->fastScroll = i->stressFastScroll;
             win->stressTest = dst;
             Start(dst, filesProvider, i->stressTestCycles);
         }
@@ -897,6 +1021,7 @@ void StartStressTest(Flags* i, MainWindow* win) {
     } else {
         // dst will be deleted when the stress ends
         StressTest* st = new StressTest(win, i->exitWhenDone);
+        st->fastScroll = i->stressFastScroll;
         win->stressTest = st;
         Start(st, i->stressTestPath, i->stressTestFilter, i->stressTestRanges, i->stressTestCycles);
     }
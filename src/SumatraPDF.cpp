@@ -90,6 +90,8 @@
 #include "Theme.h"
 #include "Caption.h"
 #include "CpsLabAnnot.h"
+#include "CpsLabExportJob.h"
+#include "CpsLabExport.h"
 
 #include "utils/Log.h"
 
@@ -702,6 +704,7 @@ struct ControllerCallbackHandler : DocControllerCallback {
     void ZoomChanged(DocController* ctrl, float zoomVirtual) override;
     void UpdateScrollbars(Size canvas) override;
     void RequestRendering(int pageNo) override;
+    void RequestPrefetch(const Vec<int>& pageNos) override;
     void CleanUp(DisplayModel* dm) override;
     void RenderThumbnail(DisplayModel* dm, Size size, const onBitmapRenderedCb&) override;
     void GotoLink(IPageDestination* dest) override {
@@ -800,9 +803,26 @@ void ControllerCallbackHandler::RequestRendering(int pageNo) {
     }
 }
 
+/* Send the pages the user is heading towards to the prefetch thread */
+void ControllerCallbackHandler::RequestPrefetch(const Vec<int>& pageNos) {
+    DisplayModel* dm = win->AsFixed();
+    if (!dm) {
+        return;
+    }
+    Vec<int> toPrefetch;
+    for (int pageNo : pageNos) {
+        // plain images are rendered directly, see RequestRendering()
+        if (dm->ShouldCacheRendering(pageNo)) {
+            toPrefetch.Append(pageNo);
+        }
+    }
+    gRenderCache->RequestPrefetch(dm, toPrefetch);
+}
+
 void ControllerCallbackHandler::CleanUp(DisplayModel* dm) {
     gRenderCache->CancelRendering(dm);
     gRenderCache->FreeForDisplayModel(dm);
+    gRenderCache->FreePrefetchedPages(dm);
 }
 
 void ControllerCallbackHandler::FocusFrame(bool always) {
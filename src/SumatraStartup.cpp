@@ -69,6 +69,8 @@
 #include "AppColors.h"
 #include "Theme.h"
 #include "CpsLabAnnot.h"
+#include "CpsLabExportJob.h"
+#include "CpsLabExport.h"
 
 #include "utils/Log.h"
 
@@ -1061,8 +1063,18 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
         ShutdownCommon();
         return 0;
     }
+
+    if (flags.perfTest) {
+        RunPerfTest(flags);
+        ShutdownCommon();
+        return 0;
+    }
 #endif
 
+    if (flags.sharedStoreMB > 0) {
+        EnableMupdfSharedStore((size_t)flags.sharedStoreMB << 20);
+    }
+
     if (flags.appdataDir) {
         SetAppDataDir(flags.appdataDir);
     }
@@ -1124,6 +1136,12 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
         }
     }
 
+    // must be after -appdata and plugin mode handling so that accelerator
+    // and repair files end up in the right directory (or aren't written at all)
+    if (HasPermission(Perm::SavePreferences)) {
+        SetMupdfAcceleratorDir(GetThumbnailCacheDirTemp());
+    }
+
     {
         // search only applies if there's 1 file
         auto nFiles = flags.fileNames.Size();
@@ -1363,6 +1381,7 @@ ContinueOpenWindow:
     exitCode = RunMessageLoop();
     SafeCloseHandle(&hMutex);
     CleanUpThumbnailCache();
+    cpslab::CancelAllExports();
 
 Exit:
     logf("Exiting with exit code: %d\n", exitCode);
@@ -1419,6 +1438,8 @@ Exit:
 
     FileWatcherWaitForShutdown();
     delete gRenderCache;
+    // all engines have been released with their windows
+    DestroyMupdfSharedStore();
     SaveCallstackLogs();
     dbghelp::FreeCallstackLogs();
 
@@ -1,6 +1,15 @@
 /* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
    License: GPLv3 */
 
+extern "C" {
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+#include "../mupdf/source/fitz/color-imp.h"
+#include "../mupdf/source/fitz/draw-imp.h"
+#include "../mupdf/source/fitz/pixmap-imp.h"
+}
+
+#include <vector>
 #include "utils/BaseUtil.h"
 
 #include "AppTools.h"
@@ -9,6 +18,7 @@
 #include "utils/WinUtil.h"
 #include "utils/StrFormat.h"
 #include "utils/ScopedWin.h"
+#include "utils/ZipUtil.h"
 
 #include "wingui/UIModels.h"
 
@@ -17,6 +27,12 @@
 #include "EngineBase.h"
 #include "GlobalPrefs.h"
 #include "Flags.h"
+#include "EngineAll.h"
+#include "EngineMupdf.h"
+#include "Annotation.h"
+#include "PageLabels.h"
+#include "PdfSync.h"
+#include "CpsLabAnnot.h"
 
 #include <float.h>
 #include <math.h>
@@ -134,6 +150,15 @@ static void ParseCommandLineTest() {
         utassert(i.startZoom == kZoomFitContent);
         utassert(0 == i.fileNames.Size());
     }
+
+    {
+        Flags i;
+        ParseFlags(L"SumatraPDF.exe -perf-test simd -page 3 foo.pdf", i);
+        utassert(str::Eq(i.perfTest, "simd"));
+        utassert(i.pageNumber == 3);
+        utassert(1 == i.fileNames.Size());
+        utassert(0 == i.fileNames.Find("foo.pdf"));
+    }
 }
 
 static void BenchRangeTest() {
@@ -222,10 +247,807 @@ static void colorTest() {
     utassert(c == c2);
 }
 
+static void assertPageLabels(PageLabels& pl, const char** labels) {
+    for (int pageNo = 1; pageNo <= pl.pageCount; pageNo++) {
+        TempStr label = pl.GetLabelTemp(pageNo);
+        utassert(str::Eq(label, labels[pageNo - 1]));
+        // the first page with the label
+        int expectedPageNo = pageNo;
+        for (int i = 0; i < pageNo - 1; i++) {
+            if (str::Eq(labels[i], label)) {
+                expectedPageNo = i + 1;
+                break;
+            }
+        }
+        utassert(pl.GetPageByLabel(label) == expectedPageNo);
+    }
+}
+
+static void PageLabelsTest() {
+    {
+        // just page numbers
+        PageLabels pl(5);
+        pl.AddRange(1, "D", nullptr, 1);
+        utassert(!pl.Finish(false));
+    }
+
+    {
+        PageLabels pl(20);
+        pl.AddRange(15, "A", "App-", 1);
+        pl.AddRange(1, "r", nullptr, 1);
+        pl.AddRange(5, "D", nullptr, 1);
+        pl.AddRange(25, "D", "unused", 1);
+        utassert(pl.Finish(false));
+        utassert(pl.ranges.Size() == 3);
+        const char* labels[] = {"i", "ii", "iii", "iv",  "1",     "2",     "3",     "4",     "5",     "6",
+                                "7", "8",  "9",   "10",  "App-A", "App-B", "App-C", "App-D", "App-E", "App-F"};
+        assertPageLabels(pl, labels);
+        const char* notLabels[] = {"",   "0",  "01",   "+1",    "11",  "v",    "IV",    "iiii",
+                                   "vi", "App-", "App-G", "App-a", "App-AA", "App-1", "x", "App-AB"};
+        for (const char* s : notLabels) {
+            utassert(pl.GetPageByLabel(s) == 0);
+        }
+        utassert(pl.GetLabelTemp(0) == nullptr);
+        utassert(pl.GetLabelTemp(21) == nullptr);
+    }
+
+    {
+        // pages before the first range have empty labels and /St other than 1
+        PageLabels pl(5);
+        pl.AddRange(3, "D", "p", 5);
+        utassert(pl.Finish(false));
+        const char* labels[] = {"", "", "p5", "p6", "p7"};
+        assertPageLabels(pl, labels);
+        utassert(pl.GetPageByLabel("p4") == 0);
+        utassert(pl.GetPageByLabel("p8") == 0);
+    }
+
+    {
+        // a range replaces an earlier one starting at the same page
+        PageLabels pl(4);
+        pl.AddRange(1, "D", nullptr, 1);
+        pl.AddRange(3, "R", nullptr, 1);
+        pl.AddRange(3, "a", "x", 27);
+        utassert(pl.Finish(false));
+        const char* labels[] = {"1", "2", "xaa", "xbb"};
+        assertPageLabels(pl, labels);
+    }
+
+    {
+        // labels that could come from more than one range
+        PageLabels pl(8);
+        pl.AddRange(1, "A", nullptr, 1);
+        pl.AddRange(3, "D", "A", 1);
+        pl.AddRange(5, "D", nullptr, 9);
+        pl.AddRange(7, nullptr, "10", 1);
+        utassert(pl.Finish(false));
+        const char* labels[] = {"A", "B", "A1", "A2", "9", "10", "10", "10"};
+        assertPageLabels(pl, labels);
+    }
+
+    {
+        // large numbers
+        PageLabels pl(3);
+        pl.AddRange(1, "R", nullptr, 3998);
+        pl.AddRange(3, "a", nullptr, 53);
+        utassert(pl.Finish(false));
+        const char* labels[] = {"MMMCMXCVIII", "MMMCMXCIX", "aaa"};
+        assertPageLabels(pl, labels);
+        utassert(pl.GetPageByLabel("MMMCMXCVIIII") == 0);
+        utassert(pl.GetPageByLabel("mmmcmxcix") == 0);
+    }
+
+    {
+        // duplicates made unique
+        PageLabels pl(9);
+        pl.AddRange(1, "D", nullptr, 1);
+        pl.AddRange(4, "D", nullptr, 1);
+        pl.AddRange(7, nullptr, "x", 1);
+        pl.AddRange(8, nullptr, "x.1", 1);
+        pl.AddRange(9, nullptr, "x", 1);
+        utassert(pl.Finish(true));
+        const char* labels[] = {"1", "2", "3", "1.1", "2.1", "3.1", "x", "x.1", "x.2"};
+        assertPageLabels(pl, labels);
+        utassert(pl.relabeled.Size() == 4);
+    }
+
+    {
+        PageLabels pl(3);
+        pl.AddRange(1, nullptr, "Cover", 1);
+        utassert(pl.Finish(false));
+        const char* labels[] = {"Cover", "Cover", "Cover"};
+        assertPageLabels(pl, labels);
+    }
+}
+
+// the SIMD levels other than scalar that the CPU supports
+static void GetSimdLevels(Vec<int>& levels) {
+    int best = fz_simd_level();
+    for (int level : {FZ_SIMD_SSE2, FZ_SIMD_AVX2, FZ_SIMD_NEON}) {
+        fz_set_simd_level(level);
+        if (fz_simd_level() == level) {
+            levels.Append(level);
+        }
+    }
+    fz_set_simd_level(best);
+}
+
+// random pixels with 3 colorants and premultiplied alpha. many of them are fully
+// transparent or opaque as those take different paths in the painters
+static void FillRandomRgba(u8* d, int nPixels) {
+    for (int i = 0; i < nPixels; i++, d += 4) {
+        int a = rand() % 4 == 0 ? 0 : (rand() % 3 == 0 ? 255 : rand() & 255);
+        for (int k = 0; k < 3; k++) {
+            d[k] = (u8)((rand() & 255) * a / 255);
+        }
+        d[3] = (u8)a;
+    }
+}
+
+static void FillRandomMask(u8* d, int n) {
+    for (int i = 0; i < n; i++) {
+        int r = rand() % 4;
+        d[i] = r == 0 ? 0 : (r == 1 ? 255 : (u8)rand());
+    }
+}
+
+// paints random spans with the scalar painters and with the SIMD painters
+// of a given level and returns the number of spans that came out different
+static int CompareSpanPainters(int level, int nIter) {
+    constexpr int kMaxDx = 100;
+    u8 orig[kMaxDx * 4], src[kMaxDx * 4], mask[kMaxDx];
+    u8 res[2][kMaxDx * 4];
+    int nDiffs = 0;
+    for (int i = 0; i < nIter; i++) {
+        int dx = 1 + rand() % kMaxDx;
+        u8 color[4] = {(u8)rand(), (u8)rand(), (u8)rand(), 255};
+        if (rand() % 2) {
+            color[3] = (u8)(1 + rand() % 255);
+        }
+        int alpha = rand() % 2 ? 255 : 1 + rand() % 255;
+        FillRandomRgba(orig, dx);
+        FillRandomRgba(src, dx);
+        FillRandomMask(mask, dx);
+        for (int kind = 0; kind < 3; kind++) {
+            for (int pass = 0; pass < 2; pass++) {
+                fz_set_simd_level(pass == 0 ? FZ_SIMD_NONE : level);
+                u8* d = res[pass];
+                memcpy(d, orig, dx * 4);
+                if (kind == 0) {
+                    fz_get_solid_color_painter(4, color, 1, nullptr)(d, 4, dx, color, 1, nullptr);
+                } else if (kind == 1) {
+                    fz_get_span_color_painter(4, 1, color, nullptr)(d, mask, 4, dx, color, 1, nullptr);
+                } else {
+                    fz_get_span_painter(1, 1, 3, alpha, nullptr)(d, 1, src, 1, 3, dx, alpha, nullptr);
+                }
+            }
+            if (memcmp(res[0], res[1], dx * 4) != 0) {
+                nDiffs++;
+            }
+        }
+    }
+    return nDiffs;
+}
+
+// same as CompareSpanPainters() for painting through a mask and for painting
+// rotated images (which uses bilinear interpolation)
+static int ComparePixmapPainters(fz_context* ctx, int level, int nIter) {
+    fz_colorspace* rgb = fz_device_rgb(ctx);
+    int nDiffs = 0;
+    for (int i = 0; i < nIter; i++) {
+        int dx = 1 + rand() % 200;
+        int dy = 1 + rand() % 50;
+        fz_pixmap* orig = fz_new_pixmap(ctx, rgb, dx, dy, nullptr, 1);
+        fz_pixmap* src = fz_new_pixmap(ctx, rgb, dx, dy, nullptr, 1);
+        fz_pixmap* mask = fz_new_pixmap(ctx, nullptr, dx, dy, nullptr, 1);
+        fz_pixmap* img = fz_new_pixmap(ctx, rgb, 1 + rand() % 64, 1 + rand() % 64, nullptr, 1);
+        FillRandomRgba(orig->samples, dx * dy);
+        FillRandomRgba(src->samples, dx * dy);
+        FillRandomMask(mask->samples, dx * dy);
+        FillRandomRgba(img->samples, img->w * img->h);
+        fz_matrix ctm = fz_scale(dx * 0.8f, dy * 0.8f);
+        ctm = fz_concat(ctm, fz_rotate((float)(rand() % 360)));
+        ctm = fz_concat(ctm, fz_translate(dx / 2.f, dy / 2.f));
+        fz_irect scissor = fz_pixmap_bbox(ctx, orig);
+
+        fz_pixmap* res[2];
+        for (int pass = 0; pass < 2; pass++) {
+            fz_set_simd_level(pass == 0 ? FZ_SIMD_NONE : level);
+            res[pass] = fz_clone_pixmap(ctx, orig);
+            fz_paint_pixmap_with_mask(res[pass], src, mask);
+            fz_paint_image(ctx, res[pass], &scissor, nullptr, nullptr, img, ctm, 255, 1, nullptr);
+        }
+        if (memcmp(res[0]->samples, res[1]->samples, (size_t)dx * dy * 4) != 0) {
+            nDiffs++;
+        }
+        fz_drop_pixmap(ctx, res[0]);
+        fz_drop_pixmap(ctx, res[1]);
+        fz_drop_pixmap(ctx, img);
+        fz_drop_pixmap(ctx, mask);
+        fz_drop_pixmap(ctx, src);
+        fz_drop_pixmap(ctx, orig);
+    }
+    return nDiffs;
+}
+
+// SIMD painters of the draw device must give exactly the same results as the scalar painters
+static void SimdPaintersTest() {
+    int best = fz_simd_level();
+    Vec<int> levels;
+    GetSimdLevels(levels);
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    for (int level : levels) {
+        srand(1);
+        utassert(CompareSpanPainters(level, 2000) == 0);
+        utassert(ComparePixmapPainters(ctx, level, 100) == 0);
+    }
+    fz_drop_context(ctx);
+    fz_set_simd_level(best);
+}
+
+struct ColorConversion {
+    const char* name;
+    fz_colorspace* (*src)(fz_context*);
+    bool srcAlpha;
+    fz_colorspace* (*dst)(fz_context*);
+    bool dstAlpha;
+};
+
+// the conversions that have SIMD kernels in color-simd.c
+static ColorConversion gColorConversions[] = {
+    {"rgba -> bgra", fz_device_rgb, true, fz_device_bgr, true},
+    {"rgb -> bgra", fz_device_rgb, false, fz_device_bgr, true},
+    {"rgb -> rgba", fz_device_rgb, false, fz_device_rgb, true},
+    {"rgb -> bgr", fz_device_rgb, false, fz_device_bgr, false},
+    {"gray -> bgra", fz_device_gray, false, fz_device_bgr, true},
+    {"graya -> bgra", fz_device_gray, true, fz_device_bgr, true},
+    {"gray -> rgb", fz_device_gray, false, fz_device_rgb, false},
+    {"cmyk -> rgb", fz_device_cmyk, false, fz_device_rgb, false},
+    {"cmyk -> bgra", fz_device_cmyk, false, fz_device_bgr, true},
+};
+
+// random premultiplied pixels for any number of colorants
+static void FillRandomPixmap(fz_pixmap* pix) {
+    for (int y = 0; y < pix->h; y++) {
+        u8* s = pix->samples + (size_t)y * pix->stride;
+        for (int x = 0; x < pix->w; x++, s += pix->n) {
+            int a = 255;
+            if (pix->alpha) {
+                a = rand() % 4 == 0 ? 0 : (rand() % 3 == 0 ? 255 : rand() & 255);
+                s[pix->n - 1] = (u8)a;
+            }
+            for (int k = 0; k < pix->n - pix->alpha; k++) {
+                s[k] = (u8)((rand() & 255) * a / 255);
+            }
+        }
+    }
+}
+
+// like FzConvertPixmap2() in EngineMupdf.cpp, always keeps or adds alpha when asked to
+static fz_pixmap* ConvertPixmap(fz_context* ctx, fz_pixmap* src, fz_colorspace* cs, bool alpha) {
+    fz_pixmap* dst = fz_new_pixmap(ctx, cs, src->w, src->h, nullptr, alpha ? 1 : 0);
+    fz_convert_pixmap_samples(ctx, src, dst, nullptr, nullptr, fz_default_color_params, 1);
+    return dst;
+}
+
+static bool SamePixels(fz_pixmap* a, fz_pixmap* b) {
+    return memcmp(a->samples, b->samples, (size_t)a->stride * a->h) == 0;
+}
+
+// SIMD color conversion and premultiplying must give exactly the same results as the scalar code
+static void SimdColorsTest() {
+    int best = fz_simd_level();
+    Vec<int> levels;
+    GetSimdLevels(levels);
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    // CMYK is converted with the naive formula only without ICC
+    fz_disable_icc(ctx);
+
+    for (int level : levels) {
+        srand(1);
+        for (int i = 0; i < 500; i++) {
+            auto& conv = gColorConversions[rand() % dimof(gColorConversions)];
+            int dx = 1 + rand() % 200;
+            int dy = 1 + rand() % 8;
+            fz_pixmap* src = fz_new_pixmap(ctx, conv.src(ctx), dx, dy, nullptr, conv.srcAlpha ? 1 : 0);
+            FillRandomPixmap(src);
+            fz_pixmap* res[2];
+            for (int pass = 0; pass < 2; pass++) {
+                fz_set_simd_level(pass == 0 ? FZ_SIMD_NONE : level);
+                res[pass] = ConvertPixmap(ctx, src, conv.dst(ctx), conv.dstAlpha);
+            }
+            utassert(SamePixels(res[0], res[1]));
+            fz_drop_pixmap(ctx, res[0]);
+            fz_drop_pixmap(ctx, res[1]);
+            fz_drop_pixmap(ctx, src);
+
+            // un-premultiplied RGBA, as loaded from images
+            fz_pixmap* rgba = fz_new_pixmap(ctx, fz_device_rgb(ctx), dx, dy, nullptr, 1);
+            for (size_t k = 0; k < (size_t)dx * dy * 4; k++) {
+                rgba->samples[k] = (u8)rand();
+            }
+            for (int pass = 0; pass < 2; pass++) {
+                fz_set_simd_level(pass == 0 ? FZ_SIMD_NONE : level);
+                res[pass] = fz_clone_pixmap(ctx, rgba);
+                fz_premultiply_pixmap(ctx, res[pass]);
+            }
+            utassert(SamePixels(res[0], res[1]));
+            fz_drop_pixmap(ctx, res[0]);
+            fz_drop_pixmap(ctx, res[1]);
+            fz_drop_pixmap(ctx, rgba);
+        }
+    }
+    fz_set_simd_level(best);
+    fz_drop_context(ctx);
+}
+
+static bool SameScaledPixmaps(fz_pixmap* a, fz_pixmap* b) {
+    if (!a || !b) {
+        return a == b;
+    }
+    if (a->w != b->w || a->h != b->h || a->n != b->n || a->x != b->x || a->y != b->y) {
+        return false;
+    }
+    return SamePixels(a, b);
+}
+
+// the SIMD filter passes of fz_scale_pixmap() must give exactly the same results
+// as the scalar ones and exact power of two reductions must average boxes of source pixels
+static void ImageScaleTest() {
+    int best = fz_simd_level();
+    Vec<int> levels;
+    GetSimdLevels(levels);
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    fz_colorspace* colorspaces[] = {nullptr, fz_device_gray(ctx), fz_device_rgb(ctx), fz_device_cmyk(ctx)};
+    fz_scale_cache* cacheX = fz_new_scale_cache(ctx);
+    fz_scale_cache* cacheY = fz_new_scale_cache(ctx);
+
+    for (int level : levels) {
+        srand(1);
+        for (int i = 0; i < 500; i++) {
+            fz_colorspace* cs = colorspaces[rand() % dimof(colorspaces)];
+            bool alpha = !cs || rand() % 2;
+            fz_pixmap* src = fz_new_pixmap(ctx, cs, 1 + rand() % 300, 1 + rand() % 200, nullptr, alpha ? 1 : 0);
+            FillRandomPixmap(src);
+            // negative sizes flip, fractional positions and sizes force alpha
+            float w = (rand() % 2 ? 1 : -1) * (1 + rand() % 400) * (rand() % 2 ? 1.f : 0.37f);
+            float h = (rand() % 3 ? 1 : -1) * (1 + rand() % 300) * (rand() % 2 ? 1.f : 0.61f);
+            float x = rand() % 2 ? 0 : (rand() % 100) / 7.f;
+            float y = rand() % 2 ? 0 : (rand() % 100) / 9.f;
+            fz_irect clip = {rand() % 50 - 60, rand() % 50 - 60, 20 + rand() % 400, 20 + rand() % 300};
+            fz_irect* clipPtr = rand() % 2 ? &clip : nullptr;
+            fz_pixmap* res[2];
+            for (int pass = 0; pass < 2; pass++) {
+                fz_set_simd_level(pass == 0 ? FZ_SIMD_NONE : level);
+                res[pass] = fz_scale_pixmap_cached(ctx, src, x, y, w, h, clipPtr, cacheX, cacheY);
+            }
+            utassert(SameScaledPixmaps(res[0], res[1]));
+            fz_drop_pixmap(ctx, res[0]);
+            fz_drop_pixmap(ctx, res[1]);
+            fz_drop_pixmap(ctx, src);
+        }
+    }
+    fz_set_simd_level(best);
+    fz_drop_scale_cache(ctx, cacheX);
+    fz_drop_scale_cache(ctx, cacheY);
+
+    srand(1);
+    for (int i = 0; i < 100; i++) {
+        fz_colorspace* cs = colorspaces[1 + rand() % 3];
+        int l2x = rand() % 4;
+        int l2y = (l2x == 0 ? 1 : 0) + rand() % 3;
+        int dx = 1 + rand() % 100;
+        int dy = 1 + rand() % 100;
+        fz_pixmap* src = fz_new_pixmap(ctx, cs, dx << l2x, dy << l2y, nullptr, 0);
+        FillRandomPixmap(src);
+        fz_pixmap* res = fz_scale_pixmap(ctx, src, 0, 0, (float)dx, (float)dy, nullptr);
+        bool same = res && res->w == dx && res->h == dy;
+        int n = src->n;
+        int shift = l2x + l2y;
+        for (int y = 0; same && y < dy; y++) {
+            for (int x = 0; same && x < dx; x++) {
+                for (int k = 0; k < n; k++) {
+                    int sum = (1 << shift) >> 1;
+                    for (int by = 0; by < (1 << l2y); by++) {
+                        const u8* s = src->samples + (size_t)((y << l2y) + by) * src->stride;
+                        for (int bx = 0; bx < (1 << l2x); bx++) {
+                            sum += s[((x << l2x) + bx) * n + k];
+                        }
+                    }
+                    same &= res->samples[(size_t)y * res->stride + x * n + k] == (u8)(sum >> shift);
+                }
+            }
+        }
+        utassert(same);
+        fz_drop_pixmap(ctx, res);
+        fz_drop_pixmap(ctx, src);
+    }
+    fz_drop_context(ctx);
+}
+
+static void PutNumberedName(fz_context* ctx, pdf_obj* dict, const char* prefix, int i, pdf_obj* val) {
+    char name[32];
+    fz_snprintf(name, sizeof(name), "%s%d", prefix, i);
+    pdf_dict_puts(ctx, dict, name, val);
+}
+
+static pdf_obj* GetNumberedName(fz_context* ctx, pdf_obj* dict, const char* prefix, int i) {
+    char name[32];
+    fz_snprintf(name, sizeof(name), "%s%d", prefix, i);
+    return pdf_dict_gets(ctx, dict, name);
+}
+
+// builds a dictionary the way resource dictionaries get built and changed,
+// interleaving lookups (which build the hash index) with changes to it
+static int CheckDictLookups(fz_context* ctx, pdf_document* doc, int n) {
+    int nErrors = 0;
+    pdf_obj* dict = pdf_new_dict(ctx, doc, 4);
+    for (int i = 0; i < n; i++) {
+        pdf_obj* val = pdf_new_int(ctx, i);
+        PutNumberedName(ctx, dict, i % 2 ? "Im" : "F", i, val);
+        pdf_drop_obj(ctx, val);
+        if (i % 7 == 0) {
+            nErrors += pdf_to_int(ctx, GetNumberedName(ctx, dict, "F", i / 2 * 2)) != i / 2 * 2;
+        }
+    }
+    pdf_dict_put(ctx, dict, PDF_NAME(Type), PDF_NAME(XObject));
+    for (int i = 0; i < n; i += 3) {
+        char name[32];
+        fz_snprintf(name, sizeof(name), "%s%d", i % 2 ? "Im" : "F", i);
+        pdf_dict_dels(ctx, dict, name);
+        if (i % 5 == 0) {
+            nErrors += GetNumberedName(ctx, dict, "Im", n + i) != nullptr;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        pdf_obj* v = GetNumberedName(ctx, dict, i % 2 ? "Im" : "F", i);
+        if (i % 3 == 0) {
+            nErrors += v != nullptr;
+        } else {
+            nErrors += pdf_to_int(ctx, v) != i;
+        }
+        // a name of the other kind never exists
+        nErrors += GetNumberedName(ctx, dict, i % 2 ? "F" : "Im", i) != nullptr;
+    }
+    nErrors += pdf_dict_get(ctx, dict, PDF_NAME(Type)) != PDF_NAME(XObject);
+    nErrors += pdf_dict_get(ctx, dict, PDF_NAME(Subtype)) != nullptr;
+    nErrors += pdf_dict_len(ctx, dict) != n - (n + 2) / 3 + 1;
+    pdf_drop_obj(ctx, dict);
+    return nErrors;
+}
+
+// dictionary lookups must give the same results with and without the hash index
+static void PdfDictTest() {
+    int threshold = pdf_dict_hash_threshold();
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    pdf_document* doc = pdf_create_document(ctx);
+    for (int n : {4, 16, 64, 256, 1024, 4096}) {
+        for (int hashed = 0; hashed < 2; hashed++) {
+            pdf_set_dict_hash_threshold(hashed ? threshold : INT_MAX);
+            utassert(CheckDictLookups(ctx, doc, n) == 0);
+        }
+    }
+    pdf_set_dict_hash_threshold(threshold);
+    pdf_drop_document(ctx, doc);
+    fz_drop_context(ctx);
+}
+
+// appends a page of tabular numbers (like a data sheet or a bank statement)
+// with glyph boxes laid out the way FzTextPageToStr() produces them.
+// every 50th page also contains a few links
+static void AppendSyntheticPage(int pageNo, str::WStr& text, Vec<Rect>& coords) {
+    for (int line = 0; line < 60; line++) {
+        TempWStr s = ToWStrTemp(str::FormatTemp("%d.%02d %d %7.3f %d-%04d %6.2f%%", pageNo, line, rand() % 100000,
+                                                 rand() / 7.0, rand() % 100, rand() % 10000, rand() / 500.0));
+        if (pageNo % 50 == 0 && line % 20 == 0) {
+            s = ToWStrTemp(str::FormatTemp("see https://www.example.com/p?id=%d, www.example.org or mailto:a%d@b.com",
+                                           pageNo, line));
+        }
+        for (int i = 0; s[i]; i++) {
+            text.AppendChar(s[i]);
+            coords.Append(Rect(10 + i * 6, 20 + line * 12, 5, 10));
+        }
+        text.AppendChar('\n');
+        coords.Append(Rect());
+    }
+}
+
+static bool LinkRectListsEqual(const LinkRectList& a, const LinkRectList& b) {
+    if (a.links.Size() != b.links.Size() || a.coords.Size() != b.coords.Size()) {
+        return false;
+    }
+    for (int i = 0; i < a.links.Size(); i++) {
+        if (!str::Eq(a.links[i], b.links[i]) || memcmp(&a.coords[i], &b.coords[i], sizeof(fz_rect)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// links in a single line of text, with and without skipping to link candidates
+static void assertLinks(const WCHAR* text, const char** links, int nLinks) {
+    int len = (int)str::Len(text);
+    Vec<Rect> coords;
+    for (int i = 0; i < len; i++) {
+        coords.Append(Rect(10 + i * 6, 20, 5, 10));
+    }
+    LinkRectList lists[2];
+    for (int skip = 0; skip < 2; skip++) {
+        LinkifyText(lists[skip], text, len, coords.LendData(), skip == 1);
+    }
+    utassert(LinkRectListsEqual(lists[0], lists[1]));
+    utassert(lists[0].links.Size() == nLinks);
+    for (int i = 0; i < nLinks && i < lists[0].links.Size(); i++) {
+        utassert(str::Eq(lists[0].links.At(i), links[i]));
+    }
+    utassert(nLinks == 0 || LinkifyHasCandidates(text, len));
+}
+
+static void LinkifyTest() {
+    {
+        const WCHAR* text = L"no links here, 1.5 and 3:4";
+        assertLinks(text, nullptr, 0);
+        utassert(!LinkifyHasCandidates(text, (int)str::Len(text)));
+    }
+
+    {
+        const char* links[] = {"https://www.example.com/p?id=1", "http://www.example.org", "mailto:a1@b.com"};
+        assertLinks(L"see https://www.example.com/p?id=1, www.example.org or mailto:a1@b.com", links, 3);
+    }
+
+    {
+        const char* links[] = {"mailto:someone@example.com", "http://example.com"};
+        assertLinks(L"contact: someone@example.com. (see http://example.com)", links, 2);
+    }
+
+    {
+        // candidates that aren't links
+        assertLinks(L"www.example is not a link and neither is x/http://example.com", nullptr, 0);
+    }
+
+    // pages of numbers, some of them with links
+    srand(1);
+    for (int pageNo = 1; pageNo <= 200; pageNo++) {
+        str::WStr text;
+        Vec<Rect> coords;
+        AppendSyntheticPage(pageNo, text, coords);
+        LinkRectList full, skipped;
+        LinkifyText(full, text.Get(), text.isize(), coords.LendData(), false);
+        LinkifyText(skipped, text.Get(), text.isize(), coords.LendData(), true);
+        utassert(LinkRectListsEqual(full, skipped));
+        utassert(full.links.Size() == (pageNo % 50 == 0 ? 9 : 0));
+        utassert(LinkifyHasCandidates(text.Get(), text.isize()) == (pageNo % 50 == 0));
+        ResetTempAllocator();
+    }
+}
+
+static void MarkersTest() {
+    cpslab::MarkerNode m(nullptr);
+    const char* words[] = {"Net_1", "Net_2", "Net_3"};
+    for (const char* w : words) {
+        m.words.Append(w);
+    }
+    // Net_1 on pages 7 and 3, Net_2 on page 3, Net_3 isn't marked
+    int marks[][2] = {{0, 7}, {1, 3}, {0, 3}};
+    for (auto& mark : marks) {
+        m.mark_words.Append(m.words.At(mark[0]));
+        m.pages.Append(mark[1]);
+        m.rects.Append(Rect(10 + mark[0] * 30, mark[1] * 10, 20, 8));
+    }
+
+    utassert(m.hasWord("Net_1"));
+    utassert(m.hasWord("Net_3"));
+    utassert(!m.hasWord("Net_4"));
+    utassert(!m.hasWord("net_1"));
+    utassert(!m.hasWord(nullptr));
+    utassert(m.hasRect(Rect(40, 30, 20, 8)));
+    utassert(!m.hasRect(Rect(41, 30, 20, 8)));
+
+    // the first marked occurrence on pageNo or later
+    utassert(m.getPage("Net_1") == 7);
+    utassert(m.getPage("Net_1", 2) == 7);
+    utassert(m.getPage("Net_1", 7) == 7);
+    utassert(m.getPage("Net_1", 8) == -1);
+    utassert(m.getPage("Net_2", 1) == 3);
+    utassert(m.getPage("Net_3") == -1);
+    utassert(m.getPage(nullptr) == -1);
+
+    utassert(m.tExist(3, "Net_1"));
+    utassert(m.tExist(7, "Net_1"));
+    utassert(!m.tExist(5, "Net_1"));
+    utassert(!m.tExist(7, "Net_2"));
+    utassert(!m.tExist(3, nullptr));
+
+    {
+        StrVec onPage;
+        utassert(m.getMarkWordsByPageNo(3, onPage) == 2);
+        utassert(str::Eq(onPage.At(0), "Net_2"));
+        utassert(str::Eq(onPage.At(1), "Net_1"));
+        StrVec none;
+        utassert(m.getMarkWordsByPageNo(5, none) == 0);
+    }
+
+    // the index is updated when marks are appended
+    m.mark_words.Append(m.words.At(2));
+    m.pages.Append(5);
+    m.rects.Append(Rect(70, 50, 20, 8));
+    utassert(m.getPage("Net_3") == 5);
+    utassert(m.hasRect(Rect(70, 50, 20, 8)));
+    {
+        StrVec onPage;
+        utassert(m.getMarkWordsByPageNo(5, onPage) == 1);
+    }
+
+    // and must be invalidated when they are changed in place
+    m.pages[0] = 9;
+    m.invalidateIndex();
+    utassert(m.getPage("Net_1", 8) == 9);
+    utassert(!m.tExist(7, "Net_1"));
+}
+
+// layout of the documents for PdfSyncTest(): a source file per kSyncPagesPerFile
+// pages and a source line every 16 points from the top of each page
+constexpr int kSyncPages = 6;
+constexpr int kSyncPagesPerFile = 3;
+constexpr int kSyncLinesPerPage = 20;
+
+static int SyncLineTop(int lineIdx) {
+    return 72 + lineIdx * 16;
+}
+
+// source line (1-based) in the source file of page pageNo
+static int SyncSourceLine(int pageNo, int lineIdx) {
+    return ((pageNo - 1) % kSyncPagesPerFile) * kSyncLinesPerPage + lineIdx + 1;
+}
+
+static TempStr SyncSourceFileTemp(int pageNo) {
+    return str::FormatTemp("chap%d.tex", (pageNo - 1) / kSyncPagesPerFile);
+}
+
+// see http://itexmac.sourceforge.net/pdfsync.html
+static ByteSlice SyntheticPdfsync() {
+    str::Str s;
+    s.Append("main\nversion 1\n");
+    int record = 1;
+    for (int pageNo = 1; pageNo <= kSyncPages; pageNo++) {
+        if ((pageNo - 1) % kSyncPagesPerFile == 0) {
+            s.AppendFmt("(%s\n", path::GetPathNoExtTemp(SyncSourceFileTemp(pageNo)));
+        }
+        s.AppendFmt("s %d\n", pageNo);
+        for (int i = 0; i < kSyncLinesPerPage; i++, record++) {
+            // y is from the bottom of the page
+            s.AppendFmt("l %d %d\n", record, SyncSourceLine(pageNo, i));
+            s.AppendFmt("p %d %d %d\n", record, (int)(72 * 65781.76), (int)((792 - SyncLineTop(i)) * 65781.76));
+        }
+        if (pageNo % kSyncPagesPerFile == 0) {
+            s.Append(")\n");
+        }
+    }
+    return s.StealAsByteSlice();
+}
+
+// hboxes of 9pt height and 3pt depth for all source lines, in the text format of SyncTeX 1
+static ByteSlice SyntheticSyncTex(const char* dir) {
+    constexpr double sp = 65781.76; // Unit:1 means 1 sp, i.e. 65781.76 per pdf point
+    str::Str s;
+    s.Append("SyncTeX Version:1\n");
+    for (int pageNo = 1; pageNo <= kSyncPages; pageNo += kSyncPagesPerFile) {
+        int tag = (pageNo - 1) / kSyncPagesPerFile + 1;
+        s.AppendFmt("Input:%d:%s\n", tag, path::JoinTemp(dir, SyncSourceFileTemp(pageNo)));
+    }
+    s.Append("Output:pdf\nMagnification:1000\nUnit:1\nX Offset:0\nY Offset:0\nContent:\n");
+    int count = 0;
+    for (int pageNo = 1; pageNo <= kSyncPages; pageNo++) {
+        int tag = (pageNo - 1) / kSyncPagesPerFile + 1;
+        s.AppendFmt("{%d\n", pageNo);
+        s.AppendFmt("[%d,1:%d,%d:%d,%d,0\n", tag, (int)(72 * sp), (int)(72 * sp), (int)(468 * sp), (int)(648 * sp));
+        for (int i = 0; i < kSyncLinesPerPage; i++) {
+            int line = SyncSourceLine(pageNo, i);
+            int h = (int)(72 * sp);
+            int v = (int)((SyncLineTop(i) + 9) * sp);
+            s.AppendFmt("(%d,%d:%d,%d:%d,%d,%d\n", tag, line, h, v, (int)(468 * sp), (int)(9 * sp), (int)(3 * sp));
+            s.AppendFmt("x%d,%d:%d,%d\n", tag, line, h + (int)(10 * sp), v);
+            s.AppendFmt("g%d,%d:%d,%d\n", tag, line, h + (int)(200 * sp), v);
+            s.Append(")\n");
+            count += 4;
+        }
+        s.AppendFmt("]\n}%d\n", pageNo);
+        count += 3;
+    }
+    s.AppendFmt("Postamble:\nCount:%d\nPost scriptum:\n", count);
+    ByteSlice data = s.AsByteSlice();
+    return GzipCompress(data);
+}
+
+static void SaveBlankPdf(const char* path, int nPages) {
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    pdf_document* doc = pdf_create_document(ctx);
+    for (int i = 0; i < nPages; i++) {
+        fz_buffer* contents = fz_new_buffer(ctx, 16);
+        pdf_obj* res = pdf_new_dict(ctx, doc, 1);
+        pdf_obj* page = pdf_add_page(ctx, doc, fz_make_rect(0, 0, 612, 792), 0, res, contents);
+        pdf_insert_page(ctx, doc, -1, page);
+        pdf_drop_obj(ctx, page);
+        pdf_drop_obj(ctx, res);
+        fz_drop_buffer(ctx, contents);
+    }
+    pdf_save_document(ctx, doc, path, nullptr);
+    pdf_drop_document(ctx, doc);
+    fz_drop_context(ctx);
+}
+
+// forward and inverse search for every source line
+static void assertSyncResults(const char* pdfPath, EngineBase* engine) {
+    Synchronizer* sync = nullptr;
+    utassert(Synchronizer::Create(pdfPath, engine, &sync) == PDFSYNCERR_SUCCESS);
+    if (!sync) {
+        return;
+    }
+    for (int pageNo = 1; pageNo <= kSyncPages; pageNo++) {
+        TempStr srcFile = SyncSourceFileTemp(pageNo);
+        for (int lineIdx = 0; lineIdx < kSyncLinesPerPage; lineIdx++) {
+            Vec<Rect> rects;
+            int page = 0;
+            int res = sync->SourceToDoc(srcFile, SyncSourceLine(pageNo, lineIdx), 0, &page, rects);
+            utassert(res == PDFSYNCERR_SUCCESS && page == pageNo && rects.Size() > 0);
+            // the highlighted rectangle must contain the top of the line
+            utassert(rects.Size() > 0 && abs(rects[0].y - SyncLineTop(lineIdx)) <= 10);
+
+            AutoFreeStr foundFile;
+            int line = 0;
+            int col = 0;
+            Point pt{80, SyncLineTop(lineIdx) + 5};
+            res = sync->DocToSource(pageNo, pt, foundFile, &line, &col);
+            utassert(res == PDFSYNCERR_SUCCESS && line == SyncSourceLine(pageNo, lineIdx));
+            utassert(str::EndsWithI(foundFile, srcFile));
+        }
+    }
+    Vec<Rect> rects;
+    int page = 0;
+    utassert(sync->SourceToDoc("missing.tex", 1, 0, &page, rects) != PDFSYNCERR_SUCCESS);
+    delete sync;
+}
+
+static void PdfSyncTest() {
+    TempStr tmpPath = GetTempFilePathTemp("sync");
+    TempStr basePath = path::GetPathNoExtTemp(tmpPath);
+    TempStr pdfPath = str::JoinTemp(basePath, ".pdf");
+    TempStr pdfsyncPath = str::JoinTemp(basePath, ".pdfsync");
+    TempStr synctexGzPath = str::JoinTemp(basePath, ".synctex.gz");
+    SaveBlankPdf(pdfPath, kSyncPages);
+    EngineBase* engine = CreateEngineFromFile(pdfPath, nullptr, false);
+    utassert(engine != nullptr);
+    if (engine) {
+        ByteSlice data = SyntheticPdfsync();
+        file::WriteFile(pdfsyncPath, data);
+        data.Free();
+        assertSyncResults(pdfPath, engine);
+        // Synchronizer::Create() prefers .pdfsync over .synctex files
+        file::Delete(pdfsyncPath);
+
+        data = SyntheticSyncTex(path::GetDirTemp(pdfPath));
+        file::WriteFile(synctexGzPath, data);
+        data.Free();
+        assertSyncResults(pdfPath, engine);
+        file::Delete(synctexGzPath);
+        engine->Release();
+    }
+    file::Delete(pdfPath);
+    file::Delete(tmpPath);
+}
+
 void SumatraPDF_UnitTests() {
     colorTest();
     BenchRangeTest();
     ParseCommandLineTest();
     versioncheck_test();
     hexstrTest();
+    PageLabelsTest();
+    SimdPaintersTest();
+    SimdColorsTest();
+    ImageScaleTest();
+    PdfDictTest();
+    LinkifyTest();
+    MarkersTest();
+    PdfSyncTest();
 }
@@ -408,8 +408,8 @@ static void AddFavoriteFromToc(MainWindow* win, TocItem* dti) {
     if (!dti) {
         return;
     }
-    if (dti->dest) {
-        pageNo = PageDestGetPageNo(dti->dest);
+    if (dti->GetPageDestination()) {
+        pageNo = PageDestGetPageNo(dti->GetPageDestination());
     }
     char* name = dti->title;
     TempStr pageLabel = win->ctrl->GetPageLabeTemp(pageNo);
@@ -534,9 +534,9 @@ static void TocContextMenu(ContextMenuEvent* ev) {
     }
     int pageNo = 0;
     TocItem* dti = (TocItem*)ti;
-    IPageDestination* dest = dti ? dti->dest : nullptr;
+    IPageDestination* dest = dti ? dti->GetPageDestination() : nullptr;
     if (dest) {
-        pageNo = PageDestGetPageNo(dti->dest);
+        pageNo = PageDestGetPageNo(dest);
     }
 
     WindowTab* tab = win->CurrentTab();
@@ -1,10 +1,22 @@
 /* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
    License: GPLv3 */
 
+extern "C" {
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+#include "../mupdf/source/fitz/color-imp.h"
+#include "../mupdf/source/fitz/draw-imp.h"
+}
+
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
+#include "utils/FileUtil.h"
+#include "utils/JsonParser.h"
+#include "utils/Timer.h"
 #include "utils/WinUtil.h"
 
+#include <psapi.h>
+
 #include "wingui/UIModels.h"
 
 #include "Settings.h"
@@ -12,8 +24,16 @@
 #include "DocController.h"
 #include "EngineBase.h"
 #include "EngineAll.h"
+#include "EngineMupdf.h"
 #include "GlobalPrefs.h"
 #include "Flags.h"
+#include "TextSelection.h"
+#include "GlyphIndex.h"
+#include "FileThumbnails.h"
+#include "CpsLabAnnot.h"
+#include "CpsLabExportJob.h"
+#include "PageLabels.h"
+#include "PdfSync.h"
 
 void TestRenderPage(const Flags& i) {
     if (i.showConsole) {
@@ -99,3 +119,1293 @@ void TestExtractPage(const Flags& ci) {
         engine->Release();
     }
 }
+
+static size_t GetWorkingSetSize() {
+    PROCESS_MEMORY_COUNTERS pmc{};
+    pmc.cb = sizeof(pmc);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return 0;
+    }
+    return pmc.WorkingSetSize;
+}
+
+// opens the same document twice, renders all pages in both engines and
+// reports how much resident memory that took
+static size_t OpenTwiceAndRender(const char* fileName, int maxPages, bool sharedStore) {
+    if (sharedStore) {
+        // same as FZ_STORE_DEFAULT used by each engine with a private store
+        EnableMupdfSharedStore((size_t)256 << 20);
+    }
+    size_t memStart = GetWorkingSetSize();
+    EngineBase* engines[2]{};
+    for (auto& engine : engines) {
+        engine = CreateEngineFromFile(fileName, nullptr, true);
+        if (!engine) {
+            printf("failed to create engine for file '%s'\n", fileName);
+            return 0;
+        }
+        int nPages = std::min(engine->PageCount(), maxPages);
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            RenderPageArgs args(pageNo, kZoomActualSize, 0);
+            delete engine->RenderPage(args);
+        }
+    }
+    size_t memEnd = GetWorkingSetSize();
+    for (auto engine : engines) {
+        if (engine) {
+            engine->Release();
+        }
+    }
+    if (sharedStore) {
+        DestroyMupdfSharedStore();
+    }
+    return memEnd > memStart ? memEnd - memStart : 0;
+}
+
+// memory used by two engines for the same document, with a private store
+// each and with one shared store
+static void PerfSharedStore(const Flags& ci) {
+    int maxPages = ci.pageNumber > 0 ? ci.pageNumber : 50;
+    const char* fileName = ci.fileNames.at(0);
+
+    // memory freed by one run stays in the working set and is reused by the
+    // next run, which favors whichever runs second. alternate the order
+    // (private, shared, shared, private) so that both get the same advantage
+    size_t privateMem = 0;
+    size_t sharedMem = 0;
+    for (int i = 0; i < 4; i++) {
+        bool sharedStore = (i == 1 || i == 2);
+        size_t mem = OpenTwiceAndRender(fileName, maxPages, sharedStore);
+        if (sharedStore) {
+            sharedMem += mem / 2;
+        } else {
+            privateMem += mem / 2;
+        }
+    }
+
+    printf("'%s' opened twice, first %d pages rendered\n", fileName, maxPages);
+    printf("private stores: %d kB\n", (int)(privateMem >> 10));
+    printf("shared store:   %d kB\n", (int)(sharedMem >> 10));
+}
+
+// what FindClosestGlyph() did before PageGlyphIndex
+static int FindClosestGlyphLinear(const PageGlyphs* glyphs, double x, double y) {
+    uint maxDist = UINT_MAX;
+    Point pti = ToPoint(PointF(x, y));
+    bool overGlyph = false;
+    int result = -1;
+    GlyphCursor coords(glyphs);
+    for (int i = 0; i < glyphs->len; i++) {
+        Rect coord = coords.At(i);
+        if (!coord.x && !coord.dx) {
+            continue;
+        }
+        if (overGlyph && !coord.Contains(pti)) {
+            continue;
+        }
+        uint dist = distSq((int)x - coord.x - coord.dx / 2, (int)y - coord.y - coord.dy / 2);
+        if (dist < maxDist) {
+            result = i;
+            maxDist = dist;
+        }
+        if (!overGlyph && coord.Contains(pti)) {
+            overGlyph = true;
+            result = i;
+            maxDist = dist;
+        }
+    }
+    return result;
+}
+
+static int CountGlyphsInRectLinear(const PageGlyphs* glyphs, Rect r) {
+    int n = 0;
+    GlyphCursor coords(glyphs);
+    for (int i = 0; i < glyphs->len; i++) {
+        if (!r.Intersect(coords.At(i)).IsEmpty()) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static int CountGlyphsInRectIndexed(const PageGlyphIndex* index, const PageGlyphs* glyphs, Rect r, Vec<int>& tmp) {
+    GlyphIndexQueryRect(index, r, tmp);
+    int n = 0;
+    for (int i : tmp) {
+        if (!r.Intersect(glyphs->At(i)).IsEmpty()) {
+            n++;
+        }
+    }
+    return n;
+}
+
+// compares hit-testing and region queries through PageGlyphIndex with
+// linear scans over all glyphs, both for speed and for equal results
+static void PerfGlyphIndex(const Flags& ci) {
+    auto files = ci.fileNames;
+    constexpr int kQueriesPerPage = 1000;
+    for (auto fileName : files) {
+        auto engine = CreateEngineFromFile(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileName);
+            continue;
+        }
+        auto textCache = new DocumentTextCache(engine);
+        int nPages = engine->PageCount();
+        if (ci.pageNumber > 0) {
+            nPages = std::min(nPages, ci.pageNumber);
+        }
+        double linearMs = 0, indexedMs = 0, buildMs = 0;
+        double linearRectMs = 0, indexedRectMs = 0;
+        i64 nGlyphs = 0;
+        int nMismatches = 0;
+        Vec<int> tmp;
+        srand(1);
+        for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+            const PageGlyphs* glyphs;
+            textCache->GetGlyphsForPage(pageNo, nullptr, &glyphs);
+            auto t = TimeGet();
+            const PageGlyphIndex* index = textCache->GetGlyphIndex(pageNo, &glyphs);
+            buildMs += TimeSinceInMs(t);
+            nGlyphs += glyphs->len;
+
+            Rect mediabox = engine->PageMediabox(pageNo).Round();
+            int dx = std::max(mediabox.dx, 1);
+            int dy = std::max(mediabox.dy, 1);
+            for (int q = 0; q < kQueriesPerPage; q++) {
+                double x = mediabox.x + rand() % dx + 0.5;
+                double y = mediabox.y + rand() % dy + 0.5;
+                t = TimeGet();
+                int linear = FindClosestGlyphLinear(glyphs, x, y);
+                linearMs += TimeSinceInMs(t);
+                t = TimeGet();
+                int indexed = GlyphIndexFindClosest(index, glyphs, x, y);
+                indexedMs += TimeSinceInMs(t);
+                if (linear != indexed) {
+                    nMismatches++;
+                }
+
+                Rect r((int)x, (int)y, 1 + rand() % (dx / 4 + 1), 1 + rand() % (dy / 8 + 1));
+                t = TimeGet();
+                int nLinear = CountGlyphsInRectLinear(glyphs, r);
+                linearRectMs += TimeSinceInMs(t);
+                t = TimeGet();
+                int nIndexed = CountGlyphsInRectIndexed(index, glyphs, r, tmp);
+                indexedRectMs += TimeSinceInMs(t);
+                if (nLinear != nIndexed) {
+                    nMismatches++;
+                }
+            }
+        }
+        printf("'%s': %d pages, %d glyphs, %d queries per page\n", fileName, nPages, (int)nGlyphs, kQueriesPerPage);
+        printf("building indexes:  %.2f ms\n", buildMs);
+        printf("closest glyph:     linear %.2f ms, indexed %.2f ms\n", linearMs, indexedMs);
+        printf("glyphs in rect:    linear %.2f ms, indexed %.2f ms\n", linearRectMs, indexedRectMs);
+        if (nMismatches > 0) {
+            printf("FAILED: %d queries returned different results\n", nMismatches);
+        } else {
+            printf("ok\n");
+        }
+        delete textCache;
+        engine->Release();
+    }
+}
+
+// opens each document with increasing number of layout threads and reports
+// how long it takes to paginate the whole document and to render the first page
+static void PerfEpubLayout(const Flags& ci) {
+    auto files = ci.fileNames;
+    SYSTEM_INFO si{};
+    GetSystemInfo(&si);
+    int nCores = std::max((int)si.dwNumberOfProcessors, 1);
+    Vec<int> threadCounts;
+    for (int n = 1; n < nCores; n *= 2) {
+        threadCounts.Append(n);
+    }
+    threadCounts.Append(nCores);
+
+    for (auto fileName : files) {
+        printf("'%s', %d cores\n", fileName, nCores);
+        for (int nThreads : threadCounts) {
+            SetMupdfLayoutThreadCount(nThreads);
+            auto t = TimeGet();
+            auto engine = CreateEngineFromFile(fileName, nullptr, true);
+            double openMs = TimeSinceInMs(t);
+            if (engine == nullptr) {
+                printf("failed to create engine for file '%s'\n", fileName);
+                break;
+            }
+            t = TimeGet();
+            RenderPageArgs args(1, kZoomActualSize, 0);
+            auto bmp = engine->RenderPage(args);
+            double renderMs = TimeSinceInMs(t);
+            delete bmp;
+            printf("%2d threads: %d pages, paginated in %.2f ms, first page in %.2f ms\n", nThreads,
+                   engine->PageCount(), openMs, openMs + renderMs);
+            engine->Release();
+        }
+    }
+    SetMupdfLayoutThreadCount(0);
+}
+
+static const char* SimdLevelName(int level) {
+    switch (level) {
+        case FZ_SIMD_SSE2:
+            return "SSE2";
+        case FZ_SIMD_AVX2:
+            return "AVX2";
+        case FZ_SIMD_NEON:
+            return "NEON";
+    }
+    return "scalar";
+}
+
+// scalar first, then all SIMD levels the CPU supports
+static void GetSupportedSimdLevels(Vec<int>& levels) {
+    int best = fz_simd_level();
+    levels.Append(FZ_SIMD_NONE);
+    for (int level : {FZ_SIMD_SSE2, FZ_SIMD_AVX2, FZ_SIMD_NEON}) {
+        fz_set_simd_level(level);
+        if (fz_simd_level() == level) {
+            levels.Append(level);
+        }
+    }
+    fz_set_simd_level(best);
+}
+
+// smooth random image that looks a bit like a scanned page
+static fz_pixmap* NewScanLikePixmap(fz_context* ctx, fz_colorspace* cs, int dx, int dy, bool alpha) {
+    fz_pixmap* pix = fz_new_pixmap(ctx, cs, dx, dy, nullptr, alpha ? 1 : 0);
+    for (int y = 0; y < dy; y++) {
+        u8* d = pix->samples + (size_t)y * pix->stride;
+        for (int x = 0; x < dx; x++) {
+            for (int k = 0; k < pix->n; k++) {
+                double v = 127 + 60 * sin(x * 0.05 + k) * cos(y * 0.03) + rand() % 16;
+                *d++ = (u8)v;
+            }
+        }
+    }
+    return pix;
+}
+
+static void PrintSimdTimes(const Vec<int>& levels, int nRepeat, const std::function<void()>& fn) {
+    for (int level : levels) {
+        fz_set_simd_level(level);
+        auto t = TimeGet();
+        for (int i = 0; i < nRepeat; i++) {
+            fn();
+        }
+        printf(" %s %.2f ms", SimdLevelName(level), TimeSinceInMs(t) / nRepeat);
+    }
+    printf("\n");
+}
+
+// times color conversion, image scaling and rendering the given documents
+// with the scalar code and each SIMD level the CPU supports
+static void PerfSimd(const Flags& ci) {
+    int best = fz_simd_level();
+    Vec<int> levels;
+    GetSupportedSimdLevels(levels);
+    printf("best supported SIMD level: %s\n", SimdLevelName(best));
+
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    // CMYK is converted with the naive formula only without ICC
+    fz_disable_icc(ctx);
+    srand(1);
+
+    constexpr int kRepeat = 5;
+    struct {
+        const char* name;
+        fz_colorspace* src;
+        fz_colorspace* dst;
+        bool dstAlpha;
+    } conversions[] = {
+        {"rgb -> bgra", fz_device_rgb(ctx), fz_device_bgr(ctx), true},
+        {"gray -> bgra", fz_device_gray(ctx), fz_device_bgr(ctx), true},
+        {"cmyk -> rgb", fz_device_cmyk(ctx), fz_device_rgb(ctx), false},
+    };
+    printf("converting a 3840x2160 tile, average of %d runs:\n", kRepeat);
+    for (auto& conv : conversions) {
+        fz_pixmap* src = NewScanLikePixmap(ctx, conv.src, 3840, 2160, false);
+        printf("%14s:", conv.name);
+        PrintSimdTimes(levels, kRepeat, [&] {
+            fz_pixmap* dst = fz_new_pixmap(ctx, conv.dst, src->w, src->h, nullptr, conv.dstAlpha ? 1 : 0);
+            fz_convert_pixmap_samples(ctx, src, dst, nullptr, nullptr, fz_default_color_params, 1);
+            fz_drop_pixmap(ctx, dst);
+        });
+        fz_drop_pixmap(ctx, src);
+    }
+
+    // A4 at 300 dpi
+    constexpr int kPageDx = 2480;
+    constexpr int kPageDy = 3508;
+    struct {
+        const char* name;
+        int dx;
+    } sizes[] = {{"thumbnail", kThumbnailDx}, {"fit page", 827}, {"half", kPageDx / 2}};
+    printf("scaling a %dx%d rgb page, average of %d runs:\n", kPageDx, kPageDy, kRepeat);
+    fz_pixmap* page = NewScanLikePixmap(ctx, fz_device_rgb(ctx), kPageDx, kPageDy, false);
+    for (auto& size : sizes) {
+        float dx = (float)size.dx;
+        float dy = dx * kPageDy / kPageDx;
+        printf("%14s:", size.name);
+        PrintSimdTimes(levels, kRepeat,
+                       [&] { fz_drop_pixmap(ctx, fz_scale_pixmap(ctx, page, 0, 0, dx, dy, nullptr)); });
+    }
+    fz_drop_pixmap(ctx, page);
+    fz_drop_context(ctx);
+
+    float zoom = ci.startZoom != kInvalidZoom ? ci.startZoom : kZoomActualSize;
+    for (auto fileName : ci.fileNames) {
+        auto engine = CreateEngineFromFile(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileName);
+            continue;
+        }
+        int nPages = engine->PageCount();
+        if (ci.pageNumber > 0) {
+            nPages = std::min(nPages, ci.pageNumber);
+        }
+        printf("'%s': %d pages, zoom %.2f:", fileName, nPages, zoom);
+        PrintSimdTimes(levels, 1, [&] {
+            for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+                RenderPageArgs args(pageNo, zoom, 0);
+                delete engine->RenderPage(args);
+            }
+        });
+        engine->Release();
+    }
+    fz_set_simd_level(best);
+}
+
+static void PutNumberedName(fz_context* ctx, pdf_obj* dict, const char* prefix, int i, pdf_obj* val) {
+    char name[32];
+    fz_snprintf(name, sizeof(name), "%s%d", prefix, i);
+    pdf_dict_puts(ctx, dict, name, val);
+}
+
+static pdf_obj* GetNumberedName(fz_context* ctx, pdf_obj* dict, const char* prefix, int i) {
+    char name[32];
+    fz_snprintf(name, sizeof(name), "%s%d", prefix, i);
+    return pdf_dict_gets(ctx, dict, name);
+}
+
+// a page drawing each of n form XObjects once, like generated CAD drawings
+// which use a separate XObject for every symbol
+static fz_page* NewResourceHeavyPage(fz_context* ctx, pdf_document* doc, int n) {
+    pdf_obj* xobjs = pdf_new_dict(ctx, doc, n);
+    fz_buffer* contents = fz_new_buffer(ctx, n * 32);
+    for (int i = 0; i < n; i++) {
+        fz_buffer* buf = fz_new_buffer(ctx, 32);
+        fz_append_printf(ctx, buf, "0 0 1 rg 0 0 %d %d re f", 1 + i % 3, 1 + i % 5);
+        pdf_obj* xobj = pdf_new_xobject(ctx, doc, fz_make_rect(0, 0, 4, 6), fz_identity, nullptr, buf);
+        PutNumberedName(ctx, xobjs, "Sym", i, xobj);
+        pdf_drop_obj(ctx, xobj);
+        fz_drop_buffer(ctx, buf);
+        fz_append_printf(ctx, contents, "q 1 0 0 1 %d %d cm /Sym%d Do Q\n", 10 + (i * 7) % 590, 10 + (i / 84) * 7, i);
+    }
+    pdf_obj* res = pdf_new_dict(ctx, doc, 1);
+    pdf_dict_put(ctx, res, PDF_NAME(XObject), xobjs);
+    pdf_obj* page = pdf_add_page(ctx, doc, fz_make_rect(0, 0, 612, 792), 0, res, contents);
+    pdf_insert_page(ctx, doc, -1, page);
+    pdf_drop_obj(ctx, page);
+    pdf_drop_obj(ctx, res);
+    pdf_drop_obj(ctx, xobjs);
+    fz_drop_buffer(ctx, contents);
+    return fz_load_page(ctx, (fz_document*)doc, pdf_count_pages(ctx, doc) - 1);
+}
+
+// times lookups in synthetic resource dictionaries and rendering pages that
+// use thousands of resources, with and without the dictionary hash index
+static void PerfPdfDict(const Flags& ci) {
+    int threshold = pdf_dict_hash_threshold();
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    fz_register_document_handlers(ctx);
+    pdf_document* doc = pdf_create_document(ctx);
+
+    int sizes[] = {4, 16, 64, 256, 1024, 4096};
+    constexpr int kLookups = 1000000;
+    printf("%d lookups of existing names:\n", kLookups);
+    for (int n : sizes) {
+        pdf_obj* dict = pdf_new_dict(ctx, doc, n);
+        for (int i = 0; i < n; i++) {
+            PutNumberedName(ctx, dict, "Im", i, PDF_TRUE);
+        }
+        printf("%5d entries:", n);
+        for (int hashed = 0; hashed < 2; hashed++) {
+            pdf_set_dict_hash_threshold(hashed ? threshold : INT_MAX);
+            srand(1);
+            int nFound = 0;
+            auto t = TimeGet();
+            for (int i = 0; i < kLookups; i++) {
+                nFound += GetNumberedName(ctx, dict, "Im", rand() % n) != nullptr;
+            }
+            printf(" %s %.2f ms (%d found)", hashed ? "hashed" : "search", TimeSinceInMs(t), nFound);
+        }
+        printf("\n");
+        pdf_drop_obj(ctx, dict);
+    }
+
+    constexpr int kRepeat = 5;
+    for (int n : {500, 5000}) {
+        fz_page* page = NewResourceHeavyPage(ctx, doc, n);
+        printf("rendering a page with %d XObjects:", n);
+        fz_drop_pixmap(ctx, fz_new_pixmap_from_page(ctx, page, fz_identity, fz_device_rgb(ctx), 0));
+        for (int hashed = 0; hashed < 2; hashed++) {
+            pdf_set_dict_hash_threshold(hashed ? threshold : INT_MAX);
+            auto t = TimeGet();
+            for (int i = 0; i < kRepeat; i++) {
+                fz_drop_pixmap(ctx, fz_new_pixmap_from_page(ctx, page, fz_identity, fz_device_rgb(ctx), 0));
+            }
+            printf(" %s %.2f ms", hashed ? "hashed" : "search", TimeSinceInMs(t) / kRepeat);
+        }
+        printf("\n");
+        fz_drop_page(ctx, page);
+    }
+    pdf_drop_document(ctx, doc);
+    fz_drop_context(ctx);
+
+    float zoom = ci.startZoom != kInvalidZoom ? ci.startZoom : kZoomActualSize;
+    // a new engine for each run so that pages are loaded and interpreted again
+    for (auto fileName : ci.fileNames) {
+        printf("'%s', zoom %.2f\n", fileName, zoom);
+        for (int hashed = 0; hashed < 2; hashed++) {
+            pdf_set_dict_hash_threshold(hashed ? threshold : INT_MAX);
+            auto t = TimeGet();
+            auto engine = CreateEngineFromFile(fileName, nullptr, true);
+            if (engine == nullptr) {
+                printf("failed to create engine for file '%s'\n", fileName);
+                break;
+            }
+            int nPages = engine->PageCount();
+            if (ci.pageNumber > 0) {
+                nPages = std::min(nPages, ci.pageNumber);
+            }
+            for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+                RenderPageArgs args(pageNo, zoom, 0);
+                delete engine->RenderPage(args);
+            }
+            engine->Release();
+            printf("%8s: %d pages in %.2f ms\n", hashed ? "hashed" : "search", nPages, TimeSinceInMs(t));
+        }
+    }
+    pdf_set_dict_hash_threshold(threshold);
+}
+
+// a pdf with npages pages of colored rectangles, written with the given write options
+static fz_buffer* NewRectanglesPdf(fz_context* ctx, int nPages, const char* opts) {
+    pdf_document* doc = pdf_create_document(ctx);
+    for (int i = 0; i < nPages; i++) {
+        fz_buffer* contents = fz_new_buffer(ctx, 256);
+        for (int k = 0; k < 50; k++) {
+            fz_append_printf(ctx, contents, "%g %g 0.5 rg %d %d %d %d re f\n", (i % 7) / 7.0, (k % 5) / 5.0,
+                             10 + k * 11, 10 + (i * 13 + k * 7) % 700, 5 + k % 9, 8 + i % 11);
+        }
+        pdf_obj* res = pdf_new_dict(ctx, doc, 1);
+        pdf_obj* page = pdf_add_page(ctx, doc, fz_make_rect(0, 0, 612, 792), 0, res, contents);
+        pdf_insert_page(ctx, doc, -1, page);
+        pdf_drop_obj(ctx, page);
+        pdf_drop_obj(ctx, res);
+        fz_drop_buffer(ctx, contents);
+    }
+    pdf_write_options wopts;
+    pdf_parse_write_options(ctx, &wopts, opts);
+    fz_buffer* buf = fz_new_buffer(ctx, 1024);
+    fz_output* out = fz_new_output_with_buffer(ctx, buf);
+    pdf_write_document(ctx, doc, out, &wopts);
+    fz_close_output(ctx, out);
+    fz_drop_output(ctx, out);
+    pdf_drop_document(ctx, doc);
+    return buf;
+}
+
+// makes all streams lack a /Length so that they have to be found by scanning for endstream
+static void BreakStreamLengths(fz_buffer* buf) {
+    for (size_t i = 0; i + 7 < buf->len; i++) {
+        if (memcmp(buf->data + i, "/Length", 7) == 0) {
+            buf->data[i + 6] = 'x';
+        }
+    }
+}
+
+static u32 RenderedPagesChecksum(fz_context* ctx, fz_document* doc, int* nPagesOut) {
+    u32 sum = 0;
+    int nPages = fz_count_pages(ctx, doc);
+    for (int i = 0; i < nPages; i++) {
+        fz_pixmap* pix = nullptr;
+        fz_var(pix);
+        fz_try(ctx) {
+            pix = fz_new_pixmap_from_page_number(ctx, doc, i, fz_scale(0.25f, 0.25f), fz_device_rgb(ctx), 0);
+            size_t len = (size_t)pix->stride * pix->h;
+            for (size_t j = 0; j < len; j++) {
+                sum = sum * 31 + pix->samples[j];
+            }
+        }
+        fz_always(ctx) {
+            fz_drop_pixmap(ctx, pix);
+        }
+        fz_catch(ctx) {
+            sum = sum * 31 + 7;
+        }
+    }
+    *nPagesOut = nPages;
+    return sum;
+}
+
+// opens the first len bytes of data with a full repair and again with the saved
+// repair data and compares the rendered pages. returns false on a mismatch
+static bool CheckRepairAccelerator(fz_context* ctx, const u8* data, size_t len, const char* desc) {
+    fz_buffer* accelBuf = fz_new_buffer(ctx, 1024);
+    fz_stream* stm = nullptr;
+    fz_stream* accel = nullptr;
+    fz_document* doc = nullptr;
+    bool ok = true;
+    fz_var(stm);
+    fz_var(accel);
+    fz_var(doc);
+    fz_try(ctx) {
+        auto t = TimeGet();
+        stm = fz_open_memory(ctx, data, len);
+        doc = fz_open_accelerated_document_with_stream(ctx, "test.pdf", stm, nullptr);
+        fz_count_pages(ctx, doc);
+        double scanMs = TimeSinceInMs(t);
+        int nPages1 = 0;
+        u32 sum1 = RenderedPagesChecksum(ctx, doc, &nPages1);
+        pdf_document* pdfdoc = pdf_specifics(ctx, doc);
+        if (!pdfdoc || !pdf_was_repaired(ctx, pdfdoc)) {
+            printf("%s, %d bytes: not damaged, %d pages\n", desc, (int)len, nPages1);
+            break;
+        }
+        fz_output_accelerator(ctx, doc, fz_new_output_with_buffer(ctx, accelBuf));
+        fz_drop_document(ctx, doc);
+        doc = nullptr;
+        fz_drop_stream(ctx, stm);
+        stm = nullptr;
+
+        t = TimeGet();
+        stm = fz_open_memory(ctx, data, len);
+        accel = fz_open_buffer(ctx, accelBuf);
+        doc = fz_open_accelerated_document_with_stream(ctx, "test.pdf", stm, accel);
+        fz_count_pages(ctx, doc);
+        double accelMs = TimeSinceInMs(t);
+        int nPages2 = 0;
+        u32 sum2 = RenderedPagesChecksum(ctx, doc, &nPages2);
+        ok = nPages1 == nPages2 && sum1 == sum2;
+        printf("%s, %d bytes: %d pages, repaired in %.2f ms, with repair data (%d bytes) in %.2f ms%s\n", desc,
+               (int)len, nPages1, scanMs, (int)accelBuf->len, accelMs, ok ? "" : " MISMATCH");
+    }
+    fz_always(ctx) {
+        fz_drop_document(ctx, doc);
+        fz_drop_stream(ctx, accel);
+        fz_drop_stream(ctx, stm);
+        fz_drop_buffer(ctx, accelBuf);
+    }
+    fz_catch(ctx) {
+        printf("%s, %d bytes: failed to open: %s\n", desc, (int)len, fz_caught_message(ctx));
+    }
+    return ok;
+}
+
+// truncates pdf files at various points and checks that opening them with
+// the repair data saved from the first open gives the same pages as
+// repairing them again. also times both for a large damaged file
+static void PerfPdfRepair(const Flags& ci) {
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    fz_register_document_handlers(ctx);
+    fz_set_warning_callback(ctx, nullptr, nullptr);
+    fz_set_error_callback(ctx, nullptr, nullptr);
+
+    bool ok = true;
+    const char* writeOpts[] = {"", "compress", "compress,garbage,objstms", "compress,garbage=compact"};
+    for (const char* opts : writeOpts) {
+        fz_buffer* buf = NewRectanglesPdf(ctx, 40, opts);
+        TempStr desc = str::FormatTemp("options '%s'", opts);
+        for (int i = 1; i <= 10; i++) {
+            // cutting off only the trailer still leaves all objects
+            size_t len = i < 10 ? buf->len * i / 10 : buf->len - 20;
+            ok &= CheckRepairAccelerator(ctx, buf->data, len, desc);
+        }
+        fz_drop_buffer(ctx, buf);
+    }
+    {
+        fz_buffer* buf = NewRectanglesPdf(ctx, 40, "");
+        BreakStreamLengths(buf);
+        ok &= CheckRepairAccelerator(ctx, buf->data, buf->len, "no stream lengths");
+        ok &= CheckRepairAccelerator(ctx, buf->data, buf->len / 2, "no stream lengths");
+        fz_drop_buffer(ctx, buf);
+    }
+    printf(ok ? "ok\n" : "FAILED\n");
+
+    {
+        fz_buffer* buf = NewRectanglesPdf(ctx, 3000, "");
+        BreakStreamLengths(buf);
+        CheckRepairAccelerator(ctx, buf->data, buf->len * 9 / 10, "large");
+        fz_drop_buffer(ctx, buf);
+    }
+
+    for (auto fileName : ci.fileNames) {
+        fz_buffer* buf = nullptr;
+        fz_var(buf);
+        fz_try(ctx) {
+            buf = fz_read_file(ctx, fileName);
+            CheckRepairAccelerator(ctx, buf->data, buf->len * 9 / 10, fileName);
+        }
+        fz_always(ctx) {
+            fz_drop_buffer(ctx, buf);
+        }
+        fz_catch(ctx) {
+            printf("failed to read '%s'\n", fileName);
+        }
+    }
+    fz_drop_context(ctx);
+}
+
+// times LinkifyText() with and without skipping to link candidates on the
+// text of the given documents
+static void PerfLinkify(const Flags& ci) {
+    Vec<PageText> pages;
+    for (auto fileName : ci.fileNames) {
+        auto engine = CreateEngineFromFile(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileName);
+            continue;
+        }
+        for (int pageNo = 1; pageNo <= engine->PageCount(); pageNo++) {
+            PageText pt = engine->ExtractPageText(pageNo);
+            if (pt.text) {
+                pages.Append(pt);
+            }
+        }
+        engine->Release();
+    }
+
+    constexpr int kIterations = 10;
+    i64 nChars = 0;
+    int nCandidatePages = 0, nLinks = 0;
+    double fullMs = 0, skipMs = 0, checkMs = 0;
+    for (auto& pt : pages) {
+        nChars += pt.len;
+        auto t = TimeGet();
+        bool hasCandidates = LinkifyHasCandidates(pt.text, pt.len);
+        checkMs += TimeSinceInMs(t);
+        nCandidatePages += hasCandidates ? 1 : 0;
+        for (int i = 0; i < kIterations; i++) {
+            LinkRectList full, skipped;
+            t = TimeGet();
+            LinkifyText(full, pt.text, pt.len, pt.coords, false);
+            fullMs += TimeSinceInMs(t);
+            t = TimeGet();
+            LinkifyText(skipped, pt.text, pt.len, pt.coords, true);
+            skipMs += TimeSinceInMs(t);
+            if (i == 0) {
+                nLinks += full.links.Size();
+            }
+        }
+        FreePageText(&pt);
+    }
+
+    printf("%d pages, %.1f MB of text, %d pages with link candidates, %d links\n", pages.Size(),
+           (double)nChars * sizeof(WCHAR) / (1 << 20), nCandidatePages, nLinks);
+    printf("checking for candidates:    %.2f ms\n", checkMs);
+    printf("linkify (all chars):        %.2f ms\n", fullMs / kIterations);
+    printf("linkify (candidates only):  %.2f ms\n", skipMs / kIterations);
+}
+
+// the scans cpslab::MarkerNode used before it had an index, for comparison
+static bool MarkerHasWordLinear(cpslab::MarkerNode* m, const char* word) {
+    for (auto w : m->words) {
+        if (str::Eq(w, word)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool MarkerHasRectLinear(cpslab::MarkerNode* m, const Rect& r) {
+    for (Rect pr : m->rects) {
+        if (r == pr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int MarkerGetPageLinear(cpslab::MarkerNode* m, const char* word, int pageNo) {
+    for (int i = 0; i < m->mark_words.Size(); i++) {
+        if (str::Eq(word, m->mark_words[i]) && (pageNo <= 0 || pageNo <= m->pages[i])) {
+            return m->pages[i];
+        }
+    }
+    return -1;
+}
+
+static int MarkerCountWordsOnPageLinear(cpslab::MarkerNode* m, int pageNo) {
+    int n = 0;
+    for (int pno : m->pages) {
+        n += pno == pageNo ? 1 : 0;
+    }
+    return n;
+}
+
+// builds a synthetic set of 100k marked nets, cells and pins and times
+// the indexed lookups of cpslab::MarkerNode against linear scans
+static void PerfMarkers(const Flags&) {
+    constexpr int kPages = 500;
+    constexpr int kQueries = 2000;
+    const char* keywords[] = {"Net", "Cell", "Pin"};
+    const int nWords[] = {50000, 20000, 30000};
+
+    srand(1);
+    auto markers = new cpslab::Markers(nullptr);
+    Vec<cpslab::MarkerNode*> nodes;
+    for (int k = 0; k < 3; k++) {
+        auto m = markers->getMarker(keywords[k]);
+        for (int i = 0; i < nWords[k]; i++) {
+            char* w = m->words.Append(str::FormatTemp("%s_%d", keywords[k], i));
+            int nOccurrences = 1 + rand() % 3;
+            for (int j = 0; j < nOccurrences; j++) {
+                int pageNo = 1 + rand() % kPages;
+                m->mark_words.Append(w);
+                m->pages.Append(pageNo);
+                m->rects.Append(Rect(rand() % 600, rand() % 800, 10 + rand() % 40, 8 + rand() % 4));
+            }
+        }
+        nodes.Append(m);
+    }
+
+    // half of the queries are for words and rects that aren't marked
+    StrVec queryWords;
+    Vec<Rect> queryRects;
+    Vec<int> queryPages;
+    for (int i = 0; i < kQueries; i++) {
+        int k = rand() % 3;
+        auto m = nodes[k];
+        int wi = rand() % (nWords[k] * 2);
+        queryWords.Append(str::FormatTemp("%s_%d", keywords[k], wi));
+        int ri = rand() % m->rects.Size();
+        Rect r = m->rects[ri];
+        if (i % 2) {
+            r.x++;
+        }
+        queryRects.Append(r);
+        queryPages.Append(rand() % (kPages + 1));
+    }
+
+    auto t = TimeGet();
+    for (auto m : nodes) {
+        m->hasWord("");
+    }
+    double buildMs = TimeSinceInMs(t);
+
+    double linearMs = 0, indexedMs = 0;
+    // counted so that the lookups can't be optimized away
+    int nLinearHits = 0, nIndexedHits = 0;
+    for (int i = 0; i < kQueries; i++) {
+        const char* w = queryWords[i];
+        Rect r = queryRects[i];
+        int pageNo = queryPages[i];
+        for (auto m : nodes) {
+            t = TimeGet();
+            nLinearHits += MarkerHasWordLinear(m, w) ? 1 : 0;
+            nLinearHits += MarkerHasRectLinear(m, r) ? 1 : 0;
+            nLinearHits += MarkerGetPageLinear(m, w, pageNo) > 0 ? 1 : 0;
+            nLinearHits += MarkerCountWordsOnPageLinear(m, pageNo);
+            linearMs += TimeSinceInMs(t);
+
+            StrVec onPage;
+            t = TimeGet();
+            nIndexedHits += m->hasWord(w) ? 1 : 0;
+            nIndexedHits += m->hasRect(r) ? 1 : 0;
+            nIndexedHits += m->tExist(m->getPage(w, pageNo), w) ? 1 : 0;
+            nIndexedHits += (int)m->getMarkWordsByPageNo(pageNo, onPage);
+            indexedMs += TimeSinceInMs(t);
+        }
+    }
+    Vec<cpslab::MarkerNode*> found;
+    t = TimeGet();
+    for (int i = 0; i < kQueries; i++) {
+        markers->getMarkersByWord(queryWords[i], found);
+        markers->getMarkersByRect(queryRects[i], found);
+    }
+    double markersMs = TimeSinceInMs(t);
+
+    printf("%d marked words on %d pages, %d queries per marker\n", nWords[0] + nWords[1] + nWords[2], kPages,
+           kQueries);
+    printf("building indexes:  %.2f ms\n", buildMs);
+    printf("lookups:           linear %.2f ms (%d hits), indexed %.2f ms (%d hits)\n", linearMs, nLinearHits,
+           indexedMs, nIndexedHits);
+    printf("Markers lookups:   %.2f ms for %d words and rects\n", markersMs, kQueries);
+    delete markers;
+}
+
+// the sort-and-dedupe word list SaveWordsToFile produced before, for comparison
+static void ExportWordsSorted(EngineBase* engine, str::Str& out) {
+    StrVec words;
+    for (int pageNo = 1; pageNo <= engine->PageCount(); pageNo++) {
+        PageText pt = engine->ExtractPageText(pageNo);
+        for (const WCHAR* src = pt.text; src && *src;) {
+            if (!IsCharAlphaNumeric(*src) && *src != '_') {
+                src++;
+                continue;
+            }
+            const WCHAR* end = src;
+            while (*end && (IsCharAlphaNumeric(*end) || *end == '_')) {
+                end++;
+            }
+            char* w = strconv::WStrToUtf8(src, end - src);
+            words.Append(w);
+            str::Free(w);
+            src = end;
+        }
+        FreePageText(&pt);
+    }
+    Sort(words);
+    char* prev = nullptr;
+    for (char* w : words) {
+        if (prev == nullptr || !str::Eq(prev, w)) {
+            out.Append(w);
+            out.Append("\n");
+            prev = w;
+        }
+    }
+}
+
+// compares the word list export with the sort-and-dedupe implementation it replaced
+static void PerfExportWords(const Flags& ci) {
+    int nMismatches = 0;
+    for (auto fileName : ci.fileNames) {
+        auto engine = CreateEngineFromFile(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileName);
+            continue;
+        }
+        str::Str sorted;
+        auto t = TimeGet();
+        ExportWordsSorted(engine, sorted);
+        double sortedMs = TimeSinceInMs(t);
+
+        cpslab::ExportJobArgs args;
+        args.engine = engine;
+        args.kind = cpslab::ExportKind::Words;
+        args.path = GetTempFilePathTemp("words");
+        t = TimeGet();
+        cpslab::ExportJob* job = cpslab::StartExportJob(args);
+        auto state = job ? cpslab::WaitForExportJob(job) : cpslab::ExportState::Failed;
+        double hashedMs = TimeSinceInMs(t);
+        if (job) {
+            cpslab::ReleaseExportJob(job);
+        }
+
+        ByteSlice d = file::ReadFile(args.path);
+        bool same = state == cpslab::ExportState::Done && d.size() == sorted.size() &&
+                    memcmp(d.data(), sorted.Get(), d.size()) == 0;
+        str::Free(d.data());
+        file::Delete(args.path);
+        nMismatches += same ? 0 : 1;
+
+        int nWords = 0;
+        for (char c : sorted) {
+            nWords += c == '\n' ? 1 : 0;
+        }
+        printf("%s: %d pages, %d unique words\n", fileName, engine->PageCount(), nWords);
+        printf("  sort and dedupe:  %.2f ms\n", sortedMs);
+        printf("  hashed export:    %.2f ms%s\n", hashedMs, same ? "" : " (DIFFERENT)");
+        engine->Release();
+    }
+    if (nMismatches > 0) {
+        printf("FAILED: %d files with different word lists\n", nMismatches);
+    } else {
+        printf("ok\n");
+    }
+}
+
+static pdf_obj* NewOutlineItem(fz_context* ctx, pdf_document* doc, pdf_obj* parent, pdf_obj* prev, pdf_obj* page,
+                               const char* title) {
+    pdf_obj* item = pdf_add_new_dict(ctx, doc, 6);
+    pdf_dict_put_text_string(ctx, item, PDF_NAME(Title), title);
+    pdf_dict_put(ctx, item, PDF_NAME(Parent), parent);
+    pdf_obj* dest = pdf_dict_put_array(ctx, item, PDF_NAME(Dest), 2);
+    pdf_array_push(ctx, dest, page);
+    pdf_array_push(ctx, dest, PDF_NAME(Fit));
+    if (prev) {
+        pdf_dict_put(ctx, item, PDF_NAME(Prev), prev);
+        pdf_dict_put(ctx, prev, PDF_NAME(Next), item);
+    }
+    return item;
+}
+
+// a pdf with nPages empty pages and an outline of nChapters closed items
+// with nSections children each
+static void SaveOutlinePdf(fz_context* ctx, const char* path, int nPages, int nChapters, int nSections) {
+    pdf_document* doc = pdf_create_document(ctx);
+    Vec<pdf_obj*> pages;
+    for (int i = 0; i < nPages; i++) {
+        fz_buffer* contents = fz_new_buffer(ctx, 16);
+        pdf_obj* res = pdf_new_dict(ctx, doc, 1);
+        pdf_obj* page = pdf_add_page(ctx, doc, fz_make_rect(0, 0, 612, 792), 0, res, contents);
+        pdf_insert_page(ctx, doc, -1, page);
+        pages.Append(page);
+        pdf_drop_obj(ctx, res);
+        fz_drop_buffer(ctx, contents);
+    }
+
+    // no outline if nChapters is 0
+    if (nChapters > 0) {
+        pdf_obj* outlines = pdf_add_new_dict(ctx, doc, 4);
+        pdf_dict_put(ctx, outlines, PDF_NAME(Type), PDF_NAME(Outlines));
+        pdf_obj* prevChapter = nullptr;
+        for (int c = 0; c < nChapters; c++) {
+            TempStr title = str::FormatTemp("Chapter %d", c + 1);
+            pdf_obj* chapter = NewOutlineItem(ctx, doc, outlines, prevChapter, pages[c % nPages], title);
+            if (!prevChapter) {
+                pdf_dict_put(ctx, outlines, PDF_NAME(First), chapter);
+            }
+            pdf_obj* prevSection = nullptr;
+            for (int i = 0; i < nSections; i++) {
+                title = str::FormatTemp("Part %d-%d", c + 1, i + 1);
+                pdf_obj* page = pages[(c * nSections + i) % nPages];
+                pdf_obj* section = NewOutlineItem(ctx, doc, chapter, prevSection, page, title);
+                if (!prevSection) {
+                    pdf_dict_put(ctx, chapter, PDF_NAME(First), section);
+                }
+                pdf_drop_obj(ctx, prevSection);
+                prevSection = section;
+            }
+            if (prevSection) {
+                pdf_dict_put(ctx, chapter, PDF_NAME(Last), prevSection);
+                pdf_dict_put_int(ctx, chapter, PDF_NAME(Count), -nSections);
+                pdf_drop_obj(ctx, prevSection);
+            }
+            pdf_drop_obj(ctx, prevChapter);
+            prevChapter = chapter;
+        }
+        pdf_dict_put(ctx, outlines, PDF_NAME(Last), prevChapter);
+        pdf_dict_put_int(ctx, outlines, PDF_NAME(Count), nChapters);
+        pdf_drop_obj(ctx, prevChapter);
+        pdf_obj* catalog = pdf_dict_get(ctx, pdf_trailer(ctx, doc), PDF_NAME(Root));
+        pdf_dict_put(ctx, catalog, PDF_NAME(Outlines), outlines);
+        pdf_drop_obj(ctx, outlines);
+    }
+
+    pdf_save_document(ctx, doc, path, nullptr);
+    for (pdf_obj* page : pages) {
+        pdf_drop_obj(ctx, page);
+    }
+    pdf_drop_document(ctx, doc);
+}
+
+// a copy of the tree in separately allocated items with all destinations
+// created, the way the ToC was built before it used an arena
+static TocItem* CloneTocItemsToHeap(TocItem* ti) {
+    TocItem* first = nullptr;
+    TocItem* last = nullptr;
+    for (; ti; ti = ti->next) {
+        TocItem* res = new TocItem(nullptr, ti->title, ti->pageNo);
+        res->dest = ti->GetPageDestination();
+        res->destNotOwned = true;
+        res->child = CloneTocItemsToHeap(ti->child);
+        if (last) {
+            last->next = res;
+        } else {
+            first = res;
+        }
+        last = res;
+    }
+    return first;
+}
+
+// builds the ToC of a pdf with a 200k items outline and reports the time
+// and memory it takes, before and after creating all destinations
+static void PerfTocTree(const Flags&) {
+    constexpr int kChapters = 2000;
+    constexpr int kSections = 99;
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    fz_register_document_handlers(ctx);
+    TempStr path = GetTempFilePathTemp("toc");
+    auto t = TimeGet();
+    SaveOutlinePdf(ctx, path, 100, kChapters, kSections);
+    printf("created pdf with %d outline items in %.2f ms\n", kChapters * (kSections + 1), TimeSinceInMs(t));
+    fz_drop_context(ctx);
+
+    auto engine = CreateEngineFromFile(path, nullptr, true);
+    if (!engine) {
+        printf("FAILED: couldn't open '%s'\n", path);
+        file::Delete(path);
+        return;
+    }
+
+    size_t memStart = GetWorkingSetSize();
+    t = TimeGet();
+    TocTree* tree = engine->GetToc();
+    double buildMs = TimeSinceInMs(t);
+    size_t memBuild = GetWorkingSetSize();
+
+    int nItems = 0;
+    t = TimeGet();
+    VisitTocTree(tree ? tree->root->child : nullptr, [&nItems](TocItem*) -> bool {
+        nItems++;
+        return true;
+    });
+    double visitMs = TimeSinceInMs(t);
+
+    t = TimeGet();
+    TocItem* heapCopy = CloneTocItemsToHeap(tree ? tree->root->child : nullptr);
+    double heapMs = TimeSinceInMs(t);
+    size_t memHeap = GetWorkingSetSize();
+
+    int nMismatches = 0;
+    VisitTocTree(heapCopy, [&nMismatches](TocItem* ti) -> bool {
+        nMismatches += ti->PageNumbersMatch() ? 0 : 1;
+        return true;
+    });
+
+    printf("%d items\n", nItems);
+    printf("building ToC:                  %.2f ms, %.2f MB\n", buildMs, (double)(memBuild - memStart) / (1 << 20));
+    printf("visiting all items:            %.2f ms\n", visitMs);
+    printf("creating all dests, heap copy: %.2f ms, %.2f MB\n", heapMs, (double)(memHeap - memBuild) / (1 << 20));
+
+    t = TimeGet();
+    delete heapCopy;
+    double deleteMs = TimeSinceInMs(t);
+    t = TimeGet();
+    engine->Release();
+    printf("deleting heap copy:            %.2f ms\n", deleteMs);
+    printf("closing document:              %.2f ms\n", TimeSinceInMs(t));
+    file::Delete(path);
+
+    if (nItems != kChapters * (kSections + 1) || nMismatches > 0) {
+        printf("FAILED: %d items, %d with wrong page numbers\n", nItems, nMismatches);
+    } else {
+        printf("ok\n");
+    }
+}
+
+static void AddBenchPageLabelRanges(PageLabels& pl) {
+    pl.AddRange(1, nullptr, "Cover", 1);
+    pl.AddRange(3, "r", nullptr, 1);
+    pl.AddRange(41, "D", nullptr, 1);
+    pl.AddRange(45001, "D", "A-", 1);
+}
+
+// compares PageLabels with keeping a label per page (as it was done before)
+// for a 50k pages document: setting up, getting all labels and looking them up
+static void PerfPageLabels(const Flags&) {
+    constexpr int kPageCount = 50000;
+    // StrVec::Find() is too slow to look up every label
+    constexpr int kFindStep = 50;
+
+    size_t memStart = GetWorkingSetSize();
+    auto t = TimeGet();
+    StrVec perPage;
+    {
+        PageLabels pl(kPageCount);
+        AddBenchPageLabelRanges(pl);
+        pl.Finish(false);
+        for (int pageNo = 1; pageNo <= kPageCount; pageNo++) {
+            perPage.Append(pl.GetLabelTemp(pageNo));
+            ResetTempAllocator();
+        }
+    }
+    double perPageMs = TimeSinceInMs(t);
+    size_t memPerPage = GetWorkingSetSize();
+
+    t = TimeGet();
+    PageLabels pl(kPageCount);
+    AddBenchPageLabelRanges(pl);
+    pl.Finish(false);
+    double rangesMs = TimeSinceInMs(t);
+
+    t = TimeGet();
+    for (int pageNo = 1; pageNo <= kPageCount; pageNo++) {
+        pl.GetLabelTemp(pageNo);
+        ResetTempAllocator();
+    }
+    double getLabelsMs = TimeSinceInMs(t);
+
+    t = TimeGet();
+    int nFound = 0;
+    for (int pageNo = 1; pageNo <= kPageCount; pageNo += kFindStep) {
+        nFound += perPage.Find(perPage.At(pageNo - 1)) >= 0 ? 1 : 0;
+    }
+    double findMs = TimeSinceInMs(t);
+
+    t = TimeGet();
+    int nLookedUp = 0;
+    for (int pageNo = 1; pageNo <= kPageCount; pageNo++) {
+        nLookedUp += pl.GetPageByLabel(perPage.At(pageNo - 1)) > 0 ? 1 : 0;
+    }
+    double lookupMs = TimeSinceInMs(t);
+
+    t = TimeGet();
+    PageLabels plUnique(kPageCount);
+    AddBenchPageLabelRanges(plUnique);
+    plUnique.Finish(true);
+    double uniqueMs = TimeSinceInMs(t);
+
+    printf("%d pages, %d label ranges\n", kPageCount, pl.ranges.Size());
+    printf("label per page:      %.2f ms, %.2f MB\n", perPageMs, (double)(memPerPage - memStart) / (1 << 20));
+    printf("label ranges:        %.3f ms\n", rangesMs);
+    printf("ensuring unique:     %.2f ms\n", uniqueMs);
+    printf("formatting %d labels: %.2f ms\n", kPageCount, getLabelsMs);
+    printf("finding %d labels in StrVec: %.2f ms\n", nFound, findMs);
+    printf("looking up %d labels in ranges: %.2f ms\n", nLookedUp, lookupMs);
+}
+
+// times creating the synchronizer for the given documents (which need a .pdfsync
+// or .synctex(.gz) file next to them), building its index (done by the first
+// query), inverse searches all over the document and forward searches for the
+// source lines they found
+static void PerfSync(const Flags& ci) {
+    constexpr int kQueries = 4000;
+    for (auto fileName : ci.fileNames) {
+        auto engine = CreateEngineFromFile(fileName, nullptr, true);
+        if (engine == nullptr) {
+            printf("failed to create engine for file '%s'\n", fileName);
+            continue;
+        }
+        auto t = TimeGet();
+        Synchronizer* sync = nullptr;
+        int res = Synchronizer::Create(fileName, engine, &sync);
+        double createMs = TimeSinceInMs(t);
+        if (res != PDFSYNCERR_SUCCESS) {
+            printf("'%s': Synchronizer::Create() failed with %d\n", fileName, res);
+            engine->Release();
+            continue;
+        }
+
+        int nPages = engine->PageCount();
+        StrVec srcFiles;
+        Vec<int> srcLines;
+        double buildMs = 0, inverseMs = 0;
+        for (int i = 0; i < kQueries; i++) {
+            int pageNo = (int)(((i64)i * 7919) % nPages) + 1;
+            Rect mediabox = engine->PageMediabox(pageNo).Round();
+            int x = mediabox.x + (i * 37) % std::max(mediabox.dx, 1);
+            int y = mediabox.y + (i * 101) % std::max(mediabox.dy, 1);
+            Point pt{x, y};
+            AutoFreeStr srcFile;
+            int line = 0;
+            int col = 0;
+            t = TimeGet();
+            res = sync->DocToSource(pageNo, pt, srcFile, &line, &col);
+            if (i == 0) {
+                buildMs = TimeSinceInMs(t);
+            } else {
+                inverseMs += TimeSinceInMs(t);
+            }
+            if (res == PDFSYNCERR_SUCCESS) {
+                srcFiles.Append(srcFile);
+                srcLines.Append(line);
+            }
+        }
+
+        Vec<Rect> rects;
+        int pageNo = 0;
+        int nFound = 0;
+        t = TimeGet();
+        for (int i = 0; i < srcFiles.Size(); i++) {
+            res = sync->SourceToDoc(srcFiles.At(i), srcLines.At(i), 0, &pageNo, rects);
+            nFound += res == PDFSYNCERR_SUCCESS ? 1 : 0;
+        }
+        double forwardMs = TimeSinceInMs(t);
+        delete sync;
+        engine->Release();
+
+        printf("'%s': %d pages\n", fileName, nPages);
+        printf("  creating synchronizer: %.2f ms\n", createMs);
+        printf("  building index:        %.2f ms\n", buildMs);
+        printf("  inverse search:        %.2f us per query, %d found\n", inverseMs * 1000 / (kQueries - 1),
+               srcFiles.Size());
+        if (srcFiles.Size() > 0) {
+            printf("  forward search:        %.2f us per query, %d found\n", forwardMs * 1000 / srcFiles.Size(),
+                   nFound);
+        }
+    }
+}
+
+// word -> pages lists, like big CPS Lab marker setup files
+static void PerfJson(const Flags&) {
+    str::Str data;
+    data.Append("{ \"Net\": {\n");
+    for (int i = 0; i < 100000; i++) {
+        data.AppendFmt("%s    \"net_%d/sub_%d\": [%d, %d, %d]", i > 0 ? ",\n" : "", i, i % 97, 1 + i % 500,
+                       2 + i % 300, 10 + i % 1000);
+    }
+    data.Append("\n  }\n}\n");
+
+    struct CountingVisitor : json::ValueVisitor {
+        int n = 0;
+        bool Visit(const char*, const char*, json::Type) override {
+            n++;
+            return true;
+        }
+    } visitor;
+    auto t = TimeGet();
+    bool ok = json::Parse(data.Get(), &visitor);
+    double parseMs = TimeSinceInMs(t);
+
+    int nValues = 0;
+    t = TimeGet();
+    json::Tokenizer tok(data.Get(), data.size());
+    json::TokenType type = tok.Next();
+    for (; type != json::TokenType::End && type != json::TokenType::Error; type = tok.Next()) {
+        nValues += type == json::TokenType::Number ? 1 : 0;
+    }
+    double tokenizeMs = TimeSinceInMs(t);
+
+    double mb = (double)data.size() / (1024 * 1024);
+    printf("%.1f MB of json\n", mb);
+    printf("Parse():    %.1f MB/s, %d values%s\n", mb * 1000 / std::max(parseMs, 0.001), visitor.n,
+           ok ? "" : " (failed)");
+    printf("Tokenizer:  %.1f MB/s, %d numbers%s\n", mb * 1000 / std::max(tokenizeMs, 0.001), nValues,
+           type == json::TokenType::Error ? " (failed)" : "");
+}
+
+using PerfTestFunc = void (*)(const Flags&);
+
+static struct {
+    const char* name;
+    PerfTestFunc fn;
+    // needs documents given on the command line
+    bool needsFiles;
+} gPerfTests[] = {
+    {"shared-store", PerfSharedStore, true},
+    {"glyph-index", PerfGlyphIndex, true},
+    {"epub-layout", PerfEpubLayout, true},
+    {"simd", PerfSimd, false},
+    {"pdf-dict", PerfPdfDict, false},
+    {"pdf-repair", PerfPdfRepair, false},
+    {"linkify", PerfLinkify, true},
+    {"markers", PerfMarkers, false},
+    {"export-words", PerfExportWords, true},
+    {"toc-tree", PerfTocTree, false},
+    {"page-labels", PerfPageLabels, false},
+    {"sync", PerfSync, true},
+    {"json", PerfJson, false},
+};
+
+// -perf-test <name> [-page <n>] [-zoom <zoom>] [files]
+// the correctness of what these time is checked by the unit tests
+void RunPerfTest(const Flags& ci) {
+    if (ci.showConsole) {
+        RedirectIOToConsole();
+    }
+
+    for (auto& test : gPerfTests) {
+        if (!str::EqI(ci.perfTest, test.name)) {
+            continue;
+        }
+        if (test.needsFiles && ci.fileNames.Size() == 0) {
+            printf("no file provided\n");
+            return;
+        }
+        test.fn(ci);
+        return;
+    }
+    printf("unknown perf test '%s', available:", ci.perfTest);
+    for (auto& test : gPerfTests) {
+        printf(" %s", test.name);
+    }
+    printf("\n");
+}
+
@@ -0,0 +1,440 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+#include "utils/BaseUtil.h"
+#include "utils/DirIter.h"
+#include "utils/FileUtil.h"
+#include "utils/WinUtil.h"
+#include "utils/ThreadUtil.h"
+#include "utils/ZipUtil.h"
+
+#include "wingui/UIModels.h"
+
+#include "DocController.h"
+#include "EngineBase.h"
+#include "FileThumbnails.h"
+#include "SumatraPDF.h"
+#include "TextSelection.h"
+#include "TextCacheFile.h"
+
+#include "utils/Log.h"
+
+/*
+File layout (all values little-endian):
+
+TextCacheHeader
+TextCachePageEntry[nPages]
+compressed page data
+
+Each page is compressed separately with zlib, so that a page can be
+decoded without touching the rest of the file. Uncompressed page data is:
+- nChars WCHARs of text
+- nChars glyph boxes as (x - prev x, y - prev y, dx, dy). Those are i16
+  when all values on the page fit (kPageBoxesI16) and i32 otherwise.
+  Storing x/y as deltas makes consecutive glyphs on a line compress well
+*/
+
+constexpr const char* kTextCacheMagic = "SumTxC02";
+constexpr const char* kTextCacheExt = ".txtcache";
+
+// don't write cache files bigger than this
+constexpr size_t kTextCacheMaxFileSize = (size_t)128 << 20;
+// when all cache files are bigger than this, least recently used are deleted
+constexpr i64 kTextCacheMaxDirSize = (i64)512 << 20;
+
+constexpr u32 kPageCached = 0x1;
+constexpr u32 kPageBoxesI16 = 0x2;
+
+struct TextCacheHeader {
+    char magic[8];
+    u8 digest[16];
+    u32 nPages;
+    u32 reserved;
+    // see TextCacheFile::layout
+    i32 layout[3];
+    u32 reserved2;
+};
+
+struct TextCachePageEntry {
+    u32 offset;
+    u32 comprSize;
+    u32 nChars;
+    u32 flags;
+};
+
+static_assert(sizeof(WCHAR) == 2, "text cache stores text as UTF-16");
+
+static TempStr GetTextCachePathTemp(const TextCacheFile* cache) {
+    TempStr dir = GetThumbnailCacheDirTemp();
+    if (!dir) {
+        return nullptr;
+    }
+    AutoFreeStr fingerPrint = str::MemToHex(cache->digest, 16);
+    const i32* l = cache->layout;
+    TempStr name = fingerPrint.Get();
+    if (l[0] != 0) {
+        // text of reflowable documents is only valid for the same layout
+        name = str::FormatTemp("%s-%dx%d-%d", name, l[0], l[1], l[2]);
+    }
+    return path::JoinTemp(dir, str::JoinTemp(name, kTextCacheExt));
+}
+
+static size_t EntriesOffset() {
+    return sizeof(TextCacheHeader);
+}
+
+static size_t DataOffset(int nPages) {
+    return sizeof(TextCacheHeader) + (size_t)nPages * sizeof(TextCachePageEntry);
+}
+
+static bool FitsI16(int v) {
+    return v >= INT16_MIN && v <= INT16_MAX;
+}
+
+// returns uncompressed page data, caller must free()
+static ByteSlice EncodePage(const WCHAR* text, const PageGlyphs* glyphs, u32* flagsOut) {
+    int n = glyphs->len;
+    GlyphCursor coords(glyphs);
+
+    bool boxesI16 = true;
+    int prevX = 0, prevY = 0;
+    for (int i = 0; i < n && boxesI16; i++) {
+        Rect r = coords.At(i);
+        boxesI16 = FitsI16(r.x - prevX) && FitsI16(r.y - prevY) && FitsI16(r.dx) && FitsI16(r.dy);
+        prevX = r.x;
+        prevY = r.y;
+    }
+
+    size_t valSize = boxesI16 ? sizeof(i16) : sizeof(i32);
+    size_t size = (size_t)n * sizeof(WCHAR) + (size_t)n * 4 * valSize;
+    u8* d = AllocArray<u8>(size);
+    if (!d) {
+        return {};
+    }
+    memcpy(d, text, (size_t)n * sizeof(WCHAR));
+    u8* boxes = d + (size_t)n * sizeof(WCHAR);
+    prevX = 0;
+    prevY = 0;
+    coords = GlyphCursor(glyphs);
+    for (int i = 0; i < n; i++) {
+        Rect r = coords.At(i);
+        int vals[4] = {r.x - prevX, r.y - prevY, r.dx, r.dy};
+        for (int v : vals) {
+            if (boxesI16) {
+                i16 v16 = (i16)v;
+                memcpy(boxes, &v16, sizeof(v16));
+            } else {
+                i32 v32 = (i32)v;
+                memcpy(boxes, &v32, sizeof(v32));
+            }
+            boxes += valSize;
+        }
+        prevX = r.x;
+        prevY = r.y;
+    }
+    *flagsOut = boxesI16 ? kPageBoxesI16 : 0;
+    return {d, size};
+}
+
+static bool DecodePage(const u8* d, size_t size, int n, u32 flags, PageText* pageText) {
+    size_t valSize = (flags & kPageBoxesI16) ? sizeof(i16) : sizeof(i32);
+    if (size != (size_t)n * sizeof(WCHAR) + (size_t)n * 4 * valSize) {
+        return false;
+    }
+    WCHAR* text = AllocArray<WCHAR>((size_t)n + 1);
+    Rect* coords = AllocArray<Rect>((size_t)n + 1);
+    if (!text || !coords) {
+        free(text);
+        free(coords);
+        return false;
+    }
+    memcpy(text, d, (size_t)n * sizeof(WCHAR));
+    const u8* boxes = d + (size_t)n * sizeof(WCHAR);
+    int prevX = 0, prevY = 0;
+    for (int i = 0; i < n; i++) {
+        int vals[4];
+        for (int& v : vals) {
+            if (valSize == sizeof(i16)) {
+                i16 v16;
+                memcpy(&v16, boxes, sizeof(v16));
+                v = v16;
+            } else {
+                i32 v32;
+                memcpy(&v32, boxes, sizeof(v32));
+                v = v32;
+            }
+            boxes += valSize;
+        }
+        Rect& r = coords[i];
+        r.x = prevX + vals[0];
+        r.y = prevY + vals[1];
+        r.dx = vals[2];
+        r.dy = vals[3];
+        prevX = r.x;
+        prevY = r.y;
+    }
+    pageText->text = text;
+    pageText->coords = coords;
+    pageText->len = n;
+    return true;
+}
+
+static const TextCachePageEntry* GetPageEntry(const TextCacheFile* cache, int pageNo) {
+    if (!cache->mapped.data || pageNo < 1 || pageNo > cache->nPages) {
+        return nullptr;
+    }
+    auto entries = (const TextCachePageEntry*)(cache->mapped.data + EntriesOffset());
+    const TextCachePageEntry* e = &entries[pageNo - 1];
+    if (!(e->flags & kPageCached)) {
+        return nullptr;
+    }
+    if ((size_t)e->offset + e->comprSize > cache->mapped.size) {
+        return nullptr;
+    }
+    return e;
+}
+
+bool TextCacheFile::HasPage(int pageNo) const {
+    return GetPageEntry(this, pageNo) != nullptr;
+}
+
+bool TextCacheFile::LoadPage(int pageNo, PageText* pageText) const {
+    const TextCachePageEntry* e = GetPageEntry(this, pageNo);
+    if (!e) {
+        return false;
+    }
+    if (e->nChars == 0) {
+        pageText->text = str::Dup(L"");
+        pageText->coords = nullptr;
+        pageText->len = 0;
+        return true;
+    }
+    size_t valSize = (e->flags & kPageBoxesI16) ? sizeof(i16) : sizeof(i32);
+    size_t size = (size_t)e->nChars * sizeof(WCHAR) + (size_t)e->nChars * 4 * valSize;
+    u8* d = AllocArray<u8>(size);
+    if (!d) {
+        return false;
+    }
+    bool ok = ZlibUncompress({data + e->offset, e->comprSize}, d, size);
+    ok = ok && DecodePage(d, size, (int)e->nChars, e->flags, pageText);
+    free(d);
+    if (!ok) {
+        logf("TextCacheFile::LoadPage: failed to decode page %d\n", pageNo);
+    }
+    return ok;
+}
+
+static bool MapTextCacheFile(TextCacheFile* cache, const char* path) {
+    if (!cache->mapped.Open(path) || cache->mapped.size < DataOffset(cache->nPages)) {
+        return false;
+    }
+    auto hdr = (const TextCacheHeader*)cache->mapped.data;
+    if (!memeq(hdr->magic, kTextCacheMagic, sizeof(hdr->magic))) {
+        return false;
+    }
+    if (!memeq(hdr->digest, cache->digest, sizeof(hdr->digest))) {
+        return false;
+    }
+    if (!memeq(hdr->layout, cache->layout, sizeof(hdr->layout))) {
+        return false;
+    }
+    return hdr->nPages == (u32)cache->nPages;
+}
+
+TextCacheFile* OpenTextCacheFile(EngineBase* engine) {
+    // the text of password protected documents must not be readable without
+    // the password and restricted mode must not write to disk
+    if (engine->IsPasswordProtected() || !HasPermission(Perm::SavePreferences)) {
+        return nullptr;
+    }
+    u8 digest[16]{};
+    if (!engine->GetFingerprint(digest)) {
+        return nullptr;
+    }
+    auto cache = new TextCacheFile();
+    memcpy(cache->digest, digest, sizeof(digest));
+    float dx, dy, fontDy;
+    if (engine->GetReflowLayout(&dx, &dy, &fontDy)) {
+        cache->layout[0] = (i32)(dx * 100);
+        cache->layout[1] = (i32)(dy * 100);
+        cache->layout[2] = (i32)(fontDy * 100);
+    }
+    cache->nPages = engine->PageCount();
+    TempStr path = GetTextCachePathTemp(cache);
+    if (!path) {
+        delete cache;
+        return nullptr;
+    }
+    if (!file::Exists(path)) {
+        return cache;
+    }
+
+    // modification time is used for pruning least recently used files
+    FILETIME now{};
+    GetSystemTimeAsFileTime(&now);
+    file::SetModificationTime(path, now);
+
+    if (!MapTextCacheFile(cache, path)) {
+        logf("OpenTextCacheFile: '%s' is not a valid text cache\n", path);
+        cache->mapped.Close();
+    }
+    return cache;
+}
+
+// writes all pages that are either already in the cache file or have been
+// extracted since into a new cache file
+bool SaveTextCacheFile(TextCacheFile* cache, const PageText* pagesText, PageGlyphs** pagesGlyphs) {
+    if (!cache || cache->nNewPages == 0) {
+        return true;
+    }
+    int nPages = cache->nPages;
+    TempStr path = GetTextCachePathTemp(cache);
+    if (!path) {
+        return false;
+    }
+
+    TextCachePageEntry* entries = AllocArray<TextCachePageEntry>(nPages);
+    if (!entries) {
+        return false;
+    }
+    defer {
+        free(entries);
+    };
+    str::Str pagesData;
+    size_t dataOffset = DataOffset(nPages);
+    for (int i = 0; i < nPages; i++) {
+        int pageNo = i + 1;
+        TextCachePageEntry& e = entries[i];
+        const TextCachePageEntry* existing = GetPageEntry(cache, pageNo);
+        if (existing) {
+            e = *existing;
+            e.offset = (u32)(dataOffset + pagesData.size());
+            pagesData.Append((const char*)cache->mapped.data + existing->offset, existing->comprSize);
+        } else if (pagesText[i].text) {
+            u32 flags = 0;
+            ByteSlice compr;
+            if (pagesText[i].len > 0) {
+                ByteSlice d = EncodePage(pagesText[i].text, pagesGlyphs[i], &flags);
+                compr = ZlibCompress(d);
+                d.Free();
+                if (compr.empty()) {
+                    continue;
+                }
+            }
+            e.offset = (u32)(dataOffset + pagesData.size());
+            e.comprSize = (u32)compr.size();
+            e.nChars = (u32)pagesText[i].len;
+            e.flags = flags | kPageCached;
+            pagesData.Append((const char*)compr.data(), compr.size());
+            compr.Free();
+        }
+        if (dataOffset + pagesData.size() > kTextCacheMaxFileSize) {
+            logf("SaveTextCacheFile: cache for '%s' would be too big\n", path);
+            return false;
+        }
+    }
+
+    TextCacheHeader hdr{};
+    memcpy(hdr.magic, kTextCacheMagic, sizeof(hdr.magic));
+    memcpy(hdr.digest, cache->digest, sizeof(hdr.digest));
+    memcpy(hdr.layout, cache->layout, sizeof(hdr.layout));
+    hdr.nPages = (u32)nPages;
+
+    str::Str d(dataOffset + pagesData.size());
+    d.Append((const char*)&hdr, sizeof(hdr));
+    d.Append((const char*)entries, (size_t)nPages * sizeof(TextCachePageEntry));
+    d.Append(pagesData.Get(), pagesData.size());
+
+    // write to a temporary file first so that a crash can't leave a half-written cache
+    cache->mapped.Close();
+    if (!dir::CreateForFile(path)) {
+        return false;
+    }
+    TempStr tmpPath = str::JoinTemp(path, ".tmp");
+    bool ok = file::WriteFile(tmpPath, d.AsByteSlice());
+    if (ok) {
+        ok = MoveFileExW(ToWStrTemp(tmpPath), ToWStrTemp(path), MOVEFILE_REPLACE_EXISTING);
+    }
+    if (!ok) {
+        file::Delete(tmpPath);
+        logf("SaveTextCacheFile: failed to write '%s'\n", path);
+        return false;
+    }
+    cache->nNewPages = 0;
+    return true;
+}
+
+// saving compresses the text of every extracted page, which can take a while
+// for big documents, so it's done on a background thread
+static SRWLOCK gSaveTextCacheLock = SRWLOCK_INIT;
+
+void SaveTextCacheFileAsync(TextCacheFile* cache, PageText* pagesText, PageGlyphs** pagesGlyphs) {
+    auto fn = [cache, pagesText, pagesGlyphs] {
+        // the same document might be closed in several windows at once
+        AcquireSRWLockExclusive(&gSaveTextCacheLock);
+        if (SaveTextCacheFile(cache, pagesText, pagesGlyphs)) {
+            PruneTextCacheDir();
+        }
+        ReleaseSRWLockExclusive(&gSaveTextCacheLock);
+
+        int n = cache->nPages;
+        for (int i = 0; i < n; i++) {
+            free(pagesText[i].coords);
+            free(pagesText[i].text);
+            FreePageGlyphs(pagesGlyphs[i]);
+        }
+        free(pagesText);
+        free(pagesGlyphs);
+        delete cache;
+    };
+    RunAsync(fn, "SaveTextCacheThread");
+}
+
+struct TextCacheFileInfo {
+    char* path = nullptr;
+    FILETIME modified{};
+    i64 size = 0;
+};
+
+// deletes least recently used cache files until they all fit in kTextCacheMaxDirSize
+void PruneTextCacheDir() {
+    TempStr dir = GetThumbnailCacheDirTemp();
+    if (!dir) {
+        return;
+    }
+    TempStr pattern = path::JoinTemp(dir, str::JoinTemp("*", kTextCacheExt));
+    StrVec paths;
+    if (!CollectPathsFromDirectory(pattern, paths)) {
+        return;
+    }
+
+    Vec<TextCacheFileInfo> files;
+    i64 totalSize = 0;
+    for (char* path : paths) {
+        TextCacheFileInfo fi;
+        fi.path = path;
+        fi.modified = file::GetModificationTime(path);
+        fi.size = file::GetSize(path);
+        if (fi.size < 0) {
+            continue;
+        }
+        totalSize += fi.size;
+        files.Append(fi);
+    }
+    if (totalSize <= kTextCacheMaxDirSize) {
+        return;
+    }
+
+    std::sort(files.begin(), files.end(), [](const TextCacheFileInfo& a, const TextCacheFileInfo& b) {
+        return CompareFileTime(&a.modified, &b.modified) < 0;
+    });
+    for (auto& fi : files) {
+        if (totalSize <= kTextCacheMaxDirSize) {
+            break;
+        }
+        if (file::Delete(fi.path)) {
+            totalSize -= fi.size;
+            logf("PruneTextCacheDir: deleted '%s'\n", fi.path);
+        }
+    }
+}
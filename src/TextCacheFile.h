@@ -0,0 +1,28 @@
+/* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
+   License: GPLv3 */
+
+// on-disk cache of extracted page text, so that re-opened documents
+// don't have to extract the text of every page again.
+// files are named <md5 of document>.txtcache (<md5>-<layout>.txtcache for
+// reflowable documents) and live next to thumbnails in GetThumbnailCacheDirTemp()
+struct TextCacheFile {
+    u8 digest[16]{};
+    // page width, height and font size (* 100) of reflowable documents, 0 otherwise
+    i32 layout[3]{};
+    int nPages = 0;
+
+    // read-only mapping of the existing cache file (if any)
+    file::MappedFile mapped;
+
+    // number of pages extracted since opening which are not in the file yet
+    int nNewPages = 0;
+
+    bool HasPage(int pageNo) const;
+    bool LoadPage(int pageNo, PageText* pageText) const;
+};
+
+TextCacheFile* OpenTextCacheFile(EngineBase* engine);
+bool SaveTextCacheFile(TextCacheFile* cache, const PageText* pagesText, PageGlyphs** pagesGlyphs);
+// takes ownership of cache, pagesText and pagesGlyphs and frees them when done
+void SaveTextCacheFileAsync(TextCacheFile* cache, PageText* pagesText, PageGlyphs** pagesGlyphs);
+void PruneTextCacheDir();
@@ -49,7 +49,7 @@ void TextSearch::Clear() {
 
 void TextSearch::Reset() {
     pageText = nullptr;
-    pageRects = nullptr;  // CPS Lab.
+    pageGlyphs = nullptr; // CPS Lab.
     TextSelection::Reset();
 }
 
@@ -161,7 +161,7 @@ void TextSearch::SetLastResult(TextSelection* sel) {
 
     searchHitStartAt = findPage = std::min(startPage, endPage);
     findIndex = (findPage == startPage ? startGlyph : endGlyph) + (int)str::Len(findText);
-    pageText = textCache->GetTextForPage(findPage, nullptr, &pageRects);
+    pageText = textCache->GetGlyphsForPage(findPage, nullptr, &pageGlyphs);
     forward = true;
 }
 
@@ -220,7 +220,7 @@ TextSearch::PageAndOffset TextSearch::wMatchEnd(const WCHAR* start) const {
                     if (matchWordEnd && end > currentPageText && isWordChar(end[-1]) && isWordChar(end[0])) {
                         // not matched
                     }
-                    else if (cpslab::IsWord(pageText, pageRects, start, end+1)) {
+                    else if (cpslab::IsWord(pageText, pageGlyphs, start, end+1)) {
                         int off = (int)(end - currentPageText) + 1;
                         return {currentPage, off};
                     }
@@ -340,7 +340,7 @@ TextSearch::PageAndOffset TextSearch::MatchEnd(const WCHAR* start) const {
 
     // CPS Lab
     if (wordSearch) {
-        if (!cpslab::IsWord(pageText, pageRects, start, end)) {
+        if (!cpslab::IsWord(pageText, pageGlyphs, start, end)) {
             return notFound;
         }
     }
@@ -430,7 +430,7 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker, bool
 
         Reset();
 
-        pageText = textCache->GetTextForPage(pageNo, &findIndex, &pageRects);
+        pageText = textCache->GetGlyphsForPage(pageNo, &findIndex, &pageGlyphs);
         if (pageText) {
             if (forward) {
                 findIndex = 0;
@@ -440,7 +440,7 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker, bool
                 if (forward) {
                     if (findPage != r.page) {
                         findPage = r.page;
-                        pageText = textCache->GetTextForPage(findPage, nullptr, &pageRects);
+                        pageText = textCache->GetGlyphsForPage(findPage, nullptr, &pageGlyphs);
                     }
                     findIndex = r.offset;
                 }
@@ -485,7 +485,7 @@ TextSel* TextSearch::FindNext(ProgressUpdateUI* tracker, bool conti, bool only_i
         if (forward) {
             findPage = finalGlyph.page;
             findIndex = finalGlyph.offset;
-            pageText = textCache->GetTextForPage(findPage, nullptr, &pageRects);
+            pageText = textCache->GetGlyphsForPage(findPage, nullptr, &pageGlyphs);
         }
         return &result;
     }
@@ -51,7 +51,7 @@ class TextSearch : public TextSelection {
 
   private:
     const WCHAR* pageText = nullptr;
-    Rect* pageRects = nullptr;    // CPS Lab
+    const PageGlyphs* pageGlyphs = nullptr; // CPS Lab
     int findIndex = 0;
 
     WCHAR* lastText = nullptr;
@@ -3,6 +3,7 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
+#include "utils/FileUtil.h"
 #include "utils/WinUtil.h"
 
 #include "wingui/UIModels.h"
@@ -12,6 +13,8 @@
 #include "DocController.h"
 #include "EngineBase.h"
 #include "TextSelection.h"
+#include "TextCacheFile.h"
+#include "GlyphIndex.h"
 
 uint distSq(int x, int y) {
     return x * x + y * y;
@@ -32,10 +35,144 @@ bool isWordChar(WCHAR c) {
     }
 }
 
+// sentinel in PageGlyphs.xs for empty boxes (e.g. of line breaks),
+// which don't start a new line
+constexpr i16 kEmptyGlyphX = INT16_MIN;
+static bool FitsGlyphI16(int v) {
+    return v > INT16_MIN && v <= INT16_MAX;
+}
+
+static bool IsEmptyGlyph(const Rect& r) {
+    return r.x == 0 && r.y == 0 && r.dx == 0 && r.dy == 0;
+}
+
+static bool StartsNewLine(const PageGlyphLine& line, const Rect& r) {
+    return r.y != line.y || r.dy != line.dy || !FitsGlyphI16(r.x - line.x);
+}
+
+// takes ownership of coords
+PageGlyphs* NewPageGlyphs(Rect* coords, int len) {
+    auto res = new PageGlyphs();
+    res->len = len;
+
+    // first pass: count lines and check if all boxes can be represented
+    bool fits = true;
+    int nLines = 0;
+    PageGlyphLine line;
+    for (int i = 0; i < len && fits; i++) {
+        const Rect& r = coords[i];
+        if (IsEmptyGlyph(r)) {
+            continue;
+        }
+        fits = FitsGlyphI16(r.dx);
+        if (nLines == 0 || StartsNewLine(line, r)) {
+            line = {i, r.x, r.y, r.dy};
+            nLines++;
+        }
+    }
+    size_t compactSize = (size_t)nLines * sizeof(PageGlyphLine) + (size_t)len * 2 * sizeof(i16);
+    if (!fits || compactSize >= (size_t)len * sizeof(Rect)) {
+        res->raw = coords;
+        return res;
+    }
+
+    u8* d = AllocArray<u8>(compactSize);
+    if (!d) {
+        res->raw = coords;
+        return res;
+    }
+    res->nLines = nLines;
+    res->lines = (PageGlyphLine*)d;
+    res->xs = (i16*)(d + (size_t)nLines * sizeof(PageGlyphLine));
+    res->dxs = res->xs + len;
+
+    int lineNo = -1;
+    for (int i = 0; i < len; i++) {
+        const Rect& r = coords[i];
+        if (IsEmptyGlyph(r)) {
+            res->xs[i] = kEmptyGlyphX;
+            continue;
+        }
+        if (lineNo < 0 || StartsNewLine(res->lines[lineNo], r)) {
+            lineNo++;
+            // leading empty boxes belong to the first line
+            res->lines[lineNo] = {lineNo == 0 ? 0 : i, r.x, r.y, r.dy};
+        }
+        res->xs[i] = (i16)(r.x - res->lines[lineNo].x);
+        res->dxs[i] = (i16)r.dx;
+    }
+    ReportIf(lineNo + 1 != nLines);
+    free(coords);
+    return res;
+}
+
+void FreePageGlyphs(PageGlyphs* glyphs) {
+    if (!glyphs) {
+        return;
+    }
+    // xs and dxs are allocated together with lines
+    free(glyphs->lines);
+    FreePageGlyphIndex(glyphs->index);
+    free(glyphs->raw);
+    delete glyphs;
+}
+
+int PageGlyphs::FindLine(int i) const {
+    int lo = 0, hi = nLines - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (lines[mid].start <= i) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+Rect PageGlyphs::At(int i) const {
+    ReportIf(i < 0 || i >= len);
+    if (raw) {
+        return raw[i];
+    }
+    if (xs[i] == kEmptyGlyphX) {
+        return {};
+    }
+    const PageGlyphLine& l = lines[FindLine(i)];
+    return Rect(l.x + xs[i], l.y, dxs[i], l.dy);
+}
+
+size_t PageGlyphs::MemSize() const {
+    if (raw) {
+        return (size_t)len * sizeof(Rect);
+    }
+    return (size_t)nLines * sizeof(PageGlyphLine) + (size_t)len * 2 * sizeof(i16);
+}
+
+Rect GlyphCursor::At(int i) {
+    if (glyphs->raw) {
+        return glyphs->raw[i];
+    }
+    if (glyphs->xs[i] == kEmptyGlyphX) {
+        return {};
+    }
+    int nLines = glyphs->nLines;
+    const PageGlyphLine* lines = glyphs->lines;
+    auto inLine = [&](int l) { return lines[l].start <= i && (l + 1 == nLines || i < lines[l + 1].start); };
+    if (!inLine(line)) {
+        // sequential scans mostly move on to the next line
+        bool inNext = line + 1 < nLines && inLine(line + 1);
+        line = inNext ? line + 1 : glyphs->FindLine(i);
+    }
+    const PageGlyphLine& l = lines[line];
+    return Rect(l.x + glyphs->xs[i], l.y, glyphs->dxs[i], l.dy);
+}
+
 DocumentTextCache::DocumentTextCache(EngineBase* engine) : engine(engine) {
     nPages = engine->PageCount();
     pagesText = AllocArray<PageText>(nPages);
-    debugSize = nPages * (sizeof(Rect*) + sizeof(WCHAR*) + sizeof(int));
+    pagesGlyphs = AllocArray<PageGlyphs*>(nPages);
+    debugSize = nPages * (sizeof(Rect*) + sizeof(WCHAR*) + sizeof(int) + sizeof(PageGlyphs*));
 
     InitializeCriticalSection(&access);
 }
@@ -43,13 +180,25 @@ DocumentTextCache::DocumentTextCache(EngineBase* engine) : engine(engine) {
 DocumentTextCache::~DocumentTextCache() {
     EnterCriticalSection(&access);
 
-    int n = engine->PageCount();
+    if (diskCache && diskCache->nNewPages > 0) {
+        // the extracted text is handed off to the thread writing the cache file
+        SaveTextCacheFileAsync(diskCache, pagesText, pagesGlyphs);
+        pagesText = nullptr;
+        pagesGlyphs = nullptr;
+    } else {
+        delete diskCache;
+    }
+    diskCache = nullptr;
+
+    int n = pagesText ? nPages : 0;
     for (int i = 0; i < n; i++) {
         PageText* pageText = &pagesText[i];
         free(pageText->coords);
         free(pageText->text);
+        FreePageGlyphs(pagesGlyphs[i]);
     }
     free(pagesText);
+    free(pagesGlyphs);
     LeaveCriticalSection(&access);
     DeleteCriticalSection(&access);
 }
@@ -60,30 +209,76 @@ bool DocumentTextCache::HasTextForPage(int pageNo) const {
     return pageText->text != nullptr;
 }
 
-const WCHAR* DocumentTextCache::GetTextForPage(int pageNo, int* lenOut, Rect** coordsOut) {
-    ReportIf(pageNo < 1 || pageNo > nPages);
-
-    ScopedCritSec scope(&access);
+// must be called while holding access
+PageText* DocumentTextCache::EnsurePageText(int pageNo) {
     PageText* pageText = &pagesText[pageNo - 1];
+    if (pageText->text) {
+        return pageText;
+    }
+
+    if (!diskCacheOpened) {
+        diskCacheOpened = true;
+        diskCache = OpenTextCacheFile(engine);
+    }
 
-    if (!pageText->text) {
+    if (!diskCache || !diskCache->LoadPage(pageNo, pageText)) {
         *pageText = engine->ExtractPageText(pageNo);
         if (!pageText->text) {
             pageText->text = str::Dup(L"");
             pageText->len = 0;
         }
-        debugSize += (pageText->len + 1) * (int)(sizeof(WCHAR) + sizeof(Rect));
+        if (diskCache) {
+            diskCache->nNewPages++;
+        }
     }
 
+    PageGlyphs* glyphs = NewPageGlyphs(pageText->coords, pageText->len);
+    pageText->coords = nullptr;
+    pagesGlyphs[pageNo - 1] = glyphs;
+    debugSize += (pageText->len + 1) * (int)sizeof(WCHAR) + (int)glyphs->MemSize();
+    return pageText;
+}
+
+const WCHAR* DocumentTextCache::GetTextForPage(int pageNo, int* lenOut) {
+    ReportIf(pageNo < 1 || pageNo > nPages);
+
+    ScopedCritSec scope(&access);
+    PageText* pageText = EnsurePageText(pageNo);
+
     if (lenOut) {
         *lenOut = pageText->len;
     }
-    if (coordsOut) {
-        *coordsOut = pageText->coords;
+    return pageText->text;
+}
+
+const WCHAR* DocumentTextCache::GetGlyphsForPage(int pageNo, int* lenOut, const PageGlyphs** glyphsOut) {
+    ReportIf(pageNo < 1 || pageNo > nPages);
+
+    ScopedCritSec scope(&access);
+    PageText* pageText = EnsurePageText(pageNo);
+    if (lenOut) {
+        *lenOut = pageText->len;
     }
+    *glyphsOut = pagesGlyphs[pageNo - 1];
     return pageText->text;
 }
 
+const PageGlyphIndex* DocumentTextCache::GetGlyphIndex(int pageNo, const PageGlyphs** glyphsOut) {
+    ReportIf(pageNo < 1 || pageNo > nPages);
+
+    ScopedCritSec scope(&access);
+    EnsurePageText(pageNo);
+    PageGlyphs* glyphs = pagesGlyphs[pageNo - 1];
+    if (!glyphs->index) {
+        glyphs->index = NewPageGlyphIndex(glyphs);
+        debugSize += (int)glyphs->index->MemSize();
+    }
+    if (glyphsOut) {
+        *glyphsOut = glyphs;
+    }
+    return glyphs->index;
+}
+
 TextSelection::TextSelection(EngineBase* engine, DocumentTextCache* textCache) : engine(engine), textCache(textCache) {
 }
 
@@ -104,37 +299,12 @@ void TextSelection::Reset() {
 // (i.e. when over the right half of a glyph, the returned index will be for the
 // glyph following it, which will be the first glyph (not) to be selected)
 static int FindClosestGlyph(TextSelection* ts, int pageNo, double x, double y) {
-    int textLen;
-    Rect* coords;
-    ts->textCache->GetTextForPage(pageNo, &textLen, &coords);
+    const PageGlyphs* glyphs;
+    const PageGlyphIndex* index = ts->textCache->GetGlyphIndex(pageNo, &glyphs);
+    int textLen = glyphs->len;
     PointF pt = PointF(x, y);
 
-    unsigned int maxDist = UINT_MAX;
-    Point pti = ToPoint(pt);
-    bool overGlyph = false;
-    int result = -1;
-
-    for (int i = 0; i < textLen; i++) {
-        Rect& coord = coords[i];
-        if (!coord.x && !coord.dx) {
-            continue;
-        }
-        if (overGlyph && !coord.Contains(pti)) {
-            continue;
-        }
-
-        uint dist = distSq((int)x - coord.x - coord.dx / 2, (int)y - coord.y - coord.dy / 2);
-        if (dist < maxDist) {
-            result = i;
-            maxDist = dist;
-        }
-        // prefer glyphs the cursor is actually over
-        if (!overGlyph && coord.Contains(pti)) {
-            overGlyph = true;
-            result = i;
-            maxDist = dist;
-        }
-    }
+    int result = GlyphIndexFindClosest(index, glyphs, x, y);
 
     if (-1 == result) {
         return 0;
@@ -142,36 +312,39 @@ static int FindClosestGlyph(TextSelection* ts, int pageNo, double x, double y) {
     ReportIf(result < 0 || result >= textLen);
 
     // the result indexes the first glyph to be selected in a forward selection
-    RectF bbox = ts->engine->Transform(ToRectF(coords[result]), pageNo, 1.0, 0);
+    RectF bbox = ts->engine->Transform(ToRectF(glyphs->At(result)), pageNo, 1.0, 0);
     pt = ts->engine->Transform(pt, pageNo, 1.0, 0);
     if (pt.x > bbox.x + 0.5 * bbox.dx) {
         result++;
         // for some (DjVu) documents, all glyphs of a word share the same bbox
-        while (result < textLen && coords[result - 1] == coords[result]) {
+        while (result < textLen && glyphs->At(result - 1) == glyphs->At(result)) {
             result++;
         }
     }
-    ReportIf(result > 0 && result < textLen && coords[result] == coords[result - 1]);
+    ReportIf(result > 0 && result < textLen && glyphs->At(result) == glyphs->At(result - 1));
 
     return result;
 }
 
 static void FillResultRects(TextSelection* ts, int pageNo, int glyph, int length, StrVec* lines = nullptr) {
     int len;
-    Rect* coords;
-    const WCHAR* text = ts->textCache->GetTextForPage(pageNo, &len, &coords);
+    const PageGlyphs* glyphs;
+    const WCHAR* text = ts->textCache->GetGlyphsForPage(pageNo, &len, &glyphs);
     ReportIf(len < glyph + length);
     Rect mediabox = ts->engine->PageMediabox(pageNo).Round();
-    Rect *c = &coords[glyph], *end = c + length;
-    while (c < end) {
+    GlyphCursor coords(glyphs);
+    int i = glyph, end = glyph + length;
+    Rect c = i < end ? coords.At(i) : Rect();
+    while (i < end) {
         // skip line breaks
-        for (; c < end && !c->x && !c->dx; c++) {
+        for (; i < end && !c.x && !c.dx; c = ++i < len ? coords.At(i) : Rect()) {
             // no-op
         }
 
-        Rect bbox, *c0 = c;
-        for (; c < end && (c->x || c->dx); c++) {
-            bbox = bbox.Union(*c);
+        Rect bbox;
+        int i0 = i;
+        for (; i < end && (c.x || c.dx); c = ++i < len ? coords.At(i) : Rect()) {
+            bbox = bbox.Union(c);
         }
         bbox = bbox.Intersect(mediabox);
         // skip text that's completely outside a page's mediabox
@@ -180,14 +353,14 @@ static void FillResultRects(TextSelection* ts, int pageNo, int glyph, int length
         }
 
         if (lines) {
-            char* s = ToUtf8Temp(text + (c0 - coords), c - c0);
+            char* s = ToUtf8Temp(text + i0, i - i0);
             lines->Append(s);
             continue;
         }
 
         // cut the right edge, if it overlaps the next character
-        if (c < coords + len && (c->x || c->dx) && bbox.x < c->x && bbox.x + bbox.dx > c->x) {
-            bbox.dx = c->x - bbox.x;
+        if (i < len && (c.x || c.dx) && bbox.x < c.x && bbox.x + bbox.dx > c.x) {
+            bbox.dx = c.x - bbox.x;
         }
 
         int currLen = ts->result.len;
@@ -215,20 +388,20 @@ static void FillResultRects(TextSelection* ts, int pageNo, int glyph, int length
 
 bool TextSelection::IsOverGlyph(int pageNo, double x, double y) {
     int textLen;
-    Rect* coords;
-    textCache->GetTextForPage(pageNo, &textLen, &coords);
+    const PageGlyphs* glyphs;
+    textCache->GetGlyphsForPage(pageNo, &textLen, &glyphs);
 
     int glyphIx = FindClosestGlyph(this, pageNo, x, y);
     Point pt = ToPoint(PointF(x, y));
     // when over the right half of a glyph, FindClosestGlyph returns the
     // index of the next glyph, in which case glyphIx must be decremented
-    if (glyphIx == textLen || !coords[glyphIx].Contains(pt)) {
+    if (glyphIx == textLen || !glyphs->At(glyphIx).Contains(pt)) {
         glyphIx--;
     }
     if (-1 == glyphIx) {
         return false;
     }
-    return coords[glyphIx].Contains(pt);
+    return glyphs->At(glyphIx).Contains(pt);
 }
 
 void TextSelection::StartAt(int pageNo, int glyphIx) {
@@ -287,16 +460,16 @@ void TextSelection::SelectUpTo(int pageNo, int glyphIx, bool conti) {
 void TextSelection::SelectWordAt(int pageNo, double x, double y, bool conti) {
     int i = FindClosestGlyph(this, pageNo, x, y);
     int textLen;
-    Rect* coords;
-    const WCHAR* text = textCache->GetTextForPage(pageNo, &textLen, &coords);
-    Rect& coord = coords[i];
+    const PageGlyphs* glyphs;
+    const WCHAR* text = textCache->GetGlyphsForPage(pageNo, &textLen, &glyphs);
+    Rect coord = glyphs->At(i);
 
     for (; i > 0; i--) {
         if (!isWordChar(text[i - 1])) {
             break;
         }
         if (gGlobalPrefs->printableCharAsWordChar) {
-            Rect& r = coords[i - 1];
+            Rect r = glyphs->At(i - 1);
             if (r.x != coord.x && r.y != coord.y) {
                 break; // CPS Lab.
             }
@@ -309,7 +482,7 @@ void TextSelection::SelectWordAt(int pageNo, double x, double y, bool conti) {
             break;
         }
         if (gGlobalPrefs->printableCharAsWordChar) {
-            Rect& r = coords[i];
+            Rect r = glyphs->At(i);
             if (r.x != coord.x && r.y != coord.y) {
                 break; // CPS Lab.
             }
@@ -1,19 +1,71 @@
 /* Copyright 2022 the SumatraPDF project authors (see AUTHORS file).
    License: GPLv3 */
 
+struct TextCacheFile;
+struct PageGlyphIndex;
+
+// glyphs on the same line (same y and dy) share a PageGlyphLine
+struct PageGlyphLine {
+    int start = 0; // index of the first glyph of the line
+    int x = 0;
+    int y = 0;
+    int dy = 0;
+};
+
+// glyph boxes of a page, stored compactly: 4 bytes per glyph plus one
+// PageGlyphLine per line instead of a 16 byte Rect per glyph
+struct PageGlyphs {
+    int len = 0;
+    int nLines = 0;
+    PageGlyphLine* lines = nullptr;
+    i16* xs = nullptr; // relative to PageGlyphLine.x
+    i16* dxs = nullptr;
+    // used instead when the boxes don't fit the compact representation
+    Rect* raw = nullptr;
+    // built on first use by DocumentTextCache::GetGlyphIndex()
+    PageGlyphIndex* index = nullptr;
+
+    Rect At(int i) const;
+    int FindLine(int i) const;
+    size_t MemSize() const;
+};
+
+PageGlyphs* NewPageGlyphs(Rect* coords, int len);
+void FreePageGlyphs(PageGlyphs*);
+
+// fast sequential access to PageGlyphs, remembers the current line
+struct GlyphCursor {
+    const PageGlyphs* glyphs = nullptr;
+    int line = 0;
+
+    explicit GlyphCursor(const PageGlyphs* glyphs) : glyphs(glyphs) {
+    }
+    Rect At(int i);
+};
+
 struct DocumentTextCache {
     EngineBase* engine = nullptr;
     int nPages = 0;
     PageText* pagesText = nullptr;
+    PageGlyphs** pagesGlyphs = nullptr;
     int debugSize = 0;
 
+    // persisted text of previously opened documents, opened on first use
+    TextCacheFile* diskCache = nullptr;
+    bool diskCacheOpened = false;
+
     CRITICAL_SECTION access;
 
     explicit DocumentTextCache(EngineBase* engine);
     ~DocumentTextCache();
 
     bool HasTextForPage(int pageNo) const;
-    const WCHAR* GetTextForPage(int pageNo, int* lenOut = nullptr, Rect** coordsOut = nullptr);
+    const WCHAR* GetTextForPage(int pageNo, int* lenOut = nullptr);
+    const WCHAR* GetGlyphsForPage(int pageNo, int* lenOut, const PageGlyphs** glyphsOut);
+    const PageGlyphIndex* GetGlyphIndex(int pageNo, const PageGlyphs** glyphsOut);
+
+  private:
+    PageText* EnsurePageText(int pageNo);
 };
 
 // TODO: replace with Vec<TextSel>
@@ -590,6 +590,51 @@ HANDLE OpenReadOnly(const char* path) {
     return CreateFileW(filePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
 }
 
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const char* path) {
+    Close();
+    WCHAR* pathW = ToWStrTemp(path);
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_DELETE;
+    hFile = CreateFileW(pathW, GENERIC_READ, share, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize{};
+    // CreateFileMapping() fails for empty files
+    bool ok = GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0 && (u64)fileSize.QuadPart <= SIZE_MAX;
+    if (ok) {
+        hMap = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    if (hMap) {
+        data = (const u8*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!data) {
+        Close();
+        return false;
+    }
+    size = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data) {
+        UnmapViewOfFile(data);
+        data = nullptr;
+    }
+    if (hMap) {
+        CloseHandle(hMap);
+        hMap = nullptr;
+    }
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+    size = 0;
+}
+
 bool Exists(const char* path) {
     if (!path) {
         return false;
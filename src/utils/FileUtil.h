@@ -48,6 +48,24 @@ bool Exists(const char* path);
 
 FILE* OpenFILE(const char* path);
 HANDLE OpenReadOnly(const char*);
+
+// read-only mapping of a whole file, which must not be empty.
+// while mapped, the file can be deleted or replaced but not written to
+struct MappedFile {
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMap = nullptr;
+    const u8* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool Open(const char* path);
+    void Close();
+};
+
 ByteSlice ReadFileWithAllocator(const char* path, Allocator*);
 ByteSlice ReadFile(const char* path);
 int ReadN(const char* path, char* buf, size_t toRead);
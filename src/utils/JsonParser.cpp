@@ -32,6 +32,47 @@ class ParseArgs {
 
 static const char* ParseValue(ParseArgs& args, const char* data);
 
+// data points to the char after a backslash
+// returns the last char of the escape sequence or nullptr if it's invalid
+static const char* AppendEscapeSeq(str::Str& string, const char* data) {
+    int i;
+    switch (*data) {
+        case '"':
+        case '\\':
+        case '/':
+            string.AppendChar(*data);
+            break;
+        case 'b':
+            string.AppendChar('\b');
+            break;
+        case 'f':
+            string.AppendChar('\f');
+            break;
+        case 'n':
+            string.AppendChar('\n');
+            break;
+        case 'r':
+            string.AppendChar('\r');
+            break;
+        case 't':
+            string.AppendChar('\t');
+            break;
+        case 'u':
+            if (str::Parse(data + 1, "%4x", &i) && 0 < i && i < 0x10000) {
+                char buf[5]{};
+                wchar_t c = (wchar_t)i;
+                WideCharToMultiByte(CP_UTF8, 0, &c, 1, buf, dimof(buf), nullptr, nullptr);
+                string.Append(buf);
+                data += 4;
+                break;
+            }
+            return nullptr;
+        default:
+            return nullptr;
+    }
+    return data;
+}
+
 static const char* ExtractString(str::Str& string, const char* data) {
     while (*++data) {
         if ('"' == *data) {
@@ -41,41 +82,9 @@ static const char* ExtractString(str::Str& string, const char* data) {
             string.AppendChar(*data);
             continue;
         }
-        // parse escape sequence
-        int i;
-        switch (*++data) {
-            case '"':
-            case '\\':
-            case '/':
-                string.AppendChar(*data);
-                break;
-            case 'b':
-                string.AppendChar('\b');
-                break;
-            case 'f':
-                string.AppendChar('\f');
-                break;
-            case 'n':
-                string.AppendChar('\n');
-                break;
-            case 'r':
-                string.AppendChar('\r');
-                break;
-            case 't':
-                string.AppendChar('\t');
-                break;
-            case 'u':
-                if (str::Parse(data + 1, "%4x", &i) && 0 < i && i < 0x10000) {
-                    char buf[5]{};
-                    wchar_t c = (wchar_t)i;
-                    WideCharToMultiByte(CP_UTF8, 0, &c, 1, buf, dimof(buf), nullptr, nullptr);
-                    string.Append(buf);
-                    data += 4;
-                    break;
-                }
-                return nullptr;
-            default:
-                return nullptr;
+        data = AppendEscapeSeq(string, data + 1);
+        if (!data) {
+            return nullptr;
         }
     }
     return nullptr;
@@ -249,4 +258,259 @@ bool Parse(const char* data, ValueVisitor* visitor) {
     return args.canceled || !*SkipWS(end);
 }
 
+
+static inline const char* SkipWS(const char* s, const char* end) {
+    while (s < end && str::IsWs(*s)) {
+        s++;
+    }
+    return s;
+}
+
+static inline const char* SkipDigits(const char* s, const char* end) {
+    while (s < end && str::IsDigit(*s)) {
+        s++;
+    }
+    return s;
+}
+
+Tokenizer::Tokenizer(const char* data, size_t len) : curr(data), end(data + len) {
+    if (len >= 3 && str::StartsWith(data, UTF8_BOM)) {
+        curr += 3;
+    }
+}
+
+TokenType Tokenizer::Error() {
+    state = State::Done;
+    failed = true;
+    return TokenType::Error;
+}
+
+TokenType Tokenizer::Open(TokenType type) {
+    if (depth >= kMaxDepth) {
+        return Error();
+    }
+    bool isObject = type == TokenType::ObjectStart;
+    if (isObject) {
+        inObject |= (u64)1 << depth;
+    } else {
+        inObject &= ~((u64)1 << depth);
+    }
+    depth++;
+    curr++;
+    state = isObject ? State::FirstKey : State::FirstValue;
+    return type;
+}
+
+TokenType Tokenizer::Close(TokenType type) {
+    bool isObject = type == TokenType::ObjectEnd;
+    if (depth == 0 || ((inObject >> (depth - 1)) & 1) != (u64)isObject) {
+        return Error();
+    }
+    depth--;
+    curr++;
+    state = State::AfterValue;
+    return type;
+}
+
+// same validation as AppendEscapeSeq(), s points to the char after a backslash
+static bool IsValidEscapeSeq(const char* s, const char* end) {
+    if (s == end) {
+        return false;
+    }
+    switch (*s) {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            return true;
+        case 'u': {
+            if (end - s < 5) {
+                return false;
+            }
+            // the hex digits aren't zero-terminated
+            char hex[5]{};
+            memcpy(hex, s + 1, 4);
+            int i;
+            return str::Parse(hex, "%4x", &i) && 0 < i && i < 0x10000;
+        }
+    }
+    return false;
+}
+
+// curr points to the opening quote
+bool Tokenizer::ScanString() {
+    const char* start = curr + 1;
+    const char* quote = (const char*)memchr(start, '"', end - start);
+    if (!quote) {
+        return false;
+    }
+    if (!memchr(start, '\\', quote - start)) {
+        value = StrSpan(start, (int)(quote - start));
+        curr = quote + 1;
+        return true;
+    }
+    // the quote might be escaped
+    hasEscapes = true;
+    for (const char* s = start; s < end; s++) {
+        if ('\\' == *s) {
+            if (!IsValidEscapeSeq(s + 1, end)) {
+                return false;
+            }
+            s += 'u' == s[1] ? 5 : 1;
+        } else if ('"' == *s) {
+            value = StrSpan(start, (int)(s - start));
+            curr = s + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+TokenType Tokenizer::ParseValue() {
+    if (curr == end) {
+        return Error();
+    }
+    const char* s = curr;
+    switch (*s) {
+        case '{':
+            return Open(TokenType::ObjectStart);
+        case '[':
+            return Open(TokenType::ArrayStart);
+        case '"':
+            if (!ScanString()) {
+                return Error();
+            }
+            state = State::AfterValue;
+            return TokenType::String;
+        case 't':
+        case 'f':
+        case 'n': {
+            const char* keywords[] = {"true", "false", "null"};
+            const TokenType types[] = {TokenType::Bool, TokenType::Bool, TokenType::Null};
+            for (int i = 0; i < (int)dimof(keywords); i++) {
+                int len = (int)str::Len(keywords[i]);
+                if (end - s >= len && memeq(s, keywords[i], len)) {
+                    value = StrSpan(s, len);
+                    curr = s + len;
+                    state = State::AfterValue;
+                    return types[i];
+                }
+            }
+            return Error();
+        }
+    }
+
+    // same validation as ParseNumber()
+    if (s < end && '-' == *s) {
+        s++;
+    }
+    if (s < end && '0' == *s) {
+        s++;
+    } else if (s < end && str::IsDigit(*s)) {
+        s = SkipDigits(s + 1, end);
+    } else {
+        return Error();
+    }
+    if (s < end && '.' == *s) {
+        s = SkipDigits(s + 1, end);
+    }
+    if (s < end && ('e' == *s || 'E' == *s)) {
+        s++;
+        if (s < end && ('+' == *s || '-' == *s)) {
+            s++;
+        }
+        s = SkipDigits(s, end);
+    }
+    if (!str::IsDigit(s[-1]) || (s < end && str::IsDigit(*s))) {
+        return Error();
+    }
+    value = StrSpan(curr, (int)(s - curr));
+    curr = s;
+    state = State::AfterValue;
+    return TokenType::Number;
+}
+
+TokenType Tokenizer::Next() {
+    value = StrSpan();
+    hasEscapes = false;
+    for (;;) {
+        curr = SkipWS(curr, end);
+        switch (state) {
+            case State::Done:
+                return failed ? TokenType::Error : TokenType::End;
+            case State::AfterValue:
+                if (depth == 0) {
+                    if (curr < end) {
+                        return Error();
+                    }
+                    state = State::Done;
+                    return TokenType::End;
+                }
+                if (curr == end) {
+                    return Error();
+                }
+                if (',' == *curr) {
+                    curr++;
+                    state = ((inObject >> (depth - 1)) & 1) ? State::Key : State::Value;
+                    continue;
+                }
+                if ('}' == *curr) {
+                    return Close(TokenType::ObjectEnd);
+                }
+                if (']' == *curr) {
+                    return Close(TokenType::ArrayEnd);
+                }
+                return Error();
+            case State::AfterKey:
+                if (curr == end || ':' != *curr) {
+                    return Error();
+                }
+                curr++;
+                state = State::Value;
+                continue;
+            case State::FirstKey:
+                if (curr < end && '}' == *curr) {
+                    return Close(TokenType::ObjectEnd);
+                }
+                [[fallthrough]];
+            case State::Key:
+                if (curr == end || '"' != *curr || !ScanString()) {
+                    return Error();
+                }
+                state = State::AfterKey;
+                return TokenType::Key;
+            case State::FirstValue:
+                if (curr < end && ']' == *curr) {
+                    return Close(TokenType::ArrayEnd);
+                }
+                [[fallthrough]];
+            case State::Value:
+                return ParseValue();
+        }
+    }
+}
+
+bool Unescape(StrSpan s, str::Str& out) {
+    const char* end = s.CStr() + s.Len();
+    for (const char* c = s.CStr(); c < end; c++) {
+        if ('\\' != *c) {
+            out.AppendChar(*c);
+            continue;
+        }
+        // the 4 hex digits of \uXXXX must be part of the span
+        if (c + 1 == end || ('u' == c[1] && end - c < 6)) {
+            return false;
+        }
+        c = AppendEscapeSeq(out, c + 1);
+        if (!c) {
+            return false;
+        }
+    }
+    return true;
+}
+
 } // namespace json
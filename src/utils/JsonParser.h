@@ -26,4 +26,53 @@ struct ValueVisitor {
 // returns false on error
 bool Parse(const char* data, ValueVisitor* visitor);
 
+// streaming alternative to Parse() for big files: returns one token at a
+// time and doesn't build paths or copy strings. e.g.
+// { "key": [false, { "name": "valu\u0065" }] }
+// is returned as
+// ObjectStart, Key "key", ArrayStart, Bool "false", ObjectStart, Key "name",
+// String "valu\u0065" (hasEscapes), ObjectEnd, ArrayEnd, ObjectEnd, End
+
+enum class TokenType { ObjectStart, ObjectEnd, ArrayStart, ArrayEnd, Key, String, Number, Bool, Null, End, Error };
+
+struct Tokenizer {
+    // containers can be nested at most this deep
+    static constexpr int kMaxDepth = 64;
+
+    // data doesn't have to be nullptr-terminated (e.g. a memory-mapped file)
+    Tokenizer(const char* data, size_t len);
+
+    TokenType Next();
+
+    // for Key and String: the string between the quotes, with escape
+    // sequences as is (see Unescape()). for Number, Bool and Null: the value
+    // points into the data, so it's only valid as long as the data is
+    StrSpan value;
+    // the Key or String contains escape sequences
+    bool hasEscapes = false;
+    // number of containers that are open after the current token
+    // (i.e. 1 for an ObjectStart at the top level and for its keys)
+    int depth = 0;
+
+  private:
+    enum class State { Value, FirstValue, Key, FirstKey, AfterKey, AfterValue, Done };
+
+    const char* curr = nullptr;
+    const char* end = nullptr;
+    State state = State::Value;
+    bool failed = false;
+    // one bit per nesting level, set for objects
+    u64 inObject = 0;
+
+    TokenType Error();
+    TokenType Open(TokenType type);
+    TokenType Close(TokenType type);
+    TokenType ParseValue();
+    bool ScanString();
+};
+
+// decodes the escape sequences of a Key or String value
+// returns false for invalid escape sequences
+bool Unescape(StrSpan s, str::Str& out);
+
 } // namespace json
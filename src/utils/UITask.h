@@ -32,6 +32,7 @@ closure crashes.
     V(TaksClearHistoryAsyncPart)      \
     V(TaskShowAutoUpdateDialog)       \
     V(TaskCheckForUpdateAsync)        \
+    V(TaskExportDone)                 \
     V(TaskUndefined)
 
 #define DEF_TASK(id) id,
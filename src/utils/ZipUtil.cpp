@@ -342,3 +342,53 @@ ByteSlice Ungzip(const ByteSlice& d) {
     dataUncr[lenUncr + 1] = 0;
     return {dataUncr, lenUncr};
 }
+
+// compresses d as a zlib stream. caller must free() the result
+ByteSlice ZlibCompress(const ByteSlice& d) {
+    uLong len = compressBound((uLong)d.size());
+    u8* res = AllocArray<u8>(len);
+    if (!res) {
+        return {};
+    }
+    int err = compress2((Bytef*)res, &len, (const Bytef*)d.data(), (uLong)d.size(), Z_DEFAULT_COMPRESSION);
+    if (err != Z_OK) {
+        free(res);
+        return {};
+    }
+    return {res, (size_t)len};
+}
+
+// compresses d in the gzip format (what Ungzip() reverts). caller must free() the result
+ByteSlice GzipCompress(const ByteSlice& d) {
+    z_stream strm{};
+    // 15 + 16: gzip header and trailer instead of zlib's
+    int err = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) {
+        return {};
+    }
+    uLong len = deflateBound(&strm, (uLong)d.size());
+    u8* res = AllocArray<u8>(len);
+    if (!res) {
+        deflateEnd(&strm);
+        return {};
+    }
+    strm.next_in = (Bytef*)d.data();
+    strm.avail_in = (uInt)d.size();
+    strm.next_out = (Bytef*)res;
+    strm.avail_out = (uInt)len;
+    err = deflate(&strm, Z_FINISH);
+    len = strm.total_out;
+    deflateEnd(&strm);
+    if (err != Z_STREAM_END) {
+        free(res);
+        return {};
+    }
+    return {res, (size_t)len};
+}
+
+// uncompresses a zlib stream into dst which must be exactly as big as the uncompressed data
+bool ZlibUncompress(const ByteSlice& compr, u8* dst, size_t dstLen) {
+    uLongf len = (uLongf)dstLen;
+    int err = uncompress((Bytef*)dst, &len, (const Bytef*)compr.data(), (uLong)compr.size());
+    return err == Z_OK && len == (uLongf)dstLen;
+}
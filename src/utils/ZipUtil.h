@@ -32,3 +32,6 @@ class ZipCreator {
 IStream* OpenDirAsZipStream(const char* dirPath, bool recursive = false);
 
 ByteSlice Ungzip(const ByteSlice&);
+ByteSlice ZlibCompress(const ByteSlice&);
+ByteSlice GzipCompress(const ByteSlice&);
+bool ZlibUncompress(const ByteSlice& compr, u8* dst, size_t dstLen);
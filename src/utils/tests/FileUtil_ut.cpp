@@ -86,4 +86,19 @@ void FileUtilTest() {
         // utassert(str::Eq(path, "foo\\bar\\z"));
         // str::Free(path);
     }
+
+    {
+        TempStr tmpPath = path::GetTempFilePathTemp("ut");
+        const char* s = "mapped file content";
+        utassert(file::WriteFile(tmpPath, s));
+        file::MappedFile mapped;
+        utassert(mapped.Open(tmpPath));
+        utassert(mapped.size == str::Len(s));
+        utassert(memcmp(mapped.data, s, mapped.size) == 0);
+        // the mapping doesn't keep the file from being deleted
+        utassert(file::Delete(tmpPath));
+        mapped.Close();
+        utassert(!mapped.data && mapped.size == 0);
+        utassert(!mapped.Open(tmpPath));
+    }
 }
@@ -42,6 +42,113 @@ class JsonVerifier : public json::ValueVisitor {
     }
 };
 
+// returns the tokens as e.g. "{ K:key [ B:false ] } $" ('!' for an error)
+static TempStr TokenizeTemp(const char* data) {
+    json::Tokenizer tok(data, str::Len(data));
+    str::Str res;
+    for (;;) {
+        json::TokenType type = tok.Next();
+        const char* prefix = nullptr;
+        switch (type) {
+            case json::TokenType::ObjectStart:
+                res.Append("{ ");
+                continue;
+            case json::TokenType::ObjectEnd:
+                res.Append("} ");
+                continue;
+            case json::TokenType::ArrayStart:
+                res.Append("[ ");
+                continue;
+            case json::TokenType::ArrayEnd:
+                res.Append("] ");
+                continue;
+            case json::TokenType::Key:
+                prefix = "K:";
+                break;
+            case json::TokenType::String:
+                prefix = "S:";
+                break;
+            case json::TokenType::Number:
+                prefix = "N:";
+                break;
+            case json::TokenType::Bool:
+                prefix = "B:";
+                break;
+            case json::TokenType::Null:
+                prefix = "0:";
+                break;
+            case json::TokenType::End:
+                res.Append("$");
+                return str::DupTemp(res.Get());
+            case json::TokenType::Error:
+                res.Append("!");
+                return str::DupTemp(res.Get());
+        }
+        res.Append(prefix);
+        if (tok.hasEscapes) {
+            str::Str unescaped;
+            if (!json::Unescape(tok.value, unescaped)) {
+                res.Append("!");
+                return str::DupTemp(res.Get());
+            }
+            res.Append(unescaped.Get());
+        } else {
+            res.Append(tok.value.CStr(), tok.value.Len());
+        }
+        res.AppendChar(' ');
+    }
+}
+
+static bool IsValidForTokenizer(const char* data) {
+    return str::EndsWith(TokenizeTemp(data), "$");
+}
+
+static void JsonTokenizerTest() {
+    static const struct {
+        const char* json;
+        const char* tokens;
+    } tokenizerData[] = {
+        {"\"test\"", "S:test $"},
+        {" 123 ", "N:123 $"},
+        {"\"a\\\"b\\u0065\"", "S:a\"be $"},
+        {"{ \"key\": [false, { \"name\": \"valu\\u0065\" }] }", "{ K:key [ B:false { K:name S:value } ] } $"},
+        {"[1, -2.5e3, null, true, {}, []]", "[ N:1 N:-2.5e3 0:null B:true { } [ ] ] $"},
+        {"{\"a\":{\"b\":[[]]},\"c\":\"\"}", "{ K:a { K:b [ [ ] ] } K:c S: } $"},
+        {"{\"a\" 1}", "{ K:a !"},
+        {"[1 2]", "[ N:1 !"},
+        {"[1,]", "[ N:1 !"},
+        {"{\"a\":1]", "{ K:a N:1 !"},
+        {"[}", "[ !"},
+        {"\"open", "!"},
+        {"truex", "B:true !"},
+        {"1 2", "N:1 !"},
+        // invalid escapes are rejected by the tokenizer, not just by Unescape()
+        {"\"\\x\"", "!"},
+        {"\"\\u0000\"", "!"},
+        {"[\"a\\u12\"]", "[ !"},
+        {"{\"k\\q\": 1}", "{ !"},
+        {"\"\\", "!"},
+    };
+    for (auto& d : tokenizerData) {
+        TempStr tokens = TokenizeTemp(d.json);
+        utassert(str::Eq(tokens, d.tokens));
+    }
+
+    // not nullptr-terminated
+    const char* data = "[12345]";
+    json::Tokenizer tok(data, 4);
+    utassert(tok.Next() == json::TokenType::ArrayStart);
+    utassert(tok.Next() == json::TokenType::Number);
+    utassert(tok.value.Len() == 3);
+    utassert(tok.Next() == json::TokenType::Error);
+
+    str::Str deep;
+    for (int i = 0; i < json::Tokenizer::kMaxDepth + 1; i++) {
+        deep.Append("[");
+    }
+    utassert(str::EndsWith(TokenizeTemp(deep.Get()), "!"));
+}
+
 void JsonTest() {
     static const struct {
         const char* json;
@@ -78,6 +185,7 @@ void JsonTest() {
     for (size_t i = 0; i < dimof(validJsonData); i++) {
         JsonVerifier verifier(&validJsonData[i].value, validJsonData[i].value.value ? 1 : 0);
         utassert(json::Parse(validJsonData[i].json, &verifier));
+        utassert(IsValidForTokenizer(validJsonData[i].json));
     }
 
     static const struct {
@@ -97,11 +205,12 @@ void JsonTest() {
     for (size_t i = 0; i < dimof(invalidJsonData); i++) {
         JsonVerifier verifier(&invalidJsonData[i].value, 1);
         utassert(!json::Parse(invalidJsonData[i].json, &verifier));
+        utassert(!IsValidForTokenizer(invalidJsonData[i].json));
     }
 
     static const char* invalidJson[] = {
         "",  "string", "nada", "\"open", "\"\\xC4\"",   "\"\\u123h\"",   "'string'",       "01", ".1", "12.", "1e",
-        "-", "-01",    "{",    "{,}",    "{\"key\": }", "{\"key: 123 }", "{ 'key': 123 }", "[",  "[,]"};
+        "-", "-01",    "{",    "{,}",    "{\"key\": }", "{\"key: 123 }", "{ 'key': 123 }", "[",  "[,]", "\"\\u0000\""};
 
     JsonVerifier verifyError(nullptr, 0);
     {
@@ -111,6 +220,7 @@ void JsonTest() {
 
     for (size_t i = 0; i < dimof(invalidJson); i++) {
         utassert(!json::Parse(invalidJson[i], &verifyError));
+        utassert(!IsValidForTokenizer(invalidJson[i]));
     }
 
     const JsonValue testData[] = {
@@ -140,4 +250,7 @@ void JsonTest() {
 }";
     JsonVerifier sampleVerifier(testData, dimof(testData));
     utassert(json::Parse(jsonSample, &sampleVerifier));
+    utassert(IsValidForTokenizer(jsonSample));
+
+    JsonTokenizerTest();
 }